@@ -3,15 +3,15 @@
 
 /* Include libraries */
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <time.h>
 #include <mqueue.h>
+#include <pthread.h>
 
-/* Define/undefine as needed */
+/* Define/undefine as needed, posix_memalign and aligned_alloc are wrapped with __USE_XOPEN2K and __USE_ISOC11 */
 #define USE_DEPRECATED_MEMALIGN
-#undef __USE_XOPEN2K
-#undef __USE_ISOC11
 
 /*
  * Version Constants: 
@@ -21,15 +21,138 @@
  * Increment only when there is a change in commands list.
  */
 #define MEMWRAP_MAJOR_VERSION "1"
-#define MEMWRAP_MINOR_VERSION "0"
+#define MEMWRAP_MINOR_VERSION "25"
 
 /* MEMWRAP_COMMANDS_VERSION is 8 bit unsigned - shouldn't be greater than 255 */
-#define MEMWRAP_COMMANDS_VERSION 2
+#define MEMWRAP_COMMANDS_VERSION 16
 
 /* Memory Management Options */
 #define PREPEND_LISTDATA /* Allocate extra for holding the data to avoid additional allocation */
 #define OPTIMIZE_MQ_TRANSFER /* Avoid holding the process during lengthy heapwalk */
 #define MAINTAIN_SINGLE_LIST /* Maintain single list for both walked and unwalked */
+#define SHARD_LIST /* Split the single list into per-thread shards, each with its own lock */
+#define SNAPSHOT_HEAPWALK /* Allow heapwalk on a fork'd copy-on-write snapshot, holding the process only for fork */
+#define CONCURRENT_HEAPWALK /* Allow heapwalk without holding the lists, frees during the walk are deferred till the walk ends */
+#define SLICED_HEAPWALK /* Allow heapwalk holding the lists in time bounded slices, frees during the walk are deferred till the walk ends */
+#define SHM_TRANSFER /* Allow heapwalk transfer through a shared memory segment instead of message queue */
+#define COMPACT_TRANSFER /* Delta/varint encode the heapwalk entries into variable length messages */
+#define SAMPLED_TRACKING /* Allow tracking a size proportional sample of allocations, set by MEMWRAP_SAMPLE_RATE env */
+#define COMPACT_LIST /* Keep small allocations with a 32 byte CLIST header instead of the 64 byte LIST */
+#define STACK_DEPOT /* Capture the backtrace of allocations, interned in a depot of stacks referred by id */
+#define SITE_STATS /* Keep live and cumulative allocations per allocation site, returned by HEAPWALK_SITES */
+#define ALIGNED_TRAILER /* Keep the LIST of allocations aligned beyond LIST after the block instead of padding by the alignment */
+#define INPLACE_REALLOC /* Realloc keeping the place of the entry in the list instead of appending it again */
+#define CXX_OPERATORS /* Interpose C++ operator new/delete, entries are marked as C++ allocations */
+#define MMAP_TRACKING /* Track the anonymous mappings made by mmap/mremap, sent with HEAPWALK_MMAP_ENTRIES */
+#define LARGE_REGISTRY /* Index the entries from MEMWRAP_LARGE_THRESHOLD bytes in a table, returned by HEAPWALK_LARGE without a walk */
+#define TRACKING_PAUSE /* Allow pausing the tracking with HEAPWALK_PAUSE, blocks allocated while paused are marked as unsampled */
+#define WALK_FILTER /* Filter the entries during the heapwalk by the filter carried in the command, only matching entries are sent */
+#define WALK_BOOKMARKS /* Keep named bookmarks set by HEAPWALK_BOOKMARK, a heapwalk since a bookmark doesn't change the walked marks */
+#define WALK_CHECKPOINTS /* Keep a sparse index of the allocation times of each shard, heapwalks filtered by age or time start at their window */
+#define ADDRESS_INDEX /* Index the entries of each shard by address, HEAPWALK_OWNER finds the entry holding an address without a walk */
+#define MIRROR_DELTAS /* Log the frees and in place reallocs of each shard, HEAPWALK_MIRROR sends a client the changes since its last sync */
+// #define SIDE_TABLE /* Keep the entries in a hash table keyed by pointer instead of a LIST before each allocation */
+
+/* The side table replaces the prepended LIST and the lists, and is walked only in bulk */
+#if defined(SIDE_TABLE) && (!defined(MAINTAIN_SINGLE_LIST) || !defined(OPTIMIZE_MQ_TRANSFER))
+#undef SIDE_TABLE
+#endif
+
+#ifdef SIDE_TABLE
+#undef PREPEND_LISTDATA
+#endif
+
+/* Sharding needs the prepended LIST (to find the owning shard on free), the single list and bulk transfer */
+#if defined(SHARD_LIST) && (!defined(PREPEND_LISTDATA) || !defined(MAINTAIN_SINGLE_LIST) || !defined(OPTIMIZE_MQ_TRANSFER))
+#undef SHARD_LIST
+#endif
+
+#if defined(SNAPSHOT_HEAPWALK) && !defined(SHARD_LIST)
+#undef SNAPSHOT_HEAPWALK
+#endif
+
+#if defined(CONCURRENT_HEAPWALK) && !defined(SHARD_LIST)
+#undef CONCURRENT_HEAPWALK
+#endif
+
+/* Slices resume from the cursor of the concurrent walk, whose free'd entries are kept till the walk ends */
+#if defined(SLICED_HEAPWALK) && !defined(CONCURRENT_HEAPWALK)
+#undef SLICED_HEAPWALK
+#endif
+
+#if defined(SHM_TRANSFER) && !defined(SHARD_LIST)
+#undef SHM_TRANSFER
+#endif
+
+#if defined(COMPACT_TRANSFER) && !defined(SHARD_LIST)
+#undef COMPACT_TRANSFER
+#endif
+
+#if defined(SAMPLED_TRACKING) && !defined(SHARD_LIST)
+#undef SAMPLED_TRACKING
+#endif
+
+/* CLIST halves the LIST of 64 bit only, on 32 bit LIST is already 32 bytes */
+#if defined(COMPACT_LIST) && (!defined(SHARD_LIST) || !defined(__LP64__))
+#undef COMPACT_LIST
+#endif
+
+/* Stacks are shipped as variable length messages, after the entries of the walk */
+#if defined(STACK_DEPOT) && (!defined(SHARD_LIST) || !defined(COMPACT_TRANSFER))
+#undef STACK_DEPOT
+#endif
+
+#if defined(SITE_STATS) && !defined(SHARD_LIST)
+#undef SITE_STATS
+#endif
+
+#if defined(ALIGNED_TRAILER) && !defined(SHARD_LIST)
+#undef ALIGNED_TRAILER
+#endif
+
+#if defined(INPLACE_REALLOC) && !defined(SHARD_LIST)
+#undef INPLACE_REALLOC
+#endif
+
+#if defined(CXX_OPERATORS) && !defined(SHARD_LIST)
+#undef CXX_OPERATORS
+#endif
+
+#if defined(MMAP_TRACKING) && !defined(SHARD_LIST)
+#undef MMAP_TRACKING
+#endif
+
+#if defined(LARGE_REGISTRY) && !defined(SHARD_LIST)
+#undef LARGE_REGISTRY
+#endif
+
+#if defined(TRACKING_PAUSE) && !defined(SAMPLED_TRACKING)
+#undef TRACKING_PAUSE
+#endif
+
+#if defined(WALK_FILTER) && !defined(SHARD_LIST) && !defined(SIDE_TABLE)
+#undef WALK_FILTER
+#endif
+
+/* Bookmarks are positions in the shard lists, kept as the walked head is */
+#if defined(WALK_BOOKMARKS) && !defined(SHARD_LIST)
+#undef WALK_BOOKMARKS
+#endif
+
+/* Checkpoints only skip the entries out of the window of a filtered walk */
+#if defined(WALK_CHECKPOINTS) && (!defined(SHARD_LIST) || !defined(WALK_FILTER))
+#undef WALK_CHECKPOINTS
+#endif
+
+/* The index is kept per shard, updated with the shard held */
+#if defined(ADDRESS_INDEX) && !defined(SHARD_LIST)
+#undef ADDRESS_INDEX
+#endif
+
+/* A mirror is a bookmark, which also keeps how far the logs of the shards are synced */
+#if defined(MIRROR_DELTAS) && !defined(WALK_BOOKMARKS)
+#undef MIRROR_DELTAS
+#endif
 
 /* Command Optimization Flags */
 #ifdef OPTIMIZE_MQ_TRANSFER
@@ -38,8 +161,11 @@
 #define OPTIMIZE_MQ_TRANSFER_FOR_CMD 0
 #endif
 
-#ifdef PREPEND_LISTDATA
+#if defined(PREPEND_LISTDATA) || defined(SIDE_TABLE)
 #define ENABLE_STATISTICS
+#endif
+
+#ifdef PREPEND_LISTDATA
 #define PREPEND_LISTDATA_FOR_CMD 1
 #else
 #define PREPEND_LISTDATA_FOR_CMD 0
@@ -51,6 +177,24 @@
 #define MAINTAIN_SINGLE_LIST_FOR_CMD 0
 #endif
 
+#ifdef COMPACT_TRANSFER
+#define COMPACT_TRANSFER_FOR_CMD 1
+#else
+#define COMPACT_TRANSFER_FOR_CMD 0
+#endif
+
+#ifdef STACK_DEPOT
+#define STACK_DEPOT_FOR_CMD 1
+#else
+#define STACK_DEPOT_FOR_CMD 0
+#endif
+
+#ifdef MMAP_TRACKING
+#define MMAP_TRACKING_FOR_CMD 1
+#else
+#define MMAP_TRACKING_FOR_CMD 0
+#endif
+
 /* Static for internal testing */
 #ifndef SELF_TEST
 #define STATIC static
@@ -70,16 +214,369 @@ typedef struct list
 #if defined(PREPEND_LISTDATA)
 	unsigned int flags; /* First 2 bytes are magic number (for LSB/MSB), next 2 are real flag */
 #endif
-	void *ptr;
 	unsigned int size;
-	void *ra;
-	pid_t tid;
-	time_t seconds;
+#ifdef SIDE_TABLE
+	unsigned int walked; /* Set once sent in a heapwalk */
+#else
 	struct list *next;
+#endif
 #ifdef PREPEND_LISTDATA
 	struct list *prev;
 #endif
+	void *ptr;
+	pid_t tid;
+#ifdef SIDE_TABLE
+	unsigned int seq; /* Allocation order, the slots are not */
+#endif
+#ifdef STACK_DEPOT
+	unsigned int stack; /* Id of the backtrace in the stack depot, 0 if not captured */
+#endif
+#ifdef __LP64__
+	unsigned int sizeHigh; /* Bits 32-63 of size, in the padding before ra. Not kept in CLIST */
+#endif
+	void *ra;
+	time_t seconds;
+#ifdef PREPEND_LISTDATA
+} __attribute__((aligned(16))) LIST; /* Keeps the pointer after it aligned as malloc's */
+#else
 } LIST;
+#endif
+
+#ifdef SHARD_LIST
+/* Define maximum shards as power of 2, up to 16. Shard index is kept in LIST flags (bits 8-11) */
+#define MAX_LIST_SHARDS 16
+#define LIST_SHARD_SHIFT 8
+#define LIST_SHARD_MASK 0x0F00
+#define LIST_TYPE_MASK 0xFF
+
+#ifdef SAMPLED_TRACKING
+/*
+ * A thread tracks the allocation that crosses its sampling byte counter, drawn exponentially with mean
+ * SAMPLE_RATE(level) bytes, so that every byte is equally likely to be sampled. Level 0 tracks all.
+ * The level of a tracked entry is kept in LIST flags (bits 12-15), to upscale its size to an estimate.
+ * Untracked blocks still carry the LIST, with LIST_UNSAMPLED_MAGIC in flags and only ptr and size set.
+ */
+#define LIST_SAMPLE_SHIFT 12
+#define LIST_SAMPLE_MASK 0xF000
+#define LIST_UNSAMPLED_MAGIC 0xFEED0000
+#ifdef TRACKING_PAUSE
+#define LIST_UNTRACKED 0x10000 /* Passed to appendItemToList only, the block is marked as unsampled */
+/*
+ * A block allocated paused keeps its pointer mixed with a constant in the LIST seconds, which no other header
+ * writes there: tracked entries keep a time, untracked ones clear it.
+ */
+#define LIST_PAUSED_KEY(ptr) (((LIST *)(ptr) - 1)->seconds)
+#define LIST_PAUSED_KEY_OF(ptr) ((time_t)((uintptr_t)(ptr) ^ (uintptr_t)0xFEED5EEDFEED5EEDULL))
+#endif
+#define SAMPLE_LEVEL_MAX 15
+#define SAMPLE_RATE_MIN_SHIFT 9
+#define SAMPLE_RATE(level) (1UL << (SAMPLE_RATE_MIN_SHIFT + (level))) /* 1KB for level 1 to 16MB for level 15 */
+#define SAMPLE_BUDGET_CHECK 64 /* Tracked allocations of a thread between checks of MEMWRAP_OVERHEAD_BUDGET */
+#endif
+
+#ifdef SITE_STATS
+/*
+ * Allocations are counted per site, the stack id with STACK_DEPOT else the return address, in an open
+ * addressing table of each shard updated with the shard held. The tables are mmap'd and merged by HEAPWALK_SITES.
+ * By default a table is doubled when half full and a site is kept for the life of the process.
+ * With MEMWRAP_SITE_TOPK, a table keeps at most that many sites: a new site replaces the one with the
+ * least live bytes and takes over its live bytes and count (space-saving), error being the bytes taken over.
+ */
+#define SITE_STATS_INITIAL_SLOTS 256 /* Power of 2 */
+
+typedef struct site_stat
+{
+	unsigned long site; /* 0 for a free slot */
+	unsigned long liveBytes; /* Estimated with SAMPLED_TRACKING */
+	unsigned long liveCount;
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long error; /* Upper bound of liveBytes not of the site */
+} SITESTAT;
+#endif
+
+#ifdef WALK_BOOKMARKS
+/*
+ * A bookmark keeps the newest entry of each shard when it was set, moved to the older neighbour when
+ * that entry is free'd, so the entries after it are the ones allocated since the bookmark.
+ */
+#define WALK_BOOKMARKS_MAX 8
+#endif
+
+#ifdef WALK_CHECKPOINTS
+/*
+ * Each shard keeps the first entry appended at or after a time, every WALK_CHECKPOINT_SPAN seconds at first.
+ * Once WALK_CHECKPOINTS_MAX are kept, every other one is dropped and the span is doubled, so the checkpoints
+ * cover the life of the process. The checkpoint of a free'd entry moves to the next entry, therefore the
+ * entries before a checkpoint are not newer than its time, up to WALK_CHECKPOINT_SLACK.
+ */
+#define WALK_CHECKPOINTS_MAX 64
+#define WALK_CHECKPOINT_SPAN 1
+#define WALK_CHECKPOINT_SLACK 2 /* Seconds an entry may be appended after a newer one, its time is read before locking the shard */
+
+typedef struct walk_checkpoint
+{
+	time_t seconds;
+	LIST *item;
+} CHECKPOINT;
+#endif
+
+#ifdef ADDRESS_INDEX
+/*
+ * Each shard keeps its entries in a treap ordered by pointer, with the priorities hashed from the pointers
+ * so that no random state is kept. Nodes are in an mmap'd array of the shard, doubled when full, and
+ * linked by index, 0 being none. Free'd nodes are reused, linked through left.
+ * Entries are added only with MEMWRAP_ADDRESS_INDEX set, the index costs a treap insert and removal per malloc/free.
+ */
+#define ADDRESS_INDEX_INITIAL_NODES 1024
+
+typedef struct addr_node
+{
+	void *ptr; /* Allocated pointer, the key */
+	LIST *item;
+	unsigned int left;
+	unsigned int right;
+	unsigned int priority;
+} ADDRNODE;
+#endif
+
+#ifdef MIRROR_DELTAS
+/*
+ * While a mirror is set, each shard logs its frees, as records with the 0xDEAD0000 magic and only ptr set, and
+ * its reallocs done in place of the entry, as the reallocated entry, in a ring of MEMWRAP_MIRROR_LOG records.
+ * The changes since a sync are the logged records and the entries allocated after the bookmark of the mirror.
+ * A mirror whose records are overwritten before its next sync is sent all the entries again.
+ */
+#define MIRROR_LOG_ENTRIES 16384 /* Default of MEMWRAP_MIRROR_LOG, rounded up to a power of 2 */
+#endif
+
+/*
+ * Threads are assigned a shard round robin on their first allocation.
+ * Each shard holds its own walked head and statistics, merged during heapwalk.
+ */
+typedef struct list_shard
+{
+	pthread_mutex_t lock;
+	LIST *head, *tail, *whead;
+	unsigned long heapSize;
+	unsigned long overhead;
+#ifdef SNAPSHOT_HEAPWALK
+	LIST *snapEnd; /* Newest entry of the snapshot a fork'd child walks, moved to the entry before it when free'd */
+#endif
+#ifdef CONCURRENT_HEAPWALK
+	LIST *wnext; /* First entry appended during a concurrent heapwalk, becomes whead after the walk */
+	LIST *wend; /* End of the walked entries of a concurrent heapwalk, moved to the next entry when free'd */
+	LIST *limbo; /* Entries free'd during a concurrent heapwalk, linked through prev */
+#ifdef INPLACE_REALLOC
+	unsigned int resizing; /* Reallocs waiting on libc, a concurrent heapwalk starts once they are back */
+#endif
+#endif
+#ifdef SITE_STATS
+	SITESTAT *sites;
+	unsigned long siteCapacity;
+	unsigned long siteCount;
+#endif
+#ifdef WALK_BOOKMARKS
+	LIST *marks[WALK_BOOKMARKS_MAX]; /* Newest entry allocated before each bookmark, NULL when all are newer */
+#endif
+#ifdef WALK_CHECKPOINTS
+	unsigned int checkpointCount;
+	time_t checkpointSpan;
+	CHECKPOINT checkpoints[WALK_CHECKPOINTS_MAX]; /* By time */
+#endif
+#ifdef ADDRESS_INDEX
+	ADDRNODE *addrNodes;
+	unsigned int addrCapacity;
+	unsigned int addrUsed; /* Nodes ever used, node 0 included */
+	unsigned int addrRoot;
+	unsigned int addrFree;
+#endif
+#ifdef MIRROR_DELTAS
+	struct list_xfer *mirrorLog; /* Ring of gMirrorLogEntries records, mmap'd by the first sync of a mirror */
+	unsigned long long mirrorSeq; /* Records ever logged */
+	unsigned long long mirrorSynced[WALK_BOOKMARKS_MAX]; /* mirrorSeq at the last sync of each mirror */
+#endif
+} __attribute__((aligned(64))) LISTSHARD;
+
+#ifdef COMPACT_LIST
+/*
+ * Allocations of up to COMPACT_LIST_MAX_SIZE bytes are kept with CLIST, which shares flags, size,
+ * next and prev with LIST so that both are linked in the same shard list. The thread and the return
+ * address are indexes into tables of the library and seconds is truncated to 32 bits.
+ * CLIST ends where LIST has its tid, see listHeader, and is marked LIST_COMPACT in its flags (type bits).
+ */
+#define LIST_COMPACT 0x80
+#define COMPACT_LIST_MAX_SIZE 512
+#define COMPACT_THREADS 65536 /* Threads beyond are kept with LIST */
+#define COMPACT_SITES 16384 /* Power of 2, return addresses beyond are shown as 0 */
+#define COMPACT_SITE_PROBES 32
+
+typedef struct list_compact
+{
+	unsigned int flags;
+	unsigned int size;
+	LIST *next;
+	LIST *prev;
+	unsigned int seconds;
+	unsigned short thread;
+	unsigned short site; /* Stack depot id with STACK_DEPOT, its first frame is the return address */
+} CLIST;
+#endif
+
+#ifdef STACK_DEPOT
+/*
+ * Backtraces of the tracked allocations are interned in a lock-free open addressing table of
+ * STACK_DEPOT_SLOTS, with their frames in a pool of STACK_DEPOT_POOL_FRAMES. Stacks are never removed,
+ * so the slot index is the id of a stack for the life of the process. Id 0 is unused, it is kept for
+ * allocations whose stack couldn't be added, and ids fit the 16 bit site of CLIST.
+ * Frame 0 of a stack is the return address of the allocation.
+ */
+#define STACK_DEPOT_SLOTS 65536 /* Power of 2, up to 65536 */
+#define STACK_DEPOT_PROBES 64
+#define STACK_DEPOT_POOL_FRAMES (1 << 19)
+#define STACK_DEPOT_MAX_FRAMES 16 /* Upper limit of MEMWRAP_STACK_DEPTH */
+#define STACK_DEPOT_DEFAULT_FRAMES 1 /* The return address only, without unwinding */
+#define STACK_FRAME_MAX_SPAN 100000 /* Largest frame accepted by the frame pointer unwinder */
+#define STACK_END_UNKNOWN ((unsigned long)-1) /* The unwinder is bounded by STACK_FRAME_MAX_SPAN only */
+
+typedef struct stack_depot_slot
+{
+	unsigned int hash; /* 0 for a free slot */
+	unsigned int depth; /* 0 till the frames are copied, set with release */
+	unsigned int frames; /* Index of the first frame in the pool */
+} STACKSLOT;
+#endif
+#endif
+
+#ifdef SIDE_TABLE
+/*
+ * Entries are kept in the LIST slots of an open addressing hash table keyed by ptr, outside of the
+ * allocations. The table is split into SIDE_TABLE_SHARDS by the hash of ptr, each with its own lock
+ * and its own mmap'd slots, doubled when 3/4 full. ptr is NULL for a free slot.
+ */
+#define SIDE_TABLE_SHARDS 16 /* Power of 2, up to 16 */
+#define SIDE_TABLE_INITIAL_SLOTS 1024 /* Power of 2 */
+#define SIDE_TABLE_DELETED ((void *)1)
+
+typedef struct side_table_shard
+{
+	pthread_mutex_t lock;
+	LIST *slots;
+	unsigned long capacity;
+	unsigned long used; /* Entries and deleted slots */
+	unsigned long heapSize;
+} __attribute__((aligned(64))) SIDETABLE;
+#endif
+
+/* Bytes before the pointer for the header of an entry, without alignment */
+#ifdef COMPACT_LIST
+#define LIST_HEADER_SIZE(flags) (((flags) & LIST_COMPACT) ? sizeof(CLIST) : sizeof(LIST))
+#else
+#define LIST_HEADER_SIZE(flags) ((void)(flags), sizeof(LIST))
+#endif
+
+#ifdef ALIGNED_TRAILER
+/*
+ * Allocations aligned beyond sizeof(LIST) keep their LIST after the block, at LIST_TRAILER_OFFSET of the
+ * pointer, marked LIST_TRAILER in its flags (type bits). The block is then the pointer itself, so the
+ * overhead is sizeof(LIST) whatever the alignment. The LIST is found from the pointer through
+ * the table of ALIGNEDSLOT, keyed by pointer and looked up only for pointers aligned as the blocks in it.
+ * Lookups don't lock, they retry when seq shows the table changed under them.
+ */
+#define LIST_TRAILER 0x40
+#define LIST_TRAILER_OFFSET(size) (((size) + __alignof__(LIST) - 1) & ~(__alignof__(LIST) - 1))
+#define LIST_PREFIX_SIZE(flags) (((flags) & LIST_TRAILER) ? 0 : LIST_HEADER_SIZE(flags))
+#define ALIGNED_TRAILER_INITIAL_SLOTS 64 /* Power of 2 */
+
+typedef struct aligned_slot
+{
+	void *ptr; /* NULL for a free slot */
+	LIST *item;
+} ALIGNEDSLOT;
+
+typedef struct aligned_table
+{
+	pthread_mutex_t lock;
+	ALIGNEDSLOT *slots; /* mmap'd, doubled when half full */
+	unsigned long capacity;
+	unsigned long count;
+	unsigned long mask; /* Alignment - 1 of the least aligned block in the table, other pointers are not looked up */
+	unsigned long seq; /* Odd while the slots change */
+} ALIGNEDTABLE;
+#else
+#define LIST_PREFIX_SIZE(flags) LIST_HEADER_SIZE(flags)
+#endif
+
+/* Type bits below LIST_TRAILER: 0 for malloc/calloc, 1 for realloc, else log2(alignment) + 1 */
+#define LIST_ALIGN_MASK 0x1F
+#define LIST_MAX_ALIGNMENT (1UL << 30) /* log2 + 1 fits LIST_ALIGN_MASK */
+
+#ifdef CXX_OPERATORS
+/*
+ * operator new and delete, with their array, nothrow, aligned and sized variants, are interposed by
+ * their mangled names. Their entries are marked LIST_CXX in the flags (type bits) and keep the return
+ * address of the caller of operator new, so that heapwalks tell C++ allocations and sites apart.
+ * With gCxxSizeCheck, sized delete checks the size against the entry, a mismatch is counted in gCxxSizeMismatch.
+ * A failed operator new is handed to the next one, which calls the new handler.
+ */
+#define LIST_CXX 0x20
+#if __SIZEOF_SIZE_T__ == __SIZEOF_LONG__
+#define CXX_SIZE_T "m" /* Itanium ABI mangling of size_t */
+#else
+#define CXX_SIZE_T "j"
+#endif
+#define CXX_NOTHROW "RKSt9nothrow_t"
+#define CXX_ALIGN "St11align_val_t"
+
+void *operatorNew(size_t size) __asm__("_Znw" CXX_SIZE_T);
+void *operatorNewArray(size_t size) __asm__("_Zna" CXX_SIZE_T);
+void *operatorNewNothrow(size_t size, const void *nothrow) __asm__("_Znw" CXX_SIZE_T CXX_NOTHROW);
+void *operatorNewArrayNothrow(size_t size, const void *nothrow) __asm__("_Zna" CXX_SIZE_T CXX_NOTHROW);
+void *operatorNewAligned(size_t size, size_t alignment) __asm__("_Znw" CXX_SIZE_T CXX_ALIGN);
+void *operatorNewArrayAligned(size_t size, size_t alignment) __asm__("_Zna" CXX_SIZE_T CXX_ALIGN);
+void *operatorNewAlignedNothrow(size_t size, size_t alignment, const void *nothrow) __asm__("_Znw" CXX_SIZE_T CXX_ALIGN CXX_NOTHROW);
+void *operatorNewArrayAlignedNothrow(size_t size, size_t alignment, const void *nothrow) __asm__("_Zna" CXX_SIZE_T CXX_ALIGN CXX_NOTHROW);
+void operatorDelete(void *ptr) __asm__("_ZdlPv");
+void operatorDeleteArray(void *ptr) __asm__("_ZdaPv");
+void operatorDeleteSized(void *ptr, size_t size) __asm__("_ZdlPv" CXX_SIZE_T);
+void operatorDeleteArraySized(void *ptr, size_t size) __asm__("_ZdaPv" CXX_SIZE_T);
+void operatorDeleteNothrow(void *ptr, const void *nothrow) __asm__("_ZdlPv" CXX_NOTHROW);
+void operatorDeleteArrayNothrow(void *ptr, const void *nothrow) __asm__("_ZdaPv" CXX_NOTHROW);
+void operatorDeleteAligned(void *ptr, size_t alignment) __asm__("_ZdlPv" CXX_ALIGN);
+void operatorDeleteArrayAligned(void *ptr, size_t alignment) __asm__("_ZdaPv" CXX_ALIGN);
+void operatorDeleteSizedAligned(void *ptr, size_t size, size_t alignment) __asm__("_ZdlPv" CXX_SIZE_T CXX_ALIGN);
+void operatorDeleteArraySizedAligned(void *ptr, size_t size, size_t alignment) __asm__("_ZdaPv" CXX_SIZE_T CXX_ALIGN);
+void operatorDeleteAlignedNothrow(void *ptr, size_t alignment, const void *nothrow) __asm__("_ZdlPv" CXX_ALIGN CXX_NOTHROW);
+void operatorDeleteArrayAlignedNothrow(void *ptr, size_t alignment, const void *nothrow) __asm__("_ZdaPv" CXX_ALIGN CXX_NOTHROW);
+#endif
+
+#ifdef MMAP_TRACKING
+/*
+ * Anonymous mappings made by mmap and mremap are kept sorted by address in an mmap'd array, doubled when full,
+ * with its own lock. munmap and mremap trim or split the mappings overlapping their range, so that a mapping
+ * is always a range still mapped. Bytes given back by madvise(MADV_DONTNEED) are counted in released,
+ * they are mapped again on access. Mappings of the library itself are not tracked.
+ */
+#define MMAP_TRACKING_INITIAL_SLOTS 256
+
+typedef struct mapping
+{
+	unsigned long start;
+	unsigned long size; /* Page rounded */
+	unsigned long released; /* MADV_DONTNEED'd bytes, at most size */
+	void *ra; /* Caller of mmap, kept across mremap */
+	pid_t tid;
+	time_t seconds;
+} MAPPING;
+
+typedef struct mapping_table
+{
+	pthread_mutex_t lock;
+	MAPPING *entries;
+	unsigned long capacity;
+	unsigned long count;
+} MAPPINGTABLE;
+#endif
 
 #ifdef OPTIMIZE_MQ_TRANSFER
 typedef struct list_xfer
@@ -88,12 +585,34 @@ typedef struct list_xfer
 	unsigned int flags; /* First 2 bytes are magic number (for LSB/MSB), next 2 are real flag */
 #endif
 	void *ptr;
-	unsigned int size;
+	unsigned long size;
 	void *ra;
 	pid_t tid;
+#ifdef STACK_DEPOT
+	unsigned int stack;
+#endif
 	time_t seconds;
 } LISTxfer;
 
+#ifdef LARGE_REGISTRY
+/*
+ * Entries of at least gLargeThreshold bytes, by default the mmap threshold of glibc, stay in the lists and are
+ * also kept in an open addressing table keyed by pointer, as LISTxfer updated on malloc, realloc and free.
+ * The table is mmap'd, doubled when half full, with its own lock taken after the shard lock.
+ */
+#define LARGE_REGISTRY_THRESHOLD (128 * 1024)
+#define LARGE_REGISTRY_INITIAL_SLOTS 64 /* Power of 2 */
+
+typedef struct large_table
+{
+	pthread_mutex_t lock;
+	LISTxfer *slots; /* ptr NULL for a free slot */
+	unsigned long capacity;
+	unsigned long count;
+	unsigned long minSize; /* Least size added, smaller entries are not looked up on free */
+} LARGETABLE;
+#endif
+
 /* Define maximum heatmap size as power of 2 */
 #define MAX_HEAT_MAP 8
 
@@ -109,6 +628,9 @@ typedef struct mmap
 	unsigned long startAddress;
 	unsigned long endAddress;
 	unsigned long long heapEntries; /* Total size of heap entries within this mmap */
+#ifdef MMAP_TRACKING
+	unsigned long long mappedEntries; /* Total size of tracked mappings starting within this mmap */
+#endif
 	unsigned int size;
 	unsigned int rss;
 	unsigned int dirty;
@@ -120,33 +642,141 @@ typedef struct mmap
 } MMAP_anon;
 #endif
 
+/*
+ * Implementations of the interposed functions, selected once by MEMWRAP_BACKEND when libc is loaded.
+ * The tracked backend is compiled with the options above, MEMWRAP_BACKEND=none passes the calls to libc.
+ * The tracking strategy, PREPEND_LISTDATA or SIDE_TABLE, sets the LIST layout, so it is not a backend.
+ * ra is the return address of the caller of the interposed function.
+ */
+#define MEMWRAP_BACKEND_TRACKED "tracked"
+#define MEMWRAP_BACKEND_NONE "none"
+#define MEMWRAP_BACKEND_PAUSED "paused" /* The tracked backend paused by HEAPWALK_PAUSE, needs TRACKING_PAUSE */
+
+typedef struct backend
+{
+	const char *name;
+	void *(*alloc)(size_t size, unsigned int api, void *ra); /* api is LIST_CXX for operator new, else 0 */
+	void *(*zalloc)(size_t nmemb, size_t size, void *ra);
+	void *(*resize)(void *ptr, size_t size, void *ra);
+	void (*release)(void *ptr);
+#if defined(USE_DEPRECATED_MEMALIGN) || defined(__USE_ISOC11) || defined(__USE_XOPEN2K)
+	void *(*alignedAlloc)(int type, size_t alignment, size_t size, unsigned int api, void *ra); /* type as common_memalign */
+#endif
+#ifdef CXX_OPERATORS
+	void (*releaseSized)(void *ptr, size_t size);
+#endif
+#ifdef MMAP_TRACKING
+	void *(*map)(void *addr, size_t length, int prot, int flags, int fd, off_t offset, void *ra);
+	int (*unmap)(void *addr, size_t length);
+	void *(*remap)(void *oldAddress, size_t oldSize, size_t newSize, int flags, void *newAddress);
+	int (*advise)(void *addr, size_t length, int advice);
+#endif
+} BACKEND;
+
+#ifdef SLICED_HEAPWALK
+/*
+ * A sliced walk holds the lists for MEMWRAP_WALK_SLICE_US at most, copying up to WALK_SLICE_ENTRIES entries,
+ * then sends them without holding the lists and resumes from its cursor.
+ */
+#define WALK_SLICE_US 200 /* Default of MEMWRAP_WALK_SLICE_US */
+#define WALK_SLICE_ENTRIES 1024
+#define WALK_SLICE_CHECK 64 /* Entries walked between the checks of the slice time */
+#endif
+
+/*
+ * Filter of a heapwalk, sent with HEAPWALK_OPT_FILTER. An entry is sent when it matches all the set fields,
+ * 0 (NULL) fields don't filter. Age is the seconds since the entry was allocated. With WALK_CHECKPOINTS, the walk
+ * starts at the checkpoint before the oldest time of the filter, and ends past its newest time.
+ */
+#define WALK_FILTER_MAX_RA 4
+typedef struct walk_filter
+{
+	pid_t tid;
+	unsigned long minSize;
+	unsigned long maxSize;
+	time_t minAge;
+	time_t maxAge;
+	time_t from; /* Allocation times from, till to (included), in seconds since the epoch */
+	time_t to;
+	void *ra[WALK_FILTER_MAX_RA]; /* Any of the set ones */
+	void *start; /* Entries from start till end (not included), set by end */
+	void *end;
+} WALKFILTER;
+
 /* Message Queue Configuration */
 #define MQ_MSG_SIZE 128
+/*
+ * Answers to the commands are given up when a message isn't received for MEMWRAP_SEND_TIMEOUT_MS,
+ * or at the next step of WALK_SEND_STEP_MS once the client has exited.
+ */
+#define WALK_SEND_TIMEOUT_MS 1000 /* Default of MEMWRAP_SEND_TIMEOUT_MS */
+#define WALK_SEND_STEP_MS 100
+#define WALK_BOOKMARK_NAME_SIZE 16
 typedef struct mq_msg_cmd
 {
 	int cmd;
 	int pid;
+	int client; /* pid of the client, its liveness is checked while an answer waits for it. 0 if unknown */
+	unsigned int options; /* heapwalkOpt bits for heapwalk commands, number of sites or entries for HEAPWALK_SITES and HEAPWALK_LARGE, pause for HEAPWALK_PAUSE */
+	WALKFILTER filter; /* Heapwalk commands with HEAPWALK_OPT_FILTER */
+	char bookmark[WALK_BOOKMARK_NAME_SIZE]; /* HEAPWALK_BOOKMARK, and heapwalk commands with HEAPWALK_OPT_BOOKMARK */
+	void *address; /* HEAPWALK_OWNER */
 } msg_cmd;
 
 typedef enum
 {
-	HEAPWALK_BASE = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21),
-	HEAPWALK_INCREMENT = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | 1),
-	HEAPWALK_FULL = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | 2),
-	HEAPWALK_MMAP_ENTRIES = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | 3),
-	HEAPWALK_MARKALL = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | 4),
-	HEAPWALK_RESET_MARKED = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | 5),
-	HEAPWALK_MALLOC_STATS = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | 6),
-	HEAPWALK_EXIT = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | 7)
+	HEAPWALK_BASE = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18),
+	HEAPWALK_INCREMENT = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 1),
+	HEAPWALK_FULL = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 2),
+	HEAPWALK_MMAP_ENTRIES = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 3),
+	HEAPWALK_MARKALL = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 4),
+	HEAPWALK_RESET_MARKED = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 5),
+	HEAPWALK_MALLOC_STATS = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 6),
+	HEAPWALK_EXIT = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 7),
+	HEAPWALK_OPTIONS = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 8), /* Local to memleakutil, not sent */
+	HEAPWALK_SITES = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 9), /* options is the number of sites, 0 for all */
+	HEAPWALK_LARGE = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 10), /* options is the number of entries, 0 for all */
+	HEAPWALK_BACKEND = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 11), /* Replied with msg_backend */
+	HEAPWALK_PAUSE = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 12), /* options is 1 to pause the tracking, 0 to resume it */
+	HEAPWALK_BOOKMARK = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 13), /* options is a bookmarkOp on the bookmark of the command, replied with msg_bookmarks */
+	HEAPWALK_OWNER = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 14), /* Finds the entry holding the address of the command, replied with msg_owner */
+	HEAPWALK_MIRROR = (MEMWRAP_COMMANDS_VERSION << 24 | OPTIMIZE_MQ_TRANSFER_FOR_CMD << 23 | PREPEND_LISTDATA_FOR_CMD << 22 | MAINTAIN_SINGLE_LIST_FOR_CMD << 21 | COMPACT_TRANSFER_FOR_CMD << 20 | STACK_DEPOT_FOR_CMD << 19 | MMAP_TRACKING_FOR_CMD << 18 | 15) /* Syncs the mirror named by the bookmark of the command, options is 1 to send all entries. Replied with msg_mirror */
 } mycmds;
 
+typedef enum
+{
+	HEAPWALK_OPT_NONE = 0x0,
+	HEAPWALK_OPT_SNAPSHOT = 0x1, /* Walk a fork'd snapshot, needs SNAPSHOT_HEAPWALK. Otherwise walks holding the lists */
+	HEAPWALK_OPT_CONCURRENT = 0x2, /* Walk without holding the lists, needs CONCURRENT_HEAPWALK. Otherwise walks holding the lists */
+	HEAPWALK_OPT_SHM = 0x4, /* Transfer through shared memory, needs SHM_TRANSFER. Otherwise transfers through message queue */
+	HEAPWALK_OPT_FILTER = 0x8, /* Send only the entries matching the filter of the command, needs WALK_FILTER. Otherwise sends all entries */
+	HEAPWALK_OPT_SLICED = 0x10, /* Walk holding the lists in time bounded slices, needs SLICED_HEAPWALK. Otherwise walks holding the lists */
+	HEAPWALK_OPT_BOOKMARK = 0x20 /* New entries are the ones allocated since the bookmark of the command, and stay unwalked. Needs WALK_BOOKMARKS */
+} heapwalkOpt;
+
+typedef enum
+{
+	BOOKMARK_LIST = 0,
+	BOOKMARK_SET = 1, /* Sets the bookmark at the newest entries, moving it if already set */
+	BOOKMARK_DELETE = 2
+} bookmarkOp;
+
 typedef enum
 {
 	HEAPWALK_EMPTY = 0x0,
 	HEAPWALK_ITEM_CONTN = 0x10000000,
-	HEAPWALK_ENDOF_LIST = 0x20000000
+	HEAPWALK_ENDOF_LIST = 0x20000000,
+	HEAPWALK_SHM_SEGMENT = 0x40000000, /* Entries of the list are in the shared memory segment of the walk */
+	HEAPWALK_STACK_DEPOT = 0x80000000 /* Stacks referred by the entries of the walk, sent after them */
 } heapwalkCtrl;
 
+/*
+ * Shared memory segments holding the msg_resp stream of a walk, same as /tmp/hpf_<pid>.dat and /tmp/hp_<pid>.dat.
+ * Created by libmemfnswrap.so and unlinked by memleakutil once mapped.
+ */
+#define SHM_WALKED_NAME "/memleak_hpf_%d"
+#define SHM_NEW_NAME "/memleak_hp_%d"
+
 #define MAX_MSG_XFER 100
 typedef struct mq_msg_recv
 {
@@ -161,6 +791,136 @@ typedef struct mq_msg_recv
 #endif
 } msg_resp;
 
+#ifdef COMPACT_TRANSFER
+/*
+ * Variable length form of msg_resp, only the header and encodedSize bytes are sent and stored.
+ * Each message is encoded on its own, entry by entry as varints:
+ * flags xor'd with the previous entry's, ptr, tid and seconds as zigzag deltas from the previous entry,
+ * size as is, and ra as an index to the message's dictionary followed by the ra delta when not yet in it.
+ * With STACK_DEPOT, the stack id follows tid as is.
+ */
+#define COMPACT_RA_DICT_SIZE 32
+#ifdef STACK_DEPOT
+#define COMPACT_ENTRY_MAX_SIZE (4 * 10 + 3 * 5 + 1) /* 64 bit ptr, size, ra, seconds, 32 bit flags, tid, stack and ra index */
+#else
+#define COMPACT_ENTRY_MAX_SIZE (4 * 10 + 2 * 5 + 1) /* 64 bit ptr, size, ra, seconds, 32 bit flags, tid and ra index */
+#endif
+typedef struct mq_msg_compact
+{
+	unsigned int numItemOrInfo;
+	unsigned int encodedSize;
+	unsigned long totalHeapSize;
+	unsigned long totalOverhead;
+	unsigned char encoded[MAX_MSG_XFER * sizeof(LISTxfer)];
+} msg_compact;
+#define COMPACT_HEADER_SIZE offsetof(msg_compact, encoded)
+
+#ifdef STACK_DEPOT
+/*
+ * Stacks are sent as msg_compact flagged HEAPWALK_STACK_DEPOT, the last one without HEAPWALK_ITEM_CONTN.
+ * Each stack is encoded as varints of its id and depth, followed by its frames as zigzag deltas from the
+ * previous frame of the message. memleakutil stores them in /tmp/hps_<pid>.dat.
+ */
+#define STACK_ENTRY_MAX_SIZE (2 * 5 + STACK_DEPOT_MAX_FRAMES * 10)
+#endif
+#endif
+
+#ifdef SITE_STATS
+/* Sites by live bytes, flagged as the messages of a walk and followed by their stacks with STACK_DEPOT */
+typedef struct site_xfer
+{
+	void *ra;
+#ifdef STACK_DEPOT
+	unsigned int stack;
+#endif
+	unsigned long liveBytes;
+	unsigned long liveCount;
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long error;
+} SITExfer;
+
+#define MAX_SITE_XFER ((sizeof(msg_resp) - offsetof(msg_resp, xfer)) / sizeof(SITExfer))
+typedef struct mq_msg_sites
+{
+	unsigned int numItemOrInfo;
+	unsigned long totalHeapSize;
+	unsigned long totalOverhead;
+	SITExfer sites[MAX_SITE_XFER];
+} msg_sites;
+#endif
+
+#ifdef MMAP_TRACKING
+/* Tracked mappings by address, sent after the walk and its stacks for HEAPWALK_MMAP_ENTRIES, flagged as the messages of a walk */
+#define MAX_MAPPING_XFER ((sizeof(msg_resp) - offsetof(msg_resp, xfer)) / sizeof(MAPPING))
+typedef struct mq_msg_mappings
+{
+	unsigned int numItemOrInfo;
+	unsigned long totalHeapSize;
+	unsigned long totalOverhead;
+	MAPPING mappings[MAX_MAPPING_XFER];
+} msg_mappings;
+#endif
+
+/* The backend serving the allocations and the build of the library, replied to HEAPWALK_BACKEND */
+#define MEMWRAP_BACKEND_NAME_SIZE 16
+typedef struct mq_msg_backend
+{
+	unsigned int numItemOrInfo; /* HEAPWALK_ENDOF_LIST */
+	unsigned long totalHeapSize;
+	unsigned long totalOverhead;
+	unsigned int cmdBase; /* HEAPWALK_BASE of the library, its commands version and FOR_CMD options */
+	char name[MEMWRAP_BACKEND_NAME_SIZE];
+} msg_backend;
+
+/* Bookmarks of the process, replied to HEAPWALK_BOOKMARK after its change */
+typedef struct bookmark_xfer
+{
+	char name[WALK_BOOKMARK_NAME_SIZE];
+	unsigned long long generation; /* Increases with every bookmark set in the process, a moved bookmark gets a new one */
+	time_t seconds; /* When it was set */
+} BOOKMARKxfer;
+
+#define MAX_BOOKMARK_XFER 8
+typedef struct mq_msg_bookmarks
+{
+	unsigned int numItemOrInfo; /* HEAPWALK_ENDOF_LIST */
+	unsigned long totalHeapSize;
+	unsigned long totalOverhead;
+	int result; /* 0, -1 when the bookmark to delete isn't set or no more bookmarks can be set */
+	unsigned int count;
+	BOOKMARKxfer bookmarks[MAX_BOOKMARK_XFER];
+} msg_bookmarks;
+
+#ifdef ADDRESS_INDEX
+/* Entry holding an address, replied to HEAPWALK_OWNER */
+typedef struct mq_msg_owner
+{
+	unsigned int numItemOrInfo; /* HEAPWALK_ENDOF_LIST */
+	unsigned long totalHeapSize;
+	unsigned long totalOverhead;
+	int result; /* 0, -1 when no tracked entry holds the address */
+	LISTxfer owner;
+} msg_owner;
+#endif
+
+#ifdef MIRROR_DELTAS
+/*
+ * Replied to HEAPWALK_MIRROR, followed by msg_resp of the changes unless result is -1: the free'd entries
+ * (0xDEAD0000 magic), then the entries reallocated in place and the ones allocated since the last sync.
+ * Applied in order by pointer, they bring the mirror of the last sync to the live entries.
+ */
+typedef struct mq_msg_mirror
+{
+	unsigned int numItemOrInfo; /* HEAPWALK_ITEM_CONTN, HEAPWALK_ENDOF_LIST when no changes follow */
+	unsigned long totalHeapSize;
+	unsigned long totalOverhead;
+	int result; /* 0, -1 when no more bookmarks can be set or the logs can't be mapped */
+	unsigned int full; /* 1 when all the entries follow, the mirror is to be cleared first */
+	unsigned long long generation; /* Of the bookmark of the mirror, set by every sync */
+} msg_mirror;
+#endif
+
 #define QUEUE_PERMISSION ((int)(0666))
 #define QUEUE_READ_PERMISSION ((int)(0444))
 #define QUEUE_MAXMSG 256
@@ -175,12 +935,44 @@ void *memalign(size_t alignment, size_t size);
 
 #ifdef OPTIMIZE_MQ_TRANSFER
 void heapwalk(mqd_t mqsend, bool walkAll);
+#ifdef SNAPSHOT_HEAPWALK
+void heapwalkSnapshot(mqd_t mqsend, bool walkAll);
+#endif
+#ifdef CONCURRENT_HEAPWALK
+void heapwalkConcurrent(mqd_t mqsend, bool walkAll);
+#endif
+#ifdef SLICED_HEAPWALK
+void heapwalkSliced(mqd_t mqsend, bool walkAll);
+#endif
+#ifdef SITE_STATS
+void heapwalkSites(mqd_t mqsend, unsigned int limit);
+#endif
+#ifdef MMAP_TRACKING
+void heapwalkMappings(mqd_t mqsend);
+#endif
+#ifdef LARGE_REGISTRY
+void heapwalkLarge(mqd_t mqsend, unsigned int limit);
+#endif
 #else
 void heapwalk(mqd_t mqsend);
 void heapwalk_full(mqd_t mqsend);
 #endif
 void heapwalkMarkall();
 void heapwalkReset();
+void heapwalkBackend(mqd_t mqsend);
+#ifdef TRACKING_PAUSE
+void heapwalkPause(bool pause);
+#endif
+#ifdef WALK_BOOKMARKS
+void heapwalkBookmark(mqd_t mqsend, bookmarkOp op, const char *name);
+#endif
+#ifdef ADDRESS_INDEX
+void heapwalkOwner(mqd_t mqsend, const void *address);
+int memwrapOwner(const void *address, LISTxfer *owner); /* For the process itself or a debugger, 0 if found */
+#endif
+#ifdef MIRROR_DELTAS
+void heapwalkMirror(mqd_t mqsend, const char *name, bool full);
+#endif
 
 #ifdef SELF_TEST
 /* Self-test functionality */
@@ -188,7 +980,18 @@ void resetList();
 void dispStatus();
 extern pthread_mutex_t lock;
 extern int gMemInitialized;
-#ifdef MAINTAIN_SINGLE_LIST
+#if defined(SHARD_LIST)
+extern LISTSHARD gListShards[MAX_LIST_SHARDS];
+LISTSHARD *getListShard();
+LIST *getItem(void *ptr);
+#ifdef CXX_OPERATORS
+extern unsigned long gCxxSizeMismatch;
+extern bool gCxxSizeCheck;
+#endif
+#elif defined(SIDE_TABLE)
+extern SIDETABLE gSideTable[SIDE_TABLE_SHARDS];
+LIST *getItem(void *ptr);
+#elif defined(MAINTAIN_SINGLE_LIST)
 extern LIST *hpfmemhead, *hpfmemtail, *hpwmemhead;
 #else
 extern LIST *memhead, *memtail;
@@ -196,6 +999,47 @@ extern LIST *wmemhead, *wmemtail;
 #endif
 extern char *gInitialAlloc;
 extern unsigned int gInitIndex;
+extern const BACKEND *gBackend;
+extern const BACKEND gTrackedBackend;
+extern const BACKEND gPassthroughBackend;
+#ifdef TRACKING_PAUSE
+extern const BACKEND gPausedBackend;
+#endif
+#ifdef SLICED_HEAPWALK
+extern long gWalkSliceNs;
+#endif
+extern long gWalkSendTimeoutMs;
+extern unsigned long gWalkAborts;
+void *bootstrapNext(size_t size);
+bool bootstrapHolds(const void *ptr);
+#ifdef SAMPLED_TRACKING
+void resetSampling();
+extern unsigned int gSampleLevel;
+extern unsigned long gOverheadBudget;
+#endif
+#ifdef COMPACT_LIST
+extern unsigned int gCompactListMaxSize;
+#endif
+#ifdef STACK_DEPOT
+void *const *stackDepotFrames(unsigned int id, unsigned int *depth);
+extern unsigned int gStackDepth;
+#endif
+#ifdef SITE_STATS
+extern unsigned long gSiteTopK;
+#endif
+#ifdef ALIGNED_TRAILER
+extern ALIGNEDTABLE gAlignedTable;
+#endif
+#ifdef MMAP_TRACKING
+extern MAPPINGTABLE gMappingTable;
+#endif
+#ifdef LARGE_REGISTRY
+extern LARGETABLE gLargeTable;
+extern unsigned long gLargeThreshold;
+#endif
+#ifdef ADDRESS_INDEX
+extern bool gAddressIndex;
+#endif
 #endif
 
 #define PRINT printf
@@ -6,6 +6,7 @@
 #include <stddef.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <fcntl.h>	  /* For O_* constants */
 #include <sys/stat.h> /* For mode constants */
@@ -13,7 +14,12 @@
 #include <time.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
 #include <malloc.h>
+#include <math.h>
+#include <stdarg.h>
+#include <sys/syscall.h>
 #include "memfns_wrap.h"
 
 #ifndef SELF_TEST
@@ -30,7 +36,133 @@ STATIC pthread_mutex_t lock;
 
 STATIC int gMemInitialized = -1;
 
-#ifdef MAINTAIN_SINGLE_LIST
+/* Client of the command being answered, and whether its answer was given up as the client doesn't receive it */
+static pid_t gWalkClient;
+static bool gWalkAborted;
+STATIC long gWalkSendTimeoutMs = WALK_SEND_TIMEOUT_MS;
+STATIC unsigned long gWalkAborts;
+
+#ifdef CXX_OPERATORS
+/* Sized delete checks the size against the entry, set by MEMWRAP_CXX_SIZE_CHECK */
+STATIC bool gCxxSizeCheck;
+#endif
+
+#ifdef WALK_FILTER
+/* Set by heapwalkCmd with the filter of the walk, ages are counted from gWalkTime */
+static bool gWalkFiltered;
+static WALKFILTER gWalkFilter;
+static time_t gWalkTime;
+#endif
+
+#ifdef WALK_BOOKMARKS
+/* Names of the bookmarks, set by the thread serving the commands only. Their positions are in the shards */
+static BOOKMARKxfer gBookmarks[WALK_BOOKMARKS_MAX];
+static unsigned long long gBookmarkGeneration;
+static unsigned int gBookmarksSet; /* Bit per set bookmark, checked on free before looking at the marks */
+/* Set by heapwalkCmd with the bookmark of the walk, -1 when its name isn't set */
+static bool gWalkBookmarked;
+static int gWalkBookmark;
+#define WALK_SINCE_BOOKMARK gWalkBookmarked
+_Static_assert(WALK_BOOKMARKS_MAX <= MAX_BOOKMARK_XFER, "Bookmarks don't fit msg_bookmarks");
+#else
+#define WALK_SINCE_BOOKMARK false
+#endif
+
+#ifdef MIRROR_DELTAS
+/* Bit per bookmark synced as a mirror, the shards log their changes while any is set */
+static unsigned int gMirrorsSet;
+STATIC unsigned long gMirrorLogEntries = MIRROR_LOG_ENTRIES;
+#endif
+
+#ifdef WALK_CHECKPOINTS
+/* Set by heapwalkCmd with the oldest and newest allocation time of the filter, 0 when not bounded */
+static time_t gWalkSince;
+static time_t gWalkUntil;
+#endif
+
+/* Mappings of the library itself, not tracked with MMAP_TRACKING */
+void *libc_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+int libc_munmap(void *addr, size_t length);
+void *libc_mremap(void *oldAddress, size_t oldSize, size_t newSize, int flags);
+
+#if defined(SHARD_LIST)
+STATIC LISTSHARD gListShards[MAX_LIST_SHARDS];
+static unsigned int gNextShard;
+/* initial-exec avoids __tls_get_addr, which may allocate, inside malloc */
+static __thread int tlsShard __attribute__((tls_model("initial-exec"))) = -1;
+#ifdef SNAPSHOT_HEAPWALK
+/* Set by the thread forking a snapshot, so that the fork'd child doesn't start a heapwalk thread */
+static __thread bool tlsSnapshotFork __attribute__((tls_model("initial-exec")));
+#endif
+#ifdef CONCURRENT_HEAPWALK
+/* Set while a concurrent heapwalk may be reading the lists */
+static bool gWalkActive;
+#endif
+#ifdef SLICED_HEAPWALK
+/* Set by heapwalkSliced while the concurrent walk holds the lists in slices of gWalkSliceNs, copied into gWalkPage */
+static bool gWalkSliced;
+STATIC long gWalkSliceNs = WALK_SLICE_US * 1000L;
+static LISTxfer *gWalkPage;
+#endif
+#ifdef SHM_TRANSFER
+/* Set by heapwalkCmd when the walk is to be transferred through shared memory */
+static bool gShmTransfer;
+/* Pid of the walked process, set when its heapwalk thread starts. A snapshot child names its segments with it */
+static pid_t gShmPid;
+#endif
+#ifdef SAMPLED_TRACKING
+/* Sampling level of new allocations, adapted between gSampleLevelMin and SAMPLE_LEVEL_MAX to keep within gOverheadBudget */
+STATIC unsigned int gSampleLevel;
+static unsigned int gSampleLevelMin;
+STATIC unsigned long gOverheadBudget;
+/* Bytes the thread allocates before its next tracked allocation, 0 till drawn */
+static __thread long tlsSampleBytes __attribute__((tls_model("initial-exec")));
+static __thread unsigned long tlsSampleRand __attribute__((tls_model("initial-exec")));
+static __thread unsigned int tlsSampleTracked __attribute__((tls_model("initial-exec")));
+#endif
+#ifdef COMPACT_LIST
+/* Largest allocation kept with CLIST, 0 keeps all with LIST */
+STATIC unsigned int gCompactListMaxSize = COMPACT_LIST_MAX_SIZE;
+/* tid and return address of the CLIST thread and site indexes, index 0 is unused */
+static pid_t gCompactThreads[COMPACT_THREADS];
+static unsigned int gCompactThreadCount;
+#ifndef STACK_DEPOT
+static void *gCompactSites[COMPACT_SITES];
+#endif
+/* Index of the thread in gCompactThreads, 0 till assigned, -1 when the table is full */
+static __thread int tlsCompactThread __attribute__((tls_model("initial-exec")));
+#endif
+#ifdef STACK_DEPOT
+/* Frames captured per tracked allocation, set by MEMWRAP_STACK_DEPTH */
+STATIC unsigned int gStackDepth = STACK_DEPOT_DEFAULT_FRAMES;
+/* End of the stack of the thread, bounding the frame pointer unwinder. 0 till read, STACK_END_UNKNOWN if it can't be */
+static __thread unsigned long tlsStackEnd __attribute__((tls_model("initial-exec")));
+static STACKSLOT gStackDepot[STACK_DEPOT_SLOTS];
+static void *gStackFrames[STACK_DEPOT_POOL_FRAMES];
+static unsigned int gStackFrameCount;
+/* Stacks referred by the entries sent in the current heapwalk, one bit per id */
+#define STACK_WALKED_BITS (8 * sizeof(unsigned long))
+static unsigned long gStackWalked[STACK_DEPOT_SLOTS / STACK_WALKED_BITS];
+#endif
+#ifdef SITE_STATS
+/* Sites kept per shard, set by MEMWRAP_SITE_TOPK, 0 keeps all */
+STATIC unsigned long gSiteTopK;
+#endif
+#ifdef LARGE_REGISTRY
+/* Entries from this size are also kept in gLargeTable, set by MEMWRAP_LARGE_THRESHOLD, 0 disables it */
+STATIC unsigned long gLargeThreshold = LARGE_REGISTRY_THRESHOLD;
+STATIC LARGETABLE gLargeTable = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, ~0UL};
+#endif
+#ifdef ADDRESS_INDEX
+/* New entries are added to the address index, set by MEMWRAP_ADDRESS_INDEX. Entries are removed while a shard has any */
+STATIC bool gAddressIndex;
+#endif
+#elif defined(SIDE_TABLE)
+STATIC SIDETABLE gSideTable[SIDE_TABLE_SHARDS];
+static unsigned int gSideTableSeq;
+/* tid of the thread, 0 till its first allocation */
+static __thread pid_t tlsSideTableTid __attribute__((tls_model("initial-exec")));
+#elif defined(MAINTAIN_SINGLE_LIST)
 STATIC LIST *hpfmemhead, *hpfmemtail, *hpwmemhead;
 #else
 STATIC LIST *memhead, *memtail, *wmemhead, *wmemtail;
@@ -40,1906 +172,7647 @@ STATIC LIST *memhead, *memtail, *wmemhead, *wmemtail;
 unsigned long totalHeapSize, totalOverhead;
 #endif
 
-#ifndef PREPEND_LISTDATA
-#ifdef SELF_TEST
-#define G_INITIAL_LIST_ALLOC_SIZE 1024 * sizeof(LIST)
-#else
-#define G_INITIAL_LIST_ALLOC_SIZE 100 * sizeof(LIST)
+#ifndef COMPACT_LIST
+#define listHeaderFlags(size) 0
 #endif
 
-char *gListInitialAlloc;
-unsigned int gListInitIndex;
-#define G_INITIAL_LIST_ALLOC_SIZE_ERROR "Increase G_INITIAL_LIST_ALLOC_SIZE\n"
-/*
-#ifdef SELF_TEST
-char __attribute__ ((aligned (sizeof(void*)))) gListInitialAllocP[G_INITIAL_LIST_ALLOC_SIZE];
+/**
+ * @brief Gets the size of an entry, sizeHigh holds the bits beyond 32 on 64 bit.
+ *
+ * @param item The entry.
+ * @return The size of the allocation.
+ */
+static inline size_t listSize(const LIST *item)
+{
+#ifdef __LP64__
+#ifdef COMPACT_LIST
+	if (item->flags & LIST_COMPACT)
+	{
+		return item->size;
+	}
 #endif
-*/
+	return ((size_t)item->sizeHigh << 32) | item->size;
+#else
+	return item->size;
 #endif
+}
 
-#ifdef SELF_TEST
-#define G_INITIAL_ALLOC_SIZE 4 * 1024 * 1024 /* Allocate 4MB for self-test */
-#else
-#define G_INITIAL_ALLOC_SIZE 2 * 1024 * 1024 /* Allocate 2MB for self-test */
+/**
+ * @brief Sets the size of an entry, CLIST has no sizeHigh and is only used for small blocks.
+ *
+ * @param item The entry, its flags already set.
+ * @param size The size of the allocation.
+ */
+static inline void listSetSize(LIST *item, size_t size)
+{
+	item->size = (unsigned int)size;
+#ifdef __LP64__
+#ifdef COMPACT_LIST
+	if (item->flags & LIST_COMPACT)
+	{
+		return;
+	}
 #endif
-/*
-#ifdef SELF_TEST
-char __attribute__ ((aligned (4096))) gInitialAllocP[G_INITIAL_ALLOC_SIZE];
+	item->sizeHigh = (unsigned int)(size >> 32);
 #endif
-*/
-char *gInitialAlloc;
-unsigned int gInitIndex;
-#define G_INITIAL_ALLOC_SIZE_ERROR "Increase G_INITIAL_ALLOC_SIZE\n"
+}
 
-#if !defined(DISABLE_DEBUG) && defined(DEBUG_RUNTIME)
-int debug_level = 0;
-void dbg(int level, const char *fmt, ...)
+#ifdef SHARD_LIST
+/**
+ * @brief Gets the list shard of the calling thread.
+ *
+ * A thread is bound to a shard, round robin, on its first allocation.
+ *
+ * @return The shard to which the calling thread appends its allocations.
+ */
+STATIC LISTSHARD *getListShard()
 {
-	va_list args;
-	// char str[256];
-	if ((level < debug_level) || (PRINT_MUST == level))
+	if (0 > tlsShard)
 	{
-		va_start(args, fmt);
-		// vsprintf(str, fmt, args);
-		// printf("%d: %s", getpid(), str);
-		if (PRINT_WALK != level) /* Both prints may be intersected by an another thread's print!! */
-		{
-			printf("%d: ", getpid());
-		}
-		vprintf(fmt, args);
-		va_end(args);
+		tlsShard = __atomic_fetch_add(&gNextShard, 1, __ATOMIC_RELAXED) & (MAX_LIST_SHARDS - 1);
+	}
+	return &gListShards[tlsShard];
+}
+
+/**
+ * @brief Locks all the list shards, always in the same order.
+ */
+static void lockAllShards()
+{
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		pthread_mutex_lock(&gListShards[i].lock);
+	}
+}
+
+/**
+ * @brief Unlocks all the list shards.
+ */
+static void unlockAllShards()
+{
+	for (int i = MAX_LIST_SHARDS - 1; i >= 0; i--)
+	{
+		pthread_mutex_unlock(&gListShards[i].lock);
+	}
+}
+
+#ifdef ENABLE_STATISTICS
+/**
+ * @brief Sums up the statistics of all shards into totalHeapSize and totalOverhead.
+ *
+ * Call with all the shards locked.
+ */
+static void updateStatistics()
+{
+	totalHeapSize = totalOverhead = 0;
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		totalHeapSize += gListShards[i].heapSize;
+		totalOverhead += gListShards[i].overhead;
 	}
 }
 #endif
 
 /**
- * @brief Initializes the initial memory mapping.
+ * @brief Gets the tool overhead of an entry from its flags.
  *
- * This function maps the initial memory for list allocation and the main allocation.
- * It uses mmap to create the mappings and handles errors accordingly.
+ * @param flags The flags indicating allocation type and alignment.
+ * @return The bytes allocated in addition to the requested size.
  */
-void mapInitialMemory()
+static unsigned int listOverhead(unsigned int flags)
 {
-#ifndef PREPEND_LISTDATA
-	if (NULL == gListInitialAlloc)
+#ifdef COMPACT_LIST
+	if (flags & LIST_COMPACT)
 	{
-		gListInitialAlloc = mmap(NULL, G_INITIAL_LIST_ALLOC_SIZE, PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-		if (gListInitialAlloc == MAP_FAILED)
-		{
-			fwrite("gListInitialAlloc mmap failed\n", strlen("gListInitialAlloc mmap failed\n"), 1, stderr);
-			exit(2);
-		}
+		return sizeof(CLIST);
 	}
 #endif
-	if (NULL == gInitialAlloc)
+#ifdef ALIGNED_TRAILER
+	if (flags & LIST_TRAILER)
 	{
-		gInitialAlloc = mmap(NULL, G_INITIAL_ALLOC_SIZE, PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-		if (gInitialAlloc == MAP_FAILED)
-		{
-			fwrite("gInitialAlloc mmap failed\n", strlen("gInitialAlloc mmap failed\n"), 1, stderr);
-			exit(2);
-		}
-#ifdef SELF_TEST /* During self test, expect the entries to be present inside the same mmap. */
-		memset(gInitialAlloc, 0, G_INITIAL_ALLOC_SIZE);
+		return sizeof(LIST);
+	}
 #endif
+	flags &= LIST_ALIGN_MASK;
+	if (2 > flags)
+	{ // 0 --> malloc/calloc 1 --> realloc
+		return sizeof(LIST);
 	}
+	unsigned int alignment = 1 << (flags - 1);
+	if (alignment > sizeof(LIST))
+	{
+		return alignment;
+	}
+	return sizeof(LIST) + (sizeof(LIST) % alignment);
 }
 
+#ifdef CONCURRENT_HEAPWALK
 /**
- * @brief Thread start function.
+ * @brief Gets the start of the block of an entry, as deleteItemFromList returns it.
  *
- * This function handles message queue operations and manages memory initialization in a concurrent environment.
+ * @param item The entry.
+ * @return The block to be free'd.
+ */
+static void *listBlock(LIST *item)
+{
+#ifdef ALIGNED_TRAILER
+	if (item->flags & LIST_TRAILER)
+	{
+		return (char *)item - LIST_TRAILER_OFFSET(listSize(item));
+	}
+#endif
+	return (char *)item + LIST_HEADER_SIZE(item->flags) - listOverhead(item->flags & LIST_TYPE_MASK);
+}
+#endif
+
+#ifdef SAMPLED_TRACKING
+/**
+ * @brief Gets the estimated bytes represented by a tracked entry.
  *
- * @param arg A generic argument passed to the thread function.
- * @return Always returns NULL.
+ * An allocation of size bytes is tracked with probability 1 - e^(-size/rate), so size divided by
+ * that probability is its unbiased estimate.
+ *
+ * @param size The size of the entry.
+ * @param level The sampling level the entry was tracked with.
+ * @return The upscaled size, size itself when tracking all.
  */
-static void *thread_start(void *arg)
+static unsigned long sampleWeight(size_t size, unsigned int level)
 {
-	dbg(PRINT_INFO, "%s: Starting thread\n", __FUNCTION__);
-#ifndef SELF_TEST
-	dbg(PRINT_INFO, "%s: Starting thread: version %s\n", __FUNCTION__, versionString);
+	if ((0 == level) || (0 == size))
+	{
+		return size;
+	}
+	return (unsigned long)(size / -expm1(-(double)size / SAMPLE_RATE(level)) + 0.5);
+}
+
+/**
+ * @brief Draws the bytes till the next tracked allocation of the thread.
+ *
+ * @param level The current sampling level.
+ * @return Exponentially distributed bytes with mean SAMPLE_RATE(level).
+ */
+static long sampleInterval(unsigned int level)
+{
+	unsigned long x = tlsSampleRand;
+	if (0 == x)
+	{
+		x = ((unsigned long)gettid() << 32) ^ (unsigned long)time(NULL) ^ (unsigned long)&tlsSampleRand;
+		x |= 1;
+	}
+	/* xorshift64* */
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	tlsSampleRand = x;
+	double u = (double)(((x * 0x2545F4914F6CDD1DUL) >> 11) + 1) / 9007199254740992.0; /* (0, 1] */
+	return (long)(-log(u) * SAMPLE_RATE(level)) + 1;
+}
+
+/**
+ * @brief Decides whether an allocation is to be tracked.
+ *
+ * @param size The size of the allocation.
+ * @param level The current sampling level, not 0.
+ * @return true if the allocation crosses the thread's sampling byte counter.
+ */
+static bool sampleAllocation(size_t size, unsigned int level)
+{
+	if (0 == tlsSampleBytes)
+	{
+		tlsSampleBytes = sampleInterval(level);
+	}
+	tlsSampleBytes -= size;
+	if (0 < tlsSampleBytes)
+	{
+		return false;
+	}
+	tlsSampleBytes = sampleInterval(level);
+	return true;
+}
+
+/**
+ * @brief Adapts the sampling level to gOverheadBudget.
+ *
+ * Sampling is made sparser while the overhead of the tracked entries exceeds the budget, and denser
+ * again, down to the configured level, once it falls below half of it.
+ * The shard statistics are read without holding the shards, an approximate sum is good enough.
+ */
+static void sampleAdapt()
+{
+	unsigned long overhead = 0;
+	unsigned int level = __atomic_load_n(&gSampleLevel, __ATOMIC_RELAXED);
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		overhead += __atomic_load_n(&gListShards[i].overhead, __ATOMIC_RELAXED);
+	}
+	if ((overhead > gOverheadBudget) && (SAMPLE_LEVEL_MAX > level))
+	{
+		__atomic_compare_exchange_n(&gSampleLevel, &level, level + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+	else if ((overhead < gOverheadBudget / 2) && (gSampleLevelMin < level))
+	{
+		__atomic_compare_exchange_n(&gSampleLevel, &level, level - 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * @brief Reads the sampling configuration from the environment.
+ *
+ * MEMWRAP_SAMPLE_RATE is the mean bytes between tracked allocations, rounded up to a power of 2
+ * between SAMPLE_RATE(1) and SAMPLE_RATE(SAMPLE_LEVEL_MAX). Unset or 0 tracks all allocations.
+ * MEMWRAP_OVERHEAD_BUDGET is the tool overhead in bytes above which sampling is made sparser.
+ */
+static void sampleInit()
+{
+	char *env = getenv("MEMWRAP_SAMPLE_RATE");
+	unsigned long rate = (env) ? strtoul(env, NULL, 0) : 0;
+	unsigned int level = 0;
+
+	if (rate)
+	{
+		for (level = 1; (SAMPLE_LEVEL_MAX > level) && (SAMPLE_RATE(level) < rate); level++)
+			;
+	}
+	gSampleLevelMin = level;
+	__atomic_store_n(&gSampleLevel, level, __ATOMIC_RELAXED);
+	env = getenv("MEMWRAP_OVERHEAD_BUDGET");
+	gOverheadBudget = (env) ? strtoul(env, NULL, 0) : 0;
+}
 #endif
-	mqd_t mq, mqsend;
-	msg_cmd msgcmd;
-	char mq_name[64];
-	unsigned int prio;
 
-	struct mq_attr mqattr = ((struct mq_attr){0, 3, sizeof(msg_cmd), 0, {0}});
-	sprintf(mq_name, "/mq_wrapper_%d", getpid());
-	/* Create with read/write */
-	mq = mq_open(mq_name, O_CREAT | O_RDONLY, QUEUE_PERMISSION, &mqattr);
-	if (0 > mq)
+#ifdef STACK_DEPOT
+/**
+ * @brief Reads the backtrace depth from the environment.
+ *
+ * MEMWRAP_STACK_DEPTH is the frames captured per tracked allocation, between 1 and STACK_DEPOT_MAX_FRAMES.
+ * 1 keeps only the return address, without unwinding.
+ */
+static void stackDepotInit()
+{
+	char *env = getenv("MEMWRAP_STACK_DEPTH");
+	unsigned long depth = (env) ? strtoul(env, NULL, 0) : STACK_DEPOT_DEFAULT_FRAMES;
+
+	if (0 == depth)
 	{
-		dbg(PRINT_MUST, "Error, cannot open/create the queue: %s.error %s\n", mq_name, strerror(errno));
-		dbg(PRINT_MSGQ, "Trying to open without O_CREAT flag..\n");
-		mq = mq_open(mq_name, O_RDONLY, QUEUE_PERMISSION, &mqattr);
-		if (0 > mq)
-		{
-			dbg(PRINT_MUST, "Error, cannot open the queue: %s.error %s\n", mq_name, strerror(errno));
-			exit(1);
-		}
+		depth = 1;
 	}
+	gStackDepth = (STACK_DEPOT_MAX_FRAMES < depth) ? STACK_DEPOT_MAX_FRAMES : (unsigned int)depth;
+}
 
-	/* Purge for new invocations, when fork'd, Selftest might be interrupted!! */
-	if (-1 == gMemInitialized)
+/**
+ * @brief Gets the end of the stack of the calling thread, read once per thread.
+ *
+ * pthread_getattr_np may allocate, the allocations made meanwhile are captured without the end.
+ * Before libc is loaded, the end isn't read.
+ *
+ * @return The address past the highest byte of the stack, STACK_END_UNKNOWN if it can't be read.
+ */
+static unsigned long stackEnd()
+{
+	pthread_attr_t attr;
+	void *addr;
+	size_t size;
+
+	if (tlsStackEnd || (0 >= gMemInitialized))
 	{
-		/* purge initial msg if any, for any process restarts */
-		struct timespec tm;
-		msgcmd.cmd = -1;
-		do
-		{
-			if (-1 != msgcmd.cmd)
-			{
-				dbg(PRINT_MSGQ, "Purging cmd %d by thread %d\n", msgcmd.cmd, gettid());
-			}
-			clock_gettime(CLOCK_REALTIME, &tm);
-			tm.tv_sec += 1;
-			errno = 0;
-		} while (0 <= mq_timedreceive(mq, (char *)&msgcmd, sizeof(msg_cmd), &prio, &tm));
-		if (ETIMEDOUT != errno)
+		return (tlsStackEnd) ? tlsStackEnd : STACK_END_UNKNOWN;
+	}
+	tlsStackEnd = STACK_END_UNKNOWN;
+	if (0 == pthread_getattr_np(pthread_self(), &attr))
+	{
+		if (0 == pthread_attr_getstack(&attr, &addr, &size))
 		{
-			dbg(PRINT_ERROR, "Error, mq_receive: %s.\n", strerror(errno));
+			tlsStackEnd = (unsigned long)addr + size;
 		}
+		pthread_attr_destroy(&attr);
 	}
-	else if (1 == gMemInitialized)
-	{ 
-		/* Mark all previous allocations, since ths process is forked */
-		// heapwalkMarkall();
+	return tlsStackEnd;
+}
+
+/**
+ * @brief Gets the caller's frame of a frame pointer chain.
+ *
+ * The saved frame pointer is trusted only if it is above the current frame, within
+ * STACK_FRAME_MAX_SPAN of it, below the end of the stack and aligned, so that a frame of code built
+ * without frame pointers ends the walk instead of leading it astray.
+ *
+ * @param fp The frame, holding the caller's frame pointer followed by the return address.
+ * @param end The end of the stack of the thread, see stackEnd.
+ * @return The caller's frame, NULL at the end of the chain.
+ */
+static void **stackFrameNext(void **fp, unsigned long end)
+{
+	void **next = (void **)fp[0];
+	if ((next <= fp) || (STACK_FRAME_MAX_SPAN < (unsigned long)((char *)next - (char *)fp)) ||
+		(end - 2 * sizeof(void *) < (unsigned long)next) || ((unsigned long)next & (sizeof(void *) - 1)) || (NULL == next[1]))
+	{
+		return NULL;
 	}
+	return next;
+}
 
-	while (1)
+/**
+ * @brief Captures the backtrace of an allocation by walking the frame pointers.
+ *
+ * The frames of the library are skipped up to the one returning to ra. If it isn't found, as
+ * when the library is built without frame pointers, only ra is captured.
+ *
+ * @param ra The return address of the allocation, frame 0.
+ * @param frames Filled with up to gStackDepth return addresses.
+ * @return The number of frames captured, at least 1.
+ */
+static unsigned int stackCapture(void *ra, void **frames)
+{
+	void **fp = (1 < gStackDepth) ? (void **)__builtin_frame_address(0) : NULL;
+	unsigned long end = (fp) ? stackEnd() : STACK_END_UNKNOWN;
+	unsigned int depth = 0;
+
+	for (int skip = 0; fp && (fp[1] != ra); skip++)
 	{
-		int msgsize = mq_receive(mq, (char *)&msgcmd, sizeof(msg_cmd), &prio);
-		if (msgsize >= 0)
-		{
-			dbg(PRINT_MSGQ, "Received cmd %d, size %d\n", msgcmd.cmd, msgsize);
-			
-			if (HEAPWALK_INCREMENT == msgcmd.cmd)
-			{
-				mqsend = mq_open("/mq_util", O_WRONLY);
-				if (mqsend < 0) {
-					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
-				}
-				else
-				{
-					dbg(PRINT_MSGQ, "%s: sending on mq %d\n", __FUNCTION__, mqsend);
-#ifdef OPTIMIZE_MQ_TRANSFER
-					heapwalk(mqsend, 0);
-#else
-					msg_resp msgresp;
-					heapwalk(mqsend);
-					msgresp.seq = -1;
-#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
-					snprintf(msgresp.msg, MQ_MSG_SIZE, "TotalHeapSize %lu Bytes + Tool Overhead %lu", totalHeapSize, totalOverhead);
-#endif
-					mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-#endif
-					dbg(PRINT_MSGQ, "%s: sent on mq %d\n", __FUNCTION__, mqsend);
-					mq_close(mqsend);
-				}
-			}
-			else if (HEAPWALK_FULL == msgcmd.cmd)
-			{
-				mqsend = mq_open("/mq_util", O_WRONLY);
-				if (mqsend < 0) {
-					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
-				}
-				else
-				{
-					dbg(PRINT_MSGQ, "%s: sending on mq %d\n", __FUNCTION__, mqsend);
-#ifdef OPTIMIZE_MQ_TRANSFER
-					heapwalk(mqsend, 1);
-#else
-					msg_resp msgresp;
-					heapwalk_full(mqsend);
-					msgresp.seq = -1;
-#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
-					snprintf(msgresp.msg, MQ_MSG_SIZE, "TotalHeapSize %lu Bytes + Tool Overhead %lu", totalHeapSize, totalOverhead);
-#endif
-					mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-#endif
-					dbg(PRINT_MSGQ, "%s: sent on mq %d\n", __FUNCTION__, mqsend);
-					mq_close(mqsend);
-				}
-			}
-			else if (HEAPWALK_MMAP_ENTRIES == msgcmd.cmd)
-			{
-				mqsend = mq_open("/mq_util", O_WRONLY);
-				if (mqsend < 0) {
-					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
-				}
-				else
-				{
-					dbg(PRINT_MSGQ, "%s: sending on mq %d\n", __FUNCTION__, mqsend);
-#ifdef OPTIMIZE_MQ_TRANSFER
-					heapwalk(mqsend, 1);
-#else
-					dbg(PRINT_MUST, "HEAPWALK_MMAP_ENTRIES supported only with OPTIMIZE_MQ_TRANSFER\n");
-#endif
-				}
-			}
-			else if (HEAPWALK_MARKALL == msgcmd.cmd)
-			{
-				dbg(PRINT_MSGQ, "Calling heapwalkMarkall(). cmd %d\n", msgcmd.cmd);
-				heapwalkMarkall();
-			}
-			else if (HEAPWALK_RESET_MARKED == msgcmd.cmd)
-			{
-				dbg(PRINT_MSGQ, "Calling heapwalkReset(). cmd %d\n", msgcmd.cmd);
-				heapwalkReset();
-			}
-			else if (HEAPWALK_MALLOC_STATS == msgcmd.cmd)
-			{
-				dbg(PRINT_MSGQ, "Calling malloc_stats(). cmd %d\n", msgcmd.cmd);
-				malloc_stats();
-				PRINT("\n");
+		fp = (STACK_DEPOT_MAX_FRAMES > skip) ? stackFrameNext(fp, end) : NULL;
+	}
+	if (NULL == fp)
+	{
+		frames[0] = ra;
+		return 1;
+	}
+	while (fp && (depth < gStackDepth))
+	{
+		frames[depth++] = fp[1];
+		fp = stackFrameNext(fp, end);
+	}
+	return depth;
+}
+
+/**
+ * @brief Gets the id of a backtrace in the stack depot, added when new.
+ *
+ * Open addressing with linear probing, without a lock. A slot is claimed by setting its hash,
+ * its frames are then copied to the pool and published by setting its depth. A lookup passes
+ * over a slot whose frames are being copied, which may rarely add the same stack twice.
+ *
+ * @param frames The backtrace.
+ * @param depth The number of frames.
+ * @return The stack id, 0 when no slot is free within STACK_DEPOT_PROBES or the pool is full.
+ */
+static unsigned int stackDepotAdd(void *const *frames, unsigned int depth)
+{
+	unsigned long h = depth;
+	for (unsigned int i = 0; i < depth; i++)
+	{
+		h = (h ^ (unsigned long)frames[i]) * 0x9E3779B97F4A7C15UL;
+	}
+	unsigned int hash = (unsigned int)(h >> 32) | 1;
+
+	for (unsigned int probe = 0; probe < STACK_DEPOT_PROBES; probe++)
+	{
+		unsigned int index = (hash + probe) & (STACK_DEPOT_SLOTS - 1);
+		STACKSLOT *slot = &gStackDepot[index];
+		if (0 == index)
+		{
+			continue;
+		}
+		unsigned int slotHash = __atomic_load_n(&slot->hash, __ATOMIC_RELAXED);
+		if ((0 == slotHash) && __atomic_compare_exchange_n(&slot->hash, &slotHash, hash, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+			unsigned int first = __atomic_fetch_add(&gStackFrameCount, depth, __ATOMIC_RELAXED);
+			if (STACK_DEPOT_POOL_FRAMES - depth < first)
+			{ /* The slot stays unpublished */
+				return 0;
 			}
-			else
-				dbg(PRINT_ERROR, "Invalid cmd 0x%x received\n", msgcmd.cmd);
+			memcpy(&gStackFrames[first], frames, depth * sizeof(void *));
+			slot->frames = first;
+			__atomic_store_n(&slot->depth, depth, __ATOMIC_RELEASE);
+			return index;
 		}
-		else
+		if ((slotHash == hash) && (__atomic_load_n(&slot->depth, __ATOMIC_ACQUIRE) == depth) &&
+			!memcmp(&gStackFrames[slot->frames], frames, depth * sizeof(void *)))
 		{
-			dbg(PRINT_ERROR, "Error, mq_receive from mq_util: %s.\n",
-				strerror(errno));
-			sleep(1);
+			return index;
 		}
 	}
-	mq_close(mq);
-	mq_unlink(mq_name);
+	return 0;
 }
 
-typedef void *(*calloc_type)(size_t, size_t);
-typedef void *(*malloc_type)(size_t);
-typedef void (*free_type)(void *);
-typedef void *(*realloc_type)(void *, size_t);
-
-calloc_type libc_calloc_fnptr = NULL;
-malloc_type libc_malloc_fnptr = NULL;
-free_type libc_free_fnptr = NULL;
-realloc_type libc_realloc_fnptr = NULL;
-
-#if defined(__USE_XOPEN2K)
-typedef int (*posix_memalign_type)(void **, size_t, size_t);
-posix_memalign_type libc_posix_memalign_fnptr = NULL;
-#endif
-
-#if defined(__USE_ISOC11)
-typedef void *(*aligned_alloc_type)(size_t, size_t);
-aligned_alloc_type libc_aligned_alloc_fnptr = NULL;
-#endif
-
-#if defined(USE_DEPRECATED_MEMALIGN)
-typedef void *(*memalign_type)(size_t, size_t);
-memalign_type libc_memalign_fnptr = NULL;
+/**
+ * @brief Gets the frames of a stack in the stack depot.
+ *
+ * @param id The stack id.
+ * @param depth Set to the number of frames, 0 if the id is not in the depot.
+ * @return The frames, NULL if the id is not in the depot.
+ */
+STATIC void *const *stackDepotFrames(unsigned int id, unsigned int *depth)
+{
+	*depth = ((0 < id) && (STACK_DEPOT_SLOTS > id)) ? __atomic_load_n(&gStackDepot[id].depth, __ATOMIC_ACQUIRE) : 0;
+	return (*depth) ? &gStackFrames[gStackDepot[id].frames] : NULL;
+}
 #endif
 
+#ifdef COMPACT_LIST
 /**
- * @brief Start the heapwalk thread.
+ * @brief Gets the index of the calling thread in gCompactThreads, assigned on its first use.
  *
- * This function initializes mutex attributes and creates a new thread for heapwalk operations.
+ * @return The thread index, -1 when the table is full.
  */
-__attribute__((constructor)) void heapwalk_thread_start()
+static int compactThread()
 {
-	pthread_attr_t attr;
-	pthread_t ptd;
-	pthread_mutexattr_t mutexattr;
-
-	pthread_mutexattr_init(&mutexattr);
-	pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_RECURSIVE);
-	pthread_mutex_init(&lock, &mutexattr);
-	pthread_attr_init(&attr);
-	pthread_attr_setstacksize(&attr, 8 * 1024);
-
-	pthread_create(&ptd, &attr, &thread_start, NULL);
-	// pthread_join(ptd, NULL);
-	pthread_attr_destroy(&attr);
+	if (0 == tlsCompactThread)
+	{
+		unsigned int index = __atomic_add_fetch(&gCompactThreadCount, 1, __ATOMIC_RELAXED);
+		if (COMPACT_THREADS > index)
+		{
+			gCompactThreads[index] = gettid();
+			tlsCompactThread = (int)index;
+		}
+		else
+		{
+			tlsCompactThread = -1;
+		}
+	}
+	return tlsCompactThread;
 }
 
-/* create a thread in child process for heapwalk. */
-/* register_atfork is similar to pthread_atfork. */
-extern int __register_atfork(void (*__prepare)(void), void (*__parent)(void), void (*__child)(void), void *dso_handle);
-extern void *__dso_handle __attribute__((__weak__));
-
+#ifndef STACK_DEPOT
 /**
- * @brief Runs in the child process context.
+ * @brief Gets the index of a return address in gCompactSites, added when new.
  *
- * This function starts the heapwalk thread when running in the context of a forked child process.
+ * Open addressing with linear probing, sites are never removed, so a lookup doesn't need a lock.
+ *
+ * @param ra The return address.
+ * @return The site index, 0 when no slot is free within COMPACT_SITE_PROBES.
  */
-static void run_in_child_context(void)
+static unsigned short compactSite(void *ra)
 {
-	dbg(PRINT_ERROR, "%s: pid %d\n", __FUNCTION__, getpid());
-	heapwalk_thread_start();
+	unsigned long hash = ((unsigned long)ra * 0x9E3779B97F4A7C15UL) >> 32;
+	for (unsigned int probe = 0; probe < COMPACT_SITE_PROBES; probe++)
+	{
+		unsigned int index = (hash + probe) & (COMPACT_SITES - 1);
+		if (0 == index)
+		{
+			continue;
+		}
+		void *site = __atomic_load_n(&gCompactSites[index], __ATOMIC_RELAXED);
+		if ((site == ra) ||
+			((NULL == site) && (__atomic_compare_exchange_n(&gCompactSites[index], &site, ra, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) || (site == ra))))
+		{
+			return (unsigned short)index;
+		}
+	}
+	return 0;
 }
-
-#ifndef SELF_TEST
-__attribute__((constructor))
 #endif
 
 /**
- * @brief Loads libc memory allocation functions.
+ * @brief Gets the header flags of a new malloc/calloc/realloc allocation.
  *
- * This function dynamically loads memory allocation functions from libc using dlsym.
+ * @param size The requested size.
+ * @return LIST_COMPACT when the allocation is to be kept with CLIST, else 0.
  */
-void load_libc_functions()
+static unsigned int listHeaderFlags(size_t size)
 {
-	fwrite("load_libc_functions+\n", strlen("load_libc_functions+\n"), 1, stderr);
+	return ((size <= gCompactListMaxSize) && (0 < compactThread())) ? LIST_COMPACT : 0;
+}
+#endif
 
-	/* Does not need an execution, No effect */
-	if (-1 == gMemInitialized)
+/**
+ * @brief Gets the allocation time of an entry.
+ */
+static time_t listSeconds(const LIST *item)
+{
+#ifdef COMPACT_LIST
+	if (item->flags & LIST_COMPACT)
 	{
-		gMemInitialized = 0;
-		// fwrite("dlsym\n", strlen("dlsym\n"), 1, stderr);
-		/* Load Memory allocation functions from libc */
-#ifdef __GLIBC__
-		libc_calloc_fnptr = dlsym(RTLD_NEXT, "__libc_calloc"); /* Throw error when all reads fail */
-		libc_malloc_fnptr = dlsym(RTLD_NEXT, "__libc_malloc");
-		libc_free_fnptr = dlsym(RTLD_NEXT, "__libc_free");
-		libc_realloc_fnptr = dlsym(RTLD_NEXT, "__libc_realloc");
-#if defined(__USE_XOPEN2K)
-		libc_posix_memalign_fnptr = dlsym(RTLD_NEXT, "__libc_posix_memalign");
+		return ((const CLIST *)item)->seconds;
+	}
 #endif
+	return item->seconds;
+}
 
-#if defined(__USE_ISOC11)
-		libc_aligned_alloc_fnptr = dlsym(RTLD_NEXT, "__libc_aligned_alloc");
-#endif
-#if defined(USE_DEPRECATED_MEMALIGN)
-		libc_memalign_fnptr = dlsym(RTLD_NEXT, "__libc_memalign");
+/**
+ * @brief Gets the transferred fields of an entry, expanding CLIST.
+ *
+ * @param item The entry.
+ * @param xfer Filled with the fields of the entry.
+ */
+static void listGetXfer(const LIST *item, LISTxfer *xfer)
+{
+	xfer->flags = item->flags;
+	xfer->size = listSize(item);
+#ifdef COMPACT_LIST
+	if (item->flags & LIST_COMPACT)
+	{
+		const CLIST *citem = (const CLIST *)item;
+		xfer->ptr = (void *)(citem + 1);
+#ifdef STACK_DEPOT
+		unsigned int depth;
+		void *const *frames = stackDepotFrames(citem->site, &depth);
+		xfer->ra = (frames) ? frames[0] : NULL;
+		xfer->stack = citem->site;
+#else
+		xfer->ra = gCompactSites[citem->site];
 #endif
-		fwrite("dlsym'd\n", strlen("dlsym'd\n"), 1, stderr);
-
-		if ((NULL == libc_malloc_fnptr) || (NULL == libc_calloc_fnptr) || (NULL == libc_free_fnptr) || (NULL == libc_realloc_fnptr)
-#if defined(USE_DEPRECATED_MEMALIGN)
-			|| (NULL == libc_memalign_fnptr)
+		xfer->tid = gCompactThreads[citem->thread];
+		xfer->seconds = citem->seconds;
+		return;
+	}
 #endif
-
-#if defined(__USE_XOPEN2K)
-			|| (NULL == libc_posix_memalign_fnptr)
+	xfer->ptr = item->ptr;
+	xfer->ra = item->ra;
+	xfer->tid = item->tid;
+#ifdef STACK_DEPOT
+	xfer->stack = item->stack;
 #endif
+	xfer->seconds = item->seconds;
+}
 
-#if defined(__USE_ISOC11)
-			|| (NULL == libc_aligned_alloc_fnptr)
+#ifdef SITE_STATS
+/**
+ * @brief Gets the site of an entry, to which it is counted.
+ */
+static unsigned long listSite(const LIST *item)
+{
+#ifdef COMPACT_LIST
+	if (item->flags & LIST_COMPACT)
+	{
+#ifdef STACK_DEPOT
+		return ((const CLIST *)item)->site;
+#else
+		return (unsigned long)gCompactSites[((const CLIST *)item)->site];
 #endif
-		)
-		{
-			fwrite("Couldn't load symbols from libc", strlen("Couldn't load symbols from libc"), 1, stderr);
-#if defined(USE_DEPRECATED_MEMALIGN)
-			if (NULL == libc_memalign_fnptr)
-			{
-				fwrite(": memalign not loaded\n", strlen(": memalign not loaded\n"), 1, stderr);
-			}
+	}
 #endif
-
-#if defined(__USE_XOPEN2K)
-			if (NULL == libc_posix_memalign_fnptr)
-			{
-				fwrite(": memalign not loaded\n", strlen(": posix_memalign not loaded\n"), 1, stderr);
-			}
+#ifdef STACK_DEPOT
+	return item->stack;
+#else
+	return (unsigned long)item->ra;
 #endif
+}
 
-#if defined(__USE_ISOC11)
-			if (NULL == libc_aligned_alloc_fnptr)
-			{
-				fwrite(": memalign not loaded\n", strlen(": aligned_alloc not loaded\n"), 1, stderr);
-			}
-#endif
-			abort();
-		}
-		else
+/**
+ * @brief Finds the slot of a site in a site table.
+ *
+ * Linear probing ends on a free slot, there is always one since a table is at most half full.
+ *
+ * @param sites The slots of the table.
+ * @param capacity The number of slots, a power of 2.
+ * @param site The site, not 0.
+ * @return The slot holding the site, else the free slot for it.
+ */
+static SITESTAT *siteStatSlot(SITESTAT *sites, unsigned long capacity, unsigned long site)
+{
+	unsigned long mask = capacity - 1;
+	for (unsigned long i = ((site * 0x9E3779B97F4A7C15UL) >> 32) & mask;; i = (i + 1) & mask)
+	{
+		if ((site == sites[i].site) || (0 == sites[i].site))
 		{
-			if (__register_atfork(NULL, NULL, run_in_child_context, __dso_handle) != 0)
-			{
-				fwrite("__register_atfork", strlen("__register_atfork"), 1, stderr);
-				dbg(PRINT_ERROR, "%s: Error __register_atfork\n", __FUNCTION__);
-				abort();
-			}
-			gMemInitialized = 1;
-			dbg(PRINT_INFO, "%s: Loaded symbols from libc, malloc:calloc:free:realloc [%p][%p][%p][%p]\n",
-				__FUNCTION__, libc_malloc_fnptr, libc_calloc_fnptr, libc_free_fnptr, libc_realloc_fnptr);
-#if defined(USE_DEPRECATED_MEMALIGN)
-			dbg(PRINT_INFO, "%s: Loaded symbols from libc, memalign [%p]\n", __FUNCTION__, libc_memalign_fnptr);
-#endif
+			return &sites[i];
+		}
+	}
+}
 
-#if defined(__USE_XOPEN2K)
-			dbg(PRINT_INFO, "%s: Loaded symbols from libc, posix_memalign [%p]\n", __FUNCTION__, libc_posix_memalign_fnptr);
-#endif
+/**
+ * @brief Doubles the site table of a shard. Call with the shard locked.
+ *
+ * The first table holds SITE_STATS_INITIAL_SLOTS, or twice gSiteTopK sites. Slots are mmap'd,
+ * so that growing never calls back into malloc.
+ *
+ * @param shard The shard.
+ * @return 0 if successful; -1 if the new slots couldn't be mapped.
+ */
+static int siteStatGrow(LISTSHARD *shard)
+{
+	unsigned long capacity = SITE_STATS_INITIAL_SLOTS;
+	SITESTAT *sites;
 
-#if defined(__USE_ISOC11)
-			dbg(PRINT_INFO, "%s: Loaded symbols from libc, aligned_alloc [%p]\n", __FUNCTION__, libc_aligned_alloc_fnptr);
-#endif
+	if (shard->siteCapacity)
+	{
+		capacity = shard->siteCapacity * 2;
+	}
+	while (capacity < gSiteTopK * 2)
+	{
+		capacity *= 2;
+	}
+	sites = libc_mmap(NULL, capacity * sizeof(SITESTAT), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == sites)
+	{
+		return -1;
+	}
+	for (unsigned long i = 0; i < shard->siteCapacity; i++)
+	{
+		if (shard->sites[i].site)
+		{
+			*siteStatSlot(sites, capacity, shard->sites[i].site) = shard->sites[i];
 		}
-#else
-		void *libcLibrary = dlopen("libc.so", RTLD_LAZY | RTLD_NOLOAD);
-		if (libcLibrary)
+	}
+	if (shard->sites)
+	{
+		libc_munmap(shard->sites, shard->siteCapacity * sizeof(SITESTAT));
+	}
+	shard->sites = sites;
+	shard->siteCapacity = capacity;
+	return 0;
+}
+
+/**
+ * @brief Removes the site with the least live bytes from the site table of a shard. Call with the shard locked.
+ *
+ * The slots following it in its probe sequence are shifted back, so that no deleted marker is needed.
+ *
+ * @param shard The shard, holding at least one site.
+ * @return The removed site.
+ */
+static SITESTAT siteStatEvict(LISTSHARD *shard)
+{
+	unsigned long mask = shard->siteCapacity - 1;
+	unsigned long hole = mask + 1;
+	SITESTAT evicted;
+
+	for (unsigned long i = 0; i <= mask; i++)
+	{
+		if (shard->sites[i].site && ((mask < hole) || (shard->sites[i].liveBytes < shard->sites[hole].liveBytes)))
 		{
-			libc_calloc_fnptr = dlsym(libcLibrary, "calloc");
-			libc_malloc_fnptr = dlsym(libcLibrary, "malloc");
-			libc_free_fnptr = dlsym(libcLibrary, "free");
-			libc_realloc_fnptr = dlsym(libcLibrary, "realloc");
-			libc_memalign_fnptr = dlsym(libcLibrary, "memalign");
-			dlclose(libcLibrary);
+			hole = i;
 		}
-		else
+	}
+	evicted = shard->sites[hole];
+	for (unsigned long i = (hole + 1) & mask; shard->sites[i].site; i = (i + 1) & mask)
+	{
+		unsigned long home = ((shard->sites[i].site * 0x9E3779B97F4A7C15UL) >> 32) & mask;
+		/* Moved back if its home is not cyclically within (hole, i] */
+		if (((i - home) & mask) >= ((i - hole) & mask))
 		{
-			fwrite("dlopen failed..try without RTLD_NOLOAD\n", strlen("dlopen failed..try without RTLD_NOLOAD\n"), 1, stderr);
+			shard->sites[hole] = shard->sites[i];
+			hole = i;
 		}
-#endif
 	}
+	shard->sites[hole].site = 0;
+	shard->siteCount--;
+	return evicted;
 }
 
-void libc_free(void *ptr);
-void *libc_malloc(size_t size);
+/**
+ * @brief Counts an allocation to its site. Call with the shard locked.
+ *
+ * @param shard The shard of the entry.
+ * @param site The site of the entry, not counted if 0.
+ * @param bytes The size of the entry, estimated with SAMPLED_TRACKING.
+ */
+static void siteStatAlloc(LISTSHARD *shard, unsigned long site, unsigned long bytes)
+{
+	SITESTAT *stat = (shard->sites && site) ? siteStatSlot(shard->sites, shard->siteCapacity, site) : NULL;
 
-#ifdef SELF_TEST
-void resetList() // for testing the list, since a default entry get in and test case couldn't be written
+	if (0 == site)
+	{
+		return;
+	}
+	if ((NULL == stat) || (0 == stat->site))
+	{
+		SITESTAT taken = {0};
+		if (gSiteTopK && (gSiteTopK <= shard->siteCount))
+		{
+			taken = siteStatEvict(shard);
+		}
+		else if (((shard->siteCount + 1) * 2 > shard->siteCapacity) && siteStatGrow(shard))
+		{
+			return;
+		}
+		stat = siteStatSlot(shard->sites, shard->siteCapacity, site);
+		stat->site = site;
+		stat->liveBytes = stat->error = taken.liveBytes;
+		stat->liveCount = taken.liveCount;
+		stat->allocs = stat->frees = 0;
+		shard->siteCount++;
+	}
+	stat->liveBytes += bytes;
+	stat->liveCount++;
+	stat->allocs++;
+}
+
+/**
+ * @brief Counts a free to the site of the entry. Call with the shard locked.
+ *
+ * Frees of a site that was replaced in the top-K table are not counted.
+ *
+ * @param shard The shard of the entry.
+ * @param site The site of the entry.
+ * @param bytes The size of the entry, estimated with SAMPLED_TRACKING.
+ */
+static void siteStatFree(LISTSHARD *shard, unsigned long site, unsigned long bytes)
 {
-#ifdef MAINTAIN_SINGLE_LIST
-	hpfmemhead = hpfmemtail = hpwmemhead = NULL;
-#else
-	memhead = memtail = wmemhead = wmemtail = NULL;
-#endif
+	SITESTAT *stat = (shard->sites && site) ? siteStatSlot(shard->sites, shard->siteCapacity, site) : NULL;
+
+	if ((NULL == stat) || (0 == stat->site))
+	{
+		return;
+	}
+	stat->liveBytes -= (bytes < stat->liveBytes) ? bytes : stat->liveBytes;
+	stat->liveCount -= (stat->liveCount) ? 1 : 0;
+	stat->frees++;
 }
 
-void dispStatus()
+#ifdef INPLACE_REALLOC
+/**
+ * @brief Counts the new size of a realloc'd entry to its site. Call with the shard locked.
+ *
+ * @param shard The shard of the entry.
+ * @param site The site of the entry.
+ * @param oldBytes The size of the entry before realloc, estimated with SAMPLED_TRACKING.
+ * @param bytes The size of the entry after realloc, estimated with SAMPLED_TRACKING.
+ */
+static void siteStatResize(LISTSHARD *shard, unsigned long site, unsigned long oldBytes, unsigned long bytes)
 {
-	dbg(PRINT_MUST, "%s: Enter from pid:tid %d:%d\n", __FUNCTION__, getpid(), gettid());
-	dbg(PRINT_MUST, "%s:\ngMemInitialized %d\n", __FUNCTION__, gMemInitialized);
-	if (0 < gMemInitialized)
+	SITESTAT *stat = (shard->sites && site) ? siteStatSlot(shard->sites, shard->siteCapacity, site) : NULL;
+
+	if ((NULL == stat) || (0 == stat->site))
 	{
-		dbg(PRINT_MUST, "Loaded symbols from libc, malloc:calloc:free:realloc [%p][%p][%p][%p]\n",
-			libc_malloc_fnptr, libc_calloc_fnptr, libc_free_fnptr, libc_realloc_fnptr);
-#if defined(USE_DEPRECATED_MEMALIGN)
-		if (NULL != libc_memalign_fnptr)
-		{
-			dbg(PRINT_MUST, "%s: Loaded symbols from libc, memalign [%p]\n", __FUNCTION__, libc_memalign_fnptr);
-		}
+		return;
+	}
+	stat->liveBytes -= (oldBytes < stat->liveBytes) ? oldBytes : stat->liveBytes;
+	stat->liveBytes += bytes;
+}
+#endif
 #endif
 
-#if defined(__USE_XOPEN2K)
-		if (NULL != libc_posix_memalign_fnptr)
+#ifdef WALK_BOOKMARKS
+/**
+ * @brief Finds a bookmark by its name.
+ *
+ * @param name The name, "" to find an unused bookmark.
+ * @return The index of the bookmark, or -1 if not found.
+ */
+static int bookmarkFind(const char *name)
+{
+	for (int i = 0; i < WALK_BOOKMARKS_MAX; i++)
+	{
+		if (!strncmp(gBookmarks[i].name, name, WALK_BOOKMARK_NAME_SIZE))
 		{
-			dbg(PRINT_MUST, "%s: Loaded symbols from libc, posix_memalign [%p]\n", __FUNCTION__, libc_posix_memalign_fnptr);
+			return i;
 		}
-#endif
+	}
+	return -1;
+}
 
-#if defined(__USE_ISOC11)
-		if (NULL != libc_aligned_alloc_fnptr)
+/**
+ * @brief Moves the bookmarks kept at an entry, when it is free'd or moved by realloc. Call with the shard locked.
+ *
+ * @param shard The shard of the entry.
+ * @param item The entry.
+ * @param to The older neighbour of a free'd entry, or the new place of a moved one.
+ */
+static inline void bookmarkMove(LISTSHARD *shard, const LIST *item, LIST *to)
+{
+	for (unsigned int set = __atomic_load_n(&gBookmarksSet, __ATOMIC_RELAXED); set; set &= set - 1)
+	{
+		int i = __builtin_ctz(set);
+		if (shard->marks[i] == item)
 		{
-			dbg(PRINT_MUST, "%s: Loaded symbols from libc, aligned_alloc [%p]\n", __FUNCTION__, libc_aligned_alloc_fnptr);
+			shard->marks[i] = to;
 		}
-#endif
 	}
-#ifndef PREPEND_LISTDATA
-	dbg(PRINT_MUST, "gInitialAlloc %p, gInitIndex %d\ngListInitialAlloc %p, gListInitIndex %d\n", gInitialAlloc, gInitIndex, gListInitialAlloc, gListInitIndex);
-#else
-	dbg(PRINT_MUST, "gInitialAlloc %p, gInitIndex %d\n", gInitialAlloc, gInitIndex);
+}
 #endif
-	pthread_mutex_lock(&lock);
-	dbg(PRINT_MUST, "Already walked:\n");
-#ifndef MAINTAIN_SINGLE_LIST
-	LIST *tmp = wmemhead;
-	while (tmp)
+
+#ifdef MIRROR_DELTAS
+/**
+ * @brief Logs a change of the shard for the mirrors. Call with the shard locked, once its log is mapped.
+ *
+ * @param shard The shard of the entry.
+ * @param item The entry reallocated in place, NULL for a free.
+ * @param ptr The free'd pointer.
+ */
+static inline void mirrorLog(LISTSHARD *shard, const LIST *item, void *ptr)
+{
+	LISTxfer *record = &shard->mirrorLog[shard->mirrorSeq++ & (gMirrorLogEntries - 1)];
+	if (item)
 	{
-		dbg(PRINT_MUST, "Ptr: %p size: %u ra: %p tid: %ld time: %ld\n", tmp->ptr, tmp->size, tmp->ra, (long)tmp->tid, (long)tmp->seconds);
-		tmp = tmp->next;
+		listGetXfer(item, record);
 	}
-	dbg(PRINT_MUST, "New Allocations:\n");
-	tmp = memhead;
-	while (tmp)
+	else
 	{
-		dbg(PRINT_MUST, "Ptr: %p size: %u ra: %p tid: %ld time: %ld\n",
-			tmp->ptr, tmp->size, tmp->ra, (long)tmp->tid, (long)tmp->seconds);
-		tmp = tmp->next;
+		memset(record, 0, sizeof(*record));
+		record->flags = 0xDEAD0000;
+		record->ptr = ptr;
 	}
-#else
-	LIST *tmp = hpfmemhead;
-	dbg(PRINT_MUST, "Ptr\tsize\tra\ttid\ttime\n");
-	while (tmp)
+}
+
+/**
+ * @brief Adds a pointer to a set of the pointers logged after the record being collected.
+ *
+ * @param set The set, of a power of 2 pointers, twice the records at least.
+ * @param capacity The pointers of the set.
+ * @param ptr The pointer of the record.
+ * @return true if the pointer is logged again later.
+ */
+static bool mirrorSeen(void **set, unsigned long capacity, void *ptr)
+{
+	unsigned long hash = ((unsigned long)ptr >> 4) * 0x9E3779B97F4A7C15UL;
+	for (unsigned long i = (hash ^ (hash >> 32)) & (capacity - 1);; i = (i + 1) & (capacity - 1))
 	{
-		if (tmp == hpwmemhead)
+		if (set[i] == ptr)
 		{
-			dbg(PRINT_MUST, "New Allocations:\n");
+			return true;
+		}
+		if (NULL == set[i])
+		{
+			set[i] = ptr;
+			return false;
 		}
-		dbg(PRINT_MUST, "%p\t%u\t%p\t%ld\t%ld\n", tmp->ptr, tmp->size, tmp->ra, (long)tmp->tid, (long)tmp->seconds);
-		tmp = tmp->next;
 	}
-#endif
-	dbg(PRINT_MUST, "\n");
-	pthread_mutex_unlock(&lock);
 }
 #endif
 
+#ifdef WALK_CHECKPOINTS
 /**
- * @brief Retrieves the item from the list for a given pointer.
+ * @brief Adds a checkpoint at an appended entry, if the span since the last checkpoint is over. Call with the shard locked.
  *
- * @param ptr The pointer for which the item needs to be retrieved.
- * @return The item corresponding to the given pointer, or NULL if not found.
+ * @param shard The shard of the entry.
+ * @param item The appended entry, the tail of the shard.
  */
-LIST *getItem(void *ptr)
+static inline void checkpointAdd(LISTSHARD *shard, LIST *item)
 {
-	LIST *ret = NULL;
-	pthread_mutex_lock(&lock);
-#ifndef PREPEND_LISTDATA
-#ifndef MAINTAIN_SINGLE_LIST
-	LIST *tmp = memhead;
-	while (tmp)
-	{
-		if (ptr == tmp->ptr)
-		{
-			pthread_mutex_unlock(&lock);
-			return tmp;
-		}
-		tmp = tmp->next;
-	}
-	tmp = wmemhead;
-	while (tmp)
+	time_t seconds = listSeconds(item);
+	unsigned int count = shard->checkpointCount;
+
+	if (count && (seconds < shard->checkpoints[count - 1].seconds + shard->checkpointSpan))
 	{
-		if (ptr == tmp->ptr)
-		{
-			ret = tmp;
-			break;
-		}
-		tmp = tmp->next;
+		return;
 	}
-#else  /* else of #ifndef MAINTAIN_SINGLE_LIST */
-	LIST *tmp = hpfmemhead;
-	while (tmp)
+	if (WALK_CHECKPOINTS_MAX == count)
 	{
-		if (ptr == tmp->ptr)
+		/* Keep every other checkpoint, the index covers twice the time with the same size */
+		for (unsigned int i = 1; i < WALK_CHECKPOINTS_MAX / 2; i++)
 		{
-			pthread_mutex_unlock(&lock);
-			return tmp;
+			shard->checkpoints[i] = shard->checkpoints[2 * i];
 		}
-		tmp = tmp->next;
+		count = WALK_CHECKPOINTS_MAX / 2;
+		shard->checkpointSpan *= 2;
 	}
-#endif /* End of #ifndef MAINTAIN_SINGLE_LIST */
-#else  /* else of #ifndef PREPEND_LISTDATA */
-	ret = (LIST *)((char *)ptr - sizeof(LIST));
-// #if defined(PREPEND_LISTDATA)
-// TODO: Add unlikely attribute
-	if (0xBEAD0000 != (ret->flags & 0xFFFF0000))
+	if (0 == shard->checkpointSpan)
 	{
-		ret = NULL;
+		shard->checkpointSpan = WALK_CHECKPOINT_SPAN;
 	}
-// #endif
-#endif
-	pthread_mutex_unlock(&lock);
-	return ret;
+	shard->checkpoints[count].seconds = seconds;
+	shard->checkpoints[count].item = item;
+	shard->checkpointCount = count + 1;
 }
 
 /**
- * @brief Marks all the memory allocations as tracked.
+ * @brief Gets the index past the last checkpoint at or before a time.
  *
- * This function moves all new allocations to the list of tracked allocations.
+ * @param shard The shard.
+ * @param seconds The time.
+ * @return The number of checkpoints at or before the time.
  */
-__attribute__((weak)) void heapwalkMarkall()
+static unsigned int checkpointSearch(const LISTSHARD *shard, time_t seconds)
 {
-	pthread_mutex_lock(&lock);
-#ifdef MAINTAIN_SINGLE_LIST
-	hpwmemhead = NULL;
-#else
-	if (wmemtail)
+	unsigned int low = 0, high = shard->checkpointCount;
+
+	while (low < high)
 	{
-		wmemtail->next = memhead;
-		if (memhead)
+		unsigned int mid = (low + high) / 2;
+		if (shard->checkpoints[mid].seconds <= seconds)
 		{
-#ifdef PREPEND_LISTDATA
-			memhead->prev = wmemtail;
-#endif
-			wmemtail = memtail;
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
 		}
 	}
-	else
-	{
-		wmemhead = memhead;
-		wmemtail = memtail;
-	}
-
-	memhead = memtail = NULL;
-#endif
-	pthread_mutex_unlock(&lock);
+	return low;
 }
 
 /**
- * @brief Resets the tracked memory allocations.
+ * @brief Moves the checkpoints kept at an entry, when it is free'd or moved by realloc. Call with the shard locked.
  *
- * This function moves all tracked allocations back to the list of new allocations.
+ * @param shard The shard of the entry.
+ * @param item The entry, not read as it may be free'd already.
+ * @param seconds The allocation time of the entry.
+ * @param to The newer neighbour of a free'd entry, or the new place of a moved one. NULL drops the checkpoints.
  */
-void heapwalkReset()
+static inline void checkpointMove(LISTSHARD *shard, const LIST *item, time_t seconds, LIST *to)
 {
-	/* Protect */
-	pthread_mutex_lock(&lock);
+	bool found = false;
 
-#ifdef MAINTAIN_SINGLE_LIST
-	hpwmemhead = hpfmemhead;
-#else
-	if (memhead)
+	/* The checkpoints at the entry are in a row, older ones moved to it from free'd entries */
+	for (unsigned int i = checkpointSearch(shard, seconds + WALK_CHECKPOINT_SLACK); i--;)
 	{
-		if (wmemtail)
+		if (shard->checkpoints[i].item == item)
 		{
-			wmemtail->next = memhead;
-#ifdef PREPEND_LISTDATA
-			memhead->prev = wmemtail;
-#endif
-			memhead = wmemhead;
+			found = true;
+			shard->checkpoints[i].item = to;
+			if (NULL == to)
+			{
+				shard->checkpointCount = i;
+			}
 		}
-	}
-	else
-	{
-		memhead = wmemhead;
-		memtail = wmemtail;
-	}
-	wmemhead = wmemtail = NULL;
-	/* LIST *tmp = wmemhead;
-	LIST *tail = wmemhead;
-		while (tmp) {
-		tail = tmp;
-				tmp = tmp->next;
+		else if (found || (shard->checkpoints[i].seconds + WALK_CHECKPOINT_SLACK < seconds))
+		{
+			break;
 		}
-	if (tail){
-		tail->next = memhead;
-		memhead = wmemhead;
-		wmemhead = NULL;
-	} */
-#endif
-	pthread_mutex_unlock(&lock);
+	}
 }
 
-#ifdef OPTIMIZE_MQ_TRANSFER
 /**
- * @brief Walks the heap and transfers memory information to the message queue.
+ * @brief Gets the entry of the last checkpoint of a shard whose older entries were all allocated before a time.
  *
- * This function transfers information about heap allocations to the provided message queue descriptor.
+ * Call with the shard locked.
  *
- * @param mqsend The message queue descriptor to which memory information will be sent.
- * @param walkAll A flag indicating whether to walk all allocations or only new ones.
+ * @param shard The shard.
+ * @param since The time.
+ * @return The entry, or NULL if no checkpoint is old enough.
  */
-void heapwalk(mqd_t mqsend, bool walkAll)
+static LIST *checkpointFind(const LISTSHARD *shard, time_t since)
 {
-	msg_resp msgresp;
-	LIST *tmp;
+	unsigned int i = checkpointSearch(shard, since - WALK_CHECKPOINT_SLACK - 1);
 
-	dbg(PRINT_NOISE, "%s: Enter\n", __FUNCTION__);
-	msgresp.numItemOrInfo = HEAPWALK_EMPTY;
-	pthread_mutex_lock(&lock);
-	if (walkAll)
+	return (i) ? shard->checkpoints[i - 1].item : NULL;
+}
+
+/**
+ * @brief Moves the start of a walk range of a shard to the time window of the filter.
+ *
+ * Entries are in allocation order up to WALK_CHECKPOINT_SLACK seconds, so the checkpoint is
+ * compared by time with the ends of the range, and the range is left as is when it isn't sure.
+ * Call with the shard locked.
+ *
+ * @param shard The shard.
+ * @param cur The start of the range, moved.
+ * @param end The end of the range, NULL for the tail.
+ * @return true if entries were skipped.
+ */
+static bool shardWalkWindow(const LISTSHARD *shard, LIST **cur, LIST *end)
+{
+	LIST *mark;
+
+	if (!gWalkSince || (*cur == end) || (NULL == (mark = checkpointFind(shard, gWalkSince))))
 	{
-#ifdef MAINTAIN_SINGLE_LIST
-		tmp = hpfmemhead;
-#else
-		tmp = wmemhead;
-#endif
-		if (NULL != tmp)
-		{
-			while (tmp)
-			{
-#ifdef MAINTAIN_SINGLE_LIST
-				if (tmp == hpwmemhead)
-				{
-					dbg(PRINT_NOISE, "%s: Breaking for processing new allocation\n", __FUNCTION__);
-					/* In case where there was no previous walk, then send full walk as empty and
-					 * then proceed with to be walked send */
-					if (hpwmemhead == hpfmemhead) {
-						msgresp.numItemOrInfo = HEAPWALK_EMPTY;
-						mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-					}
-					break;
-				}
+		return false;
+	}
+	if (end && (listSeconds(mark) > listSeconds(end) + WALK_CHECKPOINT_SLACK))
+	{
+		/* The whole range is older than the checkpoint */
+		*cur = end;
+		return true;
+	}
+	if ((!end || (listSeconds(mark) + WALK_CHECKPOINT_SLACK < listSeconds(end))) &&
+		(listSeconds(mark) > listSeconds(*cur) + WALK_CHECKPOINT_SLACK))
+	{
+		*cur = mark;
+		return true;
+	}
+	return false;
+}
 #endif
 
-#ifdef PREPEND_LISTDATA
-				msgresp.xfer[msgresp.numItemOrInfo].flags = tmp->flags;
+/**
+ * @brief Gets the first new entry of a shard, the first one not walked or allocated since the bookmark of the walk.
+ *
+ * Call with the shard locked.
+ *
+ * @param shard The shard.
+ * @return The first new entry, or NULL if none.
+ */
+static LIST *shardWalkStart(const LISTSHARD *shard)
+{
+#ifdef WALK_BOOKMARKS
+	if (gWalkBookmarked)
+	{
+		LIST *mark = (0 <= gWalkBookmark) ? shard->marks[gWalkBookmark] : NULL;
+		return (mark) ? mark->next : shard->head;
+	}
 #endif
-				msgresp.xfer[msgresp.numItemOrInfo].ptr = tmp->ptr;
-				msgresp.xfer[msgresp.numItemOrInfo].size = tmp->size;
-				msgresp.xfer[msgresp.numItemOrInfo].ra = tmp->ra;
-				msgresp.xfer[msgresp.numItemOrInfo].tid = tmp->tid;
-				msgresp.xfer[msgresp.numItemOrInfo].seconds = tmp->seconds;
-				msgresp.numItemOrInfo++;
-				if (MAX_MSG_XFER <= msgresp.numItemOrInfo)
-				{
-					if (tmp->next)
-					{
-						msgresp.numItemOrInfo |= HEAPWALK_ITEM_CONTN;
-					}
-					else
-					{ /* Set the end of list */
-						msgresp.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
-#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
-						msgresp.totalHeapSize = totalHeapSize;
-						msgresp.totalOverhead = totalOverhead;
+	return shard->whead;
+}
+
+/* Cursor for walking all shards merged in allocation time order */
+typedef struct shard_walk
+{
+	LIST *cur[MAX_LIST_SHARDS];
+	LIST *end[MAX_LIST_SHARDS];
+#ifdef CONCURRENT_HEAPWALK
+	bool shardEnd; /* The ends are the wend of the shards, moved by the frees during the walk */
 #endif
-					}
-					mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-					msgresp.numItemOrInfo = HEAPWALK_EMPTY;
-				}
-				tmp = tmp->next;
-			}
-			if (msgresp.numItemOrInfo)
-			{
-				msgresp.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
-#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
-				msgresp.totalHeapSize = totalHeapSize;
-				msgresp.totalOverhead = totalOverhead;
+#ifdef SLICED_HEAPWALK
+	LISTxfer *page; /* Entries copied by the last slice, NULL when the walk isn't sliced */
+	unsigned int count;
+	unsigned int index;
+	bool done;
 #endif
-				// TODO: for now send the full size. sync receiver to accept for lesser size
-				/* Send the message with the information collected */
-				mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-			}
+} SHARDWALK;
+
+/**
+ * @brief Initializes a merged walk over all shards.
+ *
+ * Call with all the shards locked.
+ *
+ * @param walk The walk cursor to be initialized.
+ * @param walked true to walk the already walked entries, false to walk the new entries.
+ * @return true if entries before the time window of the filter were skipped.
+ */
+static bool shardWalkInit(SHARDWALK *walk, bool walked)
+{
+	bool skipped = false;
+
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		if (walked)
+		{
+			walk->cur[i] = gListShards[i].head;
+			walk->end[i] = shardWalkStart(&gListShards[i]);
 		}
 		else
 		{
-			// msgresp.numItemOrInfo = HEAPWALK_EMPTY; Initialized already
-			mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
+			walk->cur[i] = shardWalkStart(&gListShards[i]);
+			walk->end[i] = NULL;
 		}
+#ifdef WALK_CHECKPOINTS
+		skipped |= shardWalkWindow(&gListShards[i], &walk->cur[i], walk->end[i]);
+#endif
 	}
-
-	msgresp.numItemOrInfo = HEAPWALK_EMPTY;
-#ifdef MAINTAIN_SINGLE_LIST
-	tmp = hpwmemhead;
-#else
-	tmp = memhead;
+#ifdef CONCURRENT_HEAPWALK
+	walk->shardEnd = false;
 #endif
-	if (NULL != tmp)
+#ifdef SLICED_HEAPWALK
+	walk->page = NULL;
+#endif
+	return skipped;
+}
+
+/**
+ * @brief Steps a merged walk to its next entry, also to the entries free'd during a concurrent walk.
+ *
+ * Entries of a shard are in allocation order, so the oldest head among the shards is picked.
+ *
+ * @param walk The walk cursor.
+ * @return The next entry, or NULL at the end of the walk.
+ */
+static LIST *shardWalkStep(SHARDWALK *walk)
+{
+	int next = -1;
+	LIST *ret;
+
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
 	{
-		while (tmp)
+		LIST *end = walk->end[i];
+#ifdef CONCURRENT_HEAPWALK
+		if (walk->shardEnd)
 		{
-			// memcpy(((char*)msgresp.xfer + msgresp_xfer_index), tmp, sizeof(LISTxfer));
-#ifdef PREPEND_LISTDATA
-			msgresp.xfer[msgresp.numItemOrInfo].flags = tmp->flags;
-#endif
-			msgresp.xfer[msgresp.numItemOrInfo].ptr = tmp->ptr;
-			msgresp.xfer[msgresp.numItemOrInfo].size = tmp->size;
-			msgresp.xfer[msgresp.numItemOrInfo].ra = tmp->ra;
-			msgresp.xfer[msgresp.numItemOrInfo].tid = tmp->tid;
-			msgresp.xfer[msgresp.numItemOrInfo].seconds = tmp->seconds;
-			msgresp.numItemOrInfo++;
-			if (MAX_MSG_XFER <= msgresp.numItemOrInfo)
-			{
-				if (tmp->next)
-				{
-					msgresp.numItemOrInfo |= HEAPWALK_ITEM_CONTN;
-				}
-				else
-				{ // Set End of list
-					msgresp.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
-#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
-					msgresp.totalHeapSize = totalHeapSize;
-					msgresp.totalOverhead = totalOverhead;
-#endif
-				}
-				dbg(PRINT_NOISE, "%s: Sending %d items\n", __FUNCTION__, msgresp.numItemOrInfo);
-				mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-				msgresp.numItemOrInfo = 0;
-			}
-			// prev = tmp;
-			tmp = tmp->next;
+			end = __atomic_load_n(&gListShards[i].wend, __ATOMIC_ACQUIRE);
 		}
-		if (msgresp.numItemOrInfo)
-		{
-			dbg(PRINT_NOISE, "%s: Sending final set of %d items\n", __FUNCTION__, msgresp.numItemOrInfo);
-			msgresp.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
-#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
-			msgresp.totalHeapSize = totalHeapSize;
-			msgresp.totalOverhead = totalOverhead;
 #endif
-			// TODO: for now send the full size. sync receiver to accept for lesser size
-			mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
+		if (walk->cur[i] == end)
+		{
+			continue;
 		}
-
-#ifdef MAINTAIN_SINGLE_LIST
-		hpwmemhead = NULL;
-#else
-		// if (prev)
+#ifdef WALK_CHECKPOINTS
+		/* The entries after one allocated past the time window of the filter are newer too */
+		if (gWalkUntil && walk->cur[i] && (listSeconds(walk->cur[i]) > gWalkUntil + WALK_CHECKPOINT_SLACK))
 		{
-			if (wmemtail)
-			{
-				wmemtail->next = memhead;
-				// wmemtail = prev;
-#ifdef PREPEND_LISTDATA
-				if (memhead)
-				{
-					memhead->prev = wmemtail;
-				}
-#endif
-				if (memtail)
-				{
-					wmemtail = memtail;
-				}
-			}
-			else
-			{
-				wmemhead = memhead;
-				wmemtail = memtail;
-			}
-
-			memhead = memtail = NULL;
+			walk->cur[i] = end;
+			continue;
 		}
 #endif
+		/* A cursor reaching the tail past an end that moved stops there */
+		if (walk->cur[i] &&
+			((-1 == next) || (listSeconds(walk->cur[i]) < listSeconds(walk->cur[next]))))
+		{
+			next = i;
+		}
 	}
-	else
+	if (-1 == next)
 	{
-		dbg(PRINT_INFO, "No new allocations\n");
-#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
-		msgresp.totalHeapSize = totalHeapSize;
-		msgresp.totalOverhead = totalOverhead;
-#endif
-		// msgresp.numItemOrInfo = HEAPWALK_EMPTY;
-		mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
+		return NULL;
 	}
-	pthread_mutex_unlock(&lock);
-	dbg(PRINT_NOISE, "%s: Exit\n", __FUNCTION__);
+	ret = walk->cur[next];
+	/* Pairs with the release in appendItemToList, entries may be appended during a concurrent walk */
+	walk->cur[next] = __atomic_load_n(&ret->next, __ATOMIC_ACQUIRE);
+	return ret;
 }
-#else /* else of #ifdef OPTIMIZE_MQ_TRANSFER */
 
 /**
- * @brief Walks the heap and transfers memory information to the message queue.
- *
- * This function transfers information about heap allocations to the provided message queue descriptor.
+ * @brief Gets the next entry of a merged walk.
  *
- * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walk The walk cursor.
+ * @return The next entry, or NULL at the end of the walk.
  */
-void heapwalk(mqd_t mqsend)
+static LIST *shardWalkNext(SHARDWALK *walk)
 {
-	msg_resp msgresp;
-	msgresp.seq = 1;
+	LIST *ret;
 
-	dbg(PRINT_NOISE, "%s: Enter\n", __FUNCTION__);
-	pthread_mutex_lock(&lock);
-#ifdef MAINTAIN_SINGLE_LIST
-	LIST *tmp = hpwmemhead;
-#else
-	LIST *tmp = memhead;
-#endif
-	if (NULL != tmp)
-	{
-		// LIST *prev = NULL;
-		while (tmp)
-		{
-#ifdef PREPEND_LISTDATA
-			snprintf(msgresp.msg, MQ_MSG_SIZE, "%p %u %p %u %ld%s", tmp->ptr, tmp->size, tmp->ra, tmp->tid, tmp->seconds, (tmp->flags & 0x1) ? " - R" : "");
-#else
-			// snprintf(msgresp.msg, MQ_MSG_SIZE, "Ptr: %p size: %u ra: %p tid: %ld time: %ld",
-			snprintf(msgresp.msg, MQ_MSG_SIZE, "%p %u %p %u %ld", tmp->ptr, tmp->size, tmp->ra, tmp->tid, tmp->seconds);
+	/* Skip entries free'd during a concurrent walk */
+	while ((ret = shardWalkStep(walk)) && (0xBEAD0000 != (ret->flags & 0xFFFF0000)))
+		;
+	return ret;
+}
 #endif
-			mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-			msgresp.seq++;
-			// prev = tmp;
-			tmp = tmp->next;
-		}
 
-		/* Mark as walked allocation */
-#ifndef MAINTAIN_SINGLE_LIST
-		// if (prev)
-		{
-			if (wmemtail)
-			{
-				wmemtail->next = memhead;
-				// wmemtail = prev;
-#ifdef PREPEND_LISTDATA
-				if (memhead)
-				{
-					memhead->prev = wmemtail;
-				}
-#endif
-				if (memtail)
-				{
-					wmemtail = memtail;
-				}
-			}
-			else
-			{
-				wmemhead = memhead;
-				wmemtail = memtail;
-			}
-
-			// prev->next = wmemhead;
-			// wmemhead = memhead;
-			memhead = memtail = NULL;
-		}
-#else /* else of #ifndef MAINTAIN_SINGLE_LIST */
-		hpwmemhead = NULL;
-#endif
-	}
-	else
-	{
-		dbg(PRINT_INFO, "No new allocations\n");
-		snprintf(msgresp.msg, MQ_MSG_SIZE, "No new allocations");
-		mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-	}
-	dbg(PRINT_NOISE, "%s: Exit\n", __FUNCTION__);
-	pthread_mutex_unlock(&lock);
-}
+#ifdef SIDE_TABLE
+#define SIDE_TABLE_GROW_ERROR "Side table mmap failed, allocation not tracked\n"
 
 /**
- * @brief Walks the full heap and transfers memory information to the message queue.
+ * @brief Hashes an allocated pointer with the MurmurHash3 finalizer.
  *
- * This function transfers information about all heap allocations to the provided message queue descriptor.
+ * malloc'd pointers differ only in a few middle bits, the finalizer spreads them over all the bits.
  *
- * @param mqsend The message queue descriptor to which full memory information will be sent.
+ * @param ptr The allocated pointer.
+ * @return The hash, whose top bits select the shard and low bits the slot.
  */
-void heapwalk_full(mqd_t mqsend)
+static unsigned long long sideTableHash(const void *ptr)
 {
-	msg_resp msgresp;
-	msgresp.seq = 0;
-	pthread_mutex_lock(&lock);
-	sprintf(msgresp.msg, "Already walked:");
-	mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
+	unsigned long long hash = (unsigned long long)(unsigned long)ptr;
 
-#ifdef MAINTAIN_SINGLE_LIST
-	LIST *tmp = hpfmemhead;
-#else
-	LIST *tmp = memhead;
-#endif
-	if (NULL != tmp)
-	{
-		while (tmp)
-		{
-#ifdef MAINTAIN_SINGLE_LIST
-			if (tmp == hpwmemhead)
-			{
-				sprintf(msgresp.msg, "New allocations:");
-				mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-				msgresp.seq = 0;
-			}
-#endif
-			msgresp.seq++;
-#ifdef PREPEND_LISTDATA
-			snprintf(msgresp.msg, MQ_MSG_SIZE, "%p %u %p %u %ld%s", tmp->ptr, tmp->size, tmp->ra, tmp->tid, tmp->seconds, (tmp->flags & 0x1) ? " - R" : "");
-#else
-			snprintf(msgresp.msg, MQ_MSG_SIZE, "%p %u %p %u %ld", tmp->ptr, tmp->size, tmp->ra, tmp->tid, tmp->seconds);
-#endif
-			mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-			tmp = tmp->next;
-		}
-	}
-#ifndef MAINTAIN_SINGLE_LIST
-	sprintf(msgresp.msg, "New allocations:");
-	mq_send(mqsend, (const char *)&msgresp, sizeof(msg_resp), 0);
-	heapwalk(mqsend);
-#else
-	hpwmemhead = NULL;
-#endif
-	pthread_mutex_unlock(&lock);
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
 }
-#endif
 
-// TODO: not completed for prependITem to list and prepend list data combination
-#if !defined(MAINTAIN_SINGLE_LIST) && !defined(PREPEND_LISTDATA) // Available only for normal list allocation type
 /**
- * @brief Prepends an item to the list of allocations.
+ * @brief Gets the side table shard of a pointer from its hash.
  *
- * This function adds a new allocation item to the start of the allocation list.
+ * @param hash The hash of the pointer.
+ * @return The shard holding the entry of the pointer.
+ */
+static SIDETABLE *sideTableShard(unsigned long long hash)
+{
+	return &gSideTable[(hash >> 60) & (SIDE_TABLE_SHARDS - 1)];
+}
+
+/**
+ * @brief Finds the slot of a pointer in a shard. Call with the shard locked.
  *
- * @param item The allocated memory pointer.
- * @param size The size of the allocated memory.
- * @param ra The return address where the allocation was made.
+ * Probing ends on a free slot, there is always one since the shard is at most 3/4 used.
+ *
+ * @param table The shard of the pointer.
+ * @param ptr The allocated pointer.
+ * @param hash The hash of the pointer.
+ * @return The slot holding the pointer, or NULL if not found.
  */
-void prependItemToList(void *item, unsigned int size, void *ra)
+static LIST *sideTableFind(SIDETABLE *table, const void *ptr, unsigned long long hash)
 {
-	LIST *tmp;
-	// pthread_mutex_lock(&lock);
-	if (0 < gMemInitialized)
+	if ((NULL == table->slots) || (NULL == ptr))
 	{
-		tmp = (LIST *)libc_malloc(sizeof(LIST));
+		return NULL;
 	}
-	else
+	unsigned long mask = table->capacity - 1;
+	for (unsigned long i = hash & mask;; i = (i + 1) & mask)
 	{
-		pthread_mutex_lock(&lock);
-		tmp = (LIST *)&gListInitialAlloc[gListInitIndex]; /* Aligned since not packed */
-		gListInitIndex += (sizeof(LIST)); //  + sizeof(LIST)%4);
-		pthread_mutex_unlock(&lock); /* Unlock mutex, Race condition if any will only affect the order */
-		if (G_INITIAL_LIST_ALLOC_SIZE <= gListInitIndex)
+		if (ptr == table->slots[i].ptr)
 		{
-			/* Using printf or any function that will allocate memory inside or any variable number of arg fns
-			Might get into loop and wait indefinetly on futex
-			OR might trigger recursion and end up stack full
-			*/
-			// dbg(PRINT_MUST, "%s:%s:!!!!!! INCREASE gListInitialAlloc[], size now is %ld\n", __FILE__, __FUNCTION__, (long int)G_INITIAL_LIST_ALLOC_SIZE);
-			fwrite(G_INITIAL_LIST_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_LIST_ALLOC_SIZE_ERROR), 1, stderr);
-			exit(1);
+			return &table->slots[i];
+		}
+		if (NULL == table->slots[i].ptr)
+		{
+			return NULL;
 		}
 	}
-	tmp->ptr = item;
-	tmp->size = size;
-	tmp->ra = ra;
-	tmp->tid = gettid();
-	tmp->seconds = time(NULL);
-
-	// dbg(PRINT_INFO, "%s: Prepend item %p\n", __FUNCTION__, item);
-	pthread_mutex_lock(&lock);
-	tmp->next = memhead;
-	if (NULL == memtail)
-		memtail = tmp;
-	memhead = tmp;
-	pthread_mutex_unlock(&lock);
 }
-#endif
 
-#ifndef PREPEND_LISTDATA
-/**
- * @brief Appends an item to the list of allocations.
- *
- * This function adds a new allocation item to the end of the allocation list.
- *
- * @param item The allocated memory pointer.
- * @param size The size of the allocated memory.
- * @param ra The return address where the allocation was made.
- */
-void appendItemToList(void *item, unsigned int size, void *ra)
-#else
 /**
- * @brief Appends an item to the list of allocations (with flags).
+ * @brief Rehashes the entries of a shard into new slots, dropping the deleted ones. Call with the shard locked.
  *
- * This function adds a new allocation item to the end of the allocation list and sets the flags.
+ * The slots are doubled when at least half of them hold entries, else only the deleted slots are reclaimed.
+ * Slots are mmap'd, so that growing never calls back into malloc.
  *
- * @param item The allocated memory pointer.
- * @param size The size of the allocated memory.
- * @param flags The flags indicating allocation type and alignment.
- * @param ra The return address where the allocation was made.
+ * @param table The shard to be rehashed.
+ * @return 0 if successful; -1 if the new slots couldn't be mapped.
  */
-void appendItemToList(void *item, unsigned int size, unsigned int flags, void *ra)
-#endif
+static int sideTableGrow(SIDETABLE *table)
 {
-	LIST *listPtr;
+	unsigned long entries = 0;
+	unsigned long capacity = SIDE_TABLE_INITIAL_SLOTS;
+	LIST *slots;
 
-#ifndef PREPEND_LISTDATA
-	if (0 < gMemInitialized)
-	{
-		listPtr = (LIST *)libc_malloc(sizeof(LIST));
-	}
-	else
+	for (unsigned long i = 0; i < table->capacity; i++)
 	{
-		pthread_mutex_lock(&lock);
-		listPtr = (LIST *)&gListInitialAlloc[gListInitIndex];
-		gListInitIndex += (sizeof(LIST)); // + sizeof(LIST)%4);
-		// Unlock mutex here. If there is race condition, it'll only affect the order
-		pthread_mutex_unlock(&lock);
-		if (G_INITIAL_LIST_ALLOC_SIZE <= gListInitIndex)
+		if ((NULL != table->slots[i].ptr) && (SIDE_TABLE_DELETED != table->slots[i].ptr))
 		{
-			// Using printf or any function that will allocate memory inside or any variable number of arg fns
-			// Might get into loop and wait indefinetly on futex
-			// OR might trigger recursion and end up stack full
-			// dbg(PRINT_MUST, "%s:%s:!!!!!! INCREASE gListInitialAlloc[], size now is %ld\n", __FILE__, __FUNCTION__, (long)G_INITIAL_LIST_ALLOC_SIZE);
-			fwrite(G_INITIAL_LIST_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_LIST_ALLOC_SIZE_ERROR), 1, stderr);
-			exit(1);
+			entries++;
 		}
 	}
-	listPtr->ptr = item;
-#else
-	listPtr = (LIST *)((char *)item - sizeof(LIST));
-	listPtr->ptr = item;
-	listPtr->flags = 0xBEAD0000 | flags;
-	listPtr->prev = NULL;
-#endif
-	listPtr->size = size;
-	listPtr->ra = ra;
-	listPtr->tid = gettid();
-	listPtr->seconds = time(NULL);
-	listPtr->next = NULL;
-
-	pthread_mutex_lock(&lock);
-#ifdef MAINTAIN_SINGLE_LIST
-	if (hpfmemtail)
+	if (table->capacity)
 	{
-		hpfmemtail->next = listPtr;
-#ifdef PREPEND_LISTDATA
-		listPtr->prev = hpfmemtail;
-#endif
-		hpfmemtail = listPtr;
-		if (NULL == hpwmemhead)
-		{
-			hpwmemhead = listPtr;
-		}
+		capacity = (entries * 2 >= table->capacity) ? table->capacity * 2 : table->capacity;
 	}
-	else
-	{ // head should also be null
-		hpfmemhead = hpfmemtail = hpwmemhead = listPtr;
+	slots = libc_mmap(NULL, capacity * sizeof(LIST), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == slots)
+	{
+		return -1;
 	}
-#else
-	if (memtail)
+	for (unsigned long i = 0; i < table->capacity; i++)
 	{
-		memtail->next = listPtr;
-#ifdef PREPEND_LISTDATA
-		listPtr->prev = memtail;
-#endif
-		memtail = listPtr;
+		LIST *item = &table->slots[i];
+		if ((NULL == item->ptr) || (SIDE_TABLE_DELETED == item->ptr))
+		{
+			continue;
+		}
+		unsigned long j = sideTableHash(item->ptr) & (capacity - 1);
+		while (NULL != slots[j].ptr)
+		{
+			j = (j + 1) & (capacity - 1);
+		}
+		slots[j] = *item;
 	}
-	else
-	{ // head should also be null
-		memhead = memtail = listPtr;
+	if (table->slots)
+	{
+		libc_munmap(table->slots, table->capacity * sizeof(LIST));
 	}
+	table->slots = slots;
+	table->capacity = capacity;
+	table->used = entries;
+	return 0;
+}
 
-	/*if (NULL == memhead){
-			memhead = listPtr;
-	}else {
-			LIST *trav = memhead->next;
-			LIST *prev = memhead;
-			while (trav){
-					prev = trav;
-					trav = trav->next;
-			}
-			prev->next = listPtr;
-	}*/
-#endif
-
-#ifdef ENABLE_STATISTICS
-	totalHeapSize += size;
-	if (2 > flags)
+/**
+ * @brief Locks all the side table shards, always in the same order.
+ */
+static void lockSideTable()
+{
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++)
 	{
-		totalOverhead += sizeof(LIST);
+		pthread_mutex_lock(&gSideTable[i].lock);
 	}
-#endif
-	pthread_mutex_unlock(&lock);
 }
 
-#ifdef PREPEND_LISTDATA
 /**
- * @brief Sets the alignment value for a given alignment.
- *
- * This function calculates and sets the alignment value based on the given alignment.
- *
- * @param alignment The alignment value.
- * @return The calculated alignment value.
+ * @brief Unlocks all the side table shards.
  */
-unsigned int setAlignment(unsigned int alignment)
+static void unlockSideTable()
 {
-	for (unsigned int i = 1; i <= 16; i++)
+	for (int i = SIDE_TABLE_SHARDS - 1; i >= 0; i--)
 	{
-		alignment = alignment >> 1;
-		if (!(alignment))
-		{
-			return i;
-		}
+		pthread_mutex_unlock(&gSideTable[i].lock);
 	}
-	return 0;
 }
 
-/****
- * if(alignment>sizeof LIST) then
- * 	Ptr = Alloc'd Address + alignment;
- * else if (modulus(sizeof(LIST), alignment) then
- * 	Ptr = Alloc'd Addr + sizeof(LIST) + modulus(sizeof(LIST), alignment);
- * else
- * 	Ptr = Alloc'd Addr + sizeof(LIST)
- ****/
-
 /**
- * @brief Deletes an item from the list of allocations.
- *
- * This function removes an item from the list of allocations and adjusts pointers appropriately.
+ * @brief Sets the walked mark of all the side table entries.
  *
- * @param item The item to be removed.
- * @return The adjusted pointer.
+ * @param walked 1 to mark the entries as walked, 0 to show them again in the next walk.
  */
-void *deleteItemFromList(void *item)
+static void sideTableMarkall(unsigned int walked)
 {
-	void *ptr;
-	LIST *tmp = (LIST *)((char *)item - sizeof(LIST));
-	if (0xBEAD0000 == (tmp->flags & 0xFFFF0000))
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++)
 	{
-#ifdef ENABLE_STATISTICS
-		unsigned int overhead;
+		pthread_mutex_lock(&gSideTable[i].lock);
+		for (unsigned long j = 0; j < gSideTable[i].capacity; j++)
+		{
+			gSideTable[i].slots[j].walked = walked;
+		}
+		pthread_mutex_unlock(&gSideTable[i].lock);
+	}
+}
 #endif
-		unsigned int flags = tmp->flags & 0xFFFF;
-		tmp->flags = 0xDEAD0000;
-		if (2 > flags)
-		{ // 0 --> malloc/calloc 1 --> realloc
-			ptr = (void *)tmp;
-#ifdef ENABLE_STATISTICS
-			overhead = sizeof(LIST);
+
+#if !defined(PREPEND_LISTDATA) && !defined(SIDE_TABLE)
+#ifdef SELF_TEST
+#define G_INITIAL_LIST_ALLOC_SIZE 1024 * sizeof(LIST)
+#else
+#define G_INITIAL_LIST_ALLOC_SIZE 100 * sizeof(LIST)
 #endif
-		}
-		else
-		{
-			unsigned int alignment = 1 << (flags - 1);
-			if (alignment > sizeof(LIST))
-			{
-				ptr = (char *)item - alignment;
-#ifdef ENABLE_STATISTICS
-				overhead = alignment;
+
+char *gListInitialAlloc;
+unsigned int gListInitIndex;
+#define G_INITIAL_LIST_ALLOC_SIZE_ERROR "Increase G_INITIAL_LIST_ALLOC_SIZE\n"
+/*
+#ifdef SELF_TEST
+char __attribute__ ((aligned (sizeof(void*)))) gListInitialAllocP[G_INITIAL_LIST_ALLOC_SIZE];
 #endif
-			}
-			else if ((sizeof(LIST) % alignment))
-			{
-				ptr = (char *)item - sizeof(LIST) - (sizeof(LIST) % alignment);
-#ifdef ENABLE_STATISTICS
-				overhead = sizeof(LIST) + (sizeof(LIST) % alignment);
+*/
 #endif
-			}
-			else
-			{
-				ptr = (char *)item - sizeof(LIST);
-#ifdef ENABLE_STATISTICS
-				overhead = sizeof(LIST);
+
+#ifdef SELF_TEST
+#define G_INITIAL_ALLOC_SIZE 4 * 1024 * 1024 /* Commit 4MB at a time for self-test */
+#else
+#define G_INITIAL_ALLOC_SIZE 2 * 1024 * 1024 /* Commit 2MB at a time */
 #endif
-			}
-		}
-		pthread_mutex_lock(&lock);
-#ifndef MAINTAIN_SINGLE_LIST
-		if (tmp->prev)
+#ifdef __LP64__
+#define G_BOOTSTRAP_RESERVE (1UL << 30) /* Address space only, committed G_INITIAL_ALLOC_SIZE at a time */
+#else
+#define G_BOOTSTRAP_RESERVE (64UL << 20)
+#endif
+/*
+#ifdef SELF_TEST
+char __attribute__ ((aligned (4096))) gInitialAllocP[G_INITIAL_ALLOC_SIZE];
+#endif
+*/
+char *gInitialAlloc;
+unsigned int gInitIndex;
+#define G_INITIAL_ALLOC_SIZE_ERROR "Increase G_BOOTSTRAP_RESERVE\n"
+
+/*
+ * Bootstrap arena, serving the allocations till libc functions are loaded (all of them under SELF_TEST
+ * till gMemInitialized is set). G_BOOTSTRAP_RESERVE bytes of address space are reserved at once and
+ * committed a chunk of G_INITIAL_ALLOC_SIZE bytes at a time as gInitIndex grows, so that a pointer is
+ * checked against all the chunks with a single range compare.
+ * Each block is preceded by a BOOTBLOCK holding its size. Free'd blocks of up to BOOTSTRAP_MAX_CLASS
+ * bytes are kept in power of 2 size class lists, larger ones in a first fit list, and are reused.
+ */
+#define BOOTSTRAP_MIN_CLASS 16
+#define BOOTSTRAP_CLASSES 9 /* 16 to 4096 bytes */
+#define BOOTSTRAP_MAX_CLASS (BOOTSTRAP_MIN_CLASS << (BOOTSTRAP_CLASSES - 1))
+
+typedef struct bootstrap_block
+{
+	size_t size; /* Bytes after the header */
+	struct bootstrap_block *next; /* Free list link, while the block is free'd */
+} BOOTBLOCK;
+
+static pthread_mutex_t gBootstrapLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t gBootstrapCommitted;
+static BOOTBLOCK *gBootstrapFree[BOOTSTRAP_CLASSES];
+static BOOTBLOCK *gBootstrapLarge;
+
+#if !defined(DISABLE_DEBUG) && defined(DEBUG_RUNTIME)
+int debug_level = 0;
+void dbg(int level, const char *fmt, ...)
+{
+	va_list args;
+	// char str[256];
+	if ((level < debug_level) || (PRINT_MUST == level))
+	{
+		va_start(args, fmt);
+		// vsprintf(str, fmt, args);
+		// printf("%d: %s", getpid(), str);
+		if (PRINT_WALK != level) /* Both prints may be intersected by an another thread's print!! */
 		{
-			tmp->prev->next = tmp->next;
-			if (tmp->next)
-			{
-				tmp->next->prev = tmp->prev;
-			}
-			else
-			{
-				// this is the tail. Therefore update memtail or wmemtail
-				if (memtail == tmp)
-				{
-					memtail = tmp->prev;
-					if (memtail)
-					{
-						memtail->next = NULL;
-					}
-				}
-				else if (wmemtail == tmp)
-				{
-					wmemtail = tmp->prev;
-					if (wmemtail)
-					{
-						wmemtail->next = NULL;
-					}
-				}
-				else
-				{
-					ptr = NULL;
-					fwrite("deleteItemFromList:(w)memtail not matches\n", strlen("deleteItemFromList:(w)memtail not matches\n"), 1, stderr);
-				}
-			}
+			printf("%d: ", getpid());
 		}
-		else
+		vprintf(fmt, args);
+		va_end(args);
+	}
+}
+#endif
+
+/**
+ * @brief Initializes the initial memory mapping.
+ *
+ * This function maps the initial memory for list allocation and the main allocation.
+ * It uses mmap to create the mappings and handles errors accordingly.
+ */
+void mapInitialMemory()
+{
+#if !defined(PREPEND_LISTDATA) && !defined(SIDE_TABLE)
+	if (NULL == gListInitialAlloc)
+	{
+		gListInitialAlloc = libc_mmap(NULL, G_INITIAL_LIST_ALLOC_SIZE, PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (gListInitialAlloc == MAP_FAILED)
 		{
-			if (memhead == tmp)
-			{
-				if (memhead->next)
-				{
-					memhead = memhead->next;
-					memhead->prev = NULL;
-				}
-				else
-				{ // Only one item
-					memhead = memtail = NULL;
-				}
-			}
-			else if (wmemhead == tmp)
-			{
-				if (wmemhead->next)
-				{
-					wmemhead = wmemhead->next;
-					wmemhead->prev = NULL;
-				}
-				else
-				{ // Only one item
-					wmemhead = wmemtail = NULL;
-				}
-			}
-			else
-			{
-				ptr = NULL;
-				fwrite("deleteItemFromList:(w)memhead not matches\n", strlen("deleteItemFromList:(w)memhead not matches\n"), 1, stderr);
-			}
-		}
-#else /* else of ifndef MAINTAIN_SINGLE_LIST */
-		if (tmp->prev)
-		{ // This is not a head, so check for tail
-			tmp->prev->next = tmp->next;
-			if (tmp->next)
-			{ // This is not a tail, but still check for walked head
-				tmp->next->prev = tmp->prev;
-				if (hpwmemhead == tmp)
-				{
-					hpwmemhead = tmp->next;
-				}
-			}
-			else
-			{
-				// this is the tail. Therefore update tail
-				if (hpfmemtail == tmp)
-				{
-					hpfmemtail = tmp->prev;
-					if (hpfmemtail)
-					{
-						hpfmemtail->next = NULL;
-					}
-					else
-					{ // List empty..
-						hpfmemhead = NULL;
-					}
-				}
-				else
-				{
-					ptr = NULL;
-					fwrite("deleteItemFromList:(w)memtail not matches\n", strlen("deleteItemFromList:(w)memtail not matches\n"), 1, stderr);
-				}
-				if (hpwmemhead == tmp)
-				{
-					hpwmemhead = NULL;
-				}
-			}
+			fwrite("gListInitialAlloc mmap failed\n", strlen("gListInitialAlloc mmap failed\n"), 1, stderr);
+			exit(2);
 		}
-		else
-		{ // This is the head
-			if (hpfmemhead == tmp)
-			{
-				if (hpfmemhead->next)
-				{ // More than 1 item
-					hpfmemhead = hpfmemhead->next;
-					hpfmemhead->prev = NULL;
-				}
-				else
-				{ // Only one item
-					hpfmemhead = hpfmemtail = NULL;
-				}
-			}
-			else
-			{
-				ptr = NULL;
-				fwrite("deleteItemFromList:(w)memhead not matches\n", strlen("deleteItemFromList:(w)memhead not matches\n"), 1, stderr);
-			}
-			if (hpwmemhead == tmp)
+	}
+#endif
+	if (NULL == gInitialAlloc)
+	{
+		pthread_mutex_lock(&gBootstrapLock);
+		if (NULL == gInitialAlloc)
+		{
+			char *arena = libc_mmap(NULL, G_BOOTSTRAP_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if ((arena == MAP_FAILED) || mprotect(arena, G_INITIAL_ALLOC_SIZE, PROT_READ | PROT_WRITE))
 			{
-				hpwmemhead = hpwmemhead->next;
+				fwrite("gInitialAlloc mmap failed\n", strlen("gInitialAlloc mmap failed\n"), 1, stderr);
+				exit(2);
 			}
+			gBootstrapCommitted = G_INITIAL_ALLOC_SIZE;
+			gInitialAlloc = arena;
 		}
-#endif /* End of ifndef MAINTAIN_SINGLE_LIST */
+		pthread_mutex_unlock(&gBootstrapLock);
+	}
+}
 
-#ifdef ENABLE_STATISTICS
-		totalHeapSize -= tmp->size; // Consider failed pointer size??
-		totalOverhead -= overhead;
-#endif
-		pthread_mutex_unlock(&lock);
+/**
+ * @brief Checks whether a block is allocated from the bootstrap arena.
+ *
+ * @param ptr The block to check.
+ * @return true if ptr is within the reserved range of the arena, false before the arena is mapped.
+ */
+static inline bool bootstrapContains(const void *ptr)
+{
+	return gInitialAlloc && (gInitialAlloc <= (const char *)ptr) && ((const char *)ptr < gInitialAlloc + G_BOOTSTRAP_RESERVE);
+}
+
+/**
+ * @brief Gets the size class of a bootstrap block.
+ *
+ * @param size The bytes asked for.
+ * @return The index into gBootstrapFree, BOOTSTRAP_CLASSES for blocks beyond BOOTSTRAP_MAX_CLASS.
+ */
+static inline unsigned int bootstrapClass(size_t size)
+{
+	if (BOOTSTRAP_MAX_CLASS < size)
+	{
+		return BOOTSTRAP_CLASSES;
 	}
-	else
-	{ /* Allocate & return start of the pointer no matter if its corrupted or not */
-		fwrite("deleteItemFromList: Invalid ptr\n", strlen("deleteItemFromList: Invalid ptr\n"), 1, stderr);
-		// TODO: search through the list and see where this pointer falls
-		ptr = NULL;
+	return (size <= BOOTSTRAP_MIN_CLASS) ? 0 : (unsigned int)(sizeof(size_t) * 8 - __builtin_clzl(size - 1)) - __builtin_ctz(BOOTSTRAP_MIN_CLASS);
+}
+
+/**
+ * @brief Finds a free'd bootstrap block for the size, to be called with gBootstrapLock held.
+ *
+ * @param size The bytes asked for.
+ * @param unlink Whether to take the block out of its free list.
+ * @return The free'd block, NULL if none fits.
+ */
+static BOOTBLOCK *bootstrapReuse(size_t size, bool unlink)
+{
+	unsigned int class = bootstrapClass(size);
+	BOOTBLOCK **link = (BOOTSTRAP_CLASSES > class) ? &gBootstrapFree[class] : &gBootstrapLarge;
+
+	while (*link && ((*link)->size < size))
+	{
+		link = &(*link)->next;
 	}
-	return ptr;
+	BOOTBLOCK *block = *link;
+	if (block && unlink)
+	{
+		*link = block->next;
+		if (block->size >= size + sizeof(BOOTBLOCK) + BOOTSTRAP_MAX_CLASS)
+		{ /* Split, leaving the rest of a large block in its place */
+			BOOTBLOCK *rest = (BOOTBLOCK *)((char *)(block + 1) + size);
+			rest->size = block->size - size - sizeof(BOOTBLOCK);
+			rest->next = *link;
+			*link = rest;
+			block->size = size;
+		}
+	}
+	return block;
 }
-#else /* else of #ifdef PREPEND_LISTDATA */
 
 /**
- * @brief Deletes an item from the list of allocations.
+ * @brief Allocates a block from the bootstrap arena.
  *
- * This function removes an item from a doubly-linked list of allocations and adjusts pointers accordingly.
+ * Reuses a free'd block of the size class, else takes the block from gInitIndex, committing the
+ * next chunks of the arena as needed. Aborts once G_BOOTSTRAP_RESERVE is exhausted.
  *
- * @param list The head of the list from which the item should be removed.
- * @param tail The tail of the list from which the item should be removed.
- * @param item The item to be removed.
- * @return 0 if successful; 1 if the item is not found.
+ * @param size The bytes asked for.
+ * @param alignment The alignment of the block, 0 for 2 * sizeof(size_t).
+ * @return The block.
  */
-int deleteItemFromList(LIST **list, LIST **tail, void *item)
+static void *bootstrapAlloc(size_t size, size_t alignment)
 {
-	int ret = 0;
-	dbg(PRINT_INFO, "deleteItemFromList: checking %p for item %p\n", list, item);
-	pthread_mutex_lock(&lock);
-	if (NULL != *list)
-	{
-		LIST *tmp = *list;
+	BOOTBLOCK *block = NULL;
+	size_t index;
 
-		if (item != tmp->ptr)
-		{
-			LIST *prev;
-			while (NULL != tmp && item != tmp->ptr)
-			{
-				prev = tmp;
-				tmp = tmp->next;
-			}
-			if (NULL != tmp)
+	mapInitialMemory();
+	if (BOOTSTRAP_CLASSES > bootstrapClass(size))
+	{
+		size = BOOTSTRAP_MIN_CLASS << bootstrapClass(size);
+	}
+	else
+	{
+		size = (size + sizeof(BOOTBLOCK) - 1) & ~(sizeof(BOOTBLOCK) - 1);
+	}
+	pthread_mutex_lock(&gBootstrapLock);
+	if (sizeof(BOOTBLOCK) >= alignment)
+	{
+		block = bootstrapReuse(size, true);
+	}
+	if (NULL == block)
+	{
+		index = gInitIndex + sizeof(BOOTBLOCK);
+		if (sizeof(BOOTBLOCK) < alignment)
+		{
+			index = (index + alignment - 1) & ~(alignment - 1);
+		}
+		if (G_BOOTSTRAP_RESERVE - index < size)
+		{
+			fwrite(G_INITIAL_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_ALLOC_SIZE_ERROR), 1, stderr);
+			abort();
+		}
+		if (gBootstrapCommitted < index + size)
+		{
+			size_t commit = (index + size - gBootstrapCommitted + G_INITIAL_ALLOC_SIZE - 1) / G_INITIAL_ALLOC_SIZE * G_INITIAL_ALLOC_SIZE;
+			if (G_BOOTSTRAP_RESERVE - gBootstrapCommitted < commit)
 			{
-				dbg(PRINT_INFO, "Removing %p, prev %p tmp %p\n", item, prev, tmp);
-				prev->next = tmp->next;
-				if (NULL == tmp->next)
-				{ // Last item, therefore adjust tail
-					*tail = prev;
-				}
-#ifdef MAINTAIN_SINGLE_LIST
-				if (tmp == hpwmemhead)
-				{
-					hpwmemhead = tmp->next;
-				}
-#endif
-				if ((gListInitialAlloc > (char *)tmp) ||
-					((char *)(gListInitialAlloc + G_INITIAL_LIST_ALLOC_SIZE) < (char *)tmp))
-				{
-					libc_free(tmp);
-				}
+				commit = G_BOOTSTRAP_RESERVE - gBootstrapCommitted;
 			}
-			else
+			if (mprotect(gInitialAlloc + gBootstrapCommitted, commit, PROT_READ | PROT_WRITE))
 			{
-				ret = 1;
+				fwrite(G_INITIAL_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_ALLOC_SIZE_ERROR), 1, stderr);
+				abort();
 			}
+			gBootstrapCommitted += commit;
 		}
-		else
+		block = (BOOTBLOCK *)(gInitialAlloc + index) - 1;
+		block->size = size;
+		gInitIndex = index + size;
+	}
+	pthread_mutex_unlock(&gBootstrapLock);
+	return block + 1;
+}
+
+/**
+ * @brief Returns a block to the free lists of the bootstrap arena.
+ *
+ * @param ptr The block, as returned by bootstrapAlloc.
+ */
+static void bootstrapFree(void *ptr)
+{
+	BOOTBLOCK *block = (BOOTBLOCK *)ptr - 1;
+	unsigned int class = bootstrapClass(block->size);
+
+	pthread_mutex_lock(&gBootstrapLock);
+	if (BOOTSTRAP_CLASSES > class)
+	{
+		block->next = gBootstrapFree[class];
+		gBootstrapFree[class] = block;
+	}
+	else
+	{
+		block->next = gBootstrapLarge;
+		gBootstrapLarge = block;
+	}
+	pthread_mutex_unlock(&gBootstrapLock);
+}
+
+#ifdef SELF_TEST
+/**
+ * @brief Gets the block the next bootstrapAlloc of the size would return, without allocating it.
+ *
+ * @param size The bytes to be asked for.
+ * @return The block.
+ */
+void *bootstrapNext(size_t size)
+{
+	BOOTBLOCK *block;
+
+	mapInitialMemory();
+	size = (BOOTSTRAP_CLASSES > bootstrapClass(size)) ? (size_t)BOOTSTRAP_MIN_CLASS << bootstrapClass(size) : (size + sizeof(BOOTBLOCK) - 1) & ~(sizeof(BOOTBLOCK) - 1);
+	pthread_mutex_lock(&gBootstrapLock);
+	block = bootstrapReuse(size, false);
+	pthread_mutex_unlock(&gBootstrapLock);
+	return (block) ? (void *)(block + 1) : (void *)(gInitialAlloc + gInitIndex + sizeof(BOOTBLOCK));
+}
+
+/**
+ * @brief Tells whether a block is in the bootstrap arena.
+ */
+bool bootstrapHolds(const void *ptr)
+{
+	return bootstrapContains(ptr);
+}
+#endif
+
+/**
+ * @brief Sends a message of the answer to a command, giving up when the client doesn't receive it in time.
+ *
+ * The send waits in steps of WALK_SEND_STEP_MS for gWalkSendTimeoutMs at most, and is given up at the first step
+ * once the client has exited. A given up send aborts the answer: its remaining messages are dropped at once,
+ * so that the walks release the lists in a bounded time.
+ *
+ * @param mqsend The message queue descriptor of the client.
+ * @param msg The message.
+ * @param size The size of the message.
+ * @return 0 if sent, -1 if dropped.
+ */
+static int walkSend(mqd_t mqsend, const char *msg, size_t size)
+{
+	long waited = 0;
+	struct timespec tm;
+
+	if (gWalkAborted)
+	{
+		return -1;
+	}
+	while (1)
+	{
+		clock_gettime(CLOCK_REALTIME, &tm);
+		tm.tv_nsec += WALK_SEND_STEP_MS * 1000000L;
+		tm.tv_sec += tm.tv_nsec / 1000000000L;
+		tm.tv_nsec %= 1000000000L;
+		if (0 == mq_timedsend(mqsend, msg, size, 0, &tm))
 		{
-			/* Adjust the head/whead (first item) */
-#ifdef MAINTAIN_SINGLE_LIST
-			if (hpwmemhead == *list)
-			{
-				hpwmemhead = hpwmemhead->next;
-			}
+			return 0;
+		}
+		if (EINTR == errno)
+		{
+			continue;
+		}
+		waited += WALK_SEND_STEP_MS;
+		if ((ETIMEDOUT != errno) || (waited >= gWalkSendTimeoutMs) || (gWalkClient && kill(gWalkClient, 0) && (ESRCH == errno)))
+		{
+			dbg(PRINT_ERROR, "%s: Client %d doesn't receive after %ld ms, giving up the answer\n", __FUNCTION__, gWalkClient, waited);
+			gWalkAborted = true;
+			gWalkAborts++;
+			return -1;
+		}
+	}
+}
+
+#ifdef WALK_FILTER
+/**
+ * @brief Checks whether an entry matches the filter of the heapwalk.
+ *
+ * @param entry The transferred fields of the entry.
+ * @return true if the entry is to be sent.
+ */
+static bool walkFilterMatch(const LISTxfer *entry)
+{
+	const WALKFILTER *filter = &gWalkFilter;
+	time_t age;
+
+	if (!gWalkFiltered)
+	{
+		return true;
+	}
+	age = gWalkTime - entry->seconds;
+	if ((filter->tid && (filter->tid != entry->tid)) ||
+		(entry->size < filter->minSize) || (filter->maxSize && (entry->size > filter->maxSize)) ||
+		(age < filter->minAge) || (filter->maxAge && (age > filter->maxAge)) ||
+		(filter->from && (entry->seconds < filter->from)) || (filter->to && (entry->seconds > filter->to)) ||
+		(filter->end && (((char *)entry->ptr < (char *)filter->start) || ((char *)entry->ptr >= (char *)filter->end))))
+	{
+		return false;
+	}
+	if (NULL == filter->ra[0])
+	{
+		return true;
+	}
+	for (int i = 0; (i < WALK_FILTER_MAX_RA) && filter->ra[i]; i++)
+	{
+		if (filter->ra[i] == entry->ra)
+		{
+			return true;
+		}
+	}
+	return false;
+}
 #endif
-			*list = (*list)->next;
-			if (NULL == *list)
-			{ /* Adjust tail (only one item) */
-				*tail = NULL;
-#ifdef MAINTAIN_SINGLE_LIST
-				dbg(PRINT_INFO, "%s: Only one item..[%p][%p][%p]\n", __FUNCTION__, hpfmemhead, hpwmemhead, hpfmemtail);
-				hpwmemhead = NULL;
+
+#ifdef OPTIMIZE_MQ_TRANSFER
+/**
+ * @brief Runs the heapwalk in the mode requested by the command options.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walkAll A flag indicating whether to walk all allocations or only new ones.
+ * @param options The heapwalkOpt bits received with the command.
+ * @param filter The filter received with the command, used with HEAPWALK_OPT_FILTER.
+ * @param bookmark The bookmark received with the command, used with HEAPWALK_OPT_BOOKMARK.
+ */
+static void heapwalkCmd(mqd_t mqsend, bool walkAll, unsigned int options, const WALKFILTER *filter, const char *bookmark)
+{
+#ifdef WALK_BOOKMARKS
+	char key[WALK_BOOKMARK_NAME_SIZE];
+	strncpy(key, bookmark, sizeof(key) - 1);
+	key[sizeof(key) - 1] = '\0';
+	gWalkBookmarked = (options & HEAPWALK_OPT_BOOKMARK) ? true : false;
+	gWalkBookmark = (key[0]) ? bookmarkFind(key) : -1;
+	if (gWalkBookmarked && (0 > gWalkBookmark))
+	{
+		dbg(PRINT_ERROR, "Bookmark '%s' not set, sending all entries as new\n", key);
+	}
 #else
-				dbg(PRINT_INFO, "%s: Only one item..[%p][%p][%p][%p]\n", __FUNCTION__, wmemhead, wmemtail, memhead, memtail);
+	if (options & HEAPWALK_OPT_BOOKMARK)
+	{
+		dbg(PRINT_ERROR, "Heapwalk since a bookmark supported only with WALK_BOOKMARKS, walking since the walked marks\n");
+	}
 #endif
+#ifdef WALK_FILTER
+	gWalkFiltered = (options & HEAPWALK_OPT_FILTER) ? true : false;
+	gWalkFilter = *filter;
+	gWalkTime = time(NULL);
+#ifdef WALK_CHECKPOINTS
+	gWalkSince = gWalkUntil = 0;
+	if (gWalkFiltered)
+	{
+		gWalkSince = filter->from;
+		if (filter->maxAge && (gWalkSince < gWalkTime - filter->maxAge))
+		{
+			gWalkSince = gWalkTime - filter->maxAge;
+		}
+		gWalkUntil = filter->to;
+		if (filter->minAge && (!gWalkUntil || (gWalkTime - filter->minAge < gWalkUntil)))
+		{
+			gWalkUntil = gWalkTime - filter->minAge;
+		}
+	}
+#endif
+#else
+	if (options & HEAPWALK_OPT_FILTER)
+	{
+		dbg(PRINT_ERROR, "Heapwalk filter supported only with WALK_FILTER, sending all entries\n");
+	}
+#endif
+#ifdef SHM_TRANSFER
+	gShmTransfer = (options & HEAPWALK_OPT_SHM) ? true : false;
+#else
+	if (options & HEAPWALK_OPT_SHM)
+	{
+		dbg(PRINT_ERROR, "Shared memory transfer supported only with SHM_TRANSFER, sending on the queue\n");
+	}
+#endif
+#ifdef SNAPSHOT_HEAPWALK
+	if (options & HEAPWALK_OPT_SNAPSHOT)
+	{
+		heapwalkSnapshot(mqsend, walkAll);
+		return;
+	}
+#else
+	if (options & HEAPWALK_OPT_SNAPSHOT)
+	{
+		dbg(PRINT_ERROR, "Snapshot heapwalk supported only with SNAPSHOT_HEAPWALK, walking holding the list\n");
+	}
+#endif
+#ifdef SLICED_HEAPWALK
+	if (options & HEAPWALK_OPT_SLICED)
+	{
+		heapwalkSliced(mqsend, walkAll);
+		return;
+	}
+#else
+	if (options & HEAPWALK_OPT_SLICED)
+	{
+		dbg(PRINT_ERROR, "Sliced heapwalk supported only with SLICED_HEAPWALK, walking holding the list\n");
+	}
+#endif
+#ifdef CONCURRENT_HEAPWALK
+	if (options & HEAPWALK_OPT_CONCURRENT)
+	{
+		heapwalkConcurrent(mqsend, walkAll);
+		return;
+	}
+#else
+	if (options & HEAPWALK_OPT_CONCURRENT)
+	{
+		dbg(PRINT_ERROR, "Concurrent heapwalk supported only with CONCURRENT_HEAPWALK, walking holding the list\n");
+	}
+#endif
+	heapwalk(mqsend, walkAll);
+}
+#endif
+
+/**
+ * @brief Thread start function.
+ *
+ * This function handles message queue operations and manages memory initialization in a concurrent environment.
+ *
+ * @param arg A generic argument passed to the thread function.
+ * @return Always returns NULL.
+ */
+static void *thread_start(void *arg)
+{
+	dbg(PRINT_INFO, "%s: Starting thread\n", __FUNCTION__);
+#ifndef SELF_TEST
+	dbg(PRINT_INFO, "%s: Starting thread: version %s\n", __FUNCTION__, versionString);
+#endif
+	mqd_t mq, mqsend;
+	msg_cmd msgcmd;
+	char mq_name[64];
+	unsigned int prio;
+
+	struct mq_attr mqattr = ((struct mq_attr){0, 3, sizeof(msg_cmd), 0, {0}});
+#ifdef SHM_TRANSFER
+	gShmPid = getpid();
+#endif
+	sprintf(mq_name, "/mq_wrapper_%d", getpid());
+	/* Create with read/write */
+	mq = mq_open(mq_name, O_CREAT | O_RDONLY, QUEUE_PERMISSION, &mqattr);
+	if (0 > mq)
+	{
+		dbg(PRINT_MUST, "Error, cannot open/create the queue: %s.error %s\n", mq_name, strerror(errno));
+		dbg(PRINT_MSGQ, "Trying to open without O_CREAT flag..\n");
+		mq = mq_open(mq_name, O_RDONLY, QUEUE_PERMISSION, &mqattr);
+		if (0 > mq)
+		{
+			dbg(PRINT_MUST, "Error, cannot open the queue: %s.error %s\n", mq_name, strerror(errno));
+			exit(1);
+		}
+	}
+
+	/* Purge for new invocations, when fork'd, Selftest might be interrupted!! */
+	if (-1 == gMemInitialized)
+	{
+		/* purge initial msg if any, for any process restarts */
+		struct timespec tm;
+		msgcmd.cmd = -1;
+		do
+		{
+			if (-1 != msgcmd.cmd)
+			{
+				dbg(PRINT_MSGQ, "Purging cmd %d by thread %d\n", msgcmd.cmd, gettid());
 			}
-			if ((gListInitialAlloc > (char *)tmp) ||
-				((char *)(gListInitialAlloc + G_INITIAL_LIST_ALLOC_SIZE) < (char *)tmp))
-				libc_free(tmp);
+			clock_gettime(CLOCK_REALTIME, &tm);
+			tm.tv_sec += 1;
+			errno = 0;
+		} while (0 <= mq_timedreceive(mq, (char *)&msgcmd, sizeof(msg_cmd), &prio, &tm));
+		if (ETIMEDOUT != errno)
+		{
+			dbg(PRINT_ERROR, "Error, mq_receive: %s.\n", strerror(errno));
 		}
 	}
-	else
+	else if (1 == gMemInitialized)
+	{ 
+		/* Mark all previous allocations, since ths process is forked */
+		// heapwalkMarkall();
+	}
+
+	while (1)
+	{
+		int msgsize = mq_receive(mq, (char *)&msgcmd, sizeof(msg_cmd), &prio);
+		if (msgsize >= 0)
+		{
+			dbg(PRINT_MSGQ, "Received cmd %d, size %d\n", msgcmd.cmd, msgsize);
+			gWalkClient = msgcmd.client;
+			gWalkAborted = false;
+			
+			if (HEAPWALK_INCREMENT == msgcmd.cmd)
+			{
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					dbg(PRINT_MSGQ, "%s: sending on mq %d\n", __FUNCTION__, mqsend);
+#ifdef OPTIMIZE_MQ_TRANSFER
+					heapwalkCmd(mqsend, 0, msgcmd.options, &msgcmd.filter, msgcmd.bookmark);
+#else
+					msg_resp msgresp;
+					heapwalk(mqsend);
+					msgresp.seq = -1;
+#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
+					snprintf(msgresp.msg, MQ_MSG_SIZE, "TotalHeapSize %lu Bytes + Tool Overhead %lu", totalHeapSize, totalOverhead);
+#endif
+					walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+#endif
+					dbg(PRINT_MSGQ, "%s: sent on mq %d\n", __FUNCTION__, mqsend);
+					mq_close(mqsend);
+				}
+			}
+			else if (HEAPWALK_FULL == msgcmd.cmd)
+			{
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					dbg(PRINT_MSGQ, "%s: sending on mq %d\n", __FUNCTION__, mqsend);
+#ifdef OPTIMIZE_MQ_TRANSFER
+					heapwalkCmd(mqsend, 1, msgcmd.options, &msgcmd.filter, msgcmd.bookmark);
+#else
+					msg_resp msgresp;
+					heapwalk_full(mqsend);
+					msgresp.seq = -1;
+#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
+					snprintf(msgresp.msg, MQ_MSG_SIZE, "TotalHeapSize %lu Bytes + Tool Overhead %lu", totalHeapSize, totalOverhead);
+#endif
+					walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+#endif
+					dbg(PRINT_MSGQ, "%s: sent on mq %d\n", __FUNCTION__, mqsend);
+					mq_close(mqsend);
+				}
+			}
+			else if (HEAPWALK_MMAP_ENTRIES == msgcmd.cmd)
+			{
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					dbg(PRINT_MSGQ, "%s: sending on mq %d\n", __FUNCTION__, mqsend);
+#ifdef OPTIMIZE_MQ_TRANSFER
+					/* The map needs all the entries */
+					heapwalkCmd(mqsend, 1, msgcmd.options & ~(HEAPWALK_OPT_FILTER | HEAPWALK_OPT_BOOKMARK), &msgcmd.filter, msgcmd.bookmark);
+#ifdef MMAP_TRACKING
+					heapwalkMappings(mqsend);
+#endif
+#else
+					dbg(PRINT_MUST, "HEAPWALK_MMAP_ENTRIES supported only with OPTIMIZE_MQ_TRANSFER\n");
+#endif
+					mq_close(mqsend);
+				}
+			}
+			else if (HEAPWALK_SITES == msgcmd.cmd)
+			{
+#ifdef SITE_STATS
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					heapwalkSites(mqsend, msgcmd.options);
+					mq_close(mqsend);
+				}
+#else
+				dbg(PRINT_MUST, "HEAPWALK_SITES supported only with SITE_STATS\n");
+#endif
+			}
+			else if (HEAPWALK_LARGE == msgcmd.cmd)
+			{
+#ifdef LARGE_REGISTRY
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					heapwalkLarge(mqsend, msgcmd.options);
+					mq_close(mqsend);
+				}
+#else
+				dbg(PRINT_MUST, "HEAPWALK_LARGE supported only with LARGE_REGISTRY\n");
+#endif
+			}
+			else if (HEAPWALK_BACKEND == msgcmd.cmd)
+			{
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					heapwalkBackend(mqsend);
+					mq_close(mqsend);
+				}
+			}
+			else if (HEAPWALK_PAUSE == msgcmd.cmd)
+			{
+#ifdef TRACKING_PAUSE
+				dbg(PRINT_MSGQ, "Calling heapwalkPause(%u). cmd %d\n", msgcmd.options, msgcmd.cmd);
+				heapwalkPause(0 != msgcmd.options);
+#else
+				dbg(PRINT_MUST, "HEAPWALK_PAUSE supported only with TRACKING_PAUSE\n");
+#endif
+			}
+			else if (HEAPWALK_BOOKMARK == msgcmd.cmd)
+			{
+#ifdef WALK_BOOKMARKS
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					heapwalkBookmark(mqsend, msgcmd.options, msgcmd.bookmark);
+					mq_close(mqsend);
+				}
+#else
+				dbg(PRINT_MUST, "HEAPWALK_BOOKMARK supported only with WALK_BOOKMARKS\n");
+#endif
+			}
+			else if (HEAPWALK_OWNER == msgcmd.cmd)
+			{
+#ifdef ADDRESS_INDEX
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					heapwalkOwner(mqsend, msgcmd.address);
+					mq_close(mqsend);
+				}
+#else
+				dbg(PRINT_MUST, "HEAPWALK_OWNER supported only with ADDRESS_INDEX\n");
+#endif
+			}
+			else if (HEAPWALK_MIRROR == msgcmd.cmd)
+			{
+#ifdef MIRROR_DELTAS
+				mqsend = mq_open("/mq_util", O_WRONLY);
+				if (mqsend < 0) {
+					dbg(PRINT_ERROR, "Error, cannot open mq_util queue: %s.\n", strerror(errno));
+				}
+				else
+				{
+					heapwalkMirror(mqsend, msgcmd.bookmark, 1 == msgcmd.options);
+					mq_close(mqsend);
+				}
+#else
+				dbg(PRINT_MUST, "HEAPWALK_MIRROR supported only with MIRROR_DELTAS\n");
+#endif
+			}
+			else if (HEAPWALK_MARKALL == msgcmd.cmd)
+			{
+				dbg(PRINT_MSGQ, "Calling heapwalkMarkall(). cmd %d\n", msgcmd.cmd);
+				heapwalkMarkall();
+			}
+			else if (HEAPWALK_RESET_MARKED == msgcmd.cmd)
+			{
+				dbg(PRINT_MSGQ, "Calling heapwalkReset(). cmd %d\n", msgcmd.cmd);
+				heapwalkReset();
+			}
+			else if (HEAPWALK_MALLOC_STATS == msgcmd.cmd)
+			{
+				dbg(PRINT_MSGQ, "Calling malloc_stats(). cmd %d\n", msgcmd.cmd);
+				malloc_stats();
+				PRINT("\n");
+			}
+			else
+				dbg(PRINT_ERROR, "Invalid cmd 0x%x received\n", msgcmd.cmd);
+		}
+		else
+		{
+			dbg(PRINT_ERROR, "Error, mq_receive from mq_util: %s.\n",
+				strerror(errno));
+			sleep(1);
+		}
+	}
+	mq_close(mq);
+	mq_unlink(mq_name);
+}
+
+typedef void *(*calloc_type)(size_t, size_t);
+typedef void *(*malloc_type)(size_t);
+typedef void (*free_type)(void *);
+typedef void *(*realloc_type)(void *, size_t);
+
+calloc_type libc_calloc_fnptr = NULL;
+malloc_type libc_malloc_fnptr = NULL;
+free_type libc_free_fnptr = NULL;
+realloc_type libc_realloc_fnptr = NULL;
+
+/**
+ * @brief Frees a block, to the bootstrap arena or to libc.
+ *
+ * @param ptr The start of the block.
+ */
+static inline void releaseBlock(void *ptr)
+{
+	if (bootstrapContains(ptr))
+	{
+		bootstrapFree(ptr);
+	}
+	else
+	{
+		libc_free_fnptr(ptr);
+	}
+}
+
+#if defined(__USE_XOPEN2K)
+typedef int (*posix_memalign_type)(void **, size_t, size_t);
+posix_memalign_type libc_posix_memalign_fnptr = NULL;
+#endif
+
+#if defined(__USE_ISOC11)
+typedef void *(*aligned_alloc_type)(size_t, size_t);
+aligned_alloc_type libc_aligned_alloc_fnptr = NULL;
+#endif
+
+#if defined(USE_DEPRECATED_MEMALIGN)
+typedef void *(*memalign_type)(size_t, size_t);
+memalign_type libc_memalign_fnptr = NULL;
+#endif
+
+#ifdef MMAP_TRACKING
+typedef void *(*mmap_type)(void *, size_t, int, int, int, off_t);
+typedef int (*munmap_type)(void *, size_t);
+typedef void *(*mremap_type)(void *, size_t, size_t, int, ...);
+typedef int (*madvise_type)(void *, size_t, int);
+/* NULL till loaded, the syscalls are made directly till then */
+mmap_type libc_mmap_fnptr = NULL;
+munmap_type libc_munmap_fnptr = NULL;
+mremap_type libc_mremap_fnptr = NULL;
+madvise_type libc_madvise_fnptr = NULL;
+STATIC MAPPINGTABLE gMappingTable = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
+#endif
+
+#define MEMWRAP_BACKEND_ERROR "MEMWRAP_BACKEND is not " MEMWRAP_BACKEND_TRACKED ", " MEMWRAP_BACKEND_PAUSED " or " MEMWRAP_BACKEND_NONE ", allocations are tracked\n"
+
+/* Defined after the interposed functions. The tracked backend serves them till load_libc_functions selects one */
+STATIC const BACKEND gTrackedBackend;
+STATIC const BACKEND gPassthroughBackend;
+#ifdef TRACKING_PAUSE
+STATIC const BACKEND gPausedBackend;
+/* Set while gBackend is gPausedBackend. malloc, calloc and free test it first and call the paused backend directly */
+STATIC bool gTrackingPaused;
+static void *pausedAlloc(size_t size, unsigned int api, void *ra);
+static void *pausedZalloc(size_t nmemb, size_t size, void *ra);
+static void pausedRelease(void *ptr);
+#endif
+STATIC const BACKEND *gBackend = &gTrackedBackend;
+
+/**
+ * @brief Start the heapwalk thread.
+ *
+ * This function initializes mutex attributes and creates a new thread for heapwalk operations.
+ */
+__attribute__((constructor)) void heapwalk_thread_start()
+{
+	pthread_attr_t attr;
+	pthread_t ptd;
+	pthread_mutexattr_t mutexattr;
+
+	pthread_mutexattr_init(&mutexattr);
+	pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&lock, &mutexattr);
+#ifdef MMAP_TRACKING
+	pthread_mutex_init(&gMappingTable.lock, &mutexattr);
+#endif
+#ifdef LARGE_REGISTRY
+	pthread_mutex_init(&gLargeTable.lock, &mutexattr);
+#endif
+#ifdef SHARD_LIST
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		pthread_mutex_init(&gListShards[i].lock, &mutexattr);
+	}
+#elif defined(SIDE_TABLE)
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++)
+	{
+		pthread_mutex_init(&gSideTable[i].lock, &mutexattr);
+	}
+#endif
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 8 * 1024);
+
+	pthread_create(&ptd, &attr, &thread_start, NULL);
+	// pthread_join(ptd, NULL);
+	pthread_attr_destroy(&attr);
+}
+
+/* create a thread in child process for heapwalk. */
+/* register_atfork is similar to pthread_atfork. */
+extern int __register_atfork(void (*__prepare)(void), void (*__parent)(void), void (*__child)(void), void *dso_handle);
+extern void *__dso_handle __attribute__((__weak__));
+
+#ifdef ALIGNED_TRAILER
+STATIC ALIGNEDTABLE gAlignedTable;
+#endif
+
+/**
+ * @brief Takes all the locks of the library before fork.
+ *
+ * The child then gets the lists and tables as no thread is changing them, and doesn't wait on a lock
+ * held by a thread that doesn't exist in it. The locks are taken in the order they nest, the lists first.
+ */
+static void prepare_fork(void)
+{
+#ifdef SHARD_LIST
+	lockAllShards();
+#elif defined(SIDE_TABLE)
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++)
+	{
+		pthread_mutex_lock(&gSideTable[i].lock);
+	}
+#endif
+	pthread_mutex_lock(&lock);
+#ifdef LARGE_REGISTRY
+	pthread_mutex_lock(&gLargeTable.lock);
+#endif
+#ifdef ALIGNED_TRAILER
+	pthread_mutex_lock(&gAlignedTable.lock);
+#endif
+#ifdef MMAP_TRACKING
+	pthread_mutex_lock(&gMappingTable.lock);
+#endif
+	pthread_mutex_lock(&gBootstrapLock);
+}
+
+/**
+ * @brief Releases the locks taken by prepare_fork, in the parent after fork.
+ */
+static void run_in_parent_context(void)
+{
+	pthread_mutex_unlock(&gBootstrapLock);
+#ifdef MMAP_TRACKING
+	pthread_mutex_unlock(&gMappingTable.lock);
+#endif
+#ifdef ALIGNED_TRAILER
+	pthread_mutex_unlock(&gAlignedTable.lock);
+#endif
+#ifdef LARGE_REGISTRY
+	pthread_mutex_unlock(&gLargeTable.lock);
+#endif
+	pthread_mutex_unlock(&lock);
+#ifdef SHARD_LIST
+	unlockAllShards();
+#elif defined(SIDE_TABLE)
+	for (int i = SIDE_TABLE_SHARDS - 1; i >= 0; i--)
+	{
+		pthread_mutex_unlock(&gSideTable[i].lock);
+	}
+#endif
+}
+
+/**
+ * @brief Initializes the locks taken by prepare_fork again in the child, as they are owned by the thread id of the parent.
+ */
+static void init_locks_in_child(void)
+{
+	pthread_mutexattr_t mutexattr;
+
+	pthread_mutexattr_init(&mutexattr);
+	pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&lock, &mutexattr);
+#ifdef SHARD_LIST
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		pthread_mutex_init(&gListShards[i].lock, &mutexattr);
+	}
+#elif defined(SIDE_TABLE)
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++)
+	{
+		pthread_mutex_init(&gSideTable[i].lock, &mutexattr);
+	}
+#endif
+#ifdef LARGE_REGISTRY
+	pthread_mutex_init(&gLargeTable.lock, &mutexattr);
+#endif
+#ifdef ALIGNED_TRAILER
+	pthread_mutex_init(&gAlignedTable.lock, NULL);
+#endif
+#ifdef MMAP_TRACKING
+	pthread_mutex_init(&gMappingTable.lock, &mutexattr);
+#endif
+	pthread_mutex_init(&gBootstrapLock, NULL);
+	pthread_mutexattr_destroy(&mutexattr);
+}
+
+/**
+ * @brief Runs in the child process context.
+ *
+ * This function starts the heapwalk thread when running in the context of a forked child process.
+ */
+static void run_in_child_context(void)
+{
+	init_locks_in_child();
+#ifdef COMPACT_LIST
+	tlsCompactThread = 0; /* tid differs in the child */
+#endif
+#ifdef SIDE_TABLE
+	tlsSideTableTid = 0;
+#endif
+#ifdef SNAPSHOT_HEAPWALK
+	if (tlsSnapshotFork)
+	{
+		return;
+	}
+#endif
+	dbg(PRINT_ERROR, "%s: pid %d\n", __FUNCTION__, getpid());
+	heapwalk_thread_start();
+}
+
+#ifndef SELF_TEST
+__attribute__((constructor))
+#endif
+
+/**
+ * @brief Loads libc memory allocation functions.
+ *
+ * This function dynamically loads memory allocation functions from libc using dlsym.
+ */
+void load_libc_functions()
+{
+	fwrite("load_libc_functions+\n", strlen("load_libc_functions+\n"), 1, stderr);
+
+	/* Does not need an execution, No effect */
+	if (-1 == gMemInitialized)
+	{
+		gMemInitialized = 0;
+		// fwrite("dlsym\n", strlen("dlsym\n"), 1, stderr);
+		/* Load Memory allocation functions from libc */
+#ifdef __GLIBC__
+		libc_calloc_fnptr = dlsym(RTLD_NEXT, "__libc_calloc"); /* Throw error when all reads fail */
+		libc_malloc_fnptr = dlsym(RTLD_NEXT, "__libc_malloc");
+		libc_free_fnptr = dlsym(RTLD_NEXT, "__libc_free");
+		libc_realloc_fnptr = dlsym(RTLD_NEXT, "__libc_realloc");
+#if defined(__USE_XOPEN2K)
+		libc_posix_memalign_fnptr = dlsym(RTLD_NEXT, "posix_memalign"); /* No __libc_ alias, the next is libc's */
+#endif
+
+#if defined(__USE_ISOC11)
+		libc_aligned_alloc_fnptr = dlsym(RTLD_NEXT, "aligned_alloc");
+#endif
+#if defined(USE_DEPRECATED_MEMALIGN)
+		libc_memalign_fnptr = dlsym(RTLD_NEXT, "__libc_memalign");
+#endif
+#ifdef MMAP_TRACKING
+		libc_mmap_fnptr = dlsym(RTLD_NEXT, "mmap");
+		libc_munmap_fnptr = dlsym(RTLD_NEXT, "munmap");
+		libc_mremap_fnptr = dlsym(RTLD_NEXT, "mremap");
+		libc_madvise_fnptr = dlsym(RTLD_NEXT, "madvise");
+#endif
+		fwrite("dlsym'd\n", strlen("dlsym'd\n"), 1, stderr);
+
+		if ((NULL == libc_malloc_fnptr) || (NULL == libc_calloc_fnptr) || (NULL == libc_free_fnptr) || (NULL == libc_realloc_fnptr)
+#if defined(USE_DEPRECATED_MEMALIGN)
+			|| (NULL == libc_memalign_fnptr)
+#endif
+
+#if defined(__USE_XOPEN2K)
+			|| (NULL == libc_posix_memalign_fnptr)
+#endif
+
+#if defined(__USE_ISOC11)
+			|| (NULL == libc_aligned_alloc_fnptr)
+#endif
+		)
+		{
+			fwrite("Couldn't load symbols from libc", strlen("Couldn't load symbols from libc"), 1, stderr);
+#if defined(USE_DEPRECATED_MEMALIGN)
+			if (NULL == libc_memalign_fnptr)
+			{
+				fwrite(": memalign not loaded\n", strlen(": memalign not loaded\n"), 1, stderr);
+			}
+#endif
+
+#if defined(__USE_XOPEN2K)
+			if (NULL == libc_posix_memalign_fnptr)
+			{
+				fwrite(": memalign not loaded\n", strlen(": posix_memalign not loaded\n"), 1, stderr);
+			}
+#endif
+
+#if defined(__USE_ISOC11)
+			if (NULL == libc_aligned_alloc_fnptr)
+			{
+				fwrite(": memalign not loaded\n", strlen(": aligned_alloc not loaded\n"), 1, stderr);
+			}
+#endif
+			abort();
+		}
+		else
+		{
+			if (__register_atfork(prepare_fork, run_in_parent_context, run_in_child_context, __dso_handle) != 0)
+			{
+				fwrite("__register_atfork", strlen("__register_atfork"), 1, stderr);
+				dbg(PRINT_ERROR, "%s: Error __register_atfork\n", __FUNCTION__);
+				abort();
+			}
+#ifdef SAMPLED_TRACKING
+			sampleInit();
+#endif
+#ifdef STACK_DEPOT
+			stackDepotInit();
+#endif
+#ifdef SITE_STATS
+			char *topK = getenv("MEMWRAP_SITE_TOPK");
+			gSiteTopK = (topK) ? strtoul(topK, NULL, 0) : 0;
+#endif
+#ifdef SLICED_HEAPWALK
+			char *slice = getenv("MEMWRAP_WALK_SLICE_US");
+			gWalkSliceNs = (slice) ? strtol(slice, NULL, 0) * 1000L : gWalkSliceNs;
+#endif
+			char *timeout = getenv("MEMWRAP_SEND_TIMEOUT_MS");
+			gWalkSendTimeoutMs = (timeout) ? strtol(timeout, NULL, 0) : gWalkSendTimeoutMs;
+#ifdef CXX_OPERATORS
+			char *sizeCheck = getenv("MEMWRAP_CXX_SIZE_CHECK");
+			gCxxSizeCheck = (sizeCheck) ? (0 != strtol(sizeCheck, NULL, 0)) : false;
+#endif
+#ifdef ADDRESS_INDEX
+			char *index = getenv("MEMWRAP_ADDRESS_INDEX");
+			gAddressIndex = (index) ? (0 != strtol(index, NULL, 0)) : false;
+#endif
+#ifdef MIRROR_DELTAS
+			char *logEntries = getenv("MEMWRAP_MIRROR_LOG");
+			if (logEntries)
+			{
+				unsigned long entries = strtoul(logEntries, NULL, 0);
+				for (gMirrorLogEntries = 64; gMirrorLogEntries < entries; gMirrorLogEntries <<= 1)
+					;
+			}
+#endif
+#ifdef LARGE_REGISTRY
+			char *threshold = getenv("MEMWRAP_LARGE_THRESHOLD");
+			if (threshold)
+			{
+				gLargeThreshold = strtoul(threshold, NULL, 0);
+				gLargeThreshold = (gLargeThreshold) ? gLargeThreshold : ~0UL;
+			}
+#endif
+			/* Blocks allocated till now are in the bootstrap arena, the passthrough backend hands them to the tracked one */
+			char *backend = getenv("MEMWRAP_BACKEND");
+			if (backend && !strcmp(backend, MEMWRAP_BACKEND_NONE))
+			{
+				gBackend = &gPassthroughBackend;
+			}
+#ifdef TRACKING_PAUSE
+			else if (backend && !strcmp(backend, MEMWRAP_BACKEND_PAUSED))
+			{
+				gBackend = &gPausedBackend;
+				gTrackingPaused = true;
+			}
+#endif
+			else if (backend && *backend && strcmp(backend, MEMWRAP_BACKEND_TRACKED))
+			{
+				fwrite(MEMWRAP_BACKEND_ERROR, strlen(MEMWRAP_BACKEND_ERROR), 1, stderr);
+			}
+			gMemInitialized = 1;
+			dbg(PRINT_INFO, "%s: Loaded symbols from libc, malloc:calloc:free:realloc [%p][%p][%p][%p]\n",
+				__FUNCTION__, libc_malloc_fnptr, libc_calloc_fnptr, libc_free_fnptr, libc_realloc_fnptr);
+#if defined(USE_DEPRECATED_MEMALIGN)
+			dbg(PRINT_INFO, "%s: Loaded symbols from libc, memalign [%p]\n", __FUNCTION__, libc_memalign_fnptr);
+#endif
+
+#if defined(__USE_XOPEN2K)
+			dbg(PRINT_INFO, "%s: Loaded symbols from libc, posix_memalign [%p]\n", __FUNCTION__, libc_posix_memalign_fnptr);
+#endif
+
+#if defined(__USE_ISOC11)
+			dbg(PRINT_INFO, "%s: Loaded symbols from libc, aligned_alloc [%p]\n", __FUNCTION__, libc_aligned_alloc_fnptr);
+#endif
+		}
+#else
+		void *libcLibrary = dlopen("libc.so", RTLD_LAZY | RTLD_NOLOAD);
+		if (libcLibrary)
+		{
+			libc_calloc_fnptr = dlsym(libcLibrary, "calloc");
+			libc_malloc_fnptr = dlsym(libcLibrary, "malloc");
+			libc_free_fnptr = dlsym(libcLibrary, "free");
+			libc_realloc_fnptr = dlsym(libcLibrary, "realloc");
+			libc_memalign_fnptr = dlsym(libcLibrary, "memalign");
+			dlclose(libcLibrary);
+		}
+		else
+		{
+			fwrite("dlopen failed..try without RTLD_NOLOAD\n", strlen("dlopen failed..try without RTLD_NOLOAD\n"), 1, stderr);
+		}
+#endif
+	}
+}
+
+void libc_free(void *ptr);
+void *libc_malloc(size_t size);
+
+#ifdef SELF_TEST
+void resetList() // for testing the list, since a default entry get in and test case couldn't be written
+{
+#if defined(SHARD_LIST)
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		gListShards[i].head = gListShards[i].tail = gListShards[i].whead = NULL;
+#ifdef WALK_BOOKMARKS
+		memset(gListShards[i].marks, 0, sizeof(gListShards[i].marks));
+#endif
+#ifdef MIRROR_DELTAS
+		gMirrorsSet = 0;
+#endif
+#ifdef WALK_CHECKPOINTS
+		gListShards[i].checkpointCount = 0;
+		gListShards[i].checkpointSpan = WALK_CHECKPOINT_SPAN;
+#endif
+#ifdef ADDRESS_INDEX
+		pthread_mutex_lock(&gListShards[i].lock);
+		gListShards[i].addrRoot = gListShards[i].addrFree = 0;
+		gListShards[i].addrUsed = (gListShards[i].addrNodes) ? 1 : 0;
+		pthread_mutex_unlock(&gListShards[i].lock);
+#endif
+#ifdef SITE_STATS
+		pthread_mutex_lock(&gListShards[i].lock);
+		if (gListShards[i].sites)
+		{
+			libc_munmap(gListShards[i].sites, gListShards[i].siteCapacity * sizeof(SITESTAT));
+		}
+		gListShards[i].sites = NULL;
+		gListShards[i].siteCapacity = gListShards[i].siteCount = 0;
+		pthread_mutex_unlock(&gListShards[i].lock);
+#endif
+	}
+#elif defined(SIDE_TABLE)
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++)
+	{
+		pthread_mutex_lock(&gSideTable[i].lock);
+		if (gSideTable[i].slots)
+		{
+			memset(gSideTable[i].slots, 0, gSideTable[i].capacity * sizeof(LIST));
+		}
+		gSideTable[i].used = gSideTable[i].heapSize = 0;
+		pthread_mutex_unlock(&gSideTable[i].lock);
+	}
+#elif defined(MAINTAIN_SINGLE_LIST)
+	hpfmemhead = hpfmemtail = hpwmemhead = NULL;
+#else
+	memhead = memtail = wmemhead = wmemtail = NULL;
+#endif
+}
+
+#ifdef SAMPLED_TRACKING
+void resetSampling() // for testing the sampling, the next allocation of the thread draws its counter with the current level
+{
+	tlsSampleBytes = 0;
+}
+#endif
+
+void dispStatus()
+{
+	dbg(PRINT_MUST, "%s: Enter from pid:tid %d:%d\n", __FUNCTION__, getpid(), gettid());
+	dbg(PRINT_MUST, "%s:\ngMemInitialized %d\n", __FUNCTION__, gMemInitialized);
+	if (0 < gMemInitialized)
+	{
+		dbg(PRINT_MUST, "Loaded symbols from libc, malloc:calloc:free:realloc [%p][%p][%p][%p]\n",
+			libc_malloc_fnptr, libc_calloc_fnptr, libc_free_fnptr, libc_realloc_fnptr);
+#if defined(USE_DEPRECATED_MEMALIGN)
+		if (NULL != libc_memalign_fnptr)
+		{
+			dbg(PRINT_MUST, "%s: Loaded symbols from libc, memalign [%p]\n", __FUNCTION__, libc_memalign_fnptr);
+		}
+#endif
+
+#if defined(__USE_XOPEN2K)
+		if (NULL != libc_posix_memalign_fnptr)
+		{
+			dbg(PRINT_MUST, "%s: Loaded symbols from libc, posix_memalign [%p]\n", __FUNCTION__, libc_posix_memalign_fnptr);
+		}
+#endif
+
+#if defined(__USE_ISOC11)
+		if (NULL != libc_aligned_alloc_fnptr)
+		{
+			dbg(PRINT_MUST, "%s: Loaded symbols from libc, aligned_alloc [%p]\n", __FUNCTION__, libc_aligned_alloc_fnptr);
+		}
+#endif
+	}
+#if !defined(PREPEND_LISTDATA) && !defined(SIDE_TABLE)
+	dbg(PRINT_MUST, "gInitialAlloc %p, gInitIndex %d\ngListInitialAlloc %p, gListInitIndex %d\n", gInitialAlloc, gInitIndex, gListInitialAlloc, gListInitIndex);
+#else
+	dbg(PRINT_MUST, "gInitialAlloc %p, gInitIndex %d\n", gInitialAlloc, gInitIndex);
+#endif
+	pthread_mutex_lock(&lock);
+	dbg(PRINT_MUST, "Already walked:\n");
+#ifndef MAINTAIN_SINGLE_LIST
+	LIST *tmp = wmemhead;
+	while (tmp)
+	{
+		dbg(PRINT_MUST, "Ptr: %p size: %zu ra: %p tid: %ld time: %ld\n", tmp->ptr, listSize(tmp), tmp->ra, (long)tmp->tid, (long)tmp->seconds);
+		tmp = tmp->next;
+	}
+	dbg(PRINT_MUST, "New Allocations:\n");
+	tmp = memhead;
+	while (tmp)
+	{
+		dbg(PRINT_MUST, "Ptr: %p size: %zu ra: %p tid: %ld time: %ld\n",
+			tmp->ptr, listSize(tmp), tmp->ra, (long)tmp->tid, (long)tmp->seconds);
+		tmp = tmp->next;
+	}
+#elif defined(SHARD_LIST)
+	lockAllShards();
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		LIST *tmp = gListShards[i].head;
+		if (tmp)
+		{
+			dbg(PRINT_MUST, "Shard %d:\nPtr\tsize\tra\ttid\ttime\n", i);
+		}
+		while (tmp)
+		{
+			if (tmp == gListShards[i].whead)
+			{
+				dbg(PRINT_MUST, "New Allocations:\n");
+			}
+			LISTxfer entry;
+			listGetXfer(tmp, &entry);
+			dbg(PRINT_MUST, "%p\t%lu\t%p\t%ld\t%ld\n", entry.ptr, entry.size, entry.ra, (long)entry.tid, (long)entry.seconds);
+			tmp = tmp->next;
+		}
+	}
+	unlockAllShards();
+#elif defined(SIDE_TABLE)
+	lockSideTable();
+	dbg(PRINT_MUST, "Ptr\tsize\tra\ttid\ttime\twalked\n");
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++)
+	{
+		for (unsigned long j = 0; j < gSideTable[i].capacity; j++)
+		{
+			LIST *tmp = &gSideTable[i].slots[j];
+			if ((NULL != tmp->ptr) && (SIDE_TABLE_DELETED != tmp->ptr))
+			{
+				dbg(PRINT_MUST, "%p\t%zu\t%p\t%ld\t%ld\t%u\n", tmp->ptr, listSize(tmp), tmp->ra, (long)tmp->tid, (long)tmp->seconds, tmp->walked);
+			}
+		}
+	}
+	unlockSideTable();
+#else
+	LIST *tmp = hpfmemhead;
+	dbg(PRINT_MUST, "Ptr\tsize\tra\ttid\ttime\n");
+	while (tmp)
+	{
+		if (tmp == hpwmemhead)
+		{
+			dbg(PRINT_MUST, "New Allocations:\n");
+		}
+		dbg(PRINT_MUST, "%p\t%zu\t%p\t%ld\t%ld\n", tmp->ptr, listSize(tmp), tmp->ra, (long)tmp->tid, (long)tmp->seconds);
+		tmp = tmp->next;
+	}
+#endif
+	dbg(PRINT_MUST, "\n");
+	pthread_mutex_unlock(&lock);
+}
+#endif
+
+#ifdef PREPEND_LISTDATA
+#ifdef COMPACT_LIST
+_Static_assert((offsetof(LIST, size) == offsetof(CLIST, size)) && (offsetof(LIST, next) == offsetof(CLIST, next)) &&
+				   (offsetof(LIST, prev) == offsetof(CLIST, prev)) && (offsetof(LIST, tid) == sizeof(LIST) - sizeof(CLIST)),
+			   "CLIST doesn't match LIST");
+#endif
+
+#ifdef ALIGNED_TRAILER
+STATIC ALIGNEDTABLE gAlignedTable = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, ~0UL, 0};
+
+/**
+ * @brief Finds the slot of a block in the aligned table.
+ *
+ * Linear probing ends on a free slot, there is always one since the table is at most half full.
+ *
+ * @param slots The slots of the table.
+ * @param capacity The number of slots, a power of 2.
+ * @param ptr The block, not NULL.
+ * @return The slot holding the block, else the free slot for it.
+ */
+static ALIGNEDSLOT *alignedSlot(ALIGNEDSLOT *slots, unsigned long capacity, void *ptr)
+{
+	unsigned long mask = capacity - 1;
+	for (unsigned long i = (((unsigned long)ptr * 0x9E3779B97F4A7C15UL) >> 32) & mask;; i = (i + 1) & mask)
+	{
+		if ((ptr == slots[i].ptr) || (NULL == slots[i].ptr))
+		{
+			return &slots[i];
+		}
+	}
+}
+
+/**
+ * @brief Marks the start or the end of a change of the aligned table, under its lock.
+ *
+ * @param start Whether the change starts, seq is then odd till it ends.
+ */
+static inline void alignedChange(bool start)
+{
+	if (start)
+	{
+		__atomic_store_n(&gAlignedTable.seq, gAlignedTable.seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
+	else
+	{
+		__atomic_store_n(&gAlignedTable.seq, gAlignedTable.seq + 1, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * @brief Adds the trailer of an aligned block to the aligned table.
+ *
+ * Slots are mmap'd, so that growing never calls back into malloc. The slots replaced by growing are
+ * not unmapped, as a lookup may still be reading them; they add up to less than the slots in use.
+ *
+ * @param ptr The block.
+ * @param item The LIST after the block.
+ * @param alignment The alignment of the block.
+ * @return 0 if successful; -1 if the table couldn't grow.
+ */
+static int alignedAdd(void *ptr, LIST *item, unsigned long alignment)
+{
+	pthread_mutex_lock(&gAlignedTable.lock);
+	alignedChange(true);
+	if ((gAlignedTable.count + 1) * 2 > gAlignedTable.capacity)
+	{
+		unsigned long capacity = (gAlignedTable.capacity) ? gAlignedTable.capacity * 2 : ALIGNED_TRAILER_INITIAL_SLOTS;
+		ALIGNEDSLOT *slots = libc_mmap(NULL, capacity * sizeof(ALIGNEDSLOT), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == slots)
+		{
+			alignedChange(false);
+			pthread_mutex_unlock(&gAlignedTable.lock);
+			return -1;
+		}
+		for (unsigned long i = 0; i < gAlignedTable.capacity; i++)
+		{
+			if (gAlignedTable.slots[i].ptr)
+			{
+				*alignedSlot(slots, capacity, gAlignedTable.slots[i].ptr) = gAlignedTable.slots[i];
+			}
+		}
+		/* A lookup seeing the new capacity sees the new slots too */
+		__atomic_store_n(&gAlignedTable.slots, slots, __ATOMIC_RELEASE);
+		__atomic_store_n(&gAlignedTable.capacity, capacity, __ATOMIC_RELEASE);
+	}
+	ALIGNEDSLOT *slot = alignedSlot(gAlignedTable.slots, gAlignedTable.capacity, ptr);
+	slot->ptr = ptr;
+	slot->item = item;
+	gAlignedTable.count++;
+	if (alignment - 1 < gAlignedTable.mask)
+	{
+		__atomic_store_n(&gAlignedTable.mask, alignment - 1, __ATOMIC_RELAXED);
+	}
+	alignedChange(false);
+	pthread_mutex_unlock(&gAlignedTable.lock);
+	return 0;
+}
+
+/**
+ * @brief Finds the trailer of a block in the aligned table, without locking it.
+ *
+ * The probe is repeated when the table changed during it, a removal may have shifted the slots probed.
+ *
+ * @param ptr The block.
+ * @return The LIST after the block, NULL if the block is not in the table.
+ */
+static LIST *alignedFind(void *ptr)
+{
+	for (;;)
+	{
+		unsigned long seq = __atomic_load_n(&gAlignedTable.seq, __ATOMIC_ACQUIRE);
+		LIST *item = NULL;
+
+		if (!(seq & 1) && __atomic_load_n(&gAlignedTable.count, __ATOMIC_RELAXED))
+		{
+			unsigned long capacity = __atomic_load_n(&gAlignedTable.capacity, __ATOMIC_ACQUIRE);
+			ALIGNEDSLOT *slots = __atomic_load_n(&gAlignedTable.slots, __ATOMIC_ACQUIRE);
+			unsigned long mask = capacity - 1;
+			unsigned long i = (((unsigned long)ptr * 0x9E3779B97F4A7C15UL) >> 32) & mask;
+			/* Bounded, the slots may be mid change and hold no free slot */
+			for (unsigned long probes = 0; probes < capacity; probes++, i = (i + 1) & mask)
+			{
+				void *slotPtr = __atomic_load_n(&slots[i].ptr, __ATOMIC_RELAXED);
+				if (ptr == slotPtr)
+				{
+					item = __atomic_load_n(&slots[i].item, __ATOMIC_RELAXED);
+					break;
+				}
+				if (NULL == slotPtr)
+				{
+					break;
+				}
+			}
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (!(seq & 1) && (seq == __atomic_load_n(&gAlignedTable.seq, __ATOMIC_RELAXED)))
+		{
+			return item;
+		}
+	}
+}
+
+/**
+ * @brief Removes the trailer of a block from the aligned table.
+ *
+ * The slots following the removed one in its probe sequence are shifted back, so that no deleted marker is needed.
+ * The lookups are no more limited by the alignment of the blocks once the table is empty.
+ *
+ * @param ptr The block.
+ */
+static void alignedRemove(void *ptr)
+{
+	pthread_mutex_lock(&gAlignedTable.lock);
+	if (gAlignedTable.count)
+	{
+		unsigned long mask = gAlignedTable.capacity - 1;
+		ALIGNEDSLOT *slot = alignedSlot(gAlignedTable.slots, gAlignedTable.capacity, ptr);
+		if (slot->ptr)
+		{
+			unsigned long hole = slot - gAlignedTable.slots;
+			alignedChange(true);
+			for (unsigned long i = (hole + 1) & mask; gAlignedTable.slots[i].ptr; i = (i + 1) & mask)
+			{
+				unsigned long home = (((unsigned long)gAlignedTable.slots[i].ptr * 0x9E3779B97F4A7C15UL) >> 32) & mask;
+				/* Moved back if its home is not cyclically within (hole, i] */
+				if (((i - home) & mask) >= ((i - hole) & mask))
+				{
+					gAlignedTable.slots[hole] = gAlignedTable.slots[i];
+					hole = i;
+				}
+			}
+			gAlignedTable.slots[hole].ptr = NULL;
+			if (0 == --gAlignedTable.count)
+			{
+				__atomic_store_n(&gAlignedTable.mask, ~0UL, __ATOMIC_RELAXED);
+			}
+			alignedChange(false);
+		}
+	}
+	pthread_mutex_unlock(&gAlignedTable.lock);
+}
+#endif
+
+#ifdef LARGE_REGISTRY
+/**
+ * @brief Finds the slot of a block in the large table.
+ *
+ * Linear probing ends on a free slot, there is always one since the table is at most half full.
+ *
+ * @param slots The slots of the table.
+ * @param capacity The number of slots, a power of 2.
+ * @param ptr The allocated pointer, not NULL.
+ * @return The slot holding the pointer, else the free slot for it.
+ */
+static LISTxfer *largeSlot(LISTxfer *slots, unsigned long capacity, void *ptr)
+{
+	unsigned long mask = capacity - 1;
+	for (unsigned long i = (((unsigned long)ptr * 0x9E3779B97F4A7C15UL) >> 32) & mask;; i = (i + 1) & mask)
+	{
+		if ((ptr == slots[i].ptr) || (NULL == slots[i].ptr))
+		{
+			return &slots[i];
+		}
+	}
+}
+
+/**
+ * @brief Adds an entry to the large table, updating the slot of its pointer if already there.
+ *
+ * Slots are mmap'd, so that growing never calls back into malloc. The entry is left out of the
+ * table when it couldn't grow, it is still in the lists.
+ *
+ * @param item The entry, its fields set.
+ */
+static void largeAdd(const LIST *item)
+{
+	LISTxfer xfer;
+
+	listGetXfer(item, &xfer);
+	pthread_mutex_lock(&gLargeTable.lock);
+	if ((gLargeTable.count + 1) * 2 > gLargeTable.capacity)
+	{
+		unsigned long capacity = (gLargeTable.capacity) ? gLargeTable.capacity * 2 : LARGE_REGISTRY_INITIAL_SLOTS;
+		LISTxfer *slots = libc_mmap(NULL, capacity * sizeof(LISTxfer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == slots)
+		{
+			pthread_mutex_unlock(&gLargeTable.lock);
+			return;
+		}
+		for (unsigned long i = 0; i < gLargeTable.capacity; i++)
+		{
+			if (gLargeTable.slots[i].ptr)
+			{
+				*largeSlot(slots, capacity, gLargeTable.slots[i].ptr) = gLargeTable.slots[i];
+			}
+		}
+		if (gLargeTable.slots)
+		{
+			libc_munmap(gLargeTable.slots, gLargeTable.capacity * sizeof(LISTxfer));
+		}
+		gLargeTable.slots = slots;
+		gLargeTable.capacity = capacity;
+	}
+	LISTxfer *slot = largeSlot(gLargeTable.slots, gLargeTable.capacity, xfer.ptr);
+	if (NULL == slot->ptr)
+	{
+		gLargeTable.count++;
+	}
+	*slot = xfer;
+	if (xfer.size < gLargeTable.minSize)
+	{
+		__atomic_store_n(&gLargeTable.minSize, xfer.size, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&gLargeTable.lock);
+}
+
+/**
+ * @brief Removes a pointer from the large table, if it is there.
+ *
+ * The slots following the removed one in its probe sequence are shifted back, as in alignedRemove.
+ *
+ * @param ptr The allocated pointer.
+ */
+static void largeRemove(void *ptr)
+{
+	pthread_mutex_lock(&gLargeTable.lock);
+	if (gLargeTable.count)
+	{
+		unsigned long mask = gLargeTable.capacity - 1;
+		LISTxfer *slot = largeSlot(gLargeTable.slots, gLargeTable.capacity, ptr);
+		if (slot->ptr)
+		{
+			unsigned long hole = slot - gLargeTable.slots;
+			for (unsigned long i = (hole + 1) & mask; gLargeTable.slots[i].ptr; i = (i + 1) & mask)
+			{
+				unsigned long home = (((unsigned long)gLargeTable.slots[i].ptr * 0x9E3779B97F4A7C15UL) >> 32) & mask;
+				/* Moved back if its home is not cyclically within (hole, i] */
+				if (((i - home) & mask) >= ((i - hole) & mask))
+				{
+					gLargeTable.slots[hole] = gLargeTable.slots[i];
+					hole = i;
+				}
+			}
+			gLargeTable.slots[hole].ptr = NULL;
+			gLargeTable.count--;
+		}
+	}
+	pthread_mutex_unlock(&gLargeTable.lock);
+}
+
+/**
+ * @brief Whether an entry of the given size may be in the large table, to skip the lookup of smaller ones.
+ */
+static inline bool largeMayHold(size_t size)
+{
+	return __atomic_load_n(&gLargeTable.minSize, __ATOMIC_RELAXED) <= size;
+}
+#endif
+
+#ifdef ADDRESS_INDEX
+/**
+ * @brief Gets the treap priority of a pointer, the MurmurHash3 finalizer of it.
+ */
+static inline unsigned int addrPriority(const void *ptr)
+{
+	unsigned long h = (unsigned long)ptr;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDUL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53UL;
+	h ^= h >> 33;
+	return (unsigned int)h;
+}
+
+/**
+ * @brief Inserts a node in the address index of a shard, in one pass down the treap.
+ *
+ * The node takes the place of the first node of lower priority on its path, and the subtree
+ * there is split by its pointer into its children, so no rotation is needed.
+ *
+ * @param shard The shard.
+ * @param node The node, its pointer and priority set.
+ */
+static void addrInsert(LISTSHARD *shard, unsigned int node)
+{
+	ADDRNODE *nodes = shard->addrNodes;
+	unsigned long key = (unsigned long)nodes[node].ptr;
+	unsigned int *link = &shard->addrRoot;
+	unsigned int *left = &nodes[node].left, *right = &nodes[node].right;
+	unsigned int cur;
+
+	while ((cur = *link) && (nodes[cur].priority > nodes[node].priority))
+	{
+		link = (key < (unsigned long)nodes[cur].ptr) ? &nodes[cur].left : &nodes[cur].right;
+	}
+	*link = node;
+	while (cur)
+	{
+		if ((unsigned long)nodes[cur].ptr < key)
+		{
+			*left = cur;
+			left = &nodes[cur].right;
+			cur = nodes[cur].right;
+		}
+		else
+		{
+			*right = cur;
+			right = &nodes[cur].left;
+			cur = nodes[cur].left;
+		}
+	}
+	*left = *right = 0;
+}
+
+/**
+ * @brief Joins two subtrees of the address index at a link, all pointers of the left one being lower.
+ */
+static void addrJoin(ADDRNODE *nodes, unsigned int *link, unsigned int left, unsigned int right)
+{
+	while (left && right)
+	{
+		if (nodes[left].priority > nodes[right].priority)
+		{
+			*link = left;
+			link = &nodes[left].right;
+			left = nodes[left].right;
+		}
+		else
+		{
+			*link = right;
+			link = &nodes[right].left;
+			right = nodes[right].left;
+		}
+	}
+	*link = (left) ? left : right;
+}
+
+/**
+ * @brief Doubles the nodes of the address index of a shard. Call with the shard locked.
+ *
+ * Nodes are mmap'd, so that growing never calls back into malloc.
+ *
+ * @param shard The shard.
+ * @return 0 if successful; -1 if the new nodes couldn't be mapped.
+ */
+static int addrIndexGrow(LISTSHARD *shard)
+{
+	unsigned int capacity = (shard->addrCapacity) ? shard->addrCapacity * 2 : ADDRESS_INDEX_INITIAL_NODES;
+	ADDRNODE *nodes = libc_mmap(NULL, capacity * sizeof(ADDRNODE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (MAP_FAILED == nodes)
+	{
+		return -1;
+	}
+	if (shard->addrNodes)
+	{
+		memcpy(nodes, shard->addrNodes, shard->addrUsed * sizeof(ADDRNODE));
+		libc_munmap(shard->addrNodes, shard->addrCapacity * sizeof(ADDRNODE));
+	}
+	else
+	{
+		shard->addrUsed = 1; /* Node 0 is none */
+	}
+	shard->addrNodes = nodes;
+	shard->addrCapacity = capacity;
+	return 0;
+}
+
+/**
+ * @brief Adds an entry to the address index of its shard. Call with the shard locked.
+ *
+ * The entry is left out of the index when it couldn't grow, it is still in the lists.
+ *
+ * @param shard The shard of the entry.
+ * @param ptr The allocated pointer.
+ * @param item The entry.
+ */
+static void addrIndexAdd(LISTSHARD *shard, void *ptr, LIST *item)
+{
+	unsigned int node = shard->addrFree;
+
+	if (node)
+	{
+		shard->addrFree = shard->addrNodes[node].left;
+	}
+	else if ((shard->addrUsed < shard->addrCapacity) || (0 == addrIndexGrow(shard)))
+	{
+		node = shard->addrUsed++;
+	}
+	else
+	{
+		return;
+	}
+	shard->addrNodes[node].ptr = ptr;
+	shard->addrNodes[node].item = item;
+	shard->addrNodes[node].priority = addrPriority(ptr);
+	addrInsert(shard, node);
+}
+
+/**
+ * @brief Removes a pointer from the address index of a shard, if it is there. Call with the shard locked.
+ *
+ * @param shard The shard of the entry.
+ * @param ptr The allocated pointer.
+ */
+static void addrIndexRemove(LISTSHARD *shard, const void *ptr)
+{
+	ADDRNODE *nodes = shard->addrNodes;
+	unsigned int *link = &shard->addrRoot;
+	unsigned int node;
+
+	while ((node = *link) && (ptr != nodes[node].ptr))
+	{
+		link = ((unsigned long)ptr < (unsigned long)nodes[node].ptr) ? &nodes[node].left : &nodes[node].right;
+	}
+	if (node)
+	{
+		addrJoin(nodes, link, nodes[node].left, nodes[node].right);
+		nodes[node].ptr = NULL;
+		nodes[node].left = shard->addrFree;
+		shard->addrFree = node;
+	}
+}
+
+/**
+ * @brief Finds the entry holding an address in the address index of a shard. Call with the shard locked.
+ *
+ * @param shard The shard.
+ * @param address The address.
+ * @return The entry with the highest pointer not above the address if the address is within its size, else NULL.
+ */
+static LIST *addrIndexFind(const LISTSHARD *shard, const void *address)
+{
+	const ADDRNODE *nodes = shard->addrNodes;
+	unsigned int floor = 0;
+
+	for (unsigned int node = shard->addrRoot; node;)
+	{
+		if ((unsigned long)nodes[node].ptr <= (unsigned long)address)
+		{
+			floor = node;
+			node = nodes[node].right;
+		}
+		else
+		{
+			node = nodes[node].left;
+		}
+	}
+	if (floor && (((unsigned long)address == (unsigned long)nodes[floor].ptr) ||
+				  ((unsigned long)address - (unsigned long)nodes[floor].ptr < listSize(nodes[floor].item))))
+	{
+		return nodes[floor].item;
+	}
+	return NULL;
+}
+#endif
+
+/**
+ * @brief Gets the header of an allocation from its pointer.
+ *
+ * CLIST is at the place of the LIST tid, which is below 2^22 (PID_MAX_LIMIT), so a LIST never
+ * shows a magic where CLIST flags would be. tid of untracked LIST is cleared for the same reason.
+ * With ALIGNED_TRAILER, the LIST after an aligned block is found through the aligned table.
+ *
+ * @param ptr The allocated pointer.
+ * @return The CLIST or LIST before the pointer, its magic is yet to be checked.
+ */
+static LIST *listHeader(void *ptr)
+{
+#ifdef ALIGNED_TRAILER
+	if (!((unsigned long)ptr & __atomic_load_n(&gAlignedTable.mask, __ATOMIC_RELAXED)))
+	{ /* Aligned as the blocks with a trailer, the bytes before it may belong to another block */
+		LIST *item = alignedFind(ptr);
+		if (item)
+		{
+			return item;
+		}
+	}
+#endif
+#ifdef COMPACT_LIST
+	LIST *item = (LIST *)((char *)ptr - sizeof(CLIST));
+	unsigned int magic = item->flags & 0xFFFF0000;
+	if ((item->flags & LIST_COMPACT) && ((0xBEAD0000 == magic) || (0xDEAD0000 == magic)
+#ifdef SAMPLED_TRACKING
+										 || (LIST_UNSAMPLED_MAGIC == magic)
+#endif
+											 ))
+	{
+		return item;
+	}
+#endif
+	return (LIST *)((char *)ptr - sizeof(LIST));
+}
+#endif
+
+/**
+ * @brief Retrieves the item from the list for a given pointer.
+ *
+ * With SIDE_TABLE, the item is a slot of the table, valid till the next allocation.
+ *
+ * @param ptr The pointer for which the item needs to be retrieved.
+ * @return The item corresponding to the given pointer, or NULL if not found.
+ */
+LIST *getItem(void *ptr)
+{
+	LIST *ret = NULL;
+#if defined(SIDE_TABLE)
+	unsigned long long hash = sideTableHash(ptr);
+	SIDETABLE *table = sideTableShard(hash);
+	pthread_mutex_lock(&table->lock);
+	ret = sideTableFind(table, ptr, hash);
+	pthread_mutex_unlock(&table->lock);
+#elif !defined(PREPEND_LISTDATA)
+	pthread_mutex_lock(&lock);
+#ifndef MAINTAIN_SINGLE_LIST
+	LIST *tmp = memhead;
+	while (tmp)
+	{
+		if (ptr == tmp->ptr)
+		{
+			pthread_mutex_unlock(&lock);
+			return tmp;
+		}
+		tmp = tmp->next;
+	}
+	tmp = wmemhead;
+	while (tmp)
+	{
+		if (ptr == tmp->ptr)
+		{
+			ret = tmp;
+			break;
+		}
+		tmp = tmp->next;
+	}
+#else  /* else of #ifndef MAINTAIN_SINGLE_LIST */
+	LIST *tmp = hpfmemhead;
+	while (tmp)
+	{
+		if (ptr == tmp->ptr)
+		{
+			pthread_mutex_unlock(&lock);
+			return tmp;
+		}
+		tmp = tmp->next;
+	}
+#endif /* End of #ifndef MAINTAIN_SINGLE_LIST */
+	pthread_mutex_unlock(&lock);
+#else  /* else of #if defined(SIDE_TABLE) */
+	/* Header is read from the pointer itself, no need to hold the list */
+	ret = listHeader(ptr);
+// #if defined(PREPEND_LISTDATA)
+// TODO: Add unlikely attribute
+	if (0xBEAD0000 != (ret->flags & 0xFFFF0000))
+	{
+		ret = NULL;
+	}
+// #endif
+#endif
+	return ret;
+}
+
+/**
+ * @brief Marks all the memory allocations as tracked.
+ *
+ * This function moves all new allocations to the list of tracked allocations.
+ */
+__attribute__((weak)) void heapwalkMarkall()
+{
+#if defined(SHARD_LIST)
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		pthread_mutex_lock(&gListShards[i].lock);
+		gListShards[i].whead = NULL;
+		pthread_mutex_unlock(&gListShards[i].lock);
+	}
+#elif defined(SIDE_TABLE)
+	sideTableMarkall(1);
+#else
+	pthread_mutex_lock(&lock);
+#ifdef MAINTAIN_SINGLE_LIST
+	hpwmemhead = NULL;
+#else
+	if (wmemtail)
+	{
+		wmemtail->next = memhead;
+		if (memhead)
+		{
+#ifdef PREPEND_LISTDATA
+			memhead->prev = wmemtail;
+#endif
+			wmemtail = memtail;
+		}
+	}
+	else
+	{
+		wmemhead = memhead;
+		wmemtail = memtail;
+	}
+
+	memhead = memtail = NULL;
+#endif
+	pthread_mutex_unlock(&lock);
+#endif /* End of #if defined(SHARD_LIST) */
+}
+
+/**
+ * @brief Resets the tracked memory allocations.
+ *
+ * This function moves all tracked allocations back to the list of new allocations.
+ */
+void heapwalkReset()
+{
+#if defined(SHARD_LIST)
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		pthread_mutex_lock(&gListShards[i].lock);
+		gListShards[i].whead = gListShards[i].head;
+		pthread_mutex_unlock(&gListShards[i].lock);
+	}
+#elif defined(SIDE_TABLE)
+	sideTableMarkall(0);
+#else
+	/* Protect */
+	pthread_mutex_lock(&lock);
+
+#ifdef MAINTAIN_SINGLE_LIST
+	hpwmemhead = hpfmemhead;
+#else
+	if (memhead)
+	{
+		if (wmemtail)
+		{
+			wmemtail->next = memhead;
+#ifdef PREPEND_LISTDATA
+			memhead->prev = wmemtail;
+#endif
+			memhead = wmemhead;
+		}
+	}
+	else
+	{
+		memhead = wmemhead;
+		memtail = wmemtail;
+	}
+	wmemhead = wmemtail = NULL;
+	/* LIST *tmp = wmemhead;
+	LIST *tail = wmemhead;
+		while (tmp) {
+		tail = tmp;
+				tmp = tmp->next;
+		}
+	if (tail){
+		tail->next = memhead;
+		memhead = wmemhead;
+		wmemhead = NULL;
+	} */
+#endif
+	pthread_mutex_unlock(&lock);
+#endif /* End of #if defined(SHARD_LIST) */
+}
+
+#ifdef WALK_BOOKMARKS
+/**
+ * @brief Sets, deletes or lists the bookmarks, and sends the bookmarks to the message queue.
+ *
+ * Setting a bookmark holds each shard only to keep its newest entry, no entry is written. A walk since
+ * the bookmark sends the entries allocated after it as new, and leaves the walked marks and the other
+ * bookmarks as they are, so that any number of clients can walk the new allocations of their own.
+ *
+ * @param mqsend The message queue descriptor to which the bookmarks will be sent.
+ * @param op The change of the bookmarks.
+ * @param name The name of the bookmark to set or delete, up to WALK_BOOKMARK_NAME_SIZE.
+ */
+void heapwalkBookmark(mqd_t mqsend, bookmarkOp op, const char *name)
+{
+	msg_bookmarks msg;
+	char key[WALK_BOOKMARK_NAME_SIZE];
+	int slot;
+
+	memset(&msg, 0, sizeof(msg));
+	strncpy(key, name, sizeof(key) - 1);
+	key[sizeof(key) - 1] = '\0';
+	slot = (key[0]) ? bookmarkFind(key) : -1;
+	if (BOOKMARK_SET == op)
+	{
+		slot = (0 > slot && key[0]) ? bookmarkFind("") : slot;
+		if (0 <= slot)
+		{
+			/* Marked set first, so that a free of a newest entry moves the mark as soon as it is kept */
+			__atomic_or_fetch(&gBookmarksSet, 1U << slot, __ATOMIC_RELAXED);
+#ifdef MIRROR_DELTAS
+			/* The logs aren't synced to the moved mark, a mirror of the name is sent all the entries again */
+			__atomic_and_fetch(&gMirrorsSet, ~(1U << slot), __ATOMIC_RELAXED);
+#endif
+			for (int i = 0; i < MAX_LIST_SHARDS; i++)
+			{
+				pthread_mutex_lock(&gListShards[i].lock);
+				gListShards[i].marks[slot] = gListShards[i].tail;
+				pthread_mutex_unlock(&gListShards[i].lock);
+			}
+			strcpy(gBookmarks[slot].name, key);
+			gBookmarks[slot].generation = ++gBookmarkGeneration;
+			gBookmarks[slot].seconds = time(NULL);
+		}
+		else
+		{
+			dbg(PRINT_ERROR, "%s: Bookmark '%s' not set, up to %d bookmarks\n", __FUNCTION__, key, WALK_BOOKMARKS_MAX);
+		}
+	}
+	else if ((BOOKMARK_DELETE == op) && (0 <= slot))
+	{
+		__atomic_and_fetch(&gBookmarksSet, ~(1U << slot), __ATOMIC_RELAXED);
+#ifdef MIRROR_DELTAS
+		__atomic_and_fetch(&gMirrorsSet, ~(1U << slot), __ATOMIC_RELAXED);
+#endif
+		for (int i = 0; i < MAX_LIST_SHARDS; i++)
+		{
+			pthread_mutex_lock(&gListShards[i].lock);
+			gListShards[i].marks[slot] = NULL;
+			pthread_mutex_unlock(&gListShards[i].lock);
+		}
+		memset(&gBookmarks[slot], 0, sizeof(gBookmarks[slot]));
+	}
+	msg.result = ((BOOKMARK_LIST != op) && (0 > slot)) ? -1 : 0;
+
+	msg.numItemOrInfo = HEAPWALK_ENDOF_LIST;
+#ifdef ENABLE_STATISTICS
+	updateStatistics(); /* Unlocked, the sums may be off by the allocations made meanwhile */
+	msg.totalHeapSize = totalHeapSize;
+	msg.totalOverhead = totalOverhead;
+#endif
+	for (int i = 0; i < WALK_BOOKMARKS_MAX; i++)
+	{
+		if (gBookmarks[i].name[0])
+		{
+			msg.bookmarks[msg.count++] = gBookmarks[i];
+		}
+	}
+	walkSend(mqsend, (const char *)&msg, sizeof(msg));
+}
+#endif
+
+#ifdef ADDRESS_INDEX
+/**
+ * @brief Finds the tracked entry holding an address, through the address index of each shard.
+ *
+ * Each shard is held only for its lookup. An entry is removed from the index before its block is
+ * free'd, so the found entry is read while it is still allocated. Untracked blocks are not found.
+ *
+ * @param address Any address within the block, or its pointer for a block of 0 bytes.
+ * @param owner Filled with the fields of the entry holding the address.
+ * @return 0 if found; -1 otherwise.
+ */
+int memwrapOwner(const void *address, LISTxfer *owner)
+{
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		pthread_mutex_lock(&gListShards[i].lock);
+		LIST *item = addrIndexFind(&gListShards[i], address);
+		if (item)
+		{
+			listGetXfer(item, owner);
+			pthread_mutex_unlock(&gListShards[i].lock);
+			return 0;
+		}
+		pthread_mutex_unlock(&gListShards[i].lock);
+	}
+	return -1;
+}
+
+/**
+ * @brief Finds the tracked entry holding an address, and sends it to the message queue.
+ *
+ * @param mqsend The message queue descriptor to which the entry will be sent.
+ * @param address The address.
+ */
+void heapwalkOwner(mqd_t mqsend, const void *address)
+{
+	msg_owner msg;
+
+	memset(&msg, 0, sizeof(msg));
+	if (!gAddressIndex)
+	{
+		dbg(PRINT_ERROR, "%s: Address index off, set MEMWRAP_ADDRESS_INDEX=1 to index the allocations\n", __FUNCTION__);
+	}
+	msg.result = memwrapOwner(address, &msg.owner);
+	msg.numItemOrInfo = HEAPWALK_ENDOF_LIST;
+#ifdef ENABLE_STATISTICS
+	updateStatistics(); /* Unlocked, the sums may be off by the allocations made meanwhile */
+	msg.totalHeapSize = totalHeapSize;
+	msg.totalOverhead = totalOverhead;
+#endif
+	walkSend(mqsend, (const char *)&msg, sizeof(msg));
+}
+#endif
+
+#ifdef MIRROR_DELTAS
+/**
+ * @brief Maps the logs of the shards not mapped yet. Call with all the shards locked.
+ *
+ * @return 0 if all the logs are mapped, -1 otherwise.
+ */
+static int mirrorLogMap()
+{
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		if (NULL == gListShards[i].mirrorLog)
+		{
+			LISTxfer *log = libc_mmap(NULL, gMirrorLogEntries * sizeof(LISTxfer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (MAP_FAILED == log)
+			{
+				dbg(PRINT_ERROR, "%s: mmap failed: %s\n", __FUNCTION__, strerror(errno));
+				return -1;
+			}
+			gListShards[i].mirrorLog = log;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Gets the first entry of a shard to be sent to a mirror, the first one allocated since its bookmark.
+ *
+ * @param shard The shard.
+ * @param slot The bookmark of the mirror.
+ * @param full true to send all the entries.
+ */
+static LIST *mirrorStart(const LISTSHARD *shard, int slot, bool full)
+{
+	LIST *mark = (full) ? NULL : shard->marks[slot];
+	return (mark) ? mark->next : shard->head;
+}
+
+/**
+ * @brief Syncs a mirror, and sends the changes of the heap since its last sync to the message queue.
+ *
+ * The changes are collected holding all the shards, in O(changes): the logged frees, the logged in place
+ * reallocs but the ones logged again later, and the entries allocated after the bookmark of the mirror.
+ * The bookmark and the synced logs then move to the newest entries, and the changes are sent once the shards
+ * are released. The first sync of a mirror, one whose log records are overwritten and the one after a given
+ * up answer send all the entries instead.
+ *
+ * @param mqsend The message queue descriptor to which the changes will be sent.
+ * @param name The name of the mirror, a bookmark set by its first sync.
+ * @param full true to send all the entries.
+ */
+void heapwalkMirror(mqd_t mqsend, const char *name, bool full)
+{
+	msg_mirror msg;
+	msg_resp msgresp;
+	char key[WALK_BOOKMARK_NAME_SIZE];
+	LISTxfer *records = NULL;
+	void **seen = NULL;
+	unsigned long capacity = 0, count = 0, seenCapacity = 0;
+	int slot;
+
+	memset(&msg, 0, sizeof(msg));
+	strncpy(key, name, sizeof(key) - 1);
+	key[sizeof(key) - 1] = '\0';
+	lockAllShards();
+	slot = (key[0]) ? bookmarkFind(key) : -1;
+	slot = (0 > slot && key[0]) ? bookmarkFind("") : slot;
+	msg.result = ((0 > slot) || mirrorLogMap()) ? -1 : 0;
+	if (0 == msg.result)
+	{
+		unsigned long longest = 0;
+		full = full || !(gMirrorsSet & (1U << slot));
+		for (int i = 0; i < MAX_LIST_SHARDS && !full; i++)
+		{
+			unsigned long logged = gListShards[i].mirrorSeq - gListShards[i].mirrorSynced[slot];
+			full = (gMirrorLogEntries < logged);
+			longest = (longest < logged) ? logged : longest;
+			capacity += logged;
+		}
+		capacity = (full) ? 0 : capacity;
+		for (int i = 0; i < MAX_LIST_SHARDS; i++)
+		{
+			for (LIST *cur = mirrorStart(&gListShards[i], slot, full); cur; cur = cur->next)
+			{
+				capacity++;
+			}
+		}
+		for (seenCapacity = 64; !full && longest && (seenCapacity < 2 * longest); seenCapacity <<= 1)
+			;
+		records = (capacity) ? libc_mmap(NULL, capacity * sizeof(LISTxfer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : NULL;
+		seen = (!full && longest) ? libc_mmap(NULL, seenCapacity * sizeof(void *), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : NULL;
+		msg.result = ((MAP_FAILED == records) || (MAP_FAILED == seen)) ? -1 : 0;
+	}
+	if ((0 == msg.result) && !full)
+	{
+		/* Frees first, an entry allocated again at a free'd pointer is sent after them */
+		for (int i = 0; i < MAX_LIST_SHARDS; i++)
+		{
+			LISTSHARD *shard = &gListShards[i];
+			for (unsigned long long seq = shard->mirrorSynced[slot]; seq < shard->mirrorSeq; seq++)
+			{
+				const LISTxfer *record = &shard->mirrorLog[seq & (gMirrorLogEntries - 1)];
+				if (0xDEAD0000 == (record->flags & 0xFFFF0000))
+				{
+					records[count++] = *record;
+				}
+			}
+		}
+		/* An entry is free'd or reallocated in its own shard, so a realloc logged again later in the shard is stale */
+		for (int i = 0; i < MAX_LIST_SHARDS && seen; i++)
+		{
+			LISTSHARD *shard = &gListShards[i];
+			memset(seen, 0, seenCapacity * sizeof(void *));
+			for (unsigned long long seq = shard->mirrorSeq; seq > shard->mirrorSynced[slot]; seq--)
+			{
+				const LISTxfer *record = &shard->mirrorLog[(seq - 1) & (gMirrorLogEntries - 1)];
+				if (!mirrorSeen(seen, seenCapacity, record->ptr) && (0xDEAD0000 != (record->flags & 0xFFFF0000)))
+				{
+					records[count++] = *record;
+				}
+			}
+		}
+	}
+	if (0 == msg.result)
+	{
+		for (int i = 0; i < MAX_LIST_SHARDS; i++)
+		{
+			LISTSHARD *shard = &gListShards[i];
+			for (LIST *cur = mirrorStart(shard, slot, full); cur; cur = cur->next)
+			{
+				listGetXfer(cur, &records[count++]);
+			}
+			shard->marks[slot] = shard->tail;
+			shard->mirrorSynced[slot] = shard->mirrorSeq;
+		}
+		if (!gBookmarks[slot].name[0])
+		{
+			strcpy(gBookmarks[slot].name, key);
+		}
+		gBookmarks[slot].generation = ++gBookmarkGeneration;
+		gBookmarks[slot].seconds = time(NULL);
+		__atomic_or_fetch(&gBookmarksSet, 1U << slot, __ATOMIC_RELAXED);
+		__atomic_or_fetch(&gMirrorsSet, 1U << slot, __ATOMIC_RELAXED);
+		msg.full = (full) ? 1 : 0;
+		msg.generation = gBookmarks[slot].generation;
+	}
+	else
+	{
+		dbg(PRINT_ERROR, "%s: Mirror '%s' not synced, up to %d bookmarks or no memory for its changes\n", __FUNCTION__, key, WALK_BOOKMARKS_MAX);
+	}
+	updateStatistics();
+	unlockAllShards();
+	if (seen && (MAP_FAILED != seen))
+	{
+		libc_munmap(seen, seenCapacity * sizeof(void *));
+	}
+
+	msg.numItemOrInfo = (0 == msg.result) ? HEAPWALK_ITEM_CONTN : HEAPWALK_ENDOF_LIST;
+	msg.totalHeapSize = msgresp.totalHeapSize = totalHeapSize;
+	msg.totalOverhead = msgresp.totalOverhead = totalOverhead;
+	walkSend(mqsend, (const char *)&msg, sizeof(msg));
+	msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+	for (unsigned long i = 0; (0 == msg.result) && (i < count); i++)
+	{
+		msgresp.xfer[msgresp.numItemOrInfo++] = records[i];
+		if ((MAX_MSG_XFER <= msgresp.numItemOrInfo) || (i + 1 == count))
+		{
+			msgresp.numItemOrInfo |= (i + 1 < count) ? HEAPWALK_ITEM_CONTN : HEAPWALK_ENDOF_LIST;
+			walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+			msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+		}
+	}
+	if ((0 == msg.result) && (0 == count))
+	{
+		msgresp.numItemOrInfo = HEAPWALK_ENDOF_LIST;
+		walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+	}
+	if ((0 == msg.result) && gWalkAborted)
+	{ /* The client may have missed changes, its next sync is sent all the entries */
+		__atomic_and_fetch(&gMirrorsSet, ~(1U << slot), __ATOMIC_RELAXED);
+	}
+	if (records && (MAP_FAILED != records))
+	{
+		libc_munmap(records, capacity * sizeof(LISTxfer));
+	}
+}
+#endif
+
+#if defined(SHARD_LIST)
+#ifdef SHM_TRANSFER
+/* Shared memory segment being filled with the msg_resp stream of a walk */
+typedef struct shm_xfer
+{
+	int fd;
+	char *base;
+	size_t size;
+	size_t used;
+} SHMXFER;
+
+/* Segment grows by doubling, starting with this size */
+#define SHM_XFER_INITIAL_SIZE (256 * sizeof(msg_resp))
+
+/**
+ * @brief Creates the shared memory segment for a walk.
+ *
+ * @param xfer The segment to be initialized.
+ * @param walked true for the segment of already walked entries, false for new entries.
+ * @return true on success.
+ */
+static bool shmXferOpen(SHMXFER *xfer, bool walked)
+{
+	char shmName[32];
+	sprintf(shmName, (walked) ? SHM_WALKED_NAME : SHM_NEW_NAME, gShmPid);
+	/* Remove the segment left by a previous walk, if memleakutil didn't get to it */
+	shm_unlink(shmName);
+	xfer->fd = shm_open(shmName, O_CREAT | O_EXCL | O_RDWR, QUEUE_READ_PERMISSION);
+	if (0 > xfer->fd)
+	{
+		dbg(PRINT_ERROR, "%s: shm_open %s failed: %s\n", __FUNCTION__, shmName, strerror(errno));
+		return false;
+	}
+	xfer->size = SHM_XFER_INITIAL_SIZE;
+	xfer->used = 0;
+	if (ftruncate(xfer->fd, xfer->size) ||
+		(MAP_FAILED == (xfer->base = libc_mmap(NULL, xfer->size, PROT_READ | PROT_WRITE, MAP_SHARED, xfer->fd, 0))))
+	{
+		dbg(PRINT_ERROR, "%s: mapping %s failed: %s\n", __FUNCTION__, shmName, strerror(errno));
+		close(xfer->fd);
+		shm_unlink(shmName);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Appends a message to the shared memory segment, growing it when full.
+ *
+ * @param xfer The segment.
+ * @param msg The message to be appended.
+ * @param size Size of the message.
+ * @return true on success.
+ */
+static bool shmXferWrite(SHMXFER *xfer, const void *msg, size_t size)
+{
+	if (xfer->used + size > xfer->size)
+	{
+		char *base;
+		if (ftruncate(xfer->fd, xfer->size * 2) ||
+			(MAP_FAILED == (base = libc_mremap(xfer->base, xfer->size, xfer->size * 2, MREMAP_MAYMOVE))))
+		{
+			dbg(PRINT_ERROR, "%s: growing segment failed: %s\n", __FUNCTION__, strerror(errno));
+			return false;
+		}
+		xfer->base = base;
+		xfer->size *= 2;
+	}
+	memcpy(xfer->base + xfer->used, msg, size);
+	xfer->used += size;
+	return true;
+}
+
+/**
+ * @brief Trims the segment to the written messages and unmaps it.
+ *
+ * @param xfer The segment.
+ */
+static void shmXferClose(SHMXFER *xfer)
+{
+	libc_munmap(xfer->base, xfer->size);
+	if (ftruncate(xfer->fd, xfer->used))
+	{
+		dbg(PRINT_ERROR, "%s: ftruncate failed: %s\n", __FUNCTION__, strerror(errno));
+	}
+	close(xfer->fd);
+}
+#endif
+
+#ifdef COMPACT_TRANSFER
+/* Previous entry and ra dictionary of the message being encoded */
+typedef struct compact_enc
+{
+	LISTxfer prev;
+	void *prevRa;
+	void *dict[COMPACT_RA_DICT_SIZE];
+	unsigned int dictCount;
+} COMPACTENC;
+
+/**
+ * @brief Appends an unsigned varint, 7 bits per byte with the MSB set when more bytes follow.
+ *
+ * @param out Where to write.
+ * @param value The value to be encoded.
+ * @return Next write position.
+ */
+static unsigned char *compactPutVarint(unsigned char *out, unsigned long value)
+{
+	while (0x80 <= value)
+	{
+		*out++ = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (unsigned char)value;
+	return out;
+}
+
+/**
+ * @brief Zigzag maps a signed delta to unsigned, so that small negative deltas are encoded short.
+ */
+static unsigned long compactZigzag(long value)
+{
+	return ((unsigned long)value << 1) ^ (unsigned long)(value >> 63);
+}
+
+/**
+ * @brief Encodes an entry at the end of a compact message.
+ *
+ * The caller ensures COMPACT_ENTRY_MAX_SIZE bytes are free in the message.
+ *
+ * @param msg The message being filled, encodedSize is 0 for the first entry.
+ * @param enc Encoder state, reset along with the message.
+ * @param item The entry to be encoded.
+ */
+static void compactEncode(msg_compact *msg, COMPACTENC *enc, const LISTxfer *item)
+{
+	unsigned char *out = &msg->encoded[msg->encodedSize];
+	unsigned int index;
+
+	if (0 == msg->encodedSize)
+	{
+		memset(enc, 0, sizeof(COMPACTENC));
+	}
+	for (index = 0; (index < enc->dictCount) && (enc->dict[index] != item->ra); index++)
+		;
+	out = compactPutVarint(out, item->flags ^ enc->prev.flags);
+	out = compactPutVarint(out, compactZigzag((long)((unsigned long)item->ptr - (unsigned long)enc->prev.ptr)));
+	out = compactPutVarint(out, item->size);
+	out = compactPutVarint(out, index);
+	if (index == enc->dictCount)
+	{ /* New ra, added to the dictionary while it has room */
+		out = compactPutVarint(out, compactZigzag((long)((unsigned long)item->ra - (unsigned long)enc->prevRa)));
+		enc->prevRa = item->ra;
+		if (COMPACT_RA_DICT_SIZE > enc->dictCount)
+		{
+			enc->dict[enc->dictCount++] = item->ra;
+		}
+	}
+	out = compactPutVarint(out, compactZigzag((long)item->tid - (long)enc->prev.tid));
+#ifdef STACK_DEPOT
+	out = compactPutVarint(out, item->stack);
+#endif
+	out = compactPutVarint(out, compactZigzag((long)(item->seconds - enc->prev.seconds)));
+	enc->prev.flags = item->flags;
+	enc->prev.ptr = item->ptr;
+	enc->prev.tid = item->tid;
+	enc->prev.seconds = item->seconds;
+	msg->encodedSize = out - msg->encoded;
+	msg->numItemOrInfo++;
+}
+
+#define HEAPWALK_MSG_SIZE(msg) (COMPACT_HEADER_SIZE + (msg).encodedSize)
+#define HEAPWALK_MSG_FULL(msg) ((MAX_MSG_XFER <= (msg).numItemOrInfo) || \
+								(COMPACT_ENTRY_MAX_SIZE > sizeof((msg).encoded) - (msg).encodedSize))
+#else
+#define HEAPWALK_MSG_SIZE(msg) sizeof(msg_resp)
+#define HEAPWALK_MSG_FULL(msg) (MAX_MSG_XFER <= (msg).numItemOrInfo)
+#endif
+
+#ifdef SLICED_HEAPWALK
+/**
+ * @brief Copies the next entries of a sliced walk into its page, holding all the shards.
+ *
+ * The shards are held till the page is full or for gWalkSliceNs, checked every WALK_SLICE_CHECK entries stepped.
+ * The cursor is kept across the slices as in the concurrent walk: entries free'd in between are kept in limbo
+ * till the walk ends and are skipped, and entries allocated in between may or may not be walked.
+ *
+ * @param walk The walk cursor.
+ * @param seen Set when any entry is walked, matching or not.
+ */
+static void shardWalkSlice(SHARDWALK *walk, bool *seen)
+{
+	struct timespec start, now;
+	unsigned int stepped = 0;
+	LIST *item = NULL;
+
+	walk->count = walk->index = 0;
+	lockAllShards();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while ((WALK_SLICE_ENTRIES > walk->count) && (item = shardWalkStep(walk)))
+	{
+		if (0xBEAD0000 == (item->flags & 0xFFFF0000))
+		{
+			*seen = true;
+			listGetXfer(item, &walk->page[walk->count]);
+#ifdef WALK_FILTER
+			if (walkFilterMatch(&walk->page[walk->count]))
+#endif
+			{
+				walk->count++;
+			}
+		}
+		/* Free'd entries are counted as well, the entries free'd between the slices may be chained for long */
+		if (0 == (++stepped % WALK_SLICE_CHECK))
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((now.tv_sec - start.tv_sec) * 1000000000L + now.tv_nsec - start.tv_nsec >= gWalkSliceNs)
+			{
+				break;
+			}
+		}
+	}
+	unlockAllShards();
+	walk->done = (NULL == item);
+}
+#endif
+
+/**
+ * @brief Gets the next entry of a merged walk matching the filter of the heapwalk.
+ *
+ * A sliced walk gets the entries from its page, copied by the slices as needed.
+ *
+ * @param walk The walk cursor.
+ * @param entry Filled with the transferred fields of the entry.
+ * @param seen Set when any entry is walked, matching or not.
+ * @return true if an entry is got, false at the end of the walk.
+ */
+static bool shardWalkNextMatch(SHARDWALK *walk, LISTxfer *entry, bool *seen)
+{
+	LIST *item;
+
+#ifdef SLICED_HEAPWALK
+	if (walk->page)
+	{
+		while ((walk->index == walk->count) && !walk->done)
+		{
+			shardWalkSlice(walk, seen);
+		}
+		if (walk->index == walk->count)
+		{
+			return false;
+		}
+		*entry = walk->page[walk->index++];
+		return true;
+	}
+#endif
+	while ((item = shardWalkNext(walk)))
+	{
+		*seen = true;
+		listGetXfer(item, entry);
+#ifdef WALK_FILTER
+		if (walkFilterMatch(entry))
+#endif
+		{
+			break;
+		}
+	}
+	return NULL != item;
+}
+
+/**
+ * @brief Sends the entries of a merged shard walk to the message queue.
+ *
+ * Sends HEAPWALK_EMPTY when there are no entries to be sent, else the last message is flagged with HEAPWALK_ENDOF_LIST.
+ * With WALK_FILTER, only the entries matching the filter of the heapwalk are sent.
+ * With gShmTransfer, the messages are written to the shared memory segment of the walk, and only
+ * HEAPWALK_SHM_SEGMENT is sent once the segment is complete.
+ * With COMPACT_TRANSFER, messages are msg_compact sent with their encoded size.
+ * Call with all the shards locked, unless the walk is concurrent or sliced.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walk The walk cursor.
+ * @param walked true when walking the already walked entries.
+ * @return true if any entry was walked, sent or filtered out, false also when the answer is given up.
+ */
+static bool heapwalkSendList(mqd_t mqsend, SHARDWALK *walk, bool walked)
+{
+#ifdef COMPACT_TRANSFER
+	msg_compact msgresp;
+	COMPACTENC enc;
+	msgresp.encodedSize = 0;
+#else
+	msg_resp msgresp;
+#endif
+	LISTxfer entry, nextEntry;
+	bool seen = false;
+	bool found = shardWalkNextMatch(walk, &entry, &seen);
+
+	msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+#ifdef ENABLE_STATISTICS
+	msgresp.totalHeapSize = totalHeapSize;
+	msgresp.totalOverhead = totalOverhead;
+#endif
+	if (!found)
+	{
+		walkSend(mqsend, (const char *)&msgresp, HEAPWALK_MSG_SIZE(msgresp));
+		return seen && !gWalkAborted;
+	}
+#ifdef SHM_TRANSFER
+	SHMXFER xfer;
+	bool shm = gShmTransfer && shmXferOpen(&xfer, walked);
+#endif
+	while (found && !gWalkAborted)
+	{
+		bool next = shardWalkNextMatch(walk, &nextEntry, &seen);
+#ifdef COMPACT_TRANSFER
+		compactEncode(&msgresp, &enc, &entry);
+#ifdef STACK_DEPOT
+		gStackWalked[entry.stack / STACK_WALKED_BITS] |= 1UL << (entry.stack % STACK_WALKED_BITS);
+#endif
+#else
+		msgresp.xfer[msgresp.numItemOrInfo] = entry;
+		msgresp.numItemOrInfo++;
+#endif
+		if (HEAPWALK_MSG_FULL(msgresp) || !next)
+		{
+			msgresp.numItemOrInfo |= (next) ? HEAPWALK_ITEM_CONTN : HEAPWALK_ENDOF_LIST;
+			dbg(PRINT_NOISE, "%s: Sending %d items\n", __FUNCTION__, msgresp.numItemOrInfo);
+#ifdef SHM_TRANSFER
+			if (shm && !shmXferWrite(&xfer, &msgresp, HEAPWALK_MSG_SIZE(msgresp)))
+			{ /* Segment couldn't grow, tell the entries so far are in the segment and send the rest on the queue */
+				shmXferClose(&xfer);
+				unsigned int numItemOrInfo = msgresp.numItemOrInfo;
+				msgresp.numItemOrInfo = HEAPWALK_SHM_SEGMENT | HEAPWALK_ITEM_CONTN;
+#ifdef COMPACT_TRANSFER
+				unsigned int encodedSize = msgresp.encodedSize;
+				msgresp.encodedSize = 0;
+				walkSend(mqsend, (const char *)&msgresp, HEAPWALK_MSG_SIZE(msgresp));
+				msgresp.encodedSize = encodedSize;
+#else
+				walkSend(mqsend, (const char *)&msgresp, HEAPWALK_MSG_SIZE(msgresp));
+#endif
+				msgresp.numItemOrInfo = numItemOrInfo;
+				shm = false;
+			}
+			if (!shm)
+#endif
+			walkSend(mqsend, (const char *)&msgresp, HEAPWALK_MSG_SIZE(msgresp));
+			msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+#ifdef COMPACT_TRANSFER
+			msgresp.encodedSize = 0;
+#endif
+		}
+		found = next;
+		entry = nextEntry;
+	}
+#ifdef SHM_TRANSFER
+	if (shm)
+	{
+		shmXferClose(&xfer);
+		msgresp.numItemOrInfo = HEAPWALK_SHM_SEGMENT | HEAPWALK_ENDOF_LIST;
+		walkSend(mqsend, (const char *)&msgresp, HEAPWALK_MSG_SIZE(msgresp));
+	}
+#endif
+	return !gWalkAborted;
+}
+
+#ifdef STACK_DEPOT
+/**
+ * @brief Sends the stacks referred by the entries sent in the heapwalk, and clears their marks.
+ *
+ * The stacks follow the entries on the message queue, as msg_compact flagged HEAPWALK_STACK_DEPOT.
+ * The last message is flagged with HEAPWALK_ENDOF_LIST, and is sent even if there are no stacks.
+ * The depot is read without a lock, stacks are never changed once added.
+ *
+ * @param mqsend The message queue descriptor to which the stacks will be sent.
+ */
+static void heapwalkSendStacks(mqd_t mqsend)
+{
+	msg_compact msg;
+	void *prev = NULL;
+
+	msg.numItemOrInfo = HEAPWALK_STACK_DEPOT;
+	msg.encodedSize = 0;
+	msg.totalHeapSize = totalHeapSize;
+	msg.totalOverhead = totalOverhead;
+	for (unsigned int word = 0; word < STACK_DEPOT_SLOTS / STACK_WALKED_BITS; word++)
+	{
+		unsigned long bits = gStackWalked[word];
+		gStackWalked[word] = 0;
+		while (bits)
+		{
+			unsigned int id = word * STACK_WALKED_BITS + __builtin_ctzl(bits);
+			unsigned int depth;
+			void *const *frames = stackDepotFrames(id, &depth);
+			bits &= bits - 1;
+			if (NULL == frames)
+			{
+				continue;
+			}
+			if (STACK_ENTRY_MAX_SIZE > sizeof(msg.encoded) - msg.encodedSize)
+			{
+				msg.numItemOrInfo |= HEAPWALK_ITEM_CONTN;
+				walkSend(mqsend, (const char *)&msg, COMPACT_HEADER_SIZE + msg.encodedSize);
+				msg.numItemOrInfo = HEAPWALK_STACK_DEPOT;
+				msg.encodedSize = 0;
+				prev = NULL;
+			}
+			unsigned char *out = compactPutVarint(&msg.encoded[msg.encodedSize], id);
+			out = compactPutVarint(out, depth);
+			for (unsigned int i = 0; i < depth; i++)
+			{
+				out = compactPutVarint(out, compactZigzag((long)((unsigned long)frames[i] - (unsigned long)prev)));
+				prev = frames[i];
+			}
+			msg.encodedSize = out - msg.encoded;
+			msg.numItemOrInfo++;
+		}
+	}
+	msg.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
+	walkSend(mqsend, (const char *)&msg, COMPACT_HEADER_SIZE + msg.encodedSize);
+}
+#endif
+
+#ifdef SITE_STATS
+/**
+ * @brief Restores the heap order of a subtree, least live bytes at the root.
+ */
+static void siteStatSiftDown(SITESTAT *sites, unsigned long root, unsigned long end)
+{
+	unsigned long child;
+	while ((child = 2 * root + 1) < end)
+	{
+		if ((child + 1 < end) && (sites[child + 1].liveBytes < sites[child].liveBytes))
+		{
+			child++;
+		}
+		if (sites[root].liveBytes <= sites[child].liveBytes)
+		{
+			return;
+		}
+		SITESTAT tmp = sites[root];
+		sites[root] = sites[child];
+		sites[child] = tmp;
+		root = child;
+	}
+}
+
+/**
+ * @brief Sorts sites by live bytes, most first. Heap sort, qsort may allocate.
+ */
+static void siteStatSort(SITESTAT *sites, unsigned long count)
+{
+	for (unsigned long i = count / 2; i-- > 0;)
+	{
+		siteStatSiftDown(sites, i, count);
+	}
+	for (unsigned long end = count; end-- > 1;)
+	{
+		SITESTAT tmp = sites[0];
+		sites[0] = sites[end];
+		sites[end] = tmp;
+		siteStatSiftDown(sites, 0, end);
+	}
+}
+
+#define SITE_MSG_SIZE(count) (offsetof(msg_sites, sites) + (count) * sizeof(SITExfer))
+
+/**
+ * @brief Sends the sites holding the most live bytes to the message queue.
+ *
+ * The site tables of the shards are merged holding all the shards, and sent after releasing them.
+ * Sends HEAPWALK_EMPTY when there are no sites, else the last message is flagged with HEAPWALK_ENDOF_LIST.
+ * With STACK_DEPOT, the stacks of the sites follow as in a heapwalk.
+ *
+ * @param mqsend The message queue descriptor to which the sites will be sent.
+ * @param limit The number of sites to be sent, 0 for all.
+ */
+void heapwalkSites(mqd_t mqsend, unsigned int limit)
+{
+	msg_sites msg;
+	unsigned long total = 0, capacity = SITE_STATS_INITIAL_SLOTS, count = 0;
+	SITESTAT *merged;
+
+	lockAllShards();
+	updateStatistics();
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		total += gListShards[i].siteCount;
+	}
+	while (capacity < total * 2)
+	{
+		capacity *= 2;
+	}
+	merged = libc_mmap(NULL, capacity * sizeof(SITESTAT), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	for (int i = 0; (MAP_FAILED != merged) && (i < MAX_LIST_SHARDS); i++)
+	{
+		for (unsigned long j = 0; j < gListShards[i].siteCapacity; j++)
+		{
+			const SITESTAT *stat = &gListShards[i].sites[j];
+			if (0 == stat->site)
+			{
+				continue;
+			}
+			SITESTAT *sum = siteStatSlot(merged, capacity, stat->site);
+			sum->site = stat->site;
+			sum->liveBytes += stat->liveBytes;
+			sum->liveCount += stat->liveCount;
+			sum->allocs += stat->allocs;
+			sum->frees += stat->frees;
+			sum->error += stat->error;
+		}
+	}
+	unlockAllShards();
+
+	msg.numItemOrInfo = HEAPWALK_EMPTY;
+	msg.totalHeapSize = totalHeapSize;
+	msg.totalOverhead = totalOverhead;
+	if (MAP_FAILED == merged)
+	{
+		dbg(PRINT_ERROR, "%s: mmap failed: %s\n", __FUNCTION__, strerror(errno));
+		merged = NULL;
+		capacity = 0;
+	}
+	for (unsigned long i = 0; i < capacity; i++)
+	{
+		if (merged[i].site)
+		{
+			merged[count++] = merged[i];
+		}
+	}
+	siteStatSort(merged, count);
+	if (limit && (limit < count))
+	{
+		count = limit;
+	}
+	for (unsigned long i = 0; i < count; i++)
+	{
+		SITExfer *xfer = &msg.sites[msg.numItemOrInfo++];
+#ifdef STACK_DEPOT
+		unsigned int depth;
+		void *const *frames = stackDepotFrames(merged[i].site, &depth);
+		xfer->ra = (frames) ? frames[0] : NULL;
+		xfer->stack = merged[i].site;
+		gStackWalked[xfer->stack / STACK_WALKED_BITS] |= 1UL << (xfer->stack % STACK_WALKED_BITS);
+#else
+		xfer->ra = (void *)merged[i].site;
+#endif
+		xfer->liveBytes = merged[i].liveBytes;
+		xfer->liveCount = merged[i].liveCount;
+		xfer->allocs = merged[i].allocs;
+		xfer->frees = merged[i].frees;
+		xfer->error = merged[i].error;
+		if ((MAX_SITE_XFER <= msg.numItemOrInfo) || (i + 1 == count))
+		{
+			unsigned int items = msg.numItemOrInfo;
+			msg.numItemOrInfo |= (i + 1 < count) ? HEAPWALK_ITEM_CONTN : HEAPWALK_ENDOF_LIST;
+			walkSend(mqsend, (const char *)&msg, SITE_MSG_SIZE(items));
+			msg.numItemOrInfo = HEAPWALK_EMPTY;
+		}
+	}
+	if (0 == count)
+	{
+		walkSend(mqsend, (const char *)&msg, SITE_MSG_SIZE(0));
+	}
+	if (merged)
+	{
+		libc_munmap(merged, capacity * sizeof(SITESTAT));
+	}
+#ifdef STACK_DEPOT
+	heapwalkSendStacks(mqsend);
+#endif
+}
+#endif
+
+#ifdef LARGE_REGISTRY
+/**
+ * @brief Restores the heap order of a subtree, least size at the root.
+ */
+static void largeSiftDown(LISTxfer *entries, unsigned long root, unsigned long end)
+{
+	unsigned long child;
+	while ((child = 2 * root + 1) < end)
+	{
+		if ((child + 1 < end) && (entries[child + 1].size < entries[child].size))
+		{
+			child++;
+		}
+		if (entries[root].size <= entries[child].size)
+		{
+			return;
+		}
+		LISTxfer tmp = entries[root];
+		entries[root] = entries[child];
+		entries[child] = tmp;
+		root = child;
+	}
+}
+
+/**
+ * @brief Sorts entries by size, largest first. Heap sort, qsort may allocate.
+ */
+static void largeSort(LISTxfer *entries, unsigned long count)
+{
+	for (unsigned long i = count / 2; i-- > 0;)
+	{
+		largeSiftDown(entries, i, count);
+	}
+	for (unsigned long end = count; end-- > 1;)
+	{
+		LISTxfer tmp = entries[0];
+		entries[0] = entries[end];
+		entries[end] = tmp;
+		largeSiftDown(entries, 0, end);
+	}
+}
+
+/**
+ * @brief Sends the largest live entries, from the large table, to the message queue.
+ *
+ * Only the large table is held while it is copied, the lists are neither held nor walked.
+ * Sends HEAPWALK_EMPTY when there are no large entries, else the last message is flagged with HEAPWALK_ENDOF_LIST.
+ * With STACK_DEPOT, the stacks of the entries follow as in a heapwalk.
+ *
+ * @param mqsend The message queue descriptor to which the entries will be sent.
+ * @param limit The number of entries to be sent, 0 for all.
+ */
+void heapwalkLarge(mqd_t mqsend, unsigned int limit)
+{
+	msg_resp msgresp;
+	unsigned long capacity, count = 0;
+	LISTxfer *entries;
+
+	pthread_mutex_lock(&gLargeTable.lock);
+	capacity = gLargeTable.count;
+	entries = (capacity) ? libc_mmap(NULL, capacity * sizeof(LISTxfer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : NULL;
+	for (unsigned long i = 0; (MAP_FAILED != entries) && (count < capacity) && (i < gLargeTable.capacity); i++)
+	{
+		if (gLargeTable.slots[i].ptr)
+		{
+			entries[count++] = gLargeTable.slots[i];
+		}
+	}
+	pthread_mutex_unlock(&gLargeTable.lock);
+
+	/* The shards are not held, the totals are approximate as in sampleAdapt */
+	updateStatistics();
+	msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+	msgresp.totalHeapSize = totalHeapSize;
+	msgresp.totalOverhead = totalOverhead;
+	if (MAP_FAILED == entries)
+	{
+		dbg(PRINT_ERROR, "%s: mmap failed: %s\n", __FUNCTION__, strerror(errno));
+		entries = NULL;
+		capacity = count = 0;
+	}
+	largeSort(entries, count);
+	if (limit && (limit < count))
+	{
+		count = limit;
+	}
+	for (unsigned long i = 0; i < count; i++)
+	{
+		msgresp.xfer[msgresp.numItemOrInfo++] = entries[i];
+#ifdef STACK_DEPOT
+		gStackWalked[entries[i].stack / STACK_WALKED_BITS] |= 1UL << (entries[i].stack % STACK_WALKED_BITS);
+#endif
+		if ((MAX_MSG_XFER <= msgresp.numItemOrInfo) || (i + 1 == count))
+		{
+			msgresp.numItemOrInfo |= (i + 1 < count) ? HEAPWALK_ITEM_CONTN : HEAPWALK_ENDOF_LIST;
+			walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+			msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+		}
+	}
+	if (0 == count)
+	{
+		walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+	}
+	if (entries)
+	{
+		libc_munmap(entries, capacity * sizeof(LISTxfer));
+	}
+#ifdef STACK_DEPOT
+	heapwalkSendStacks(mqsend);
+#endif
+}
+#endif
+
+/**
+ * @brief Walks the heap and transfers memory information to the message queue.
+ *
+ * All the shards are held during the walk and their entries are merged in allocation time order.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walkAll A flag indicating whether to walk all allocations or only new ones.
+ */
+void heapwalk(mqd_t mqsend, bool walkAll)
+{
+	SHARDWALK walk;
+	bool skipped;
+
+	dbg(PRINT_NOISE, "%s: Enter\n", __FUNCTION__);
+	lockAllShards();
+#ifdef ENABLE_STATISTICS
+	updateStatistics();
+#endif
+	if (walkAll)
+	{
+		shardWalkInit(&walk, true);
+		heapwalkSendList(mqsend, &walk, true);
+	}
+	skipped = shardWalkInit(&walk, false);
+	if (heapwalkSendList(mqsend, &walk, false) || (skipped && !gWalkAborted))
+	{
+		/* Mark as walked allocation, also the ones skipped before the filter window. A walk since a bookmark leaves the marks */
+		for (int i = 0; i < MAX_LIST_SHARDS && !WALK_SINCE_BOOKMARK; i++)
+		{
+			gListShards[i].whead = NULL;
+		}
+	}
+	else
+	{
+		dbg(PRINT_INFO, "No new allocations\n");
+	}
+	unlockAllShards();
+#ifdef STACK_DEPOT
+	heapwalkSendStacks(mqsend);
+#endif
+	dbg(PRINT_NOISE, "%s: Exit\n", __FUNCTION__);
+}
+
+#ifdef SNAPSHOT_HEAPWALK
+/**
+ * @brief Walks a copy-on-write snapshot of the heap in a fork'd child.
+ *
+ * The shards are held only across fork(). The child walks its frozen copy of the lists and
+ * sends it to the message queue, while the allocating threads continue. The entries of the snapshot
+ * are marked as walked once the child exits with 0, a walk given up or a child killed leaves them new.
+ * Falls back to heapwalk() if fork fails.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walkAll A flag indicating whether to walk all allocations or only new ones.
+ */
+void heapwalkSnapshot(mqd_t mqsend, bool walkAll)
+{
+	struct timespec start, end;
+	pid_t pid;
+	int status = 0;
+
+	dbg(PRINT_NOISE, "%s: Enter\n", __FUNCTION__);
+	lockAllShards();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		gListShards[i].snapEnd = gListShards[i].tail;
+	}
+	tlsSnapshotFork = true;
+	pid = fork();
+	tlsSnapshotFork = false;
+	if (0 == pid)
+	{
+		/* Only this thread exists in the child. The fork handlers are registered once libc is loaded, before that the locks are initialized here */
+		init_locks_in_child();
+		heapwalk(mqsend, walkAll);
+		_exit((gWalkAborted) ? 1 : 0);
+	}
+	else if (0 > pid)
+	{
+		for (int i = 0; i < MAX_LIST_SHARDS; i++)
+		{
+			gListShards[i].snapEnd = NULL;
+		}
+		unlockAllShards();
+		dbg(PRINT_ERROR, "%s: fork failed: %s. Walking holding the lists\n", __FUNCTION__, strerror(errno));
+		heapwalk(mqsend, walkAll);
+		return;
+	}
+
+	unlockAllShards();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	dbg(PRINT_INFO, "%s: Lists held for %ld us\n", __FUNCTION__,
+		(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+
+	/* Wait for the walk to complete, so that the next command doesn't mix with the snapshot */
+	while ((0 > waitpid(pid, &status, 0)) && (EINTR == errno))
+		;
+	bool walked = WIFEXITED(status) && (0 == WEXITSTATUS(status));
+	if (!walked)
+	{
+		dbg(PRINT_ERROR, "%s: Snapshot walk %d didn't complete, status 0x%x. Entries stay new\n", __FUNCTION__, pid, status);
+		gWalkAborted = true;
+		gWalkAborts++;
+	}
+	/* Mark the entries of the snapshot as walked, the ones allocated since stay new */
+	lockAllShards();
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		if (walked && !WALK_SINCE_BOOKMARK)
+		{
+			gListShards[i].whead = (gListShards[i].snapEnd) ? gListShards[i].snapEnd->next : gListShards[i].head;
+		}
+		gListShards[i].snapEnd = NULL;
+	}
+	unlockAllShards();
+	dbg(PRINT_NOISE, "%s: Exit\n", __FUNCTION__);
+}
+#endif
+
+#ifdef CONCURRENT_HEAPWALK
+/**
+ * @brief Walks the heap without holding the lists while sending.
+ *
+ * Each shard is held only to read its heads, so allocating threads are not held during the walk.
+ * Entries free'd during the walk are skipped, and their blocks are kept in limbo till the walk ends,
+ * therefore the walk never reads a free'd block. The walk is fuzzy: entries allocated
+ * during the walk may or may not be shown, and are shown again by the next incremental walk.
+ * With gWalkSliced, the lists are read in slices holding all the shards for gWalkSliceNs at most, and the
+ * entries of each slice are sent without holding the lists.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walkAll A flag indicating whether to walk all allocations or only new ones.
+ */
+void heapwalkConcurrent(mqd_t mqsend, bool walkAll)
+{
+	SHARDWALK walked, walk;
+	LIST *limbo;
+
+	dbg(PRINT_NOISE, "%s: Enter\n", __FUNCTION__);
+	__atomic_store_n(&gWalkActive, true, __ATOMIC_SEQ_CST);
+	/* Taking each shard once also waits out the frees that didn't see gWalkActive */
+#ifdef ENABLE_STATISTICS
+	totalHeapSize = totalOverhead = 0;
+#endif
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		pthread_mutex_lock(&gListShards[i].lock);
+#ifdef INPLACE_REALLOC
+		/* A realloc waiting on libc has a copy of its entry in the list, gone once it is back */
+		while (gListShards[i].resizing)
+		{
+			pthread_mutex_unlock(&gListShards[i].lock);
+			sched_yield();
+			pthread_mutex_lock(&gListShards[i].lock);
+		}
+#endif
+		walked.cur[i] = gListShards[i].head;
+		gListShards[i].wend = walked.end[i] = walk.cur[i] = shardWalkStart(&gListShards[i]);
+		walk.end[i] = NULL;
+#ifdef WALK_CHECKPOINTS
+		shardWalkWindow(&gListShards[i], &walked.cur[i], walked.end[i]);
+		shardWalkWindow(&gListShards[i], &walk.cur[i], NULL);
+#endif
+		gListShards[i].wnext = NULL;
+#ifdef ENABLE_STATISTICS
+		totalHeapSize += gListShards[i].heapSize;
+		totalOverhead += gListShards[i].overhead;
+#endif
+		pthread_mutex_unlock(&gListShards[i].lock);
+	}
+	walked.shardEnd = true;
+	walk.shardEnd = false;
+#ifdef SLICED_HEAPWALK
+	walked.page = walk.page = (gWalkSliced) ? gWalkPage : NULL;
+	walked.count = walked.index = walk.count = walk.index = 0;
+	walked.done = walk.done = false;
+#endif
+
+	if (walkAll)
+	{
+		heapwalkSendList(mqsend, &walked, true);
+	}
+	if (!heapwalkSendList(mqsend, &walk, false))
+	{
+		dbg(PRINT_INFO, "No new allocations\n");
+	}
+#ifdef STACK_DEPOT
+	heapwalkSendStacks(mqsend);
+#endif
+
+	__atomic_store_n(&gWalkActive, false, __ATOMIC_SEQ_CST);
+	for (int i = 0; i < MAX_LIST_SHARDS; i++)
+	{
+		pthread_mutex_lock(&gListShards[i].lock);
+		/* Mark as walked allocation, except the ones allocated during the walk, unless the walk was given up or since a bookmark */
+		if (!gWalkAborted && !WALK_SINCE_BOOKMARK)
+		{
+			gListShards[i].whead = gListShards[i].wnext;
+		}
+		gListShards[i].wnext = gListShards[i].wend = NULL;
+		limbo = gListShards[i].limbo;
+		gListShards[i].limbo = NULL;
+		pthread_mutex_unlock(&gListShards[i].lock);
+		while (limbo)
+		{
+			LIST *prev = limbo->prev;
+			releaseBlock(listBlock(limbo));
+			limbo = prev;
+		}
+	}
+	dbg(PRINT_NOISE, "%s: Exit\n", __FUNCTION__);
+}
+
+#ifdef SLICED_HEAPWALK
+/**
+ * @brief Walks the heap holding the lists in slices of gWalkSliceNs at most.
+ *
+ * Runs the concurrent walk reading the lists in slices, see heapwalkConcurrent().
+ * Falls back to heapwalk() if the page of the slices can't be mapped.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walkAll A flag indicating whether to walk all allocations or only new ones.
+ */
+void heapwalkSliced(mqd_t mqsend, bool walkAll)
+{
+	if (NULL == gWalkPage)
+	{
+		gWalkPage = libc_mmap(NULL, WALK_SLICE_ENTRIES * sizeof(LISTxfer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == gWalkPage)
+		{
+			gWalkPage = NULL;
+			dbg(PRINT_ERROR, "%s: mmap of the slice page failed: %s. Walking holding the lists\n", __FUNCTION__, strerror(errno));
+			heapwalk(mqsend, walkAll);
+			return;
+		}
+	}
+	gWalkSliced = true;
+	heapwalkConcurrent(mqsend, walkAll);
+	gWalkSliced = false;
+}
+#endif
+#endif
+#elif defined(SIDE_TABLE)
+/**
+ * @brief Checks whether a copied side table entry is to be sent before another.
+ *
+ * Already walked entries are sent first, each in allocation order. seq wraps, therefore it
+ * only orders the entries of the same second.
+ */
+static bool sideTableBefore(const LIST *x, const LIST *y)
+{
+	if (x->walked != y->walked)
+	{
+		return x->walked > y->walked;
+	}
+	if (x->seconds != y->seconds)
+	{
+		return x->seconds < y->seconds;
+	}
+	return 0 > (int)(x->seq - y->seq);
+}
+
+/**
+ * @brief Sifts an entry down the heap of copied side table entries.
+ *
+ * @param entries The heap, the entry to be sent last at the root.
+ * @param root The index of the entry to be sifted.
+ * @param end The number of entries in the heap.
+ */
+static void sideTableSiftDown(LIST *entries, unsigned long root, unsigned long end)
+{
+	for (unsigned long child; (child = 2 * root + 1) < end; root = child)
+	{
+		if ((child + 1 < end) && sideTableBefore(&entries[child], &entries[child + 1]))
+		{
+			child++;
+		}
+		if (!sideTableBefore(&entries[root], &entries[child]))
+		{
+			return;
+		}
+		LIST tmp = entries[root];
+		entries[root] = entries[child];
+		entries[child] = tmp;
+	}
+}
+
+/**
+ * @brief Heap sorts the copied side table entries into the order to be sent.
+ *
+ * qsort isn't used since it may malloc, heapsort needs no memory.
+ *
+ * @param entries The entries to be sorted.
+ * @param count The number of entries.
+ */
+static void sideTableSort(LIST *entries, unsigned long count)
+{
+	for (unsigned long i = count / 2; i > 0; i--)
+	{
+		sideTableSiftDown(entries, i - 1, count);
+	}
+	for (unsigned long end = count; end > 1; end--)
+	{
+		LIST tmp = entries[0];
+		entries[0] = entries[end - 1];
+		entries[end - 1] = tmp;
+		sideTableSiftDown(entries, 0, end - 1);
+	}
+}
+
+/**
+ * @brief Sends a set of copied side table entries, an empty set as HEAPWALK_EMPTY.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param entries The entries to be sent.
+ * @param count The number of entries.
+ */
+static void sideTableSend(mqd_t mqsend, const LIST *entries, unsigned long count)
+{
+	msg_resp msgresp;
+
+	msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+	msgresp.totalHeapSize = totalHeapSize;
+	msgresp.totalOverhead = totalOverhead;
+	for (unsigned long i = 0; i < count; i++)
+	{
+		msgresp.xfer[msgresp.numItemOrInfo].ptr = entries[i].ptr;
+		msgresp.xfer[msgresp.numItemOrInfo].size = listSize(&entries[i]);
+		msgresp.xfer[msgresp.numItemOrInfo].ra = entries[i].ra;
+		msgresp.xfer[msgresp.numItemOrInfo].tid = entries[i].tid;
+		msgresp.xfer[msgresp.numItemOrInfo].seconds = entries[i].seconds;
+		msgresp.numItemOrInfo++;
+		if ((MAX_MSG_XFER <= msgresp.numItemOrInfo) || (i + 1 == count))
+		{
+			msgresp.numItemOrInfo |= (i + 1 < count) ? HEAPWALK_ITEM_CONTN : HEAPWALK_ENDOF_LIST;
+			walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+			msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+		}
+	}
+	if (0 == count)
+	{
+		walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+	}
+}
+
+/**
+ * @brief Walks the side table and transfers memory information to the message queue.
+ *
+ * The entries to be walked are copied into an mmap'd array and marked as walked, holding the shards.
+ * They are sorted and sent after releasing the shards, so that allocations wait only for the copy.
+ * With WALK_FILTER, only the entries matching the filter of the heapwalk are copied.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walkAll A flag indicating whether to walk all allocations or only new ones.
+ */
+void heapwalk(mqd_t mqsend, bool walkAll)
+{
+	unsigned long count = 0, n = 0, walked;
+	size_t mapSize = 0;
+	LIST *entries = NULL;
+
+	dbg(PRINT_NOISE, "%s: Enter\n", __FUNCTION__);
+	lockSideTable();
+	totalHeapSize = totalOverhead = 0;
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++)
+	{
+		totalHeapSize += gSideTable[i].heapSize;
+		totalOverhead += gSideTable[i].capacity * sizeof(LIST);
+		for (unsigned long j = 0; j < gSideTable[i].capacity; j++)
+		{
+			LIST *tmp = &gSideTable[i].slots[j];
+			if ((NULL != tmp->ptr) && (SIDE_TABLE_DELETED != tmp->ptr) && (walkAll || !tmp->walked))
+			{
+				count++;
+			}
+		}
+	}
+	if (count)
+	{
+		mapSize = count * sizeof(LIST);
+		entries = libc_mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == entries)
+		{
+			dbg(PRINT_ERROR, "%s: mmap for %lu entries failed: %s\n", __FUNCTION__, count, strerror(errno));
+			entries = NULL;
+			count = 0;
+		}
+	}
+	for (int i = 0; entries && (i < SIDE_TABLE_SHARDS); i++)
+	{
+		for (unsigned long j = 0; j < gSideTable[i].capacity; j++)
+		{
+			LIST *tmp = &gSideTable[i].slots[j];
+			if ((NULL != tmp->ptr) && (SIDE_TABLE_DELETED != tmp->ptr) && (walkAll || !tmp->walked))
+			{
+#ifdef WALK_FILTER
+				LISTxfer entry;
+				entry.ptr = tmp->ptr;
+				entry.size = listSize(tmp);
+				entry.ra = tmp->ra;
+				entry.tid = tmp->tid;
+				entry.seconds = tmp->seconds;
+				if (walkFilterMatch(&entry))
+#endif
+				{
+					entries[n++] = *tmp;
+				}
+				tmp->walked = 1;
+			}
+		}
+	}
+	unlockSideTable();
+	count = n; /* Entries matching the filter of the heapwalk */
+
+	sideTableSort(entries, count);
+	for (walked = 0; (walked < count) && entries[walked].walked; walked++)
+		;
+	if (walkAll)
+	{
+		sideTableSend(mqsend, entries, walked);
+	}
+	sideTableSend(mqsend, entries + walked, count - walked);
+	if (entries)
+	{
+		libc_munmap(entries, mapSize);
+	}
+	dbg(PRINT_NOISE, "%s: Exit\n", __FUNCTION__);
+}
+#elif defined(OPTIMIZE_MQ_TRANSFER)
+/**
+ * @brief Walks the heap and transfers memory information to the message queue.
+ *
+ * This function transfers information about heap allocations to the provided message queue descriptor.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ * @param walkAll A flag indicating whether to walk all allocations or only new ones.
+ */
+void heapwalk(mqd_t mqsend, bool walkAll)
+{
+	msg_resp msgresp;
+	LIST *tmp;
+
+	dbg(PRINT_NOISE, "%s: Enter\n", __FUNCTION__);
+	msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+	pthread_mutex_lock(&lock);
+	if (walkAll)
+	{
+#ifdef MAINTAIN_SINGLE_LIST
+		tmp = hpfmemhead;
+#else
+		tmp = wmemhead;
+#endif
+		if (NULL != tmp)
+		{
+			while (tmp)
+			{
+#ifdef MAINTAIN_SINGLE_LIST
+				if (tmp == hpwmemhead)
+				{
+					dbg(PRINT_NOISE, "%s: Breaking for processing new allocation\n", __FUNCTION__);
+					/* In case where there was no previous walk, then send full walk as empty and
+					 * then proceed with to be walked send */
+					if (hpwmemhead == hpfmemhead) {
+						msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+						walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+					}
+					break;
+				}
+#endif
+
+#ifdef PREPEND_LISTDATA
+				msgresp.xfer[msgresp.numItemOrInfo].flags = tmp->flags;
+#endif
+				msgresp.xfer[msgresp.numItemOrInfo].ptr = tmp->ptr;
+				msgresp.xfer[msgresp.numItemOrInfo].size = listSize(tmp);
+				msgresp.xfer[msgresp.numItemOrInfo].ra = tmp->ra;
+				msgresp.xfer[msgresp.numItemOrInfo].tid = tmp->tid;
+				msgresp.xfer[msgresp.numItemOrInfo].seconds = tmp->seconds;
+				msgresp.numItemOrInfo++;
+				if (MAX_MSG_XFER <= msgresp.numItemOrInfo)
+				{
+					if (tmp->next)
+					{
+						msgresp.numItemOrInfo |= HEAPWALK_ITEM_CONTN;
+					}
+					else
+					{ /* Set the end of list */
+						msgresp.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
+#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
+						msgresp.totalHeapSize = totalHeapSize;
+						msgresp.totalOverhead = totalOverhead;
+#endif
+					}
+					walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+					msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+				}
+				tmp = tmp->next;
+			}
+			if (msgresp.numItemOrInfo)
+			{
+				msgresp.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
+#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
+				msgresp.totalHeapSize = totalHeapSize;
+				msgresp.totalOverhead = totalOverhead;
+#endif
+				// TODO: for now send the full size. sync receiver to accept for lesser size
+				/* Send the message with the information collected */
+				walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+			}
+		}
+		else
+		{
+			// msgresp.numItemOrInfo = HEAPWALK_EMPTY; Initialized already
+			walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+		}
+	}
+
+	msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+#ifdef MAINTAIN_SINGLE_LIST
+	tmp = hpwmemhead;
+#else
+	tmp = memhead;
+#endif
+	if (NULL != tmp)
+	{
+		while (tmp)
+		{
+			// memcpy(((char*)msgresp.xfer + msgresp_xfer_index), tmp, sizeof(LISTxfer));
+#ifdef PREPEND_LISTDATA
+			msgresp.xfer[msgresp.numItemOrInfo].flags = tmp->flags;
+#endif
+			msgresp.xfer[msgresp.numItemOrInfo].ptr = tmp->ptr;
+			msgresp.xfer[msgresp.numItemOrInfo].size = listSize(tmp);
+			msgresp.xfer[msgresp.numItemOrInfo].ra = tmp->ra;
+			msgresp.xfer[msgresp.numItemOrInfo].tid = tmp->tid;
+			msgresp.xfer[msgresp.numItemOrInfo].seconds = tmp->seconds;
+			msgresp.numItemOrInfo++;
+			if (MAX_MSG_XFER <= msgresp.numItemOrInfo)
+			{
+				if (tmp->next)
+				{
+					msgresp.numItemOrInfo |= HEAPWALK_ITEM_CONTN;
+				}
+				else
+				{ // Set End of list
+					msgresp.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
+#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
+					msgresp.totalHeapSize = totalHeapSize;
+					msgresp.totalOverhead = totalOverhead;
+#endif
+				}
+				dbg(PRINT_NOISE, "%s: Sending %d items\n", __FUNCTION__, msgresp.numItemOrInfo);
+				walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+				msgresp.numItemOrInfo = 0;
+			}
+			// prev = tmp;
+			tmp = tmp->next;
+		}
+		if (msgresp.numItemOrInfo)
+		{
+			dbg(PRINT_NOISE, "%s: Sending final set of %d items\n", __FUNCTION__, msgresp.numItemOrInfo);
+			msgresp.numItemOrInfo |= HEAPWALK_ENDOF_LIST;
+#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
+			msgresp.totalHeapSize = totalHeapSize;
+			msgresp.totalOverhead = totalOverhead;
+#endif
+			// TODO: for now send the full size. sync receiver to accept for lesser size
+			walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+		}
+
+#ifdef MAINTAIN_SINGLE_LIST
+		hpwmemhead = NULL;
+#else
+		// if (prev)
+		{
+			if (wmemtail)
+			{
+				wmemtail->next = memhead;
+				// wmemtail = prev;
+#ifdef PREPEND_LISTDATA
+				if (memhead)
+				{
+					memhead->prev = wmemtail;
+				}
+#endif
+				if (memtail)
+				{
+					wmemtail = memtail;
+				}
+			}
+			else
+			{
+				wmemhead = memhead;
+				wmemtail = memtail;
+			}
+
+			memhead = memtail = NULL;
+		}
+#endif
+	}
+	else
+	{
+		dbg(PRINT_INFO, "No new allocations\n");
+#if defined(PREPEND_LISTDATA) && defined(ENABLE_STATISTICS)
+		msgresp.totalHeapSize = totalHeapSize;
+		msgresp.totalOverhead = totalOverhead;
+#endif
+		// msgresp.numItemOrInfo = HEAPWALK_EMPTY;
+		walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+	}
+	pthread_mutex_unlock(&lock);
+	dbg(PRINT_NOISE, "%s: Exit\n", __FUNCTION__);
+}
+#else /* else of #ifdef OPTIMIZE_MQ_TRANSFER */
+
+/**
+ * @brief Walks the heap and transfers memory information to the message queue.
+ *
+ * This function transfers information about heap allocations to the provided message queue descriptor.
+ *
+ * @param mqsend The message queue descriptor to which memory information will be sent.
+ */
+void heapwalk(mqd_t mqsend)
+{
+	msg_resp msgresp;
+	msgresp.seq = 1;
+
+	dbg(PRINT_NOISE, "%s: Enter\n", __FUNCTION__);
+	pthread_mutex_lock(&lock);
+#ifdef MAINTAIN_SINGLE_LIST
+	LIST *tmp = hpwmemhead;
+#else
+	LIST *tmp = memhead;
+#endif
+	if (NULL != tmp)
+	{
+		// LIST *prev = NULL;
+		while (tmp)
+		{
+#ifdef PREPEND_LISTDATA
+			snprintf(msgresp.msg, MQ_MSG_SIZE, "%p %zu %p %u %ld%s", tmp->ptr, listSize(tmp), tmp->ra, tmp->tid, tmp->seconds, (tmp->flags & 0x1) ? " - R" : "");
+#else
+			// snprintf(msgresp.msg, MQ_MSG_SIZE, "Ptr: %p size: %u ra: %p tid: %ld time: %ld",
+			snprintf(msgresp.msg, MQ_MSG_SIZE, "%p %zu %p %u %ld", tmp->ptr, listSize(tmp), tmp->ra, tmp->tid, tmp->seconds);
+#endif
+			walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+			msgresp.seq++;
+			// prev = tmp;
+			tmp = tmp->next;
+		}
+
+		/* Mark as walked allocation */
+#ifndef MAINTAIN_SINGLE_LIST
+		// if (prev)
+		{
+			if (wmemtail)
+			{
+				wmemtail->next = memhead;
+				// wmemtail = prev;
+#ifdef PREPEND_LISTDATA
+				if (memhead)
+				{
+					memhead->prev = wmemtail;
+				}
+#endif
+				if (memtail)
+				{
+					wmemtail = memtail;
+				}
+			}
+			else
+			{
+				wmemhead = memhead;
+				wmemtail = memtail;
+			}
+
+			// prev->next = wmemhead;
+			// wmemhead = memhead;
+			memhead = memtail = NULL;
+		}
+#else /* else of #ifndef MAINTAIN_SINGLE_LIST */
+		hpwmemhead = NULL;
+#endif
+	}
+	else
+	{
+		dbg(PRINT_INFO, "No new allocations\n");
+		snprintf(msgresp.msg, MQ_MSG_SIZE, "No new allocations");
+		walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+	}
+	dbg(PRINT_NOISE, "%s: Exit\n", __FUNCTION__);
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * @brief Walks the full heap and transfers memory information to the message queue.
+ *
+ * This function transfers information about all heap allocations to the provided message queue descriptor.
+ *
+ * @param mqsend The message queue descriptor to which full memory information will be sent.
+ */
+void heapwalk_full(mqd_t mqsend)
+{
+	msg_resp msgresp;
+	msgresp.seq = 0;
+	pthread_mutex_lock(&lock);
+	sprintf(msgresp.msg, "Already walked:");
+	walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+
+#ifdef MAINTAIN_SINGLE_LIST
+	LIST *tmp = hpfmemhead;
+#else
+	LIST *tmp = memhead;
+#endif
+	if (NULL != tmp)
+	{
+		while (tmp)
+		{
+#ifdef MAINTAIN_SINGLE_LIST
+			if (tmp == hpwmemhead)
+			{
+				sprintf(msgresp.msg, "New allocations:");
+				walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+				msgresp.seq = 0;
+			}
+#endif
+			msgresp.seq++;
+#ifdef PREPEND_LISTDATA
+			snprintf(msgresp.msg, MQ_MSG_SIZE, "%p %zu %p %u %ld%s", tmp->ptr, listSize(tmp), tmp->ra, tmp->tid, tmp->seconds, (tmp->flags & 0x1) ? " - R" : "");
+#else
+			snprintf(msgresp.msg, MQ_MSG_SIZE, "%p %zu %p %u %ld", tmp->ptr, listSize(tmp), tmp->ra, tmp->tid, tmp->seconds);
+#endif
+			walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+			tmp = tmp->next;
+		}
+	}
+#ifndef MAINTAIN_SINGLE_LIST
+	sprintf(msgresp.msg, "New allocations:");
+	walkSend(mqsend, (const char *)&msgresp, sizeof(msg_resp));
+	heapwalk(mqsend);
+#else
+	hpwmemhead = NULL;
+#endif
+	pthread_mutex_unlock(&lock);
+}
+#endif
+
+// TODO: not completed for prependITem to list and prepend list data combination
+#if !defined(MAINTAIN_SINGLE_LIST) && !defined(PREPEND_LISTDATA) // Available only for normal list allocation type
+/**
+ * @brief Prepends an item to the list of allocations.
+ *
+ * This function adds a new allocation item to the start of the allocation list.
+ *
+ * @param item The allocated memory pointer.
+ * @param size The size of the allocated memory.
+ * @param ra The return address where the allocation was made.
+ */
+void prependItemToList(void *item, size_t size, void *ra)
+{
+	LIST *tmp;
+	// pthread_mutex_lock(&lock);
+	if (0 < gMemInitialized)
+	{
+		tmp = (LIST *)libc_malloc(sizeof(LIST));
+	}
+	else
+	{
+		pthread_mutex_lock(&lock);
+		tmp = (LIST *)&gListInitialAlloc[gListInitIndex]; /* Aligned since not packed */
+		gListInitIndex += (sizeof(LIST)); //  + sizeof(LIST)%4);
+		pthread_mutex_unlock(&lock); /* Unlock mutex, Race condition if any will only affect the order */
+		if (G_INITIAL_LIST_ALLOC_SIZE <= gListInitIndex)
+		{
+			/* Using printf or any function that will allocate memory inside or any variable number of arg fns
+			Might get into loop and wait indefinetly on futex
+			OR might trigger recursion and end up stack full
+			*/
+			// dbg(PRINT_MUST, "%s:%s:!!!!!! INCREASE gListInitialAlloc[], size now is %ld\n", __FILE__, __FUNCTION__, (long int)G_INITIAL_LIST_ALLOC_SIZE);
+			fwrite(G_INITIAL_LIST_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_LIST_ALLOC_SIZE_ERROR), 1, stderr);
+			exit(1);
+		}
+	}
+	tmp->ptr = item;
+	listSetSize(tmp, size);
+	tmp->ra = ra;
+	tmp->tid = gettid();
+	tmp->seconds = time(NULL);
+
+	// dbg(PRINT_INFO, "%s: Prepend item %p\n", __FUNCTION__, item);
+	pthread_mutex_lock(&lock);
+	tmp->next = memhead;
+	if (NULL == memtail)
+		memtail = tmp;
+	memhead = tmp;
+	pthread_mutex_unlock(&lock);
+}
+#endif
+
+#if defined(SIDE_TABLE)
+/**
+ * @brief Adds an item to the side table.
+ *
+ * The item is left untracked when the shard couldn't grow.
+ *
+ * @param item The allocated memory pointer.
+ * @param size The size of the allocated memory.
+ * @param ra The return address where the allocation was made.
+ */
+void appendItemToList(void *item, size_t size, void *ra)
+{
+	unsigned long long hash = sideTableHash(item);
+	SIDETABLE *table = sideTableShard(hash);
+	time_t seconds = time(NULL);
+	unsigned int seq = __atomic_fetch_add(&gSideTableSeq, 1, __ATOMIC_RELAXED);
+	LIST *listPtr = NULL;
+
+	if (0 == tlsSideTableTid)
+	{
+		tlsSideTableTid = gettid();
+	}
+	pthread_mutex_lock(&table->lock);
+	if (((table->used + 1) * 4 > table->capacity * 3) && sideTableGrow(table))
+	{
+		pthread_mutex_unlock(&table->lock);
+		fwrite(SIDE_TABLE_GROW_ERROR, sizeof(SIDE_TABLE_GROW_ERROR), 1, stderr);
+		return;
+	}
+	unsigned long mask = table->capacity - 1;
+	for (unsigned long i = hash & mask;; i = (i + 1) & mask)
+	{
+		LIST *slot = &table->slots[i];
+		if (item == slot->ptr)
+		{ /* Free of the earlier block was missed */
+			table->heapSize -= listSize(slot);
+			listPtr = slot;
+			break;
+		}
+		if ((NULL == listPtr) && (SIDE_TABLE_DELETED == slot->ptr))
+		{
+			listPtr = slot;
+		}
+		else if (NULL == slot->ptr)
+		{
+			if (NULL == listPtr)
+			{
+				listPtr = slot;
+				table->used++;
+			}
+			break;
+		}
+	}
+	listPtr->ptr = item;
+	listSetSize(listPtr, size);
+	listPtr->walked = 0;
+	listPtr->ra = ra;
+	listPtr->tid = tlsSideTableTid;
+	listPtr->seq = seq;
+	listPtr->seconds = seconds;
+	table->heapSize += size;
+	pthread_mutex_unlock(&table->lock);
+}
+#else
+#ifdef SAMPLED_TRACKING
+/**
+ * @brief Marks the header of an untracked block, keeping only what free and realloc need.
+ *
+ * @param listPtr The CLIST or LIST of the block.
+ * @param size The size of the block.
+ * @param flags The flags indicating allocation type and alignment.
+ */
+static inline void listMarkUntracked(LIST *listPtr, size_t size, unsigned int flags)
+{
+	listPtr->flags = LIST_UNSAMPLED_MAGIC | flags;
+	listSetSize(listPtr, size);
+#ifdef COMPACT_LIST
+	if (flags & LIST_COMPACT)
+	{
+#ifdef TRACKING_PAUSE
+		/* The key of a paused block freed at the same pointer would be in this CLIST */
+		LIST_PAUSED_KEY((char *)listPtr + sizeof(CLIST)) = 0;
+#endif
+		return;
+	}
+	listPtr->tid = 0;
+#endif
+#ifdef TRACKING_PAUSE
+	listPtr->seconds = 0; /* Not a paused block, see LIST_PAUSED_KEY */
+#endif
+}
+#endif
+
+#ifndef PREPEND_LISTDATA
+/**
+ * @brief Appends an item to the list of allocations.
+ *
+ * This function adds a new allocation item to the end of the allocation list.
+ *
+ * @param item The allocated memory pointer.
+ * @param size The size of the allocated memory.
+ * @param ra The return address where the allocation was made.
+ */
+void appendItemToList(void *item, size_t size, void *ra)
+#else
+/**
+ * @brief Appends an item to the list of allocations (with flags).
+ *
+ * This function adds a new allocation item to the end of the allocation list and sets the flags.
+ *
+ * @param item The allocated memory pointer.
+ * @param size The size of the allocated memory.
+ * @param flags The flags indicating allocation type and alignment.
+ * @param ra The return address where the allocation was made.
+ */
+void appendItemToList(void *item, size_t size, unsigned int flags, void *ra)
+#endif
+{
+	LIST *listPtr;
+
+#ifndef PREPEND_LISTDATA
+	if (0 < gMemInitialized)
+	{
+		listPtr = (LIST *)libc_malloc(sizeof(LIST));
+	}
+	else
+	{
+		pthread_mutex_lock(&lock);
+		listPtr = (LIST *)&gListInitialAlloc[gListInitIndex];
+		gListInitIndex += (sizeof(LIST)); // + sizeof(LIST)%4);
+		// Unlock mutex here. If there is race condition, it'll only affect the order
+		pthread_mutex_unlock(&lock);
+		if (G_INITIAL_LIST_ALLOC_SIZE <= gListInitIndex)
+		{
+			// Using printf or any function that will allocate memory inside or any variable number of arg fns
+			// Might get into loop and wait indefinetly on futex
+			// OR might trigger recursion and end up stack full
+			// dbg(PRINT_MUST, "%s:%s:!!!!!! INCREASE gListInitialAlloc[], size now is %ld\n", __FILE__, __FUNCTION__, (long)G_INITIAL_LIST_ALLOC_SIZE);
+			fwrite(G_INITIAL_LIST_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_LIST_ALLOC_SIZE_ERROR), 1, stderr);
+			exit(1);
+		}
+	}
+	listPtr->ptr = item;
+#else
+#ifdef ALIGNED_TRAILER
+	if (flags & LIST_TRAILER)
+	{
+		listPtr = (LIST *)((char *)item + LIST_TRAILER_OFFSET(size));
+	}
+	else
+#endif
+	listPtr = (LIST *)((char *)item - LIST_HEADER_SIZE(flags));
+#ifdef SAMPLED_TRACKING
+	unsigned int level = __atomic_load_n(&gSampleLevel, __ATOMIC_RELAXED);
+#ifdef TRACKING_PAUSE
+	if (flags & LIST_UNTRACKED)
+	{
+		listMarkUntracked(listPtr, size, flags & ~LIST_UNTRACKED);
+		return;
+	}
+#endif
+	if (level && !sampleAllocation(size, level))
+	{ /* Untracked, keep only what free and realloc need */
+		listMarkUntracked(listPtr, size, flags);
+		return;
+	}
+#endif
+#ifdef STACK_DEPOT
+	void *frames[STACK_DEPOT_MAX_FRAMES];
+	unsigned int stack = stackDepotAdd(frames, stackCapture(ra, frames));
+#endif
+#ifdef SHARD_LIST
+	LISTSHARD *shard = getListShard();
+	listPtr->flags = 0xBEAD0000 | (unsigned int)((shard - gListShards) << LIST_SHARD_SHIFT) | flags;
+#ifdef SAMPLED_TRACKING
+	listPtr->flags |= level << LIST_SAMPLE_SHIFT;
+#endif
+#else
+	listPtr->flags = 0xBEAD0000 | flags;
+#endif
+	listPtr->prev = NULL;
+#endif
+	listSetSize(listPtr, size);
+#ifdef COMPACT_LIST
+	if (flags & LIST_COMPACT)
+	{
+		CLIST *citem = (CLIST *)listPtr;
+		citem->seconds = (unsigned int)time(NULL);
+		citem->thread = (unsigned short)tlsCompactThread;
+#ifdef STACK_DEPOT
+		citem->site = (unsigned short)stack;
+#else
+		citem->site = compactSite(ra);
+#endif
+	}
+	else
+#endif
+	{
+#ifdef PREPEND_LISTDATA
+		listPtr->ptr = item;
+#endif
+		listPtr->ra = ra;
+		listPtr->tid = gettid();
+#ifdef STACK_DEPOT
+		listPtr->stack = stack;
+#endif
+		listPtr->seconds = time(NULL);
+	}
+	listPtr->next = NULL;
+
+#if defined(SHARD_LIST)
+	pthread_mutex_lock(&shard->lock);
+	if (shard->tail)
+	{
+		listPtr->prev = shard->tail;
+		/* Publish the filled entry, a concurrent heapwalk reads next without the lock */
+		__atomic_store_n(&shard->tail->next, listPtr, __ATOMIC_RELEASE);
+		shard->tail = listPtr;
+		if (NULL == shard->whead)
+		{
+			shard->whead = listPtr;
+		}
+	}
+	else
+	{ // head should also be null
+		shard->head = shard->tail = shard->whead = listPtr;
+	}
+#ifdef CONCURRENT_HEAPWALK
+	if (__atomic_load_n(&gWalkActive, __ATOMIC_RELAXED) && (NULL == shard->wnext))
+	{
+		shard->wnext = listPtr;
+	}
+#endif
+#ifdef WALK_CHECKPOINTS
+	checkpointAdd(shard, listPtr);
+#endif
+#ifdef ENABLE_STATISTICS
+#ifdef SAMPLED_TRACKING
+	unsigned long bytes = sampleWeight(size, level);
+#else
+	unsigned long bytes = size;
+#endif
+	shard->heapSize += bytes;
+	shard->overhead += listOverhead(flags);
+#ifdef SITE_STATS
+	siteStatAlloc(shard, listSite(listPtr), bytes);
+#endif
+#endif
+#ifdef LARGE_REGISTRY
+	if (gLargeThreshold <= size)
+	{
+		largeAdd(listPtr);
+	}
+#endif
+#ifdef ADDRESS_INDEX
+	if (gAddressIndex)
+	{
+		addrIndexAdd(shard, item, listPtr);
+	}
+#endif
+	pthread_mutex_unlock(&shard->lock);
+#ifdef SAMPLED_TRACKING
+	if (gOverheadBudget && !(++tlsSampleTracked % SAMPLE_BUDGET_CHECK))
+	{
+		sampleAdapt();
+	}
+#endif
+#else /* else of #if defined(SHARD_LIST) */
+	pthread_mutex_lock(&lock);
+#ifdef MAINTAIN_SINGLE_LIST
+	if (hpfmemtail)
+	{
+		hpfmemtail->next = listPtr;
+#ifdef PREPEND_LISTDATA
+		listPtr->prev = hpfmemtail;
+#endif
+		hpfmemtail = listPtr;
+		if (NULL == hpwmemhead)
+		{
+			hpwmemhead = listPtr;
+		}
+	}
+	else
+	{ // head should also be null
+		hpfmemhead = hpfmemtail = hpwmemhead = listPtr;
+	}
+#else
+	if (memtail)
+	{
+		memtail->next = listPtr;
+#ifdef PREPEND_LISTDATA
+		listPtr->prev = memtail;
+#endif
+		memtail = listPtr;
+	}
+	else
+	{ // head should also be null
+		memhead = memtail = listPtr;
+	}
+
+	/*if (NULL == memhead){
+			memhead = listPtr;
+	}else {
+			LIST *trav = memhead->next;
+			LIST *prev = memhead;
+			while (trav){
+					prev = trav;
+					trav = trav->next;
+			}
+			prev->next = listPtr;
+	}*/
+#endif
+
+#ifdef ENABLE_STATISTICS
+	totalHeapSize += size;
+	if (2 > flags)
+	{
+		totalOverhead += sizeof(LIST);
+	}
+#endif
+	pthread_mutex_unlock(&lock);
+#endif /* End of #if defined(SHARD_LIST) */
+}
+#endif /* End of #if defined(SIDE_TABLE) */
+
+#ifdef PREPEND_LISTDATA
+/**
+ * @brief Sets the alignment value for a given alignment.
+ *
+ * This function calculates and sets the alignment value based on the given alignment.
+ *
+ * @param alignment The alignment value.
+ * @return The calculated alignment value.
+ */
+unsigned int setAlignment(unsigned int alignment)
+{
+	for (unsigned int i = 1; i <= 32; i++)
+	{
+		alignment = alignment >> 1;
+		if (!(alignment))
+		{
+			return i;
+		}
+	}
+	return 0;
+}
+
+/****
+ * if(alignment>sizeof LIST) then
+ * 	Ptr = Alloc'd Address + alignment;
+ * else if (modulus(sizeof(LIST), alignment) then
+ * 	Ptr = Alloc'd Addr + sizeof(LIST) + modulus(sizeof(LIST), alignment);
+ * else
+ * 	Ptr = Alloc'd Addr + sizeof(LIST)
+ ****/
+
+/**
+ * @brief Deletes an item from the list of allocations.
+ *
+ * This function removes an item from the list of allocations and adjusts pointers appropriately.
+ *
+ * @param item The item to be removed.
+ * @return The adjusted pointer.
+ */
+void *deleteItemFromList(void *item)
+{
+	void *ptr;
+	LIST *tmp = listHeader(item);
+#ifdef SAMPLED_TRACKING
+	bool tracked = (0xBEAD0000 == (tmp->flags & 0xFFFF0000));
+	if (tracked || (LIST_UNSAMPLED_MAGIC == (tmp->flags & 0xFFFF0000)))
+#else
+	if (0xBEAD0000 == (tmp->flags & 0xFFFF0000))
+#endif
+	{
+#ifdef ENABLE_STATISTICS
+		unsigned int overhead;
+#endif
+#ifdef SHARD_LIST
+		LISTSHARD *shard = &gListShards[(tmp->flags & LIST_SHARD_MASK) >> LIST_SHARD_SHIFT];
+		unsigned int flags = tmp->flags & LIST_TYPE_MASK;
+		/* Keep shard and type, a deferred free needs them after the walk */
+		tmp->flags = 0xDEAD0000 | (tmp->flags & 0xFFFF);
+#else
+		unsigned int flags = tmp->flags & 0xFFFF;
+		tmp->flags = 0xDEAD0000;
+#endif
+#ifdef COMPACT_LIST
+		if (flags & LIST_COMPACT)
+		{
+			ptr = (void *)tmp;
+#ifdef ENABLE_STATISTICS
+			overhead = sizeof(CLIST);
+#endif
+		}
+		else
+#endif
+#ifdef ALIGNED_TRAILER
+		if (flags & LIST_TRAILER)
+		{ /* The block is the pointer, no more to be found through the table */
+			ptr = item;
+			alignedRemove(item);
+#ifdef ENABLE_STATISTICS
+			overhead = sizeof(LIST);
+#endif
+		}
+		else
+#endif
+		if (2 > (flags & LIST_ALIGN_MASK))
+		{ // 0 --> malloc/calloc 1 --> realloc
+			ptr = (void *)tmp;
+#ifdef ENABLE_STATISTICS
+			overhead = sizeof(LIST);
+#endif
+		}
+		else
+		{
+			unsigned int alignment = 1 << ((flags & LIST_ALIGN_MASK) - 1);
+			if (alignment > sizeof(LIST))
+			{
+				ptr = (char *)item - alignment;
+#ifdef ENABLE_STATISTICS
+				overhead = alignment;
+#endif
+			}
+			else if ((sizeof(LIST) % alignment))
+			{
+				ptr = (char *)item - sizeof(LIST) - (sizeof(LIST) % alignment);
+#ifdef ENABLE_STATISTICS
+				overhead = sizeof(LIST) + (sizeof(LIST) % alignment);
+#endif
+			}
+			else
+			{
+				ptr = (char *)item - sizeof(LIST);
+#ifdef ENABLE_STATISTICS
+				overhead = sizeof(LIST);
+#endif
+			}
+		}
+#ifdef SAMPLED_TRACKING
+		if (!tracked)
+		{ /* Not in the list */
+			return ptr;
+		}
+#endif
+#ifdef SHARD_LIST
+		pthread_mutex_lock(&shard->lock);
+#else
+		pthread_mutex_lock(&lock);
+#endif
+#ifndef MAINTAIN_SINGLE_LIST
+		if (tmp->prev)
+		{
+			tmp->prev->next = tmp->next;
+			if (tmp->next)
+			{
+				tmp->next->prev = tmp->prev;
+			}
+			else
+			{
+				// this is the tail. Therefore update memtail or wmemtail
+				if (memtail == tmp)
+				{
+					memtail = tmp->prev;
+					if (memtail)
+					{
+						memtail->next = NULL;
+					}
+				}
+				else if (wmemtail == tmp)
+				{
+					wmemtail = tmp->prev;
+					if (wmemtail)
+					{
+						wmemtail->next = NULL;
+					}
+				}
+				else
+				{
+					ptr = NULL;
+					fwrite("deleteItemFromList:(w)memtail not matches\n", strlen("deleteItemFromList:(w)memtail not matches\n"), 1, stderr);
+				}
+			}
+		}
+		else
+		{
+			if (memhead == tmp)
+			{
+				if (memhead->next)
+				{
+					memhead = memhead->next;
+					memhead->prev = NULL;
+				}
+				else
+				{ // Only one item
+					memhead = memtail = NULL;
+				}
+			}
+			else if (wmemhead == tmp)
+			{
+				if (wmemhead->next)
+				{
+					wmemhead = wmemhead->next;
+					wmemhead->prev = NULL;
+				}
+				else
+				{ // Only one item
+					wmemhead = wmemtail = NULL;
+				}
+			}
+			else
+			{
+				ptr = NULL;
+				fwrite("deleteItemFromList:(w)memhead not matches\n", strlen("deleteItemFromList:(w)memhead not matches\n"), 1, stderr);
+			}
+		}
+#else /* else of ifndef MAINTAIN_SINGLE_LIST */
+#ifdef SHARD_LIST
+		LIST **head = &shard->head, **tail = &shard->tail, **whead = &shard->whead;
+#ifdef SNAPSHOT_HEAPWALK
+		if (shard->snapEnd == tmp)
+		{
+			shard->snapEnd = tmp->prev;
+		}
+#endif
+#ifdef CONCURRENT_HEAPWALK
+		if (shard->wnext == tmp)
+		{
+			shard->wnext = tmp->next;
+		}
+		if (shard->wend == tmp)
+		{
+			__atomic_store_n(&shard->wend, tmp->next, __ATOMIC_RELEASE);
+		}
+#endif
+#ifdef WALK_BOOKMARKS
+		bookmarkMove(shard, tmp, tmp->prev);
+#endif
+#ifdef WALK_CHECKPOINTS
+		checkpointMove(shard, tmp, listSeconds(tmp), tmp->next);
+#endif
+#else
+		LIST **head = &hpfmemhead, **tail = &hpfmemtail, **whead = &hpwmemhead;
+#endif
+		if (tmp->prev)
+		{ // This is not a head, so check for tail
+			__atomic_store_n(&tmp->prev->next, tmp->next, __ATOMIC_RELEASE);
+			if (tmp->next)
+			{ // This is not a tail, but still check for walked head
+				tmp->next->prev = tmp->prev;
+				if (*whead == tmp)
+				{
+					*whead = tmp->next;
+				}
+			}
+			else
+			{
+				// this is the tail. Therefore update tail
+				if (*tail == tmp)
+				{
+					*tail = tmp->prev;
+					if (*tail)
+					{
+						(*tail)->next = NULL;
+					}
+					else
+					{ // List empty..
+						*head = NULL;
+					}
+				}
+				else
+				{
+					ptr = NULL;
+					fwrite("deleteItemFromList:(w)memtail not matches\n", strlen("deleteItemFromList:(w)memtail not matches\n"), 1, stderr);
+				}
+				if (*whead == tmp)
+				{
+					*whead = NULL;
+				}
+			}
+		}
+		else
+		{ // This is the head
+			if (*head == tmp)
+			{
+				if ((*head)->next)
+				{ // More than 1 item
+					*head = (*head)->next;
+					(*head)->prev = NULL;
+				}
+				else
+				{ // Only one item
+					*head = *tail = NULL;
+				}
+			}
+			else
+			{
+				ptr = NULL;
+				fwrite("deleteItemFromList:(w)memhead not matches\n", strlen("deleteItemFromList:(w)memhead not matches\n"), 1, stderr);
+			}
+			if (*whead == tmp)
+			{
+				*whead = (*whead)->next;
+			}
+		}
+#endif /* End of ifndef MAINTAIN_SINGLE_LIST */
+
+#ifdef SHARD_LIST
+#ifdef ENABLE_STATISTICS
+#ifdef SAMPLED_TRACKING
+		unsigned long bytes = sampleWeight(listSize(tmp), (tmp->flags & LIST_SAMPLE_MASK) >> LIST_SAMPLE_SHIFT);
+#else
+		unsigned long bytes = listSize(tmp);
+#endif
+		shard->heapSize -= bytes;
+		shard->overhead -= overhead;
+#ifdef SITE_STATS
+		siteStatFree(shard, listSite(tmp), bytes);
+#endif
+#endif
+#ifdef LARGE_REGISTRY
+		if (largeMayHold(listSize(tmp)))
+		{
+			largeRemove(item);
+		}
+#endif
+#ifdef ADDRESS_INDEX
+		if (shard->addrRoot)
+		{
+			addrIndexRemove(shard, item);
+		}
+#endif
+#ifdef MIRROR_DELTAS
+		if (__atomic_load_n(&gMirrorsSet, __ATOMIC_RELAXED))
+		{
+			mirrorLog(shard, NULL, item);
+		}
+#endif
+		pthread_mutex_unlock(&shard->lock);
+#else
+#ifdef ENABLE_STATISTICS
+		totalHeapSize -= listSize(tmp); // Consider failed pointer size??
+		totalOverhead -= overhead;
+#endif
+		pthread_mutex_unlock(&lock);
+#endif
+	}
+	else
+	{ /* Allocate & return start of the pointer no matter if its corrupted or not */
+		fwrite("deleteItemFromList: Invalid ptr\n", strlen("deleteItemFromList: Invalid ptr\n"), 1, stderr);
+		// TODO: search through the list and see where this pointer falls
+		ptr = NULL;
+	}
+	return ptr;
+}
+
+#ifdef CONCURRENT_HEAPWALK
+/**
+ * @brief Frees a block whose entry is deleted from the list.
+ *
+ * A concurrent heapwalk may still be on the entry, so while a walk is active the block is
+ * kept in the limbo of its shard and free'd once the walk ends.
+ *
+ * @param ptr The start of the block, as returned by deleteItemFromList.
+ * @param item The deleted entry of the block.
+ */
+static void freeBlock(void *ptr, LIST *item)
+{
+	if (__atomic_load_n(&gWalkActive, __ATOMIC_SEQ_CST))
+	{
+		LISTSHARD *shard = &gListShards[(item->flags & LIST_SHARD_MASK) >> LIST_SHARD_SHIFT];
+		pthread_mutex_lock(&shard->lock);
+		/* Check again with the shard held, the walk drains the limbo holding it */
+		if (__atomic_load_n(&gWalkActive, __ATOMIC_RELAXED))
+		{
+			item->prev = shard->limbo;
+			shard->limbo = item;
+			pthread_mutex_unlock(&shard->lock);
+			return;
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+	releaseBlock(ptr);
+}
+#endif
+#elif defined(SIDE_TABLE)
+
+/**
+ * @brief Deletes an item from the side table.
+ *
+ * The slot is marked deleted, so that probing for the other entries continues over it.
+ *
+ * @param item The allocated memory pointer.
+ * @param size Set to the size of the allocation when found.
+ * @return 0 if successful; 1 if the item is not found.
+ */
+int deleteItemFromList(void *item, size_t *size)
+{
+	unsigned long long hash = sideTableHash(item);
+	SIDETABLE *table = sideTableShard(hash);
+	LIST *slot;
+
+	pthread_mutex_lock(&table->lock);
+	slot = sideTableFind(table, item, hash);
+	if (NULL == slot)
+	{
+		pthread_mutex_unlock(&table->lock);
+		return 1;
+	}
+	*size = listSize(slot);
+	table->heapSize -= listSize(slot);
+	slot->ptr = SIDE_TABLE_DELETED;
+	pthread_mutex_unlock(&table->lock);
+	return 0;
+}
+#else /* else of #ifdef PREPEND_LISTDATA */
+
+/**
+ * @brief Deletes an item from the list of allocations.
+ *
+ * This function removes an item from a doubly-linked list of allocations and adjusts pointers accordingly.
+ *
+ * @param list The head of the list from which the item should be removed.
+ * @param tail The tail of the list from which the item should be removed.
+ * @param item The item to be removed.
+ * @return 0 if successful; 1 if the item is not found.
+ */
+int deleteItemFromList(LIST **list, LIST **tail, void *item)
+{
+	int ret = 0;
+	dbg(PRINT_INFO, "deleteItemFromList: checking %p for item %p\n", list, item);
+	pthread_mutex_lock(&lock);
+	if (NULL != *list)
+	{
+		LIST *tmp = *list;
+
+		if (item != tmp->ptr)
+		{
+			LIST *prev;
+			while (NULL != tmp && item != tmp->ptr)
+			{
+				prev = tmp;
+				tmp = tmp->next;
+			}
+			if (NULL != tmp)
+			{
+				dbg(PRINT_INFO, "Removing %p, prev %p tmp %p\n", item, prev, tmp);
+				prev->next = tmp->next;
+				if (NULL == tmp->next)
+				{ // Last item, therefore adjust tail
+					*tail = prev;
+				}
+#ifdef MAINTAIN_SINGLE_LIST
+				if (tmp == hpwmemhead)
+				{
+					hpwmemhead = tmp->next;
+				}
+#endif
+				if ((gListInitialAlloc > (char *)tmp) ||
+					((char *)(gListInitialAlloc + G_INITIAL_LIST_ALLOC_SIZE) < (char *)tmp))
+				{
+					libc_free(tmp);
+				}
+			}
+			else
+			{
+				ret = 1;
+			}
+		}
+		else
+		{
+			/* Adjust the head/whead (first item) */
+#ifdef MAINTAIN_SINGLE_LIST
+			if (hpwmemhead == *list)
+			{
+				hpwmemhead = hpwmemhead->next;
+			}
+#endif
+			*list = (*list)->next;
+			if (NULL == *list)
+			{ /* Adjust tail (only one item) */
+				*tail = NULL;
+#ifdef MAINTAIN_SINGLE_LIST
+				dbg(PRINT_INFO, "%s: Only one item..[%p][%p][%p]\n", __FUNCTION__, hpfmemhead, hpwmemhead, hpfmemtail);
+				hpwmemhead = NULL;
+#else
+				dbg(PRINT_INFO, "%s: Only one item..[%p][%p][%p][%p]\n", __FUNCTION__, wmemhead, wmemtail, memhead, memtail);
+#endif
+			}
+			if ((gListInitialAlloc > (char *)tmp) ||
+				((char *)(gListInitialAlloc + G_INITIAL_LIST_ALLOC_SIZE) < (char *)tmp))
+				libc_free(tmp);
+		}
+	}
+	else
+	{
+		dbg(PRINT_INFO, "%s: List is null\n", __FUNCTION__);
+		ret = 1;
+	}
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+#endif
+
+/**
+ * @brief Allocates memory with tracking.
+ *
+ * This function allocates memory of the given size and tracks the allocation.
+ *
+ * @param __size The size of memory to be allocated.
+ * @param api LIST_CXX for operator new, else 0.
+ * @param ra The return address of the caller of the allocation function.
+ * @return The allocated memory pointer.
+ */
+static void *trackedAlloc(size_t __size, unsigned int api, void *ra)
+{
+	/* Track this */
+	void *p = NULL;
+#ifdef PREPEND_LISTDATA
+	unsigned int header = listHeaderFlags(__size) | api;
+	if (__size > SIZE_MAX - LIST_HEADER_SIZE(header))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	__size += LIST_HEADER_SIZE(header);
+#endif
+
+	if (0 < gMemInitialized)
+	{
+		p = libc_malloc_fnptr(__size);
+	}
+	else
+	{
+#ifndef SELF_TEST
+		if (-1 == gMemInitialized)
+		{
+			load_libc_functions(); /* Request to static buffer, Try once */
+		}
+#endif
+		p = bootstrapAlloc(__size, 0);
+	}
+	if (NULL == p)
+	{
+		return NULL;
+	}
+#ifdef PREPEND_LISTDATA
+	appendItemToList((char *)p + LIST_HEADER_SIZE(header), __size - LIST_HEADER_SIZE(header), header, ra);
+	return (void *)((char *)p + LIST_HEADER_SIZE(header));
+#else
+	// prependItemToList(p, __size, 0, ra);
+	appendItemToList(p, __size, ra);
+	return p;
+#endif
+}
+
+/**
+ * @brief Interposes malloc, allocating with the selected backend.
+ */
+__attribute__((visibility("default"))) void *malloc(size_t __size)
+{
+#ifdef TRACKING_PAUSE
+	if (__builtin_expect(gTrackingPaused, 0))
+	{
+		return pausedAlloc(__size, 0, NULL);
+	}
+#endif
+	return gBackend->alloc(__size, 0, __builtin_return_address(0));
+}
+
+/**
+ * @brief Allocates and clears memory with tracking.
+ *
+ * This function allocates memory for an array of the given number of elements, each of the given size,
+ * and initializes all bytes in the allocated memory to zero. The allocation is then tracked for debugging.
+ *
+ * @param __nmemb The number of elements to be allocated.
+ * @param __size The size of each element.
+ * @param ra The return address of the caller of calloc.
+ * @return The allocated and zero-initialized memory pointer.
+ */
+static void *trackedZalloc(size_t __nmemb, size_t __size, void *ra)
+{
+	// track me
+	void *p = NULL;
+#ifdef PREPEND_LISTDATA
+	if (__nmemb && (__size > (SIZE_MAX - sizeof(LIST)) / __nmemb))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	/* Adjust the LIST structure size, doesn't matter, whether 2 * 5 is allocated or 1 * 10 */
+	unsigned int header = listHeaderFlags(__nmemb * __size);
+	__size = (__nmemb * __size) + LIST_HEADER_SIZE(header);
+	__nmemb = 1;
+#endif
+
+	if (0 < gMemInitialized)
+	{
+		p = libc_calloc_fnptr(__nmemb, __size);
+	}
+	else
+	{
+#ifndef SELF_TEST
+		if (-1 == gMemInitialized)
+		{
+			load_libc_functions(); /* Request to static buffer, Try once */
+		}
+#endif
+		p = bootstrapAlloc(__size * __nmemb, 0);
+		if (p)
+		{
+			memset(p, 0, __nmemb * __size); /* Free'd blocks are reused */
+		}
+	}
+	if (NULL == p)
+	{
+		return NULL;
+	}
+#ifdef PREPEND_LISTDATA
+    /* Append item to the list and return adjusted pointer */
+	appendItemToList((char *)p + LIST_HEADER_SIZE(header), (__size - LIST_HEADER_SIZE(header)), header, ra);
+	return (void *)((char *)p + LIST_HEADER_SIZE(header));
+#else
+	// prependItemToList(p, __size*__nmemb, __nmemb, ra);
+	appendItemToList(p, __size * __nmemb, ra);
+	return p;
+#endif
+}
+
+/**
+ * @brief Interposes calloc, allocating with the selected backend.
+ */
+__attribute__((visibility("default"))) void *calloc(size_t __nmemb, size_t __size)
+{
+#ifdef TRACKING_PAUSE
+	if (__builtin_expect(gTrackingPaused, 0))
+	{
+		return pausedZalloc(__nmemb, __size, NULL);
+	}
+#endif
+	return gBackend->zalloc(__nmemb, __size, __builtin_return_address(0));
+}
+
+#ifdef INPLACE_REALLOC
+/**
+ * @brief Links an entry in place of another one, with the links of the other one. Call with the shard locked.
+ *
+ * @param shard The shard of the entries.
+ * @param item The entry replaced, not read as it may be free'd already.
+ * @param to The entry taking its place, prev and next set.
+ */
+static void listReplace(LISTSHARD *shard, const LIST *item, LIST *to)
+{
+	if (to->prev)
+	{
+		__atomic_store_n(&to->prev->next, to, __ATOMIC_RELEASE);
+	}
+	else
+	{
+		shard->head = to;
+	}
+	if (to->next)
+	{
+		to->next->prev = to;
+	}
+	else
+	{
+		shard->tail = to;
+	}
+	if (shard->whead == item)
+	{
+		shard->whead = to;
+	}
+#ifdef SNAPSHOT_HEAPWALK
+	if (shard->snapEnd == item)
+	{
+		shard->snapEnd = to;
+	}
+#endif
+#ifdef CONCURRENT_HEAPWALK
+	if (shard->wnext == item)
+	{
+		shard->wnext = to;
+	}
+	if (shard->wend == item)
+	{
+		shard->wend = to;
+	}
+#endif
+#ifdef WALK_BOOKMARKS
+	bookmarkMove(shard, item, to);
+#endif
+#ifdef WALK_CHECKPOINTS
+	checkpointMove(shard, item, listSeconds(to), to);
+#endif
+}
+
+/**
+ * @brief Reallocates a tracked block keeping the place of its entry in the list.
+ *
+ * The entry keeps its allocation time, thread and site, so that a chain of reallocs stays a single allocation.
+ * While libc reallocates, the shard isn't held and a copy of the header stands in the list for the entry,
+ * then the reallocated entry is linked in place of the copy. A compact block, at most gCompactListMaxSize,
+ * is reallocated holding the shard, as its copy wouldn't give its pointer. Untracked, sampled and aligned blocks,
+ * blocks of the bootstrap arena, blocks whose header changes and reallocs during a concurrent heapwalk
+ * are not done, and are left to the realloc that appends the entry again. A sampled block is so
+ * tracked by a sampling decision on its new size, whose weight free takes back.
+ *
+ * @param ptr The allocated pointer, not NULL.
+ * @param size The new size, not 0.
+ * @param done Set to true if the realloc is done, the return value being its result.
+ * @return The reallocated pointer, NULL if libc realloc failed and the block is left as it was.
+ */
+static void *reallocInList(void *ptr, size_t size, bool *done)
+{
+	LIST *item = listHeader(ptr);
+	unsigned int flags = item->flags;
+	unsigned int header = LIST_HEADER_SIZE(flags);
+	LISTSHARD *shard = &gListShards[(flags & LIST_SHARD_MASK) >> LIST_SHARD_SHIFT];
+	LIST copy, *entry = item, *moved;
+	bool unlocked = true, failed;
+
+	*done = false;
+	if ((0xBEAD0000 != (flags & 0xFFFF0000)) || ((flags & LIST_TYPE_MASK & ~1U) != listHeaderFlags(size)) || bootstrapContains(item))
+	{
+		return NULL;
+	}
+#ifdef SAMPLED_TRACKING
+	if (flags & LIST_SAMPLE_MASK)
+	{
+		return NULL;
+	}
+#endif
+#ifdef COMPACT_LIST
+	unlocked = !(flags & LIST_COMPACT);
+#endif
+	pthread_mutex_lock(&shard->lock);
+#ifdef CONCURRENT_HEAPWALK
+	/* A concurrent heapwalk takes each shard after setting gWalkActive, so it doesn't start with the shard held */
+	if (__atomic_load_n(&gWalkActive, __ATOMIC_SEQ_CST))
+	{
+		pthread_mutex_unlock(&shard->lock);
+		return NULL;
+	}
+#endif
+	*done = true;
+#ifdef ADDRESS_INDEX
+	if (shard->addrRoot)
+	{
+		addrIndexRemove(shard, ptr);
+	}
+#endif
+	if (unlocked)
+	{ /* The copy stands for the entry till it is back, the neighbours and the walks only see the copy */
+		memcpy(&copy, item, header);
+		entry = &copy;
+		listReplace(shard, item, entry);
+#ifdef CONCURRENT_HEAPWALK
+		shard->resizing++;
+#endif
+		pthread_mutex_unlock(&shard->lock);
+	}
+	moved = (LIST *)libc_realloc_fnptr(item, size + header);
+	if (unlocked)
+	{
+		pthread_mutex_lock(&shard->lock);
+#ifdef CONCURRENT_HEAPWALK
+		shard->resizing--;
+#endif
+		/* The links and the flags of the copy are the current ones */
+		memcpy((moved) ? moved : item, entry, header);
+	}
+	failed = (NULL == moved);
+	if (failed)
+	{ /* The block is left as it was */
+		moved = item;
+	}
+	if (unlocked || (moved != item))
+	{
+		listReplace(shard, entry, moved);
+#ifdef COMPACT_LIST
+		if (!(flags & LIST_COMPACT))
+#endif
+		{
+			moved->ptr = (char *)moved + header;
+		}
+	}
+#ifdef ADDRESS_INDEX
+	if (gAddressIndex)
+	{
+		addrIndexAdd(shard, (char *)moved + header, moved);
+	}
+#endif
+	if (failed)
+	{
+		pthread_mutex_unlock(&shard->lock);
+		return NULL;
+	}
+#ifdef MIRROR_DELTAS
+	if ((moved != item) && __atomic_load_n(&gMirrorsSet, __ATOMIC_RELAXED))
+	{
+		mirrorLog(shard, NULL, ptr);
+	}
+#endif
+#ifdef ENABLE_STATISTICS
+	shard->heapSize += size - listSize(moved);
+#ifdef SITE_STATS
+	siteStatResize(shard, listSite(moved), listSize(moved), size);
+#endif
+#endif
+#ifdef LARGE_REGISTRY
+	if (largeMayHold(listSize(moved)))
+	{
+		largeRemove(ptr);
+	}
+#endif
+	listSetSize(moved, size);
+	moved->flags |= 1; /* realloc */
+#ifdef LARGE_REGISTRY
+	if (gLargeThreshold <= size)
+	{
+		largeAdd(moved);
+	}
+#endif
+#ifdef MIRROR_DELTAS
+	if (__atomic_load_n(&gMirrorsSet, __ATOMIC_RELAXED))
+	{
+		mirrorLog(shard, moved, NULL);
+	}
+#endif
+	pthread_mutex_unlock(&shard->lock);
+	return (char *)moved + header;
+}
+#endif
+
+/**
+ * @brief Reallocates memory with tracking.
+ *
+ * This function reallocates memory to a new size and preserves the content up to the lesser of the old and new sizes.
+ * If the pointer is NULL, it behaves like malloc. The reallocation is then tracked for debugging.
+ *
+ * @param curPtr The current memory pointer to be reallocated.
+ * @param newSize The new size to allocate.
+ * @param ra The return address of the caller of realloc.
+ * @return The reallocated memory pointer.
+ */
+static void *trackedResize(void *curPtr, size_t newSize, void *ra)
+{
+	void *np;
+
+#ifdef INPLACE_REALLOC
+	if (curPtr && newSize && (0 < gMemInitialized))
+	{
+		bool done;
+		np = reallocInList(curPtr, newSize, &done);
+		if (done)
+		{
+			return np;
+		}
+	}
+#endif
+
+	/* check curPtr, it can be null, or pointer allocated earlier via malloc or calloc */
+	/* With SIDE_TABLE, the size is taken on delete, the table slot may not outlive it */
+#ifndef SIDE_TABLE
+	LIST *item = (curPtr) ? getItem(curPtr) : NULL;
+#endif
+	size_t size = 0;
+#ifdef PREPEND_LISTDATA
+	LIST *curItem = (curPtr) ? listHeader(curPtr) : NULL;
+	/* Header of the current and the new block, differing when the size crosses gCompactListMaxSize */
+	unsigned int curHeader = (curPtr) ? LIST_PREFIX_SIZE(curItem->flags) : 0;
+	unsigned int header = listHeaderFlags(newSize);
+#endif
+
+	if (NULL != curPtr)
+	{
+#ifdef PREPEND_LISTDATA
+		/* Increase this for realloc to copy the entire previously allocated buffer into newly allocated pointer
+		size += sizeof(LIST); */
+		size = curHeader;
+		if (NULL == (item = deleteItemFromList(curPtr)))
+#elif defined(SIDE_TABLE)
+		if (deleteItemFromList(curPtr, &size) && (0 < gMemInitialized))
+#elif MAINTAIN_SINGLE_LIST
+		if (deleteItemFromList(&hpfmemhead, &hpfmemtail, curPtr) && (0 < gMemInitialized))
+#else
+		if (deleteItemFromList(&wmemhead, &wmemtail, curPtr) && deleteItemFromList(&memhead, &memtail, curPtr) && (0 < gMemInitialized))
+#endif
+		{
+			dbg(PRINT_ERROR, "%s: Delete failed for %p, probably bug in list? corrupt?\n",
+				__FUNCTION__, curPtr);
+		}
+#ifdef PREPEND_LISTDATA
+		else
+		{ /* The block doesn't start with the LIST when aligned */
+			size += listSize(curItem);
+		}
+#elif !defined(SIDE_TABLE)
+		else
+		{
+			size += listSize(item);
+		}
+#endif
+	}
+	// else {
+	//	item = NULL;
+	// }
+
+	if (!newSize && curPtr)
+	{
+#ifdef PREPEND_LISTDATA
+		if (bootstrapContains(item) || (0 < gMemInitialized))
+		{
+#if defined(CONCURRENT_HEAPWALK)
+			freeBlock((void *)item, curItem);
+#else
+			releaseBlock((void *)item);
+#endif
+		}
+#else
+		if (bootstrapContains(curPtr) || (0 < gMemInitialized))
+		{
+			releaseBlock(curPtr);
+		}
+#endif
+		return NULL;
+	}
+#ifdef PREPEND_LISTDATA
+	newSize += LIST_HEADER_SIZE(header);
+	curPtr = (void *)item;
+#endif
+
+	if (0 < gMemInitialized)
+	{
+		/* During the previous allocation, since the start of the buffer was used for LIST, after reallocation, realloc is going to copy the whole
+		to the new buffer. Remember, we are going to give the newly allocated pointer + LIST size to the application.
+		Therefore there is no need to adjust the data before giving to realloc. */
+#ifdef PREPEND_LISTDATA
+		if (curPtr && ((curHeader != LIST_HEADER_SIZE(header)) || bootstrapContains(curPtr)
+#ifdef CONCURRENT_HEAPWALK
+					   /* libc realloc may free the block, while a concurrent heapwalk is still on its entry */
+					   || __atomic_load_n(&gWalkActive, __ATOMIC_SEQ_CST)
+#endif
+						   ))
+		{ /* Copy the data alone, the header may change its size and blocks of the bootstrap arena move to libc */
+			np = libc_malloc_fnptr(newSize);
+			if (np)
+			{
+				memcpy((char *)np + LIST_HEADER_SIZE(header), (char *)curPtr + curHeader,
+					   (size - curHeader < newSize - LIST_HEADER_SIZE(header)) ? size - curHeader : newSize - LIST_HEADER_SIZE(header));
+#ifdef CONCURRENT_HEAPWALK
+				freeBlock(curPtr, curItem);
+#else
+				releaseBlock(curPtr);
+#endif
+			}
+		}
+		else
+#else
+		if (curPtr && bootstrapContains(curPtr))
+		{ /* Blocks of the bootstrap arena move to libc */
+			np = libc_malloc_fnptr(newSize);
+			if (np)
+			{
+				memcpy(np, curPtr, (size < newSize) ? size : newSize);
+				bootstrapFree(curPtr);
+			}
+		}
+		else
+#endif
+		np = libc_realloc_fnptr(curPtr, newSize);
+	}
+	else
+	{
+#ifndef SELF_TEST
+		if (-1 == gMemInitialized)
+		{
+			load_libc_functions(); /* Request to static buffer, Try once */
+		}
+#endif
+		np = bootstrapAlloc(newSize, 0);
+		if (NULL != curPtr)
+		{
+#ifdef PREPEND_LISTDATA
+			memcpy((char *)np + LIST_HEADER_SIZE(header), (char *)curPtr + curHeader,
+				   (size - curHeader < newSize - LIST_HEADER_SIZE(header)) ? size - curHeader : newSize - LIST_HEADER_SIZE(header));
+#ifdef CONCURRENT_HEAPWALK
+			freeBlock(curPtr, curItem);
+#else
+			bootstrapFree(curPtr);
+#endif
+#else
+			memcpy(np, curPtr, (size < newSize) ? size : newSize);
+			bootstrapFree(curPtr);
+#endif
+		}
+	}
+#ifdef PREPEND_LISTDATA
+	appendItemToList((char *)np + LIST_HEADER_SIZE(header), newSize - LIST_HEADER_SIZE(header), 1 | header, ra);
+	return (void *)((char *)np + LIST_HEADER_SIZE(header));
+#else
+	// prependItemToList(np, totalsize, nmem, ra);
+	appendItemToList(np, newSize, ra);
+	return np;
+#endif
+}
+
+/**
+ * @brief Interposes realloc, reallocating with the selected backend.
+ */
+__attribute__((visibility("default"))) void *realloc(void *curPtr, size_t newSize)
+{
+	return gBackend->resize(curPtr, newSize, __builtin_return_address(0));
+}
+
+/**
+ * @brief Frees memory with tracking.
+ *
+ * This function frees the memory allocated and tracked earlier. It adjusts the tracking information accordingly.
+ *
+ * @param ptr The memory pointer to be freed.
+ */
+static void trackedRelease(void *ptr)
+{
+#ifdef PREPEND_LISTDATA
+	if (ptr)
+	{
+#ifdef CONCURRENT_HEAPWALK
+		LIST *item = listHeader(ptr);
+#endif
+		if (NULL == (ptr = deleteItemFromList(ptr)))
+		{
+			dbg(PRINT_ERROR, "%s: List Delete failed for %p list bug? corrupt pointer?\n", __FUNCTION__, ptr);
+		}
+		else if (bootstrapContains(ptr) || (0 < gMemInitialized))
+		{
+#ifdef CONCURRENT_HEAPWALK
+			freeBlock(ptr, item);
+#else
+			releaseBlock(ptr);
+#endif
+		}
+	}
+#elif defined(SIDE_TABLE)
+	size_t size;
+
+	if (ptr)
+	{
+		if (deleteItemFromList(ptr, &size) && (0 < gMemInitialized))
+		{
+			dbg(PRINT_ERROR, "%s: Side table delete failed for %p, corrupt pointer?\n", __FUNCTION__, ptr);
+		}
+		releaseBlock(ptr);
+	}
+#else
+#ifdef MAINTAIN_SINGLE_LIST
+	if (deleteItemFromList(&hpfmemhead, &hpfmemtail, ptr) && (0 < gMemInitialized))
+#else
+	if (deleteItemFromList(&wmemhead, &wmemtail, ptr) && deleteItemFromList(&memhead, &memtail, ptr) && (0 < gMemInitialized))
+#endif // #ifdef MAINTAIN_SINGLE_LIST
+	{
+		dbg(PRINT_ERROR, "%s: List Delete failed for %p list bug? corrupt pointer?\n", __FUNCTION__, ptr);
+	}
+	if (ptr != NULL)
+	{
+		releaseBlock(ptr);
+	}
+#endif
+}
+
+/**
+ * @brief Interposes free, freeing with the selected backend.
+ */
+__attribute__((visibility("default"))) void free(void *ptr)
+{
+#ifdef TRACKING_PAUSE
+	if (__builtin_expect(gTrackingPaused, 0))
+	{
+		pausedRelease(ptr);
+		return;
+	}
+#endif
+	gBackend->release(ptr);
+}
+
+#if defined(USE_DEPRECATED_MEMALIGN) || defined(__USE_ISOC11) || defined(__USE_XOPEN2K)
+/**
+ * @brief Common memory alignment function.
+ *
+ * This function handles different types of aligned memory allocations.
+ *
+ * @param type The type of alignment function to use (memalign, posix_memalign, or aligned_alloc).
+ * @param alignment The alignment value.
+ * @param size The size of memory to be allocated.
+ * @param api LIST_CXX for operator new, else 0.
+ * @param ra The return address of the caller of the allocation function.
+ * @return The aligned memory pointer.
+ */
+void *common_memalign(int type, size_t alignment, size_t size, unsigned int api, void *ra)
+{
+	// track me
+	void *p = NULL;
+#ifdef PREPEND_LISTDATA
+	if (LIST_MAX_ALIGNMENT < alignment)
+	{ /* Its log2 + 1 doesn't fit the type bits */
+		return NULL;
+	}
+	/* 2 challenges.
+	First, memalign'd address returns needs to hold LIST pointer as well, which is 32/64 bytes in 32-bit/64-bit compilers
+	Placing the LIST pointer at the beginning of the memalign'd address doesn't guarantee the asked alignment
+	Therefore to calculate the newSize, used the following formula
+	          if(alignment > sizeof(LIST)) then
+	              newSize = size + alignment;
+	          else
+	              newSize = size + sizeof(LIST) + modulus(sizeof(LIST),alignment);
+	Second, when this pointer comes for free'ng, need to get the item address in the list.
+	Free'ng pointer - sizeof LIST is used
+	         if (alignment > sizeof(LIST)) then
+	             Ptr = Alloc'd Address + alignment;
+	         else if (modulus(sizeof(LIST), alignment) then
+	             Ptr = Alloc'd Addr + sizeof(LIST) + modulus(sizeof(LIST), alignment);
+	         else
+	             Ptr = Alloc'd Addr + sizeof(LIST)
+	With ALIGNED_TRAILER, alignments beyond sizeof(LIST) keep the LIST after the block instead
+	          newSize = LIST_TRAILER_OFFSET(size) + sizeof(LIST);
+	          Ptr = Alloc'd Address;
+	*/
+	size_t newSize;
+	unsigned int flags = setAlignment(alignment) | api;
+#ifdef ALIGNED_TRAILER
+	if (sizeof(LIST) < alignment)
+	{
+		newSize = LIST_TRAILER_OFFSET(size) + sizeof(LIST);
+		flags |= LIST_TRAILER;
+	}
+	else
+#endif
+	if (sizeof(LIST) < alignment)
+	{
+		// TODO, will anyone ask for MAX size_t ??
+		newSize = size + alignment;
+	}
+	else
+	{
+		newSize = size + sizeof(LIST) + (sizeof(LIST) % alignment);
+	}
+#else
+	size_t newSize = size;
+#endif
+	if (0 < gMemInitialized)
+	{
+#if defined(USE_DEPRECATED_MEMALIGN)
+		if (1 == type)
+		{
+			p = libc_memalign_fnptr(alignment, newSize);
+		}
+#endif
+#if defined(__USE_ISOC11)
+		if (2 == type)
+		{
+			p = libc_aligned_alloc_fnptr(alignment, newSize);
+		}
+#endif
+#if defined(__USE_XOPEN2K)
+		if (3 == type)
+		{
+			if (0 != libc_posix_memalign_fnptr(&p, alignment, newSize))
+			{
+				p = NULL;
+			}
+		}
+#endif
+	}
+	else
+	{
+#ifndef SELF_TEST
+		if (-1 == gMemInitialized)
+		{
+			load_libc_functions(); /* Request to static buffer, Try once */
+		}
+#endif
+		// TODO: check if alignment is power of 2 as well as multiple of sizeof(void*)??. %%NOT IMPORTANT%%
+		p = bootstrapAlloc(newSize, alignment);
+	}
+#ifdef PREPEND_LISTDATA
+	char *ptr;
+	if (p)
+	{
+		ptr = (char *)p;
+#ifdef ALIGNED_TRAILER
+		if (flags & LIST_TRAILER)
+		{
+			if (alignedAdd(ptr, (LIST *)(ptr + LIST_TRAILER_OFFSET(size)), alignment))
+			{
+				releaseBlock(ptr);
+				return NULL;
+			}
+		}
+		else
+#endif
+		if (alignment > sizeof(LIST))
+		{
+			ptr = ptr + alignment;
+		}
+		else if ((sizeof(LIST) % alignment))
+		{
+			ptr = ptr + sizeof(LIST) + (sizeof(LIST) % alignment);
+		}
+		else
+		{
+			ptr = ptr + sizeof(LIST);
+		}
+	}
+	else
+	{
+		ptr = NULL;
+	}
+#if defined(ENABLE_STATISTICS) && !defined(SHARD_LIST) /* Shards account the overhead on append */
+	pthread_mutex_lock(&lock);
+	totalOverhead += (newSize - size);
+	pthread_mutex_unlock(&lock);
+#endif
+	if (ptr)
+	{
+		appendItemToList(ptr, size, flags, ra);
+	}
+	return ptr;
+#else
+	// prependItemToList(p, size, 0, __builtin_return_address(0));
+	appendItemToList(p, size, ra);
+	return p;
+#endif
+}
+#endif
+
+#if defined(USE_DEPRECATED_MEMALIGN)
+/**
+ * @brief Allocates aligned memory with tracking.
+ *
+ * This function allocates memory with the specified alignment and size, and tracks the allocation.
+ *
+ * @param alignment The alignment value.
+ * @param size The size of memory to be allocated.
+ * @return The aligned memory pointer.
+ */
+__attribute__((visibility("default"))) void *memalign(size_t alignment, size_t size)
+{
+	return gBackend->alignedAlloc(1, alignment, size, 0, __builtin_return_address(0));
+}
+#endif
+
+#if defined(__USE_ISOC11)
+/**
+ * @brief Allocates aligned memory with tracking (ISO C11).
+ *
+ * This function allocates memory with the specified alignment and size, and tracks the allocation.
+ *
+ * @param __alignment The alignment value.
+ * @param __size The size of memory to be allocated.
+ * @return The aligned memory pointer.
+ */
+__attribute__((visibility("default"))) void *aligned_alloc(size_t __alignment, size_t __size)
+{
+	return gBackend->alignedAlloc(2, __alignment, __size, 0, __builtin_return_address(0));
+}
+#endif
+
+#if defined(__USE_XOPEN2K)
+/**
+ * @brief Allocates aligned memory with tracking (POSIX).
+ *
+ * This function allocates memory with the specified alignment and size, and tracks the allocation.
+ *
+ * @param __memptr Pointer to the memory that will be allocated.
+ * @param __alignment The alignment value.
+ * @param __size The size of memory to be allocated.
+ * @return 0 if successful; error code otherwise.
+ */
+__attribute__((visibility("default"))) int posix_memalign(void **__memptr, size_t __alignment, size_t __size)
+{
+	if ((__alignment % sizeof(void *)) || (__alignment & (__alignment - 1)) || (0 == __alignment))
+	{
+		return EINVAL;
+	}
+	void *p = gBackend->alignedAlloc(3, __alignment, __size, 0, __builtin_return_address(0));
+	if (NULL == p)
+	{
+		return ENOMEM;
+	}
+	*__memptr = p;
+	return 0;
+}
+#endif
+
+#ifdef CXX_OPERATORS
+#define CXX_NEW_ERROR "operator new failed, no next operator new to throw bad_alloc\n"
+#define CXX_SIZE_MISMATCH_ERROR "sized operator delete, size differs from the allocation\n"
+
+STATIC unsigned long gCxxSizeMismatch;
+
+/**
+ * @brief Allocates for aligned operator new, marking the entry as a C++ allocation.
+ *
+ * Alignments up to malloc's are allocated as by operator new.
+ *
+ * @param size The size of memory to be allocated.
+ * @param alignment The alignment, a power of 2.
+ * @param ra The return address of the caller of operator new.
+ * @return The allocated memory pointer, NULL if the allocation failed.
+ */
+static void *cxxAlignedAlloc(size_t size, size_t alignment, void *ra)
+{
+	if (alignment <= __alignof__(LIST))
+	{
+		return gBackend->alloc(size, LIST_CXX, ra);
+	}
+#if defined(__USE_XOPEN2K)
+	return gBackend->alignedAlloc(3, alignment, size, LIST_CXX, ra);
+#else
+	return NULL; /* posix_memalign is not wrapped */
+#endif
+}
+
+/**
+ * @brief Hands a failed operator new to the next one, which calls the new handler, then throws bad_alloc
+ * or, for the nothrow ones, returns NULL.
+ *
+ * Blocks it allocates go through malloc, they are kept as C allocations.
+ *
+ * @param symbol The mangled name of the operator new.
+ * @param size The size of memory to be allocated.
+ * @param alignment The alignment of aligned operator new, else 0.
+ * @param nothrow The std::nothrow_t of nothrow operator new, else NULL.
+ * @return The memory pointer allocated by the next operator new, NULL for a nothrow one without a next one.
+ */
+static void *cxxNewFailed(const char *symbol, size_t size, size_t alignment, const void *nothrow)
+{
+	void *next = dlsym(RTLD_NEXT, symbol);
+
+	if (NULL == next)
+	{
+		if (nothrow)
+		{
+			return NULL;
+		}
+		fwrite(CXX_NEW_ERROR, sizeof(CXX_NEW_ERROR), 1, stderr);
+		abort();
+	}
+	if (nothrow)
+	{
+		if (alignment)
+		{
+			return ((void *(*)(size_t, size_t, const void *))next)(size, alignment, nothrow);
+		}
+		return ((void *(*)(size_t, const void *))next)(size, nothrow);
+	}
+	if (alignment)
+	{
+		return ((void *(*)(size_t, size_t))next)(size, alignment);
+	}
+	return ((void *(*)(size_t))next)(size);
+}
+
+/**
+ * @brief Frees for sized operator delete, counting a size that differs from the allocation with gCxxSizeCheck.
+ *
+ * @param ptr The memory pointer to be freed, may be NULL.
+ * @param size The size given to operator delete.
+ */
+static void trackedReleaseSized(void *ptr, size_t size)
+{
+	if (ptr && gCxxSizeCheck)
+	{
+		LIST *item = listHeader(ptr);
+		if ((0xBEAD0000 == (item->flags & 0xFFFF0000)) && (size != listSize(item)))
+		{
+			__atomic_fetch_add(&gCxxSizeMismatch, 1, __ATOMIC_RELAXED);
+			fwrite(CXX_SIZE_MISMATCH_ERROR, sizeof(CXX_SIZE_MISMATCH_ERROR), 1, stderr);
+		}
+	}
+	trackedRelease(ptr);
+}
+
+/**
+ * @brief Interposes operator new(size_t).
+ */
+__attribute__((visibility("default"))) void *operatorNew(size_t size)
+{
+	void *p = gBackend->alloc(size, LIST_CXX, __builtin_return_address(0));
+	return (p) ? p : cxxNewFailed("_Znw" CXX_SIZE_T, size, 0, NULL);
+}
+
+/**
+ * @brief Interposes operator new[](size_t).
+ */
+__attribute__((visibility("default"))) void *operatorNewArray(size_t size)
+{
+	void *p = gBackend->alloc(size, LIST_CXX, __builtin_return_address(0));
+	return (p) ? p : cxxNewFailed("_Zna" CXX_SIZE_T, size, 0, NULL);
+}
+
+/**
+ * @brief Interposes operator new(size_t, const std::nothrow_t &).
+ */
+__attribute__((visibility("default"))) void *operatorNewNothrow(size_t size, const void *nothrow)
+{
+	void *p = gBackend->alloc(size, LIST_CXX, __builtin_return_address(0));
+	return (p) ? p : cxxNewFailed("_Znw" CXX_SIZE_T CXX_NOTHROW, size, 0, nothrow);
+}
+
+/**
+ * @brief Interposes operator new[](size_t, const std::nothrow_t &).
+ */
+__attribute__((visibility("default"))) void *operatorNewArrayNothrow(size_t size, const void *nothrow)
+{
+	void *p = gBackend->alloc(size, LIST_CXX, __builtin_return_address(0));
+	return (p) ? p : cxxNewFailed("_Zna" CXX_SIZE_T CXX_NOTHROW, size, 0, nothrow);
+}
+
+/**
+ * @brief Interposes operator new(size_t, std::align_val_t).
+ */
+__attribute__((visibility("default"))) void *operatorNewAligned(size_t size, size_t alignment)
+{
+	void *p = cxxAlignedAlloc(size, alignment, __builtin_return_address(0));
+	return (p) ? p : cxxNewFailed("_Znw" CXX_SIZE_T CXX_ALIGN, size, alignment, NULL);
+}
+
+/**
+ * @brief Interposes operator new[](size_t, std::align_val_t).
+ */
+__attribute__((visibility("default"))) void *operatorNewArrayAligned(size_t size, size_t alignment)
+{
+	void *p = cxxAlignedAlloc(size, alignment, __builtin_return_address(0));
+	return (p) ? p : cxxNewFailed("_Zna" CXX_SIZE_T CXX_ALIGN, size, alignment, NULL);
+}
+
+/**
+ * @brief Interposes operator new(size_t, std::align_val_t, const std::nothrow_t &).
+ */
+__attribute__((visibility("default"))) void *operatorNewAlignedNothrow(size_t size, size_t alignment, const void *nothrow)
+{
+	void *p = cxxAlignedAlloc(size, alignment, __builtin_return_address(0));
+	return (p) ? p : cxxNewFailed("_Znw" CXX_SIZE_T CXX_ALIGN CXX_NOTHROW, size, alignment, nothrow);
+}
+
+/**
+ * @brief Interposes operator new[](size_t, std::align_val_t, const std::nothrow_t &).
+ */
+__attribute__((visibility("default"))) void *operatorNewArrayAlignedNothrow(size_t size, size_t alignment, const void *nothrow)
+{
+	void *p = cxxAlignedAlloc(size, alignment, __builtin_return_address(0));
+	return (p) ? p : cxxNewFailed("_Zna" CXX_SIZE_T CXX_ALIGN CXX_NOTHROW, size, alignment, nothrow);
+}
+
+/**
+ * @brief Interposes operator delete(void *).
+ */
+__attribute__((visibility("default"))) void operatorDelete(void *ptr)
+{
+	free(ptr);
+}
+
+/**
+ * @brief Interposes operator delete[](void *).
+ */
+__attribute__((visibility("default"))) void operatorDeleteArray(void *ptr)
+{
+	free(ptr);
+}
+
+/**
+ * @brief Interposes operator delete(void *, size_t).
+ */
+__attribute__((visibility("default"))) void operatorDeleteSized(void *ptr, size_t size)
+{
+	gBackend->releaseSized(ptr, size);
+}
+
+/**
+ * @brief Interposes operator delete[](void *, size_t).
+ */
+__attribute__((visibility("default"))) void operatorDeleteArraySized(void *ptr, size_t size)
+{
+	gBackend->releaseSized(ptr, size);
+}
+
+/**
+ * @brief Interposes operator delete(void *, const std::nothrow_t &).
+ */
+__attribute__((visibility("default"))) void operatorDeleteNothrow(void *ptr, const void *nothrow)
+{
+	free(ptr);
+}
+
+/**
+ * @brief Interposes operator delete[](void *, const std::nothrow_t &).
+ */
+__attribute__((visibility("default"))) void operatorDeleteArrayNothrow(void *ptr, const void *nothrow)
+{
+	free(ptr);
+}
+
+/**
+ * @brief Interposes operator delete(void *, std::align_val_t).
+ */
+__attribute__((visibility("default"))) void operatorDeleteAligned(void *ptr, size_t alignment)
+{
+	free(ptr);
+}
+
+/**
+ * @brief Interposes operator delete[](void *, std::align_val_t).
+ */
+__attribute__((visibility("default"))) void operatorDeleteArrayAligned(void *ptr, size_t alignment)
+{
+	free(ptr);
+}
+
+/**
+ * @brief Interposes operator delete(void *, size_t, std::align_val_t).
+ */
+__attribute__((visibility("default"))) void operatorDeleteSizedAligned(void *ptr, size_t size, size_t alignment)
+{
+	gBackend->releaseSized(ptr, size);
+}
+
+/**
+ * @brief Interposes operator delete[](void *, size_t, std::align_val_t).
+ */
+__attribute__((visibility("default"))) void operatorDeleteArraySizedAligned(void *ptr, size_t size, size_t alignment)
+{
+	gBackend->releaseSized(ptr, size);
+}
+
+/**
+ * @brief Interposes operator delete(void *, std::align_val_t, const std::nothrow_t &).
+ */
+__attribute__((visibility("default"))) void operatorDeleteAlignedNothrow(void *ptr, size_t alignment, const void *nothrow)
+{
+	free(ptr);
+}
+
+/**
+ * @brief Interposes operator delete[](void *, std::align_val_t, const std::nothrow_t &).
+ */
+__attribute__((visibility("default"))) void operatorDeleteArrayAlignedNothrow(void *ptr, size_t alignment, const void *nothrow)
+{
+	free(ptr);
+}
+#endif
+
+#ifdef MMAP_TRACKING
+/**
+ * @brief Rounds a length up to the pages mapped for it.
+ */
+static unsigned long mappingLength(size_t length)
+{
+	unsigned long page = getpagesize();
+	return (length + page - 1) & ~(page - 1);
+}
+
+/**
+ * @brief Finds the first tracked mapping ending after an address. Called with the table held.
+ *
+ * @param address The address.
+ * @return The index of the mapping, the number of mappings if there is none.
+ */
+static unsigned long mappingFind(unsigned long address)
+{
+	unsigned long low = 0, high = gMappingTable.count;
+	while (low < high)
 	{
-		dbg(PRINT_INFO, "%s: List is null\n", __FUNCTION__);
-		ret = 1;
+		unsigned long mid = low + (high - low) / 2;
+		if (gMappingTable.entries[mid].start + gMappingTable.entries[mid].size <= address)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
 	}
-	pthread_mutex_unlock(&lock);
-	return ret;
+	return low;
 }
-#endif
 
 /**
- * @brief Allocates memory with tracking.
+ * @brief Opens a slot at an index of the table, doubling the table when full. Called with the table held.
  *
- * This function allocates memory of the given size and tracks the allocation.
+ * Entries are mapped with libc_mmap, so that growing is neither tracked nor calls back into malloc.
  *
- * @param __size The size of memory to be allocated.
- * @return The allocated memory pointer.
+ * @param index The index of the slot, the mappings from it are moved up.
+ * @return 0 if successful; -1 if the table couldn't grow.
  */
-__attribute__((visibility("default"))) void *malloc(size_t __size)
+static int mappingOpenSlot(unsigned long index)
 {
-	/* Track this */
-	void *p = NULL;
-#ifdef PREPEND_LISTDATA
-	__size += sizeof(LIST);
-#endif
+	if (gMappingTable.count == gMappingTable.capacity)
+	{
+		unsigned long capacity = (gMappingTable.capacity) ? gMappingTable.capacity * 2 : MMAP_TRACKING_INITIAL_SLOTS;
+		MAPPING *entries = libc_mmap(NULL, capacity * sizeof(MAPPING), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == entries)
+		{
+			return -1;
+		}
+		if (gMappingTable.entries)
+		{
+			memcpy(entries, gMappingTable.entries, gMappingTable.count * sizeof(MAPPING));
+			libc_munmap(gMappingTable.entries, gMappingTable.capacity * sizeof(MAPPING));
+		}
+		gMappingTable.entries = entries;
+		gMappingTable.capacity = capacity;
+	}
+	memmove(&gMappingTable.entries[index + 1], &gMappingTable.entries[index], (gMappingTable.count - index) * sizeof(MAPPING));
+	gMappingTable.count++;
+	return 0;
+}
 
-	if (0 < gMemInitialized)
+/**
+ * @brief Trims a tracked mapping to a range of it, released bytes are kept up to its new size.
+ */
+static void mappingTrim(MAPPING *mapping, unsigned long start, unsigned long end)
+{
+	mapping->start = start;
+	mapping->size = end - start;
+	if (mapping->released > mapping->size)
 	{
-		p = libc_malloc_fnptr(__size);
+		mapping->released = mapping->size;
 	}
-	else
+}
+
+/**
+ * @brief Removes a range from the tracked mappings. Called with the table held.
+ *
+ * Mappings partly within the range are trimmed, a mapping beyond both ends of it is split in two.
+ *
+ * @param start The start of the range.
+ * @param end The end of the range.
+ */
+static void mappingRemove(unsigned long start, unsigned long end)
+{
+	unsigned long i = mappingFind(start);
+	while ((i < gMappingTable.count) && (gMappingTable.entries[i].start < end))
 	{
-		mapInitialMemory();
-#ifndef SELF_TEST
-		if (-1 == gMemInitialized)
+		MAPPING *mapping = &gMappingTable.entries[i];
+		unsigned long mappingEnd = mapping->start + mapping->size;
+		if (mapping->start < start)
 		{
-			load_libc_functions(); /* Request to static buffer, Try once */
+			if ((end < mappingEnd) && !mappingOpenSlot(i + 1))
+			{ /* The table may have moved */
+				gMappingTable.entries[i + 1] = gMappingTable.entries[i];
+				mappingTrim(&gMappingTable.entries[i + 1], end, mappingEnd);
+			}
+			mappingTrim(&gMappingTable.entries[i], gMappingTable.entries[i].start, start);
+			i++;
 		}
-#endif
-		pthread_mutex_lock(&lock);
-		p = (void *)&gInitialAlloc[gInitIndex];
-		// TODO: Optimize
-		if (__size % sizeof(void *))
+		else if (end < mappingEnd)
 		{
-			gInitIndex += (__size + (sizeof(void *) - __size % sizeof(void *)));
+			mappingTrim(mapping, end, mappingEnd);
+			break;
 		}
 		else
 		{
-			gInitIndex += (__size);
+			memmove(mapping, mapping + 1, (gMappingTable.count - i - 1) * sizeof(MAPPING));
+			gMappingTable.count--;
 		}
-		pthread_mutex_unlock(&lock);
-		if (G_INITIAL_ALLOC_SIZE <= gInitIndex)
+	}
+}
+
+/**
+ * @brief Adds a mapping to the table, in its address order. Called with the table held.
+ */
+static void mappingAdd(const MAPPING *mapping)
+{
+	unsigned long i = mappingFind(mapping->start);
+	if (!mappingOpenSlot(i))
+	{
+		gMappingTable.entries[i] = *mapping;
+	}
+}
+
+/**
+ * @brief Maps memory, tracking anonymous mappings.
+ *
+ * The table is held around the mmap, so that the mappings are updated in the order they are made.
+ * A mapping made over tracked ones (MAP_FIXED) replaces them.
+ */
+static void *trackedMap(void *addr, size_t length, int prot, int flags, int fd, off_t offset, void *ra)
+{
+	pthread_mutex_lock(&gMappingTable.lock);
+	void *ptr = libc_mmap(addr, length, prot, flags, fd, offset);
+	if (MAP_FAILED != ptr)
+	{
+		mappingRemove((unsigned long)ptr, (unsigned long)ptr + mappingLength(length));
+		if (flags & MAP_ANONYMOUS)
 		{
-			fwrite(G_INITIAL_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_ALLOC_SIZE_ERROR), 1, stderr);
-			abort();
+			MAPPING mapping = {(unsigned long)ptr, mappingLength(length), 0, ra, gettid(), time(NULL)};
+			mappingAdd(&mapping);
 		}
 	}
-	// TODO: NULL check is not done
-#ifdef PREPEND_LISTDATA
-	appendItemToList((char *)p + sizeof(LIST), __size - sizeof(LIST), 0, __builtin_return_address(0));
-	return (void *)((char *)p + sizeof(LIST));
-#else
-	// prependItemToList(p, __size, 0, __builtin_return_address(0));
-	appendItemToList(p, __size, __builtin_return_address(0));
-	return p;
-#endif
+	pthread_mutex_unlock(&gMappingTable.lock);
+	return ptr;
 }
 
 /**
- * @brief Allocates and clears memory with tracking.
- *
- * This function allocates memory for an array of the given number of elements, each of the given size,
- * and initializes all bytes in the allocated memory to zero. The allocation is then tracked for debugging.
- *
- * @param __nmemb The number of elements to be allocated.
- * @param __size The size of each element.
- * @return The allocated and zero-initialized memory pointer.
+ * @brief Interposes mmap, mapping with the selected backend.
  */
-__attribute__((visibility("default"))) void *calloc(size_t __nmemb, size_t __size)
+__attribute__((visibility("default"))) void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
 {
-	// track me
-	void *p = NULL;
-#ifdef PREPEND_LISTDATA
-	/* Adjust the LIST structure size, doesn't matter, whether 2 * 5 is allocated or 1 * 10 */
-	__size = (__nmemb * __size) + sizeof(LIST);
-	__nmemb = 1;
-#endif
+	return gBackend->map(addr, length, prot, flags, fd, offset, __builtin_return_address(0));
+}
 
-	if (0 < gMemInitialized)
+/**
+ * @brief Unmaps memory, removing the range from the tracked mappings.
+ */
+static int trackedUnmap(void *addr, size_t length)
+{
+	pthread_mutex_lock(&gMappingTable.lock);
+	int rc = libc_munmap(addr, length);
+	if (0 == rc)
 	{
-		p = libc_calloc_fnptr(__nmemb, __size);
+		mappingRemove((unsigned long)addr, (unsigned long)addr + mappingLength(length));
 	}
-	else
+	pthread_mutex_unlock(&gMappingTable.lock);
+	return rc;
+}
+
+/**
+ * @brief Interposes munmap, unmapping with the selected backend.
+ */
+__attribute__((visibility("default"))) int munmap(void *addr, size_t length)
+{
+	return gBackend->unmap(addr, length);
+}
+
+/**
+ * @brief Remaps memory, moving a tracked mapping to its new range.
+ *
+ * The mapping keeps its caller and time. An old size of 0 (a duplicate of a shared mapping)
+ * and MREMAP_DONTUNMAP leave the old range mapped.
+ *
+ * @param newAddress The address of MREMAP_FIXED, else NULL.
+ */
+static void *trackedRemap(void *oldAddress, size_t oldSize, size_t newSize, int flags, void *newAddress)
+{
+	pthread_mutex_lock(&gMappingTable.lock);
+	void *ptr = (libc_mremap_fnptr) ? libc_mremap_fnptr(oldAddress, oldSize, newSize, flags, newAddress) :
+			(void *)syscall(SYS_mremap, oldAddress, oldSize, newSize, flags, newAddress);
+	if (MAP_FAILED != ptr)
 	{
-		mapInitialMemory();
-#ifndef SELF_TEST
-		if (-1 == gMemInitialized)
-		{
-			load_libc_functions(); /* Request to static buffer, Try once */
-		}
+		unsigned long old = (unsigned long)oldAddress;
+		unsigned long i = mappingFind(old);
+		bool tracked = (i < gMappingTable.count) && (gMappingTable.entries[i].start <= old);
+		MAPPING mapping = (tracked) ? gMappingTable.entries[i] : (MAPPING){0};
+#ifdef MREMAP_DONTUNMAP
+		if (oldSize && !(flags & MREMAP_DONTUNMAP))
+#else
+		if (oldSize)
 #endif
-		pthread_mutex_lock(&lock);
-		p = &gInitialAlloc[gInitIndex];
-		// TODO: Optimize
-		if ((__size * __nmemb) % sizeof(void *))
 		{
-			gInitIndex += (__size * __nmemb + (sizeof(void *) - (__size * __nmemb) % sizeof(void *)));
+			mappingRemove(old, old + mappingLength(oldSize));
 		}
-		else
+		mappingRemove((unsigned long)ptr, (unsigned long)ptr + mappingLength(newSize));
+		if (tracked)
 		{
-			gInitIndex += (__size * __nmemb);
+			mappingTrim(&mapping, (unsigned long)ptr, (unsigned long)ptr + mappingLength(newSize));
+			mappingAdd(&mapping);
 		}
-		pthread_mutex_unlock(&lock);
+	}
+	pthread_mutex_unlock(&gMappingTable.lock);
+	return ptr;
+}
+
+/**
+ * @brief Interposes mremap, remapping with the selected backend.
+ */
+__attribute__((visibility("default"))) void *mremap(void *oldAddress, size_t oldSize, size_t newSize, int flags, ...)
+{
+	void *newAddress = NULL;
+	if (flags & MREMAP_FIXED)
+	{
+		va_list args;
+		va_start(args, flags);
+		newAddress = va_arg(args, void *);
+		va_end(args);
+	}
+	return gBackend->remap(oldAddress, oldSize, newSize, flags, newAddress);
+}
 
-		if (G_INITIAL_ALLOC_SIZE <= gInitIndex)
+/**
+ * @brief Advises on memory, counting the bytes of the tracked mappings given back by MADV_DONTNEED.
+ */
+static int trackedAdvise(void *addr, size_t length, int advice)
+{
+	int rc = (libc_madvise_fnptr) ? libc_madvise_fnptr(addr, length, advice) : syscall(SYS_madvise, addr, length, advice);
+	if ((0 == rc) && (MADV_DONTNEED == advice))
+	{
+		unsigned long start = (unsigned long)addr, end = start + mappingLength(length);
+		pthread_mutex_lock(&gMappingTable.lock);
+		for (unsigned long i = mappingFind(start); (i < gMappingTable.count) && (gMappingTable.entries[i].start < end); i++)
 		{
-			fwrite(G_INITIAL_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_ALLOC_SIZE_ERROR), 1, stderr);
-			abort();
+			MAPPING *mapping = &gMappingTable.entries[i];
+			unsigned long from = (mapping->start > start) ? mapping->start : start;
+			unsigned long to = (mapping->start + mapping->size < end) ? mapping->start + mapping->size : end;
+			mapping->released = (mapping->released + (to - from) < mapping->size) ? mapping->released + (to - from) : mapping->size;
 		}
-		memset(&gInitialAlloc[gInitIndex], 0, __nmemb * __size);
+		pthread_mutex_unlock(&gMappingTable.lock);
 	}
-#ifdef PREPEND_LISTDATA
-    /* Append item to the list and return adjusted pointer */
-	appendItemToList((char *)p + sizeof(LIST), (__size - sizeof(LIST)), 0, __builtin_return_address(0));
-	return (void *)((char *)p + sizeof(LIST));
-#else
-	// prependItemToList(p, __size*__nmemb, __nmemb, __builtin_return_address(0));
-	appendItemToList(p, __size * __nmemb, __builtin_return_address(0));
-	return p;
-#endif
+	return rc;
 }
 
 /**
- * @brief Reallocates memory with tracking.
+ * @brief Interposes madvise, advising with the selected backend.
+ */
+__attribute__((visibility("default"))) int madvise(void *addr, size_t length, int advice)
+{
+	return gBackend->advise(addr, length, advice);
+}
+
+#define MAPPING_MSG_SIZE(count) (offsetof(msg_mappings, mappings) + (count) * sizeof(MAPPING))
+
+/**
+ * @brief Sends the tracked mappings to the message queue, by address.
  *
- * This function reallocates memory to a new size and preserves the content up to the lesser of the old and new sizes.
- * If the pointer is NULL, it behaves like malloc. The reallocation is then tracked for debugging.
+ * The mappings are copied holding the table, and sent after releasing it.
+ * Sends HEAPWALK_EMPTY when there are no mappings, else the last message is flagged with HEAPWALK_ENDOF_LIST.
  *
- * @param curPtr The current memory pointer to be reallocated.
- * @param newSize The new size to allocate.
- * @return The reallocated memory pointer.
+ * @param mqsend The message queue descriptor to which the mappings will be sent.
  */
-__attribute__((visibility("default"))) void *realloc(void *curPtr, size_t newSize)
+void heapwalkMappings(mqd_t mqsend)
 {
-	void *np;
-
-	/* check curPtr, it can be null, or pointer allocated earlier via malloc or calloc */
-	LIST *item = (curPtr) ? getItem(curPtr) : NULL;
-	unsigned int size = 0;
+	msg_mappings msg;
+	MAPPING *entries = NULL;
+	unsigned long count;
 
-	if (NULL != curPtr)
+	pthread_mutex_lock(&gMappingTable.lock);
+	count = gMappingTable.count;
+	if (count)
 	{
-#ifdef PREPEND_LISTDATA
-		/* Increase this for realloc to copy the entire previously allocated buffer into newly allocated pointer
-		size += sizeof(LIST); */
-		size = sizeof(LIST);
-		if (NULL == (item = deleteItemFromList(curPtr)))
-#elif MAINTAIN_SINGLE_LIST
-		if (deleteItemFromList(&hpfmemhead, &hpfmemtail, curPtr) && (0 < gMemInitialized))
-#else
-		if (deleteItemFromList(&wmemhead, &wmemtail, curPtr) && deleteItemFromList(&memhead, &memtail, curPtr) && (0 < gMemInitialized))
-#endif
-		{
-			dbg(PRINT_ERROR, "%s: Delete failed for %p, probably bug in list? corrupt?\n",
-				__FUNCTION__, curPtr);
-		}
-		else
+		entries = libc_mmap(NULL, count * sizeof(MAPPING), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED != entries)
 		{
-			size += item->size;
+			memcpy(entries, gMappingTable.entries, count * sizeof(MAPPING));
 		}
 	}
-	// else {
-	//	item = NULL;
-	// }
+	pthread_mutex_unlock(&gMappingTable.lock);
 
-	if (!newSize && curPtr)
+	if (MAP_FAILED == entries)
+	{
+		dbg(PRINT_ERROR, "%s: mmap failed: %s\n", __FUNCTION__, strerror(errno));
+		entries = NULL;
+		count = 0;
+	}
+	msg.numItemOrInfo = HEAPWALK_EMPTY;
+	msg.totalHeapSize = totalHeapSize;
+	msg.totalOverhead = totalOverhead;
+	for (unsigned long i = 0; i < count; i++)
 	{
-		if ((0 < gMemInitialized) && ((gInitialAlloc > (char *)item) || ((char *)(gInitialAlloc + G_INITIAL_ALLOC_SIZE) < (char *)item)))
+		msg.mappings[msg.numItemOrInfo++] = entries[i];
+		if ((MAX_MAPPING_XFER <= msg.numItemOrInfo) || (i + 1 == count))
 		{
+			unsigned int items = msg.numItemOrInfo;
+			msg.numItemOrInfo |= (i + 1 < count) ? HEAPWALK_ITEM_CONTN : HEAPWALK_ENDOF_LIST;
+			walkSend(mqsend, (const char *)&msg, MAPPING_MSG_SIZE(items));
+			msg.numItemOrInfo = HEAPWALK_EMPTY;
+		}
+	}
+	if (0 == count)
+	{
+		walkSend(mqsend, (const char *)&msg, MAPPING_MSG_SIZE(0));
+	}
+	if (entries)
+	{
+		libc_munmap(entries, count * sizeof(MAPPING));
+	}
+}
+#endif
+
+/*
+ * Passthrough backend, MEMWRAP_BACKEND=none. The calls go to libc untracked, except for the blocks
+ * of the bootstrap arena, which were allocated and tracked before the backend was selected.
+ */
+
+/**
+ * @brief Returns the size of a tracked block.
+ */
+static size_t trackedSize(void *ptr)
+{
 #ifdef PREPEND_LISTDATA
-			libc_free_fnptr((void *)item);
+	return listSize(listHeader(ptr));
 #else
-			libc_free_fnptr(curPtr);
+	LIST *item = getItem(ptr);
+	return (item) ? listSize(item) : 0;
 #endif
-		}
+}
+
+static void *passAlloc(size_t size, unsigned int api, void *ra)
+{
+	return libc_malloc_fnptr(size);
+}
+
+static void *passZalloc(size_t nmemb, size_t size, void *ra)
+{
+	return libc_calloc_fnptr(nmemb, size);
+}
+
+/**
+ * @brief Reallocates with libc, moving blocks of the bootstrap arena to libc.
+ */
+static void *passResize(void *ptr, size_t size, void *ra)
+{
+	if (!bootstrapContains(ptr))
+	{
+		return libc_realloc_fnptr(ptr, size);
+	}
+	if (0 == size)
+	{
+		trackedRelease(ptr);
 		return NULL;
 	}
-#ifdef PREPEND_LISTDATA
-	newSize += sizeof(LIST);
-	curPtr = (void *)item;
-#endif
+	void *np = libc_malloc_fnptr(size);
+	if (np)
+	{
+		size_t oldSize = trackedSize(ptr);
+		memcpy(np, ptr, (oldSize < size) ? oldSize : size);
+		trackedRelease(ptr);
+	}
+	return np;
+}
 
-	// TODO: To be moved to general heap if initialized, see if curPtr allocated from gInitialAlloc..
-	if ((0 < gMemInitialized) && ((NULL == curPtr) || (gInitialAlloc > (char *)curPtr) ||
-								  ((char *)(gInitialAlloc + G_INITIAL_ALLOC_SIZE) < (char *)curPtr)))
+static void passRelease(void *ptr)
+{
+	if (bootstrapContains(ptr))
 	{
-		/* During the previous allocation, since the start of the buffer was used for LIST, after reallocation, realloc is going to copy the whole
-		to the new buffer. Remember, we are going to give the newly allocated pointer + LIST size to the application.
-		Therefore there is no need to adjust the data before giving to realloc. */
-		np = libc_realloc_fnptr(curPtr, newSize);
+		trackedRelease(ptr);
 	}
 	else
 	{
-		mapInitialMemory();
-#ifndef SELF_TEST
-		if (-1 == gMemInitialized)
-		{
-			load_libc_functions(); /* Request to static buffer, Try once */
-		}
+		libc_free_fnptr(ptr);
+	}
+}
+
+#if defined(USE_DEPRECATED_MEMALIGN) || defined(__USE_ISOC11) || defined(__USE_XOPEN2K)
+static void *passAlignedAlloc(int type, size_t alignment, size_t size, unsigned int api, void *ra)
+{
+	void *p = NULL;
+#if defined(USE_DEPRECATED_MEMALIGN)
+	if (1 == type)
+	{
+		p = libc_memalign_fnptr(alignment, size);
+	}
 #endif
-		pthread_mutex_lock(&lock);
-		np = (void *)&gInitialAlloc[gInitIndex];
-		if (newSize % sizeof(void *))
-		{
-			gInitIndex += (newSize + sizeof(void *) - (newSize % sizeof(void *)));
-		}
-		else
-		{
-			gInitIndex += newSize;
-		}
-		pthread_mutex_unlock(&lock);
-		if (G_INITIAL_ALLOC_SIZE <= gInitIndex)
-		{
-			fwrite(G_INITIAL_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_ALLOC_SIZE_ERROR), 1, stderr);
-			abort();
-		}
-		if (NULL != curPtr)
-		{
-			memcpy(np, curPtr, size); // FIXME: see if size needs to be checked..
-		}
+#if defined(__USE_ISOC11)
+	if (2 == type)
+	{
+		p = libc_aligned_alloc_fnptr(alignment, size);
+	}
+#endif
+#if defined(__USE_XOPEN2K)
+	if ((3 == type) && (0 != libc_posix_memalign_fnptr(&p, alignment, size)))
+	{
+		p = NULL;
 	}
-#ifdef PREPEND_LISTDATA
-	appendItemToList((char *)np + sizeof(LIST), newSize - sizeof(LIST), 1, __builtin_return_address(0));
-	return (void *)((char *)np + sizeof(LIST));
-#else
-	// prependItemToList(np, totalsize, nmem, __builtin_return_address(0));
-	appendItemToList(np, newSize, __builtin_return_address(0));
-	return np;
 #endif
+	return p;
 }
+#endif
 
-/**
- * @brief Frees memory with tracking.
- *
- * This function frees the memory allocated and tracked earlier. It adjusts the tracking information accordingly.
- *
- * @param ptr The memory pointer to be freed.
+#ifdef CXX_OPERATORS
+static void passReleaseSized(void *ptr, size_t size)
+{
+	passRelease(ptr);
+}
+#endif
+
+#ifdef MMAP_TRACKING
+static void *passMap(void *addr, size_t length, int prot, int flags, int fd, off_t offset, void *ra)
+{
+	return libc_mmap(addr, length, prot, flags, fd, offset);
+}
+
+static void *passRemap(void *oldAddress, size_t oldSize, size_t newSize, int flags, void *newAddress)
+{
+	return (libc_mremap_fnptr) ? libc_mremap_fnptr(oldAddress, oldSize, newSize, flags, newAddress) :
+			(void *)syscall(SYS_mremap, oldAddress, oldSize, newSize, flags, newAddress);
+}
+
+static int passAdvise(void *addr, size_t length, int advice)
+{
+	return (libc_madvise_fnptr) ? libc_madvise_fnptr(addr, length, advice) : syscall(SYS_madvise, addr, length, advice);
+}
+#endif
+
+#ifdef TRACKING_PAUSE
+/*
+ * Paused backend, HEAPWALK_PAUSE or MEMWRAP_BACKEND=paused. Blocks are allocated by libc with the LIST of an
+ * unsampled block and no list work, so that the tracked backend frees and reallocs them once resumed.
+ * malloc, calloc and free call it directly while gTrackingPaused is set. A paused block always has a LIST,
+ * never a CLIST, with its LIST_PAUSED_KEY, so free recognizes it with one read and frees it straight to libc.
+ * Any other block goes through listHeader: untracked blocks are freed to libc, the others by the tracked backend.
  */
-__attribute__((visibility("default"))) void free(void *ptr)
+
+/* The key can be read before any block only if seconds ends the LIST within the chunk header of libc */
+#define PAUSED_KEY_READABLE (offsetof(LIST, seconds) >= sizeof(LIST) - 2 * sizeof(size_t))
+
+static void *pausedAlloc(size_t size, unsigned int api, void *ra)
 {
-#ifdef PREPEND_LISTDATA
-	if (ptr)
+	if (size > SIZE_MAX - sizeof(LIST))
 	{
-		if (NULL == (ptr = deleteItemFromList(ptr)))
-		{
-			dbg(PRINT_ERROR, "%s: List Delete failed for %p list bug? corrupt pointer?\n", __FUNCTION__, ptr);
-		}
-		else if ((0 < gMemInitialized) && ((gInitialAlloc > (char *)ptr) || ((char *)(gInitialAlloc + G_INITIAL_ALLOC_SIZE) < (char *)ptr)))
-		{
-			libc_free_fnptr(ptr);
-		}
+		errno = ENOMEM;
+		return NULL;
 	}
-#else
-#ifdef MAINTAIN_SINGLE_LIST
-	if (deleteItemFromList(&hpfmemhead, &hpfmemtail, ptr) && (0 < gMemInitialized))
-#else
-	if (deleteItemFromList(&wmemhead, &wmemtail, ptr) && deleteItemFromList(&memhead, &memtail, ptr) && (0 < gMemInitialized))
-#endif // #ifdef MAINTAIN_SINGLE_LIST
+	LIST *item = (LIST *)libc_malloc_fnptr(size + sizeof(LIST));
+
+	if (NULL == item)
 	{
-		dbg(PRINT_ERROR, "%s: List Delete failed for %p list bug? corrupt pointer?\n", __FUNCTION__, ptr);
+		return NULL;
+	}
+	item->flags = LIST_UNSAMPLED_MAGIC | api;
+	listSetSize(item, size);
+	item->tid = 0;
+	LIST_PAUSED_KEY(item + 1) = LIST_PAUSED_KEY_OF(item + 1);
+	return item + 1;
+}
+
+static void *pausedZalloc(size_t nmemb, size_t size, void *ra)
+{
+	if (nmemb && (size > (SIZE_MAX - sizeof(LIST)) / nmemb))
+	{
+		errno = ENOMEM;
+		return NULL;
 	}
-	if ((ptr != NULL) && ((gInitialAlloc > (char *)ptr) || ((char *)(gInitialAlloc + G_INITIAL_ALLOC_SIZE) < (char *)ptr)))
+	LIST *item = (LIST *)libc_calloc_fnptr(1, nmemb * size + sizeof(LIST));
+
+	if (NULL == item)
 	{
-		libc_free_fnptr(ptr);
+		return NULL;
 	}
-#endif
+	item->flags = LIST_UNSAMPLED_MAGIC;
+	listSetSize(item, nmemb * size);
+	LIST_PAUSED_KEY(item + 1) = LIST_PAUSED_KEY_OF(item + 1);
+	return item + 1;
 }
 
-#if defined(USE_DEPRECATED_MEMALIGN) || defined(__USE_ISOC11) || defined(__USE_XOPEN2K)
 /**
- * @brief Common memory alignment function.
- *
- * This function handles different types of aligned memory allocations.
- *
- * @param type The type of alignment function to use (memalign, posix_memalign, or aligned_alloc).
- * @param alignment The alignment value.
- * @param size The size of memory to be allocated.
- * @return The aligned memory pointer.
+ * @brief Frees a paused or an untracked block straight to libc, any other block through the tracked backend.
  */
-void *common_memalign(int type, size_t alignment, size_t size)
+static void pausedRelease(void *ptr)
 {
-	// track me
-	void *p = NULL;
-#ifdef PREPEND_LISTDATA
-	/* 2 challenges.
-	First, memalign'd address returns needs to hold LIST pointer as well, which is 32/64 bytes in 32-bit/64-bit compilers
-	Placing the LIST pointer at the beginning of the memalign'd address doesn't guarantee the asked alignment
-	Therefore to calculate the newSize, used the following formula
-	          if(alignment > sizeof(LIST)) then
-	              newSize = size + alignment;
-	          else
-	              newSize = size + sizeof(LIST) + modulus(sizeof(LIST),alignment);
-	Second, when this pointer comes for free'ng, need to get the item address in the list.
-	Free'ng pointer - sizeof LIST is used
-	         if (alignment > sizeof(LIST)) then
-	             Ptr = Alloc'd Address + alignment;
-	         else if (modulus(sizeof(LIST), alignment) then
-	             Ptr = Alloc'd Addr + sizeof(LIST) + modulus(sizeof(LIST), alignment);
-	         else
-	             Ptr = Alloc'd Addr + sizeof(LIST)
-	*/
-	size_t newSize;
-	if (sizeof(LIST) < alignment)
-	{
-		// TODO, will anyone ask for MAX size_t ??
-		newSize = size + alignment;
-	}
-	else
+	LIST *item;
+
+	if (PAUSED_KEY_READABLE && ptr && (LIST_PAUSED_KEY(ptr) == LIST_PAUSED_KEY_OF(ptr)))
 	{
-		newSize = size + sizeof(LIST) + (sizeof(LIST) % alignment);
+		item = (LIST *)ptr - 1;
+		item->flags = 0xDEAD0000;
+		item->seconds = 0;
+		libc_free_fnptr(item);
+		return;
 	}
-#else
-	size_t newSize = size;
+	item = (ptr) ? listHeader(ptr) : NULL;
+	if (item && (LIST_UNSAMPLED_MAGIC == (item->flags & 0xFFFF0000)) && (2 > (item->flags & LIST_ALIGN_MASK)) &&
+#ifdef ALIGNED_TRAILER
+		!(item->flags & LIST_TRAILER) &&
 #endif
-	if (0 < gMemInitialized)
+		!bootstrapContains(item))
 	{
-#if defined(USE_DEPRECATED_MEMALIGN)
-		if (1 == type)
-		{
-			p = libc_memalign_fnptr(alignment, newSize);
-		}
-#endif
-#if defined(__USE_ISOC11)
-		if (2 == type)
-		{
-			p = libc_aligned_alloc_fnptr(alignment, newSize);
-		}
-#endif
-#if defined(__USE_XOPEN2K)
-		if (3 == type)
-		{
-			if (0 != libc_posix_memalign_fnptr(&p, alignment, newSize))
-			{
-				p = NULL;
-			}
-		}
-#endif
+		item->flags = 0xDEAD0000;
+		libc_free_fnptr(item);
+		return;
 	}
-	else
+	trackedRelease(ptr);
+}
+
+/**
+ * @brief Reallocates untracked, resizing a paused block in place.
+ *
+ * Any other block is copied to a paused block.
+ */
+static void *pausedResize(void *ptr, size_t size, void *ra)
+{
+	if (ptr && !size)
 	{
-		mapInitialMemory();
-#ifndef SELF_TEST
-		if (-1 == gMemInitialized)
-		{
-			load_libc_functions(); /* Request to static buffer, Try once */
-		}
-#endif
-		pthread_mutex_lock(&lock);
-		/* If gInitIndex == alignment, then below will unnecessarily add alignment. But that is rare */
-		gInitIndex = gInitIndex + alignment - (gInitIndex % alignment);
-		p = &gInitialAlloc[gInitIndex];
-		// TODO: check if alignment is power of 2 as well as multiple of sizeof(void*)??. %%NOT IMPORTANT%%
-		if (newSize % sizeof(void *))
-		{
-			gInitIndex += (newSize + (sizeof(void *) - newSize % sizeof(void *)));
-		}
-		else
-		{
-			gInitIndex += (newSize);
-		}
-		pthread_mutex_unlock(&lock);
-		if (G_INITIAL_ALLOC_SIZE <= gInitIndex)
-		{
-			fwrite(G_INITIAL_ALLOC_SIZE_ERROR, sizeof(G_INITIAL_ALLOC_SIZE_ERROR), 1, stderr);
-			abort();
-		}
+		pausedRelease(ptr);
+		return NULL;
 	}
-#ifdef PREPEND_LISTDATA
-	char *ptr;
-	if (p)
+	if (PAUSED_KEY_READABLE && ptr && (LIST_PAUSED_KEY(ptr) == LIST_PAUSED_KEY_OF(ptr)))
 	{
-		ptr = (char *)p;
-		if (alignment > sizeof(LIST))
-		{
-			ptr = ptr + alignment;
-		}
-		else if ((sizeof(LIST) % alignment))
+		if (size > SIZE_MAX - sizeof(LIST))
 		{
-			ptr = ptr + sizeof(LIST) + (sizeof(LIST) % alignment);
+			errno = ENOMEM;
+			return NULL;
 		}
-		else
+		LIST *moved = (LIST *)libc_realloc_fnptr((LIST *)ptr - 1, size + sizeof(LIST));
+		if (NULL == moved)
 		{
-			ptr = ptr + sizeof(LIST);
+			return NULL;
 		}
+		listSetSize(moved, size);
+		moved->flags |= 1; /* realloc */
+		LIST_PAUSED_KEY(moved + 1) = LIST_PAUSED_KEY_OF(moved + 1);
+		return moved + 1;
 	}
-	else
+	LIST *item = (ptr) ? listHeader(ptr) : NULL;
+	char *np = pausedAlloc(size, 0, ra);
+	if (np && ptr)
 	{
-		ptr = NULL;
+		memcpy(np, ptr, (listSize(item) < size) ? listSize(item) : size);
+		trackedRelease(ptr);
 	}
-#ifdef ENABLE_STATISTICS
-	pthread_mutex_lock(&lock);
-	totalOverhead += (newSize - size);
-	pthread_mutex_unlock(&lock);
-#endif
-	appendItemToList(ptr, size, setAlignment(alignment), __builtin_return_address(0));
-	return ptr;
-#else
-	// prependItemToList(p, size, 0, __builtin_return_address(0));
-	appendItemToList(p, size, __builtin_return_address(0));
-	return p;
-#endif
+	return np;
 }
-#endif
 
-#if defined(USE_DEPRECATED_MEMALIGN)
-/**
- * @brief Allocates aligned memory with tracking.
- *
- * This function allocates memory with the specified alignment and size, and tracks the allocation.
- *
- * @param alignment The alignment value.
- * @param size The size of memory to be allocated.
- * @return The aligned memory pointer.
- */
-__attribute__((visibility("default"))) void *memalign(size_t alignment, size_t size)
+#if defined(USE_DEPRECATED_MEMALIGN) || defined(__USE_ISOC11) || defined(__USE_XOPEN2K)
+static void *pausedAlignedAlloc(int type, size_t alignment, size_t size, unsigned int api, void *ra)
 {
-	return common_memalign(1, alignment, size);
+	return common_memalign(type, alignment, size, api | LIST_UNTRACKED, ra);
 }
 #endif
 
-#if defined(__USE_ISOC11)
 /**
- * @brief Allocates aligned memory with tracking (ISO C11).
+ * @brief Pauses or resumes the tracking, when the tracked backend is selected.
  *
- * This function allocates memory with the specified alignment and size, and tracks the allocation.
+ * Untracked blocks keep their header once resumed, a heapwalk doesn't show them.
  *
- * @param __alignment The alignment value.
- * @param __size The size of memory to be allocated.
- * @return The aligned memory pointer.
+ * @param pause true to pause, false to resume.
  */
-__attribute__((visibility("default"))) void *aligned_alloc(size_t __alignment, size_t __size)
+void heapwalkPause(bool pause)
 {
-	return common_memalign(2, __alignment, __size);
+	const BACKEND *from = (pause) ? &gTrackedBackend : &gPausedBackend;
+
+	if (0 < gMemInitialized)
+	{ /* libc is loaded */
+		__atomic_compare_exchange_n(&gBackend, &from, (pause) ? &gPausedBackend : &gTrackedBackend, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		gTrackingPaused = (&gPausedBackend == gBackend);
+	}
 }
 #endif
 
-#if defined(__USE_XOPEN2K)
+STATIC const BACKEND gTrackedBackend = {
+	MEMWRAP_BACKEND_TRACKED, trackedAlloc, trackedZalloc, trackedResize, trackedRelease,
+#if defined(USE_DEPRECATED_MEMALIGN) || defined(__USE_ISOC11) || defined(__USE_XOPEN2K)
+	common_memalign,
+#endif
+#ifdef CXX_OPERATORS
+	trackedReleaseSized,
+#endif
+#ifdef MMAP_TRACKING
+	trackedMap, trackedUnmap, trackedRemap, trackedAdvise,
+#endif
+};
+
+STATIC const BACKEND gPassthroughBackend = {
+	MEMWRAP_BACKEND_NONE, passAlloc, passZalloc, passResize, passRelease,
+#if defined(USE_DEPRECATED_MEMALIGN) || defined(__USE_ISOC11) || defined(__USE_XOPEN2K)
+	passAlignedAlloc,
+#endif
+#ifdef CXX_OPERATORS
+	passReleaseSized,
+#endif
+#ifdef MMAP_TRACKING
+	passMap, libc_munmap, passRemap, passAdvise,
+#endif
+};
+
+#ifdef TRACKING_PAUSE
+/* Mappings made while paused are not tracked, the tracked ones are still kept up to date */
+STATIC const BACKEND gPausedBackend = {
+	MEMWRAP_BACKEND_PAUSED, pausedAlloc, pausedZalloc, pausedResize, pausedRelease,
+#if defined(USE_DEPRECATED_MEMALIGN) || defined(__USE_ISOC11) || defined(__USE_XOPEN2K)
+	pausedAlignedAlloc,
+#endif
+#ifdef CXX_OPERATORS
+	trackedReleaseSized,
+#endif
+#ifdef MMAP_TRACKING
+	passMap, trackedUnmap, trackedRemap, trackedAdvise,
+#endif
+};
+#endif
+
 /**
- * @brief Allocates aligned memory with tracking (POSIX).
- *
- * This function allocates memory with the specified alignment and size, and tracks the allocation.
+ * @brief Sends the selected backend and the build of the library to the message queue.
  *
- * @param __memptr Pointer to the memory that will be allocated.
- * @param __alignment The alignment value.
- * @param __size The size of memory to be allocated.
- * @return 0 if successful; error code otherwise.
+ * @param mqsend The message queue descriptor to which the reply will be sent.
  */
-__attribute__((visibility("default"))) int posix_memalign(void **__memptr, size_t __alignment, size_t __size)
+void heapwalkBackend(mqd_t mqsend)
 {
-	*__memptr = common_memalign(3, __alignment, __size);
-}
+	msg_backend msg = {0};
+
+	msg.numItemOrInfo = HEAPWALK_ENDOF_LIST;
+#ifdef ENABLE_STATISTICS
+#ifdef SHARD_LIST
+	updateStatistics(); /* Unlocked, the sums may be off by the allocations made meanwhile */
+#endif
+	msg.totalHeapSize = totalHeapSize;
+	msg.totalOverhead = totalOverhead;
 #endif
+	msg.cmdBase = HEAPWALK_BASE;
+	strncpy(msg.name, gBackend->name, sizeof(msg.name) - 1);
+	walkSend(mqsend, (const char *)&msg, sizeof(msg));
+}
 
 /* Bypass tracking APIs */
 /**
@@ -2043,3 +7916,63 @@ void *libc_aligned_alloc(size_t alignment, size_t size)
 	return libc_aligned_alloc_fnptr(alignment, size);
 }
 #endif
+
+/**
+ * @brief Maps memory without tracking it.
+ *
+ * With MMAP_TRACKING, the next mmap is called once loaded, else the syscall is made directly.
+ *
+ * @return The mapping, MAP_FAILED on failure.
+ */
+void *libc_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+#ifdef MMAP_TRACKING
+	if (NULL == libc_mmap_fnptr)
+	{
+#ifdef SYS_mmap2
+		return (void *)syscall(SYS_mmap2, addr, length, prot, flags, fd, offset >> 12);
+#else
+		return (void *)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+#endif
+	}
+	return libc_mmap_fnptr(addr, length, prot, flags, fd, offset);
+#else
+	return mmap(addr, length, prot, flags, fd, offset);
+#endif
+}
+
+/**
+ * @brief Unmaps memory mapped by libc_mmap.
+ *
+ * @return 0 if successful; -1 otherwise.
+ */
+int libc_munmap(void *addr, size_t length)
+{
+#ifdef MMAP_TRACKING
+	if (NULL == libc_munmap_fnptr)
+	{
+		return syscall(SYS_munmap, addr, length);
+	}
+	return libc_munmap_fnptr(addr, length);
+#else
+	return munmap(addr, length);
+#endif
+}
+
+/**
+ * @brief Remaps memory mapped by libc_mmap.
+ *
+ * @return The mapping, MAP_FAILED on failure.
+ */
+void *libc_mremap(void *oldAddress, size_t oldSize, size_t newSize, int flags)
+{
+#ifdef MMAP_TRACKING
+	if (NULL == libc_mremap_fnptr)
+	{
+		return (void *)syscall(SYS_mremap, oldAddress, oldSize, newSize, flags);
+	}
+	return libc_mremap_fnptr(oldAddress, oldSize, newSize, flags);
+#else
+	return mremap(oldAddress, oldSize, newSize, flags);
+#endif
+}
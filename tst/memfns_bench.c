@@ -0,0 +1,640 @@
+/*
+ * Thread scaling benchmark for libmemfnswrap.so
+ *
+ * Run without and with the library preloaded to compare the overhead:
+ *   ./memfns_bench
+ *   LD_PRELOAD=./libmemfnswrap.so ./memfns_bench
+ *
+ * Usage: memfns_bench [max threads] [iterations per thread] [cross|realloc]
+ *   cross --> Frees are done by the neighbour thread (allocation and free shards differ)
+ *   realloc --> Each block is grown by BENCH_REALLOC_STEPS reallocs before the free, reallocs per second are shown
+ *
+ * Heapwalk stall of an allocating thread, for each heapwalk mode (needs the library preloaded):
+ *   LD_PRELOAD=./libmemfnswrap.so ./memfns_bench walk [entries]
+ *
+ * Full heapwalk transfer time through message queue and shared memory, as memleakutil
+ * receives it (needs the library preloaded, and memleakutil not running):
+ *   LD_PRELOAD=./libmemfnswrap.so ./memfns_bench xfer [entries]
+ *
+ * Heap bytes taken per aligned allocation beyond its size, for 64 byte, 4KB and 2MB alignment:
+ *   LD_PRELOAD=./libmemfnswrap.so ./memfns_bench align [blocks]
+ *
+ * Time of a malloc/free pair of libc, of the library tracking and of the library paused
+ * (needs the library preloaded, built with TRACKING_PAUSE):
+ *   LD_PRELOAD=./libmemfnswrap.so ./memfns_bench pause [pairs]
+ *
+ * Time of a lookup of the allocation holding an address, and of a malloc/free pair, with that many
+ * blocks live (needs the library preloaded, built with ADDRESS_INDEX). Run without MEMWRAP_ADDRESS_INDEX to compare
+ * the malloc/free pair, the lookups then find nothing:
+ *   MEMWRAP_ADDRESS_INDEX=1 LD_PRELOAD=./libmemfnswrap.so ./memfns_bench owner [blocks]
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "memfns_wrap.h"
+
+#define BENCH_BATCH 64
+#define BENCH_REALLOC_STEPS 8
+
+static int gIterations = 1000000;
+static int gCross = 0;
+static int gRealloc = 0;
+static int gThreads;
+static void **gHandoff;
+static pthread_barrier_t gBarrier;
+
+/**
+ * @brief Allocates and frees a batch of blocks in a loop.
+ *
+ * In cross mode every batch is handed off to the next thread, which frees it.
+ * In realloc mode every block of the batch is grown in steps, as strings and vectors are.
+ *
+ * @param arg The index of the thread.
+ * @return NULL
+ */
+static void *bench_thread_start(void *arg)
+{
+	long index = (long)arg;
+	void *batch[BENCH_BATCH];
+	int i, j, k;
+
+	pthread_barrier_wait(&gBarrier);
+	for (i = 0; i < gIterations / BENCH_BATCH; i++)
+	{
+		for (j = 0; j < BENCH_BATCH; j++)
+		{
+			batch[j] = malloc(16 + ((i + j) % 16) * 16);
+		}
+		for (k = 1; gRealloc && (k <= BENCH_REALLOC_STEPS); k++)
+		{
+			for (j = 0; j < BENCH_BATCH; j++)
+			{
+				batch[j] = realloc(batch[j], 16 + ((i + j) % 16) * 16 + k * 24);
+			}
+		}
+		if (gCross)
+		{
+			void **slot = &gHandoff[((index + 1) % gThreads) * BENCH_BATCH];
+			for (j = 0; j < BENCH_BATCH; j++)
+			{
+				void *old = __atomic_exchange_n(&slot[j], batch[j], __ATOMIC_ACQ_REL);
+				free(old);
+			}
+		}
+		else
+		{
+			for (j = 0; j < BENCH_BATCH; j++)
+			{
+				free(batch[j]);
+			}
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Runs the benchmark with the given number of threads.
+ *
+ * @param threads Number of threads to run.
+ * @return Millions of malloc/free pairs per second, of reallocs in realloc mode.
+ */
+static double runBench(int threads)
+{
+	pthread_t *tid = malloc(threads * sizeof(pthread_t));
+	struct timespec start, end;
+	long i;
+
+	gThreads = threads;
+	gHandoff = calloc(threads * BENCH_BATCH, sizeof(void *));
+	pthread_barrier_init(&gBarrier, NULL, threads + 1);
+	for (i = 0; i < threads; i++)
+	{
+		pthread_create(&tid[i], NULL, bench_thread_start, (void *)i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_barrier_wait(&gBarrier);
+	for (i = 0; i < threads; i++)
+	{
+		pthread_join(tid[i], NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pthread_barrier_destroy(&gBarrier);
+
+	for (i = 0; i < threads * BENCH_BATCH; i++)
+	{
+		free(gHandoff[i]);
+	}
+	free(gHandoff);
+	free(tid);
+
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	return ((double)threads * (gIterations / BENCH_BATCH) * BENCH_BATCH * (gRealloc ? BENCH_REALLOC_STEPS : 1)) / elapsed / 1e6;
+}
+
+#ifdef OPTIMIZE_MQ_TRANSFER
+static volatile int gChurn;
+static double gMaxStall;
+
+static double now()
+{
+	struct timespec tm;
+	clock_gettime(CLOCK_MONOTONIC, &tm);
+	return tm.tv_sec + tm.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Reallocates and frees blocks while the heapwalk runs, recording the longest call.
+ *
+ * @param arg Unused.
+ * @return NULL
+ */
+static void *churn_thread_start(void *arg)
+{
+	void *live[BENCH_BATCH] = {NULL};
+	unsigned int i = 0;
+
+	while (gChurn)
+	{
+		double start = now();
+		void **slot = &live[i++ % BENCH_BATCH];
+		if (i & 1)
+		{
+			*slot = realloc(*slot, 16 + (i % 16) * 16);
+		}
+		else
+		{
+			free(*slot);
+			*slot = malloc(32);
+		}
+		double stall = now() - start;
+		if (stall > gMaxStall)
+		{
+			gMaxStall = stall;
+		}
+	}
+	for (i = 0; i < BENCH_BATCH; i++)
+	{
+		free(live[i]);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Receives and drops the heapwalk messages.
+ *
+ * @param arg The message queue to be drained.
+ * @return NULL
+ */
+static void *drain_thread_start(void *arg)
+{
+	mqd_t mq = *(mqd_t *)arg;
+	msg_resp msgresp;
+
+	while (0 <= mq_receive(mq, (char *)&msgresp, sizeof(msg_resp), NULL))
+		;
+	return NULL;
+}
+
+/**
+ * @brief Runs a full heapwalk in every available mode while a thread keeps allocating.
+ *
+ * @param entries Number of live allocations to walk.
+ * @return 0 on success, 1 if the library is not preloaded.
+ */
+static int runWalkBench(int entries)
+{
+	const char *modes[] = {"heapwalk", "heapwalkSnapshot", "heapwalkConcurrent", "heapwalkSliced"};
+	struct mq_attr mqattr = ((struct mq_attr){0, 10, sizeof(msg_resp), 0, {0}});
+	void **keep = malloc(entries * sizeof(void *));
+	pthread_t drain, churn;
+	mqd_t mqrecv, mqsend;
+	int i;
+
+	if (NULL == dlsym(RTLD_DEFAULT, modes[0]))
+	{
+		printf("Preload libmemfnswrap.so to run the heapwalk benchmark\n");
+		return 1;
+	}
+	for (i = 0; i < entries; i++)
+	{
+		keep[i] = malloc(16);
+	}
+	mq_unlink("/mq_memfns_bench");
+	mqrecv = mq_open("/mq_memfns_bench", O_CREAT | O_RDONLY, QUEUE_PERMISSION, &mqattr);
+	mqsend = mq_open("/mq_memfns_bench", O_WRONLY);
+	if ((0 > mqrecv) || (0 > mqsend))
+	{
+		printf("Couldn't open /mq_memfns_bench\n");
+		return 1;
+	}
+	pthread_create(&drain, NULL, drain_thread_start, &mqrecv);
+
+	printf("Mode                Walk(ms)  Max malloc stall(ms)  (%d entries)\n", entries);
+	for (i = 0; i < (int)(sizeof(modes) / sizeof(modes[0])); i++)
+	{
+		void (*walk)(mqd_t, bool) = (void (*)(mqd_t, bool))dlsym(RTLD_DEFAULT, modes[i]);
+		if (NULL == walk)
+		{
+			printf("%-18s  not built\n", modes[i]);
+			continue;
+		}
+		gChurn = 1;
+		pthread_create(&churn, NULL, churn_thread_start, NULL);
+		usleep(100000);
+		gMaxStall = 0;
+		double start = now();
+		walk(mqsend, 1);
+		double end = now();
+		gChurn = 0;
+		pthread_join(churn, NULL);
+		printf("%-18s  %8.1f  %20.2f\n", modes[i], (end - start) * 1e3, gMaxStall * 1e3);
+	}
+
+	mq_close(mqsend);
+	mq_close(mqrecv);
+	mq_unlink("/mq_memfns_bench");
+	for (i = 0; i < entries; i++)
+	{
+		free(keep[i]);
+	}
+	free(keep);
+	return 0;
+}
+
+/**
+ * @brief Gets the size of a stored heapwalk message, variable with COMPACT_TRANSFER.
+ */
+static size_t storedMsgSize(const char *msg)
+{
+#ifdef COMPACT_TRANSFER
+	return COMPACT_HEADER_SIZE + ((const msg_compact *)msg)->encodedSize;
+#else
+	(void)msg;
+	return sizeof(msg_resp);
+#endif
+}
+
+/**
+ * @brief Requests a full heapwalk from the heapwalk thread of this process and receives it.
+ *
+ * @param mqrecv The /mq_util queue.
+ * @param options The heapwalkOpt bits of the walk.
+ * @param msgs Number of messages received.
+ * @param bytes Number of bytes received, through the queue and the segments.
+ * @return Number of entries received.
+ */
+static unsigned long receiveWalk(mqd_t mqrecv, unsigned int options, unsigned long *msgs, unsigned long *bytes)
+{
+	msg_cmd msgcmd = {HEAPWALK_FULL, getpid(), getpid(), options};
+	unsigned long entries = 0;
+	int phases = 2; /* Already walked, then new */
+	char mq_name[64];
+	msg_resp msgresp;
+	mqd_t mqsend;
+	ssize_t msgsize;
+
+	sprintf(mq_name, "/mq_wrapper_%d", getpid());
+	while (0 > (mqsend = mq_open(mq_name, O_WRONLY)))
+	{
+		usleep(10000);
+	}
+	mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0);
+	mq_close(mqsend);
+
+	*msgs = *bytes = 0;
+	while (phases && (0 <= (msgsize = mq_receive(mqrecv, (char *)&msgresp, sizeof(msg_resp), NULL))))
+	{
+		(*msgs)++;
+		*bytes += msgsize;
+		if (HEAPWALK_SHM_SEGMENT & msgresp.numItemOrInfo)
+		{
+			char shmName[32];
+			struct stat st;
+			sprintf(shmName, (2 == phases) ? SHM_WALKED_NAME : SHM_NEW_NAME, getpid());
+			int fd = shm_open(shmName, O_RDONLY, 0);
+			shm_unlink(shmName);
+			if ((0 <= fd) && !fstat(fd, &st) && st.st_size)
+			{
+				char *shm = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+				if (MAP_FAILED != shm)
+				{
+					for (char *msg = shm; msg < shm + st.st_size; msg += storedMsgSize(msg))
+					{
+						entries += ((msg_resp *)msg)->numItemOrInfo & 0xFFFFFFF;
+					}
+					*bytes += st.st_size;
+					munmap(shm, st.st_size);
+				}
+			}
+			if (0 <= fd)
+			{
+				close(fd);
+			}
+		}
+		else
+		{
+			entries += msgresp.numItemOrInfo & 0xFFFFFFF;
+		}
+		if (!(HEAPWALK_ITEM_CONTN & msgresp.numItemOrInfo))
+		{
+			phases--;
+		}
+	}
+	return entries;
+}
+
+/**
+ * @brief Times a full heapwalk transfer through message queue and through shared memory.
+ *
+ * @param entries Number of live allocations to walk.
+ * @return 0 on success, 1 if the library is not preloaded.
+ */
+static int runXferBench(int entries)
+{
+	const unsigned int options[] = {HEAPWALK_OPT_NONE, HEAPWALK_OPT_SHM};
+	const char *names[] = {"message queue", "shared memory"};
+	struct mq_attr mqattr = ((struct mq_attr){0, QUEUE_MAXMSG, sizeof(msg_resp), 0, {0}});
+	void **keep = malloc(entries * sizeof(void *));
+	mqd_t mqrecv;
+	int i;
+
+	if (NULL == dlsym(RTLD_DEFAULT, "heapwalk"))
+	{
+		printf("Preload libmemfnswrap.so to run the transfer benchmark\n");
+		return 1;
+	}
+	for (i = 0; i < entries; i++)
+	{
+		keep[i] = malloc(16);
+	}
+	mqrecv = mq_open("/mq_util", O_CREAT | O_RDONLY, QUEUE_PERMISSION, &mqattr);
+	if (0 > mqrecv)
+	{ /* Unprivileged queues are limited by /proc/sys/fs/mqueue/msg_max, 10 by default */
+		mqattr.mq_maxmsg = 10;
+		mqrecv = mq_open("/mq_util", O_CREAT | O_RDONLY, QUEUE_PERMISSION, &mqattr);
+	}
+	if (0 > mqrecv)
+	{
+		printf("Couldn't open /mq_util\n");
+		return 1;
+	}
+
+	printf("Transfer        Time(ms)  Messages  Entries  Bytes/entry\n");
+	for (i = 0; i < (int)(sizeof(options) / sizeof(options[0])); i++)
+	{
+		unsigned long msgs, bytes, received;
+		double start = now();
+		received = receiveWalk(mqrecv, options[i], &msgs, &bytes);
+		double end = now();
+		printf("%-14s  %8.1f  %8lu  %7lu  %11.1f\n", names[i], (end - start) * 1e3, msgs, received,
+			   (received) ? (double)bytes / received : 0);
+	}
+
+	mq_close(mqrecv);
+	mq_unlink("/mq_util");
+	for (i = 0; i < entries; i++)
+	{
+		free(keep[i]);
+	}
+	free(keep);
+	return 0;
+}
+#endif
+
+/**
+ * @brief Returns the heap bytes in use, including mmapped chunks.
+ */
+static size_t heapInUse()
+{
+#if __GLIBC_PREREQ(2, 33)
+	struct mallinfo2 info = mallinfo2();
+#else
+	struct mallinfo info = mallinfo();
+#endif
+	return (size_t)info.uordblks + (size_t)info.hblkhd;
+}
+
+/**
+ * @brief Reports the heap bytes taken per aligned allocation beyond the requested size.
+ *
+ * 2MB aligned blocks are capped to 64 so that the run stays within a few hundred MB.
+ *
+ * @param blocks Number of blocks allocated for each alignment.
+ * @return 0 on success.
+ */
+static int runAlignBench(int blocks)
+{
+	const size_t alignments[] = {64, 4096, 2 << 20};
+	const size_t size = 256;
+	void **keep = malloc(blocks * sizeof(void *));
+	unsigned int a;
+	int i;
+
+	if (NULL == keep)
+	{
+		return 1;
+	}
+	printf("Alignment  Blocks  Overhead/block (bytes)\n");
+	for (a = 0; a < sizeof(alignments) / sizeof(alignments[0]); a++)
+	{
+		int count = ((alignments[a] >= (2 << 20)) && (blocks > 64)) ? 64 : blocks;
+		size_t before = heapInUse();
+		size_t used;
+
+		for (i = 0; i < count; i++)
+		{
+			keep[i] = memalign(alignments[a], size);
+		}
+		used = heapInUse() - before;
+		for (i = 0; i < count; i++)
+		{
+			free(keep[i]);
+		}
+		printf("%9zu  %6d  %10.1f\n", alignments[a], count, (double)used / count - size);
+	}
+	free(keep);
+	return 0;
+}
+
+/**
+ * @brief Times malloc/free pairs in batches, single threaded.
+ *
+ * @param allocate The malloc to be timed.
+ * @param release The free to be timed.
+ * @param pairs Number of malloc/free pairs.
+ * @return Nanoseconds per pair.
+ */
+static double timePairs(void *(*allocate)(size_t), void (*release)(void *), int pairs)
+{
+	void *batch[BENCH_BATCH];
+	struct timespec start, end;
+	int i, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < pairs / BENCH_BATCH; i++)
+	{
+		for (j = 0; j < BENCH_BATCH; j++)
+		{
+			batch[j] = allocate(16 + ((i + j) % 16) * 16);
+		}
+		for (j = 0; j < BENCH_BATCH; j++)
+		{
+			release(batch[j]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ((pairs / BENCH_BATCH) * BENCH_BATCH);
+}
+
+/**
+ * @brief Compares a malloc/free pair of libc with the library tracking and paused.
+ *
+ * Each is timed twice, the first run warms up the heap.
+ *
+ * @param pairs Number of malloc/free pairs.
+ * @return 0 on success, 1 if the library is not preloaded or built without TRACKING_PAUSE.
+ */
+static int runPauseBench(int pairs)
+{
+	void *(*libcMalloc)(size_t) = (void *(*)(size_t))dlsym(RTLD_DEFAULT, "__libc_malloc");
+	void (*libcFree)(void *) = (void (*)(void *))dlsym(RTLD_DEFAULT, "__libc_free");
+	void (*pause)(bool) = (void (*)(bool))dlsym(RTLD_DEFAULT, "heapwalkPause");
+
+	if ((NULL == pause) || (NULL == libcMalloc) || (NULL == libcFree) || (pairs < BENCH_BATCH))
+	{
+		printf("Preload libmemfnswrap.so built with TRACKING_PAUSE to run the pause benchmark\n");
+		return 1;
+	}
+	printf("Backend   ns/pair  (%d malloc/free pairs)\n", pairs);
+	timePairs(libcMalloc, libcFree, pairs);
+	printf("libc      %7.1f\n", timePairs(libcMalloc, libcFree, pairs));
+	timePairs(malloc, free, pairs);
+	printf("tracked   %7.1f\n", timePairs(malloc, free, pairs));
+	pause(true);
+	timePairs(malloc, free, pairs);
+	printf("paused    %7.1f\n", timePairs(malloc, free, pairs));
+	pause(false);
+	return 0;
+}
+
+/**
+ * @brief Times lookups of the allocation holding an address, and malloc/free pairs, with blocks live.
+ *
+ * @param blocks Number of live blocks, of 16 to 256 bytes.
+ * @return 0 on success, 1 if the library is not preloaded or built without ADDRESS_INDEX.
+ */
+static int runOwnerBench(int blocks)
+{
+	int (*owner)(const void *, LISTxfer *) = (int (*)(const void *, LISTxfer *))dlsym(RTLD_DEFAULT, "memwrapOwner");
+	struct timespec start, end;
+	LISTxfer found;
+	char **live;
+	int missed = 0;
+
+	if ((NULL == owner) || (blocks < 1))
+	{
+		printf("Preload libmemfnswrap.so built with ADDRESS_INDEX to run the owner benchmark\n");
+		return 1;
+	}
+	live = malloc(blocks * sizeof(char *));
+	for (int i = 0; i < blocks; i++)
+	{
+		live[i] = malloc(16 + (i % 16) * 16);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < blocks; i++)
+	{
+		/* Interior addresses in an order unrelated to the allocation order */
+		int j = (int)(((unsigned long)i * 2654435761UL) % blocks);
+		missed += (0 != owner(live[j] + (j % 16) * 8, &found));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("Live blocks  ns/lookup  ns/pair  Not found\n");
+	printf("%11d  %9.1f  %7.1f  %9d\n", blocks,
+		   ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / blocks, timePairs(malloc, free, 1000000), missed);
+	for (int i = 0; i < blocks; i++)
+	{
+		free(live[i]);
+	}
+	free(live);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int maxThreads = 8;
+	int threads;
+
+	if ((argc > 1) && (0 == strcmp(argv[1], "walk")))
+	{
+#ifdef OPTIMIZE_MQ_TRANSFER
+		return runWalkBench((argc > 2) ? atoi(argv[2]) : 1000000);
+#else
+		printf("Heapwalk benchmark needs OPTIMIZE_MQ_TRANSFER\n");
+		return 1;
+#endif
+	}
+	if ((argc > 1) && (0 == strcmp(argv[1], "xfer")))
+	{
+#ifdef OPTIMIZE_MQ_TRANSFER
+		return runXferBench((argc > 2) ? atoi(argv[2]) : 1000000);
+#else
+		printf("Heapwalk benchmark needs OPTIMIZE_MQ_TRANSFER\n");
+		return 1;
+#endif
+	}
+
+	if ((argc > 1) && (0 == strcmp(argv[1], "align")))
+	{
+		return runAlignBench((argc > 2) ? atoi(argv[2]) : 10000);
+	}
+
+	if ((argc > 1) && (0 == strcmp(argv[1], "pause")))
+	{
+		return runPauseBench((argc > 2) ? atoi(argv[2]) : 10000000);
+	}
+
+	if ((argc > 1) && (0 == strcmp(argv[1], "owner")))
+	{
+		return runOwnerBench((argc > 2) ? atoi(argv[2]) : 1000000);
+	}
+
+	if (argc > 1)
+	{
+		maxThreads = atoi(argv[1]);
+	}
+	if (argc > 2)
+	{
+		gIterations = atoi(argv[2]);
+	}
+	if ((argc > 3) && (0 == strcmp(argv[3], "cross")))
+	{
+		gCross = 1;
+	}
+	if ((argc > 3) && (0 == strcmp(argv[3], "realloc")))
+	{
+		gRealloc = 1;
+	}
+	if ((maxThreads < 1) || (gIterations < BENCH_BATCH))
+	{
+		printf("Usage: %s [max threads] [iterations per thread] [cross|realloc]\n", argv[0]);
+		return 1;
+	}
+
+	printf("Threads  Mops/sec  (%s)\n", gRealloc ? "realloc" : (gCross ? "cross thread free" : "same thread free"));
+	for (threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		printf("%7d  %8.2f\n", threads, runBench(threads));
+	}
+	return 0;
+}
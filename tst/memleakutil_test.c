@@ -13,15 +13,44 @@
 #include <errno.h>
 #include <string.h>
 #include <malloc.h>
+#include <dlfcn.h>
 
 
 #include <semaphore.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
 #include "memfns_wrap.h"
 
+#ifdef SHARD_LIST
+/* List checks below run against the shard of the calling thread */
+#define hpfmemhead (getListShard()->head)
+#define hpfmemtail (getListShard()->tail)
+#define hpwmemhead (getListShard()->whead)
+#endif
+
+/* Options sent with the heapwalk commands, the filter with HEAPWALK_OPT_FILTER and the bookmark with HEAPWALK_OPT_BOOKMARK */
+static unsigned int gWalkOptions = HEAPWALK_OPT_NONE;
+static WALKFILTER gWalkFilter;
+static char gWalkBookmark[WALK_BOOKMARK_NAME_SIZE];
+
 extern mqd_t createMq(void);
 extern void storeHeapwalk(mqd_t mqrecv, int cmd, int pid, bool isSelfTest);
 extern void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int *listIndex, MMAP_anon *mmapIn);
+#ifdef SITE_STATS
+extern int processSites(mqd_t mqrecv, int pid, SITExfer *resp, int respSize);
+#endif
+#ifdef LARGE_REGISTRY
+extern int processLarge(mqd_t mqrecv, int pid, LISTxfer *resp, int respSize);
+#endif
+extern int processBackend(mqd_t mqrecv, msg_backend *resp);
+extern int processBookmarks(mqd_t mqrecv, msg_bookmarks *resp);
+#ifdef ADDRESS_INDEX
+extern int processOwner(mqd_t mqrecv, const void *address, msg_owner *resp);
+#endif
+#ifdef MIRROR_DELTAS
+extern int processMirror(mqd_t mqrecv, int pid, const char *name, msg_mirror *resp, LISTxfer *entries, int size);
+extern void mirrorFree(void);
+#endif
 
 /* Just run a test thread, that allocates and deallocates, so that
  * a testrun shall be done to see heap walk and other options */
@@ -105,6 +134,27 @@ void spawntestrunthread()
         pthread_create(&ptd, &attr, &test_thread_start, NULL);
 }
 
+#ifdef CONCURRENT_HEAPWALK
+/* Frees the block while the heapwalk started by the test is waiting on the full queue */
+static void *freeDuringWalk(void *arg)
+{
+	usleep(300000);
+	free(arg);
+	return NULL;
+}
+#endif
+
+#ifdef ALIGNED_TRAILER
+/* Holds the aligned table while the test forks */
+static void *holdDuringFork(void *arg)
+{
+	pthread_mutex_lock(&gAlignedTable.lock);
+	usleep(300000);
+	pthread_mutex_unlock(&gAlignedTable.lock);
+	return NULL;
+}
+#endif
+
 #ifndef MAINTAIN_SINGLE_LIST
 /*
 Having the below 2 functions redundantly here because in selftest, certain tests are failing due to 
@@ -170,6 +220,7 @@ void sendAndRecv(mqd_t mq, int cmd, LIST *resp, int listSize, int initVal)
 
 			memset(resp, initVal, listSize*sizeof(LIST));
 			msgcmd.pid = getpid();	
+			msgcmd.client = getpid();
 			sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
 			mqsend = mq_open(mq_name, O_WRONLY);
 			if(mqsend < 0) {
@@ -177,6 +228,9 @@ void sendAndRecv(mqd_t mq, int cmd, LIST *resp, int listSize, int initVal)
 				return;
 			}
 			msgcmd.cmd = cmd;
+			msgcmd.options = gWalkOptions;
+			msgcmd.filter = gWalkFilter;
+			memcpy(msgcmd.bookmark, gWalkBookmark, sizeof(msgcmd.bookmark));
 			dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
 			if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0)){
 				dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
@@ -267,236 +321,1659 @@ void sendAndRecv(mqd_t mq, int cmd, LIST *resp, int listSize, int initVal)
 			break;
 
 	}
-}
-
-void runAllocationTests(mqd_t mq)
-{
-	resetList();
-	LIST resp[8];
-	int passed=0, failed=0;
-#ifdef PREPEND_LISTDATA
-	int listSize = sizeof(LIST);
-#else
-	int listSize = 0;
+}
+
+#ifdef SITE_STATS
+int requestSites(mqd_t mq, unsigned int limit, SITExfer *sites, int size)
+{
+	mqd_t mqsend;
+	msg_cmd msgcmd;
+	char mq_name[64];
+
+	memset(sites, 0, size * sizeof(SITExfer));
+	msgcmd.pid = getpid();
+	msgcmd.client = getpid();
+	msgcmd.cmd = HEAPWALK_SITES;
+	msgcmd.options = limit;
+	sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
+	mqsend = mq_open(mq_name, O_WRONLY);
+	if (mqsend < 0) {
+		dbg(PRINT_ERROR, "Error, cannot open the queue: %s, error: %s.\n", mq_name, strerror(errno));
+		return -1;
+	}
+	if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0)) {
+		dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+		mq_close(mqsend);
+		return -1;
+	}
+	mq_close(mqsend);
+	return processSites(mq, msgcmd.pid, sites, size);
+}
+#endif
+
+#ifdef LARGE_REGISTRY
+int requestLarge(mqd_t mq, unsigned int limit, LISTxfer *entries, int size)
+{
+	mqd_t mqsend;
+	msg_cmd msgcmd;
+	char mq_name[64];
+
+	memset(entries, 0, size * sizeof(LISTxfer));
+	msgcmd.pid = getpid();
+	msgcmd.client = getpid();
+	msgcmd.cmd = HEAPWALK_LARGE;
+	msgcmd.options = limit;
+	sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
+	mqsend = mq_open(mq_name, O_WRONLY);
+	if (mqsend < 0) {
+		dbg(PRINT_ERROR, "Error, cannot open the queue: %s, error: %s.\n", mq_name, strerror(errno));
+		return -1;
+	}
+	if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0)) {
+		dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+		mq_close(mqsend);
+		return -1;
+	}
+	mq_close(mqsend);
+	return processLarge(mq, msgcmd.pid, entries, size);
+}
+#endif
+
+int requestBackend(mqd_t mq, msg_backend *backend)
+{
+	mqd_t mqsend;
+	msg_cmd msgcmd;
+	char mq_name[64];
+
+	memset(backend, 0, sizeof(msg_backend));
+	msgcmd.pid = getpid();
+	msgcmd.client = getpid();
+	msgcmd.cmd = HEAPWALK_BACKEND;
+	msgcmd.options = 0;
+	sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
+	mqsend = mq_open(mq_name, O_WRONLY);
+	if (mqsend < 0) {
+		dbg(PRINT_ERROR, "Error, cannot open the queue: %s, error: %s.\n", mq_name, strerror(errno));
+		return -1;
+	}
+	if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0)) {
+		dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+		mq_close(mqsend);
+		return -1;
+	}
+	mq_close(mqsend);
+	return processBackend(mq, backend);
+}
+
+#ifdef WALK_BOOKMARKS
+int requestBookmark(mqd_t mq, bookmarkOp op, const char *name, msg_bookmarks *bookmarks)
+{
+	mqd_t mqsend;
+	msg_cmd msgcmd;
+	char mq_name[64];
+
+	memset(bookmarks, 0, sizeof(msg_bookmarks));
+	msgcmd.pid = getpid();
+	msgcmd.client = getpid();
+	msgcmd.cmd = HEAPWALK_BOOKMARK;
+	msgcmd.options = op;
+	strncpy(msgcmd.bookmark, name, sizeof(msgcmd.bookmark));
+	sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
+	mqsend = mq_open(mq_name, O_WRONLY);
+	if (mqsend < 0) {
+		dbg(PRINT_ERROR, "Error, cannot open the queue: %s, error: %s.\n", mq_name, strerror(errno));
+		return -1;
+	}
+	if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0)) {
+		dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+		mq_close(mqsend);
+		return -1;
+	}
+	mq_close(mqsend);
+	return processBookmarks(mq, bookmarks);
+}
+#endif
+
+#ifdef ADDRESS_INDEX
+int requestOwner(mqd_t mq, void *address, msg_owner *owner)
+{
+	mqd_t mqsend;
+	msg_cmd msgcmd;
+	char mq_name[64];
+
+	memset(owner, 0, sizeof(msg_owner));
+	memset(&msgcmd, 0, sizeof(msgcmd));
+	msgcmd.pid = getpid();
+	msgcmd.client = getpid();
+	msgcmd.cmd = HEAPWALK_OWNER;
+	msgcmd.address = address;
+	sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
+	mqsend = mq_open(mq_name, O_WRONLY);
+	if (mqsend < 0) {
+		dbg(PRINT_ERROR, "Error, cannot open the queue: %s, error: %s.\n", mq_name, strerror(errno));
+		return -1;
+	}
+	if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0)) {
+		dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+		mq_close(mqsend);
+		return -1;
+	}
+	mq_close(mqsend);
+	return processOwner(mq, address, owner);
+}
+#endif
+
+#ifdef MIRROR_DELTAS
+int requestMirror(mqd_t mq, const char *name, bool full, msg_mirror *mirror, LISTxfer *entries, int size)
+{
+	mqd_t mqsend;
+	msg_cmd msgcmd;
+	char mq_name[64];
+
+	memset(mirror, 0, sizeof(msg_mirror));
+	memset(entries, 0, size * sizeof(LISTxfer));
+	memset(&msgcmd, 0, sizeof(msgcmd));
+	msgcmd.pid = getpid();
+	msgcmd.client = getpid();
+	msgcmd.cmd = HEAPWALK_MIRROR;
+	msgcmd.options = (full) ? 1 : 0;
+	strncpy(msgcmd.bookmark, name, sizeof(msgcmd.bookmark) - 1);
+	sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
+	mqsend = mq_open(mq_name, O_WRONLY);
+	if (mqsend < 0) {
+		dbg(PRINT_ERROR, "Error, cannot open the queue: %s, error: %s.\n", mq_name, strerror(errno));
+		return -1;
+	}
+	if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0)) {
+		dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+		mq_close(mqsend);
+		return -1;
+	}
+	mq_close(mqsend);
+	return processMirror(mq, msgcmd.pid, name, mirror, entries, size);
+}
+
+/* Size of the mirrored entry of ptr, -1 if not mirrored */
+static long mirroredSize(const LISTxfer *entries, int size, const void *ptr)
+{
+	for (int i = 0; i < size && entries[i].ptr; i++)
+	{
+		if (ptr == entries[i].ptr)
+		{
+			return entries[i].size;
+		}
+	}
+	return -1;
+}
+#endif
+
+#ifdef INPLACE_REALLOC
+/**
+ * @brief Realloc of a walked entry keeps its place in the list, so the incremental walk doesn't show it again.
+ * The entry is then checked through its header and filled in resp as the walk showed it before.
+ */
+static void reallocKeptInPlace(void *ptr, unsigned int size, LIST *resp)
+{
+	LIST *item = getItem(ptr);
+	if ((0 < gMemInitialized) && (NULL == resp[0].ptr) && item && (size == item->size) && (1 == (item->flags & LIST_TYPE_MASK))) {
+		resp[0].ptr = ptr;
+		resp[0].size = size;
+	}
+}
+#endif
+
+#ifdef MMAP_TRACKING
+/**
+ * @brief Finds the tracked mapping starting at an address.
+ */
+static MAPPING *trackedMapping(const void *start)
+{
+	for (unsigned long i = 0; i < gMappingTable.count; i++) {
+		if ((unsigned long)start == gMappingTable.entries[i].start) {
+			return &gMappingTable.entries[i];
+		}
+	}
+	return NULL;
+}
+#endif
+
+void runAllocationTests(mqd_t mq)
+{
+	resetList();
+	LIST resp[8];
+	int passed=0, failed=0;
+#ifdef PREPEND_LISTDATA
+	int listSize = sizeof(LIST);
+#else
+	int listSize = 0;
+#endif
+	int testnum = 1;
+#ifdef COMPACT_LIST
+	/* Entries are checked through their LIST, CLIST is tested at the end */
+	gCompactListMaxSize = 0;
+#endif
+
+	char *z = malloc(27);
+	dbg(PRINT_MUST, "\n**********************************\n%s: %d\n**********************************\n", __FUNCTION__, getpid());
+	memset(z,0,27);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz");
+	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, z, 26, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((z == (char*)resp[0].ptr) && (27 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+
+	// In sendAndRecv, fopen might use heap and free'd blocks are reused, therefore get the next ptr
+	char *z1 = (char *)bootstrapNext(72 + listSize) + listSize;
+	z = realloc(z, 72);
+	memset(&z[25],0,45);
+	strcpy(&z[25], "1234567890");
+	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 72, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+#ifdef INPLACE_REALLOC
+	reallocKeptInPlace(z, 72, resp);
+#endif
+	if (((0 < gMemInitialized)? 1 : (z1 == (char*)resp[0].ptr)) && (72 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+
+	free(z);
+	z1 = (char *)bootstrapNext(83 + listSize) + listSize;
+	z = realloc(NULL, 83);
+	memset(z,0,83);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz1234567890abcdefghijklmnopqrstuvwxyz");
+	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 83, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (83 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+
+	free(z);
+	z1 = (char *)bootstrapNext(32 + listSize) + listSize;
+	z = calloc(1, 32);
+	memset(z,0,32);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz01234");
+	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 32, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (32 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		// This will fail, since we don't display nmem blocks in heapwalk!! we need to change the approach
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+
+	z1 = (char *)bootstrapNext(40 + listSize) + listSize;
+	z = realloc(z, 40);
+	memset(&z[31],0,8);
+	strcpy(&z[31], "567890a");
+	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 40, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+#ifdef INPLACE_REALLOC
+	reallocKeptInPlace(z, 40, resp);
+#endif
+	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (40 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+
+	free(z);
+	z1 = (char *)bootstrapNext(32 + listSize) + listSize;
+	z = calloc(2, 16);
+	memset(z,0,32);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz01234");
+	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z1:z, 32, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (32 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+
+	z1 = (char *)bootstrapNext(40 + listSize) + listSize;
+	z = realloc(z, 40);
+	memset(&z[31],0,8);
+	strcpy(&z[31], "567890a");
+	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 40, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+#ifdef INPLACE_REALLOC
+	reallocKeptInPlace(z, 40, resp);
+#endif
+	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (40 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+	z = realloc(z, 0);
+	z = (char *)bootstrapNext(40 + listSize) + listSize;
+	z1 = realloc(NULL, 40);
+	strcpy(z1, "abcdefghijklmnopqrstuvwxyz1234567890");
+	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z1:z, 40, z1);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if (((0 < gMemInitialized)?(z1 == (char*)resp[0].ptr):(z == (char*)resp[0].ptr)) && (40 == resp[0].size) && (!strcmp(z1,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+
+#ifdef INPLACE_REALLOC
+	/* A realloc chain stays one entry where it was in the list, moved by libc or resized in place */
+	char *chain = malloc(100);
+	char *blocker = malloc(100);
+	strcpy(chain, "0123456789");
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	LIST *chainItem = getItem(chain);
+	LIST *chainPrev = chainItem ? chainItem->prev : NULL;
+	time_t chainSeconds = chainItem ? chainItem->seconds : 0;
+	LISTSHARD *chainShard = chainItem ? &gListShards[(chainItem->flags & LIST_SHARD_MASK) >> LIST_SHARD_SHIFT] : gListShards;
+	unsigned long chainHeap = chainShard->heapSize;
+	unsigned long chainAddr = (unsigned long)chain;
+	char *grown = realloc(chain, 1 << 20);
+	unsigned long grownAddr = (unsigned long)grown;
+	char *shrunk = realloc(grown, 1 << 19);
+	LIST *shrunkItem = getItem(shrunk);
+	PRINT("%d. [%d] Show %p,%d,0123456789 realloc'd in place of %lx\n", testnum++,__LINE__, shrunk, 1 << 19, chainAddr);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((0 >= gMemInitialized) || ((grownAddr != chainAddr) && ((unsigned long)shrunk == grownAddr) && shrunkItem && ((1 << 19) == shrunkItem->size) &&
+			(shrunkItem->prev == chainPrev) && ((NULL == chainPrev) || (shrunkItem == chainPrev->next)) && (chainSeconds == shrunkItem->seconds) &&
+			(chainHeap + (1 << 19) - 100 == chainShard->heapSize) && !strcmp(shrunk, "0123456789") && (NULL == resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %lx,%lx,%p,%lu,%lu %p\n", __LINE__, chainAddr, grownAddr, shrunk, chainHeap, chainShard->heapSize, resp[0].ptr);
+		failed++;
+	}
+	free(shrunk);
+	free(blocker);
+#endif
+
+	/* Blocks beyond a chunk of the bootstrap arena commit the next chunks, free'd blocks are reused */
+	char *boot = malloc(5 << 20);
+	memset(boot, 0x5a, 5 << 20);
+	unsigned long bootAddr = (unsigned long)boot;
+	free(boot);
+	int bootReused = ((unsigned long)bootstrapNext((5 << 20) + listSize) + listSize == bootAddr);
+	char *small = malloc(100);
+	unsigned long smallAddr = (unsigned long)small;
+	free(small);
+	z = malloc(90);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz");
+	PRINT("%d. [%d] Show %p,%d,%s reusing 0x%lx and 0x%lx\n", testnum++,__LINE__, z, 90, z, smallAddr, bootAddr);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if (((0 < gMemInitialized) || (bootReused && ((unsigned long)z == smallAddr))) && (z == (char*)resp[0].ptr) && (90 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s,%d\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, bootReused);
+		failed++;
+	}
+	free(z);
+
+	z = memalign(64, 40);
+	free(z1);
+#if 0 //def PREPEND_LISTDATA
+	unsigned int alignment = 64;
+	unsigned int size = 40;
+	unsigned int newSize;
+        if (listSize < alignment) {
+                newSize = size + alignment;
+        } else {
+                newSize = size + listSize + (listSize % alignment);
+        }
+#endif
+	
+	//z1 = z1 + 40 + listSize;
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz1234567890");
+	PRINT("%d. [%d] Show %p,%d,%s,mod(z,64)=0\n", testnum++,__LINE__, z, 40, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((z == (char*)resp[0].ptr) && (40 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr)) && !((unsigned long)z%64)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s,%lu\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, ((unsigned long)z%64));
+		failed++;
+	}
+	z1 = memalign(32, 64);
+	free(z);
+	//z = z1 + 64 + listSize;
+	strcpy(z1, "abcdefghijklmnopqrstuvwxyz123456abcdefghijklmnopqrstuvwxyz12345");
+	PRINT("%d. [%d] Show %p,%d,%s,mod(z,32)=0\n", testnum++,__LINE__, z1, 64, z1);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((z1 == (char*)resp[0].ptr) && (64 == resp[0].size) && (!strcmp(z1,(char*)resp[0].ptr)) && !((unsigned long)z1%32)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s,%lu\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, ((unsigned long)z1%32));
+		failed++;
+	}
+	free(z1);
+	z = memalign(128, 27);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz");
+	PRINT("%d. [%d] Show %p,%d,%s,mod(z,128)=0\n", testnum++,__LINE__, z, 27, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((z == (char*)resp[0].ptr) && (27 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr)) && !((unsigned long)z%128)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s,%lu\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, ((unsigned long)z%128));
+		failed++;
+	}
+	z1 = memalign(4096, 64);
+	strcpy(z1, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz0123456789");
+	PRINT("%d. [%d] Show %p,%d,%s,mod(z,4096)=0\n", testnum++,__LINE__, z1, 64, z1);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((z1 == (char*)resp[0].ptr) && (64 == resp[0].size) && (!strcmp(z1,(char*)resp[0].ptr)) && !((unsigned long)z1%4096)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s,%lu\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, ((unsigned long)z1%4096));
+		failed++;
+	}
+
+#ifdef ALIGNED_TRAILER
+	/* Aligned beyond LIST, the LIST follows the block and the overhead is sizeof(LIST) whatever the alignment */
+	unsigned long alignedCount = gAlignedTable.count, overhead = 0, trailerOverhead = 0;
+	for (int i = 0; i < MAX_LIST_SHARDS; i++) {
+		overhead += gListShards[i].overhead;
+	}
+	void *huge = NULL;
+	int rc = posix_memalign(&huge, 1 << 21, 100);
+	char *page = aligned_alloc(4096, 4096);
+	for (int i = 0; i < MAX_LIST_SHARDS; i++) {
+		trailerOverhead += gListShards[i].overhead;
+	}
+	trailerOverhead -= overhead;
+	strcpy(huge, "abcdefghijklmnopqrstuvwxyz");
+	strcpy(page, "0123456789");
+	PRINT("%d. [%d] Show %p,%d,%s,mod(z,2M)=0 and %p,%d,%s,mod(z,4096)=0 with %lu overhead\n", testnum++,__LINE__, huge, 100, (char*)huge, page, 4096, page, trailerOverhead);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((0 == rc) && (huge == resp[0].ptr) && (100 == resp[0].size) && !((unsigned long)huge % (1 << 21)) && (page == (char*)resp[1].ptr) && (4096 == resp[1].size) &&
+			!((unsigned long)page % 4096) && (2 * sizeof(LIST) == trailerOverhead) && (alignedCount + 2 == gAlignedTable.count)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d %p,%d %p,%d,%lu\n", __LINE__, rc, resp[0].ptr, resp[0].size, resp[1].ptr, resp[1].size, gAlignedTable.count);
+		failed++;
+	}
+	free(huge);
+	page = realloc(page, 8192);
+	PRINT("%d. [%d] Show %p,%d,%s moved out of the aligned table\n", testnum++,__LINE__, page, 8192, page);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((page == (char*)resp[0].ptr) && (8192 == resp[0].size) && (!strcmp("0123456789", (char*)resp[0].ptr)) && (alignedCount == gAlignedTable.count)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%lu\n", __LINE__, resp[0].ptr, resp[0].size, gAlignedTable.count);
+		failed++;
+	}
+	/* The header of an aligned block is found without the table lock */
+	huge = aligned_alloc(4096, 64);
+	pthread_mutex_lock(&gAlignedTable.lock);
+	LIST *hugeItem = getItem(huge);
+	pthread_mutex_unlock(&gAlignedTable.lock);
+	PRINT("%d. [%d] Show %p,%d found holding the aligned table lock\n", testnum++,__LINE__, huge, 64);
+	if (hugeItem && (huge == hugeItem->ptr) && (hugeItem->flags & LIST_TRAILER) && (alignedCount + 1 == gAlignedTable.count)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%lu\n", __LINE__, (void*)hugeItem, gAlignedTable.count);
+		failed++;
+	}
+	free(huge);
+	/* fork waits for the table held by another thread, the child allocating from it doesn't block. The fork handlers are registered by load_libc_functions */
+	if (0 < gMemInitialized) {
+		pthread_t holding;
+		int status = -1, waitedMs = 0;
+
+		pthread_create(&holding, NULL, &holdDuringFork, NULL);
+		usleep(100000);
+		pid_t child = fork();
+		if (0 == child) {
+			free(aligned_alloc(4096, 64));
+			_exit(0);
+		}
+		pthread_join(holding, NULL);
+		while ((0 < child) && (0 == waitpid(child, &status, WNOHANG)) && (waitedMs < 5000)) {
+			usleep(10000);
+			waitedMs += 10;
+		}
+		PRINT("%d. [%d] Show child forked holding the aligned table allocates in %d ms\n", testnum++,__LINE__, waitedMs);
+		if ((0 < child) && WIFEXITED(status) && (0 == WEXITSTATUS(status))) {
+			PRINT("\tPass\n");
+			passed++;
+		}
+		else {
+			PRINT("\t%d: Fail %d,%d\n", __LINE__, child, status);
+			failed++;
+			if (0 < child) {
+				kill(child, SIGKILL);
+				waitpid(child, NULL, 0);
+			}
+		}
+	}
+	free(page);
+#endif
+
+#ifdef CXX_OPERATORS
+	/* operator new keeps the caller as RA and marks the entries as C++ allocations */
+	Dl_info testInfo, raInfo = {0};
+	dladdr((void *)runAllocationTests, &testInfo);
+	char *obj = operatorNew(40);
+	char *arr = operatorNewArrayAligned(100, 256);
+	strcpy(obj, "abcdefghijklmnopqrstuvwxyz");
+	PRINT("%d. [%d] Show %p,%d,%s and %p,%d,mod(z,256)=0 allocated by operator new\n", testnum++,__LINE__, obj, 40, obj, arr, 100);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	dladdr(resp[0].ra, &raInfo);
+	if ((obj == (char*)resp[0].ptr) && (40 == resp[0].size) && (resp[0].flags & LIST_CXX) && (raInfo.dli_fbase == testInfo.dli_fbase) &&
+			(arr == (char*)resp[1].ptr) && (100 == resp[1].size) && (resp[1].flags & LIST_CXX) && !((unsigned long)arr % 256) && (NULL == resp[2].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%x,%p %p,%d,%x\n", __LINE__, resp[0].ptr, resp[0].size, resp[0].flags, resp[0].ra, resp[1].ptr, resp[1].size, resp[1].flags);
+		failed++;
+	}
+	unsigned long mismatch = gCxxSizeMismatch;
+	/* Not checked unless asked for */
+	operatorDeleteSized(operatorNew(40), 41);
+	unsigned long unchecked = gCxxSizeMismatch - mismatch;
+	gCxxSizeCheck = true;
+	operatorDeleteArraySizedAligned(arr, 100, 256);
+	operatorDeleteSized(obj, 41);
+	gCxxSizeCheck = false;
+	char *plain = malloc(24);
+	PRINT("%d. [%d] Show %p,%d allocated by malloc, sized delete of a wrong size counted when checked\n", testnum++,__LINE__, plain, 24);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((plain == (char*)resp[0].ptr) && !(resp[0].flags & LIST_CXX) && (NULL == resp[1].ptr) && (0 == unchecked) && (mismatch + 1 == gCxxSizeMismatch)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%x %p %lu\n", __LINE__, resp[0].ptr, resp[0].flags, resp[1].ptr, gCxxSizeMismatch - mismatch);
+		failed++;
+	}
+	free(plain);
+	/* Without a next nothrow operator new in a C process, a failed nothrow one returns NULL. The bootstrap arena aborts instead */
+	char nothrowTag = 0;
+	void *none = (0 < gMemInitialized) ? operatorNewNothrow(~0UL >> 2, &nothrowTag) : NULL;
+	void *noneAligned = (0 < gMemInitialized) ? operatorNewArrayAlignedNothrow(~0UL >> 2, 256, &nothrowTag) : NULL;
+	PRINT("%d. [%d] Show failed nothrow operator new returning NULL\n", testnum++,__LINE__);
+	if ((NULL == none) && (NULL == noneAligned)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p %p\n", __LINE__, none, noneAligned);
+		failed++;
+	}
+	/* libdl allocates the error of the missing operators */
+	sendAndRecv(mq, HEAPWALK_MARKALL, resp, 8, 0);
+#endif
+
+#ifdef MMAP_TRACKING
+	/* munmap in the middle splits the mapping, mremap moves the rest with its site */
+	unsigned long pageSize = getpagesize(), mappingCount = gMappingTable.count;
+	Dl_info mapInfo = {0}, mapTestInfo;
+	dladdr((void *)runAllocationTests, &mapTestInfo);
+	char *region = mmap(NULL, 4 * pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	munmap(region + pageSize, pageSize);
+	madvise(region + 2 * pageSize, pageSize, MADV_DONTNEED);
+	MAPPING *head = trackedMapping(region), *rest = trackedMapping(region + 2 * pageSize);
+	PRINT("%d. [%d] Show mapping %p of %lu split by munmap, %lu released\n", testnum++,__LINE__, region, 4 * pageSize, pageSize);
+	if (head && rest) {
+		dladdr(head->ra, &mapInfo);
+	}
+	if (head && rest && (pageSize == head->size) && (2 * pageSize == rest->size) && (pageSize == rest->released) && !head->released &&
+			(head->ra == rest->ra) && (mapInfo.dli_fbase == mapTestInfo.dli_fbase) && (mappingCount + 2 == gMappingTable.count)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p %p %lu %lu\n", __LINE__, head, rest, (rest) ? rest->size : 0, gMappingTable.count - mappingCount);
+		failed++;
+	}
+	void *ra = (head) ? head->ra : NULL;
+	char *moved = mremap(region + 2 * pageSize, 2 * pageSize, 64 * pageSize, MREMAP_MAYMOVE);
+	rest = trackedMapping(moved);
+	PRINT("%d. [%d] Show mapping %p grown to %lu by mremap, unmapped after\n", testnum++,__LINE__, moved, 64 * pageSize);
+	if ((MAP_FAILED != moved) && rest && (64 * pageSize == rest->size) && (ra == rest->ra) && (mappingCount + 2 == gMappingTable.count) &&
+			!munmap(region, pageSize) && !munmap(moved, 64 * pageSize) && (mappingCount == gMappingTable.count)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p %p %lu %lu\n", __LINE__, moved, rest, (rest) ? rest->size : 0, gMappingTable.count - mappingCount);
+		failed++;
+	}
+#endif
+
+#ifdef SNAPSHOT_HEAPWALK
+	gWalkOptions = HEAPWALK_OPT_SNAPSHOT;
+	free(z);
+	z = malloc(48);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz0123456789");
+	PRINT("%d. [%d] Show %p,%d,%s from snapshot\n", testnum++,__LINE__, z, 48, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((z == (char*)resp[0].ptr) && (48 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr)) && (NULL == resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+	// Snapshot walk should have marked the entries as walked in this process
+	PRINT("%d. [%d] Show no new allocations from snapshot\n", testnum++,__LINE__);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0xff);
+	if (NULL == resp[0].ptr) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d\n", __LINE__, resp[0].ptr, resp[0].size);
+		failed++;
+	}
+	gWalkOptions = HEAPWALK_OPT_NONE;
+#endif
+
+#ifdef CONCURRENT_HEAPWALK
+	gWalkOptions = HEAPWALK_OPT_CONCURRENT;
+	free(z);
+	z = malloc(56);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz0123456789abcdefghij");
+	PRINT("%d. [%d] Show %p,%d,%s from concurrent walk\n", testnum++,__LINE__, z, 56, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((z == (char*)resp[0].ptr) && (56 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr)) && (NULL == resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+	PRINT("%d. [%d] Show no new allocations from concurrent walk\n", testnum++,__LINE__);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0xff);
+	if (NULL == resp[0].ptr) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d\n", __LINE__, resp[0].ptr, resp[0].size);
+		failed++;
+	}
+	/* The first entry not walked yet ends the walk of the walked ones, free it while they are walked */
+	{
+		int walkedCount = 5 * MAX_MSG_XFER * 10, respCount = walkedCount + 10000, index;
+		char **walkedBlock = malloc(walkedCount * sizeof(char *));
+		LIST *walkedResp = malloc(respCount * sizeof(LIST));
+		long timeoutMs = gWalkSendTimeoutMs;
+		bool endFound = false, nextFound = false;
+		pthread_t freeing;
+
+		gWalkSendTimeoutMs = 5000;
+		for (index = 0; index < walkedCount; index++) {
+			walkedBlock[index] = malloc(32);
+		}
+		sendAndRecv(mq, HEAPWALK_MARKALL, resp, 8, 0);
+		char *end = malloc(25);
+		char *next = malloc(26);
+		PRINT("%d. [%d] Show %p freeing the end of the walked entries during a concurrent walk\n", testnum++,__LINE__, end);
+		pthread_create(&freeing, NULL, &freeDuringWalk, end);
+		sendAndRecv(mq, HEAPWALK_FULL, walkedResp, respCount, 0);
+		pthread_join(freeing, NULL);
+		for (index = 0; (index < respCount) && walkedResp[index].ptr; index++) {
+			endFound |= (end == (char*)walkedResp[index].ptr);
+			nextFound |= (next == (char*)walkedResp[index].ptr);
+		}
+		if (!endFound && nextFound) {
+			PRINT("\tPass\n");
+			passed++;
+		}
+		else {
+			PRINT("\t%d: Fail %d,%d of %d\n", __LINE__, endFound, nextFound, index);
+			failed++;
+		}
+		free(next);
+		for (index = 0; index < walkedCount; index++) {
+			free(walkedBlock[index]);
+		}
+		free(walkedResp);
+		free(walkedBlock);
+		gWalkSendTimeoutMs = timeoutMs;
+	}
+	gWalkOptions = HEAPWALK_OPT_NONE;
+#endif
+
+#ifdef SLICED_HEAPWALK
+	LIST sliced[2 * WALK_SLICE_CHECK + 8];
+	char *slicedBlock[2 * WALK_SLICE_CHECK + 1];
+	int slicedCount = sizeof(slicedBlock) / sizeof(slicedBlock[0]), slicedIndex;
+	long sliceNs = gWalkSliceNs;
+	gWalkOptions = HEAPWALK_OPT_SLICED;
+	gWalkSliceNs = 0; // A slice per WALK_SLICE_CHECK entries
+	for (slicedIndex = 0; slicedIndex < slicedCount; slicedIndex++) {
+		slicedBlock[slicedIndex] = malloc(72);
+	}
+	PRINT("%d. [%d] Show %d entries walked in slices of %d\n", testnum++,__LINE__, slicedCount, WALK_SLICE_CHECK);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, sliced, sizeof(sliced) / sizeof(sliced[0]), 0);
+	for (slicedIndex = 0; (slicedIndex < slicedCount) && (slicedBlock[slicedIndex] == (char*)sliced[slicedIndex].ptr); slicedIndex++)
+		;
+	if ((slicedCount == slicedIndex) && (NULL == sliced[slicedIndex].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail at %d %p,%d\n", __LINE__, slicedIndex, sliced[slicedIndex].ptr, sliced[slicedIndex].size);
+		failed++;
+	}
+	PRINT("%d. [%d] Show no new allocations from sliced walk\n", testnum++,__LINE__);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, sliced, sizeof(sliced) / sizeof(sliced[0]), 0xff);
+	if (NULL == sliced[0].ptr) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d\n", __LINE__, sliced[0].ptr, sliced[0].size);
+		failed++;
+	}
+	/* Same for the end of the walked entries free'd between the slices */
+	{
+		int walkedCount = 5 * MAX_MSG_XFER * 10, respCount = walkedCount + 10000, index;
+		char **walkedBlock = malloc(walkedCount * sizeof(char *));
+		LIST *walkedResp = malloc(respCount * sizeof(LIST));
+		long timeoutMs = gWalkSendTimeoutMs;
+		bool endFound = false, nextFound = false;
+		pthread_t freeing;
+
+		gWalkSendTimeoutMs = 5000;
+		for (index = 0; index < walkedCount; index++) {
+			walkedBlock[index] = malloc(32);
+		}
+		sendAndRecv(mq, HEAPWALK_MARKALL, sliced, 8, 0);
+		char *end = malloc(25);
+		char *next = malloc(26);
+		PRINT("%d. [%d] Show %p freeing the end of the walked entries between slices\n", testnum++,__LINE__, end);
+		pthread_create(&freeing, NULL, &freeDuringWalk, end);
+		sendAndRecv(mq, HEAPWALK_FULL, walkedResp, respCount, 0);
+		pthread_join(freeing, NULL);
+		for (index = 0; (index < respCount) && walkedResp[index].ptr; index++) {
+			endFound |= (end == (char*)walkedResp[index].ptr);
+			nextFound |= (next == (char*)walkedResp[index].ptr);
+		}
+		if (!endFound && nextFound) {
+			PRINT("\tPass\n");
+			passed++;
+		}
+		else {
+			PRINT("\t%d: Fail %d,%d of %d\n", __LINE__, endFound, nextFound, index);
+			failed++;
+		}
+		free(next);
+		for (index = 0; index < walkedCount; index++) {
+			free(walkedBlock[index]);
+		}
+		free(walkedResp);
+		free(walkedBlock);
+		gWalkSendTimeoutMs = timeoutMs;
+	}
+	for (slicedIndex = 0; slicedIndex < slicedCount; slicedIndex++) {
+		free(slicedBlock[slicedIndex]);
+	}
+	gWalkSliceNs = sliceNs;
+	gWalkOptions = HEAPWALK_OPT_NONE;
+#endif
+
+#ifdef SHM_TRANSFER
+	gWalkOptions = HEAPWALK_OPT_SHM;
+	free(z);
+	z = malloc(64);
+	strcpy(z, "abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz");
+	PRINT("%d. [%d] Show %p,%d,%s through shared memory\n", testnum++,__LINE__, z, 64, z);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((z == (char*)resp[0].ptr) && (64 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr)) && (NULL == resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		failed++;
+	}
+	PRINT("%d. [%d] Show no new allocations through shared memory\n", testnum++,__LINE__);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0xff);
+	if (NULL == resp[0].ptr) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d\n", __LINE__, resp[0].ptr, resp[0].size);
+		failed++;
+	}
+#ifdef SNAPSHOT_HEAPWALK
+	/* The snapshot child writes the segments named with the pid of this process */
+	{
+		char *shmBlock[3];
+		int count = 0, found = 0;
+
+		gWalkOptions = HEAPWALK_OPT_SNAPSHOT | HEAPWALK_OPT_SHM;
+		for (int i = 0; i < 3; i++) {
+			shmBlock[i] = malloc(72 + i);
+		}
+		PRINT("%d. [%d] Show %p,%p,%p from snapshot through shared memory\n", testnum++,__LINE__, shmBlock[0], shmBlock[1], shmBlock[2]);
+		sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+		for (; (count < 8) && resp[count].ptr; count++) {
+			for (int i = 0; i < 3; i++) {
+				found += (shmBlock[i] == (char*)resp[count].ptr) && (72 + i == resp[count].size);
+			}
+		}
+		if ((3 == count) && (3 == found)) {
+			PRINT("\tPass\n");
+			passed++;
+		}
+		else {
+			PRINT("\t%d: Fail %d,%d %p\n", __LINE__, count, found, resp[0].ptr);
+			failed++;
+		}
+		for (int i = 0; i < 3; i++) {
+			free(shmBlock[i]);
+		}
+	}
+#endif
+	gWalkOptions = HEAPWALK_OPT_NONE;
+#endif
+
+#ifdef WALK_FILTER
+	char *f[3];
+	f[0] = malloc(100);
+	f[1] = malloc(200);
+	f[2] = malloc(300);
+	gWalkOptions = HEAPWALK_OPT_FILTER;
+	memset(&gWalkFilter, 0, sizeof(gWalkFilter));
+	gWalkFilter.tid = gettid();
+	gWalkFilter.minSize = 150;
+	gWalkFilter.maxSize = 250;
+	PRINT("%d. [%d] Show only %p,%d of thread %d filtered by the process\n", testnum++,__LINE__, f[1], 200, gettid());
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((f[1] == (char*)resp[0].ptr) && (200 == resp[0].size) && (NULL == resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d %p\n", __LINE__, resp[0].ptr, resp[0].size, resp[1].ptr);
+		failed++;
+	}
+	// Entries filtered out are marked as walked as well
+	gWalkOptions = HEAPWALK_OPT_NONE;
+	PRINT("%d. [%d] Show no new allocations after the filtered walk\n", testnum++,__LINE__);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0xff);
+	if (NULL == resp[0].ptr) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d\n", __LINE__, resp[0].ptr, resp[0].size);
+		failed++;
+	}
+	gWalkOptions = HEAPWALK_OPT_FILTER;
+	memset(&gWalkFilter, 0, sizeof(gWalkFilter));
+	gWalkFilter.start = f[2];
+	gWalkFilter.end = f[2] + 1;
+	PRINT("%d. [%d] Show only %p,%d filtered by address\n", testnum++,__LINE__, f[2], 300);
+	sendAndRecv(mq, HEAPWALK_FULL, resp, 8, 0);
+	if ((f[2] == (char*)resp[0].ptr) && (300 == resp[0].size) && (NULL == resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d %p\n", __LINE__, resp[0].ptr, resp[0].size, resp[1].ptr);
+		failed++;
+	}
+	memset(&gWalkFilter, 0, sizeof(gWalkFilter));
+	gWalkFilter.ra[0] = resp[0].ra;
+	PRINT("%d. [%d] Show only %p,%d filtered by its site %p\n", testnum++,__LINE__, f[2], 300, resp[0].ra);
+	sendAndRecv(mq, HEAPWALK_FULL, resp, 8, 0);
+	if ((f[2] == (char*)resp[0].ptr) && (NULL == resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d %p\n", __LINE__, resp[0].ptr, resp[0].size, resp[1].ptr);
+		failed++;
+	}
+	gWalkOptions = HEAPWALK_OPT_NONE;
+	memset(&gWalkFilter, 0, sizeof(gWalkFilter));
+	free(f[0]);
+	free(f[1]);
+	free(f[2]);
+#endif
+
+#ifdef WALK_CHECKPOINTS
+	LISTSHARD *cpShard = getListShard();
+	sleep(1); // The older entries of the thread are out of the time window
+	pthread_mutex_lock(&cpShard->lock);
+	cpShard->checkpointCount = 0;
+	cpShard->checkpointSpan = WALK_CHECKPOINT_SPAN;
+	pthread_mutex_unlock(&cpShard->lock);
+	time_t cpTime = time(NULL);
+	char *cp[2];
+	cp[0] = malloc(700);
+	cp[1] = malloc(701);
+	PRINT("%d. [%d] Show checkpoint at %p, and moved to %p when it is free'd\n", testnum++,__LINE__, cp[0], cp[1]);
+	bool cpAtFirst = cpShard->checkpointCount && (getItem(cp[0]) == cpShard->checkpoints[0].item);
+	free(cp[0]);
+	if (cpAtFirst && (getItem(cp[1]) == cpShard->checkpoints[0].item)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d %u %p\n", __LINE__, cpAtFirst, cpShard->checkpointCount, cpShard->checkpoints[0].item);
+		failed++;
+	}
+	gWalkOptions = HEAPWALK_OPT_FILTER;
+	memset(&gWalkFilter, 0, sizeof(gWalkFilter));
+	gWalkFilter.tid = gettid();
+	gWalkFilter.from = cpTime;
+	PRINT("%d. [%d] Show only %p,%d allocated since %ld\n", testnum++,__LINE__, cp[1], 701, (long)cpTime);
+	sendAndRecv(mq, HEAPWALK_FULL, resp, 8, 0);
+	if ((cp[1] == (char*)resp[0].ptr) && (701 == resp[0].size) && (NULL == resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d %p\n", __LINE__, resp[0].ptr, resp[0].size, resp[1].ptr);
+		failed++;
+	}
+	gWalkFilter.from = gWalkFilter.to = cpTime - 1;
+	PRINT("%d. [%d] Show no allocations of thread %d at %ld\n", testnum++,__LINE__, gettid(), (long)cpTime - 1);
+	sendAndRecv(mq, HEAPWALK_FULL, resp, 8, 0xff);
+	if (NULL == resp[0].ptr) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d\n", __LINE__, resp[0].ptr, resp[0].size);
+		failed++;
+	}
+	gWalkOptions = HEAPWALK_OPT_NONE;
+	memset(&gWalkFilter, 0, sizeof(gWalkFilter));
+	free(cp[1]);
+#endif
+
+#ifdef WALK_BOOKMARKS
+	char *bm[3];
+	msg_bookmarks bookmarks;
+	bm[0] = malloc(40);
+	requestBookmark(mq, BOOKMARK_SET, "first", &bookmarks);
+	bm[1] = malloc(41);
+	requestBookmark(mq, BOOKMARK_SET, "second", &bookmarks);
+	PRINT("%d. [%d] Show bookmarks first and second set, second with a later generation\n", testnum++,__LINE__);
+	if ((0 == bookmarks.result) && (2 == bookmarks.count) && !strcmp("first", bookmarks.bookmarks[0].name) &&
+			!strcmp("second", bookmarks.bookmarks[1].name) && (bookmarks.bookmarks[0].generation < bookmarks.bookmarks[1].generation)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d,%u %s,%llu\n", __LINE__, bookmarks.result, bookmarks.count, bookmarks.bookmarks[0].name, bookmarks.bookmarks[0].generation);
+		failed++;
+	}
+	bm[2] = malloc(42);
+	// The entry kept by bookmark first is free'd, the bookmark moves to the entry before it
+	free(bm[0]);
+	gWalkOptions = HEAPWALK_OPT_BOOKMARK;
+	strcpy(gWalkBookmark, "first");
+	PRINT("%d. [%d] Show %p,%d %p,%d allocated since bookmark first\n", testnum++,__LINE__, bm[1], 41, bm[2], 42);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((bm[1] == (char*)resp[0].ptr) && (41 == resp[0].size) && (bm[2] == (char*)resp[1].ptr) && (42 == resp[1].size) && (NULL == resp[2].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d %p,%d %p\n", __LINE__, resp[0].ptr, resp[0].size, resp[1].ptr, resp[1].size, resp[2].ptr);
+		failed++;
+	}
+	strcpy(gWalkBookmark, "second");
+	PRINT("%d. [%d] Show only %p,%d allocated since bookmark second\n", testnum++,__LINE__, bm[2], 42);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((bm[2] == (char*)resp[0].ptr) && (42 == resp[0].size) && (NULL == resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p,%d %p\n", __LINE__, resp[0].ptr, resp[0].size, resp[1].ptr);
+		failed++;
+	}
+	// Walks since a bookmark leave the walked marks
+	gWalkOptions = HEAPWALK_OPT_NONE;
+	gWalkBookmark[0] = '\0';
+	PRINT("%d. [%d] Show %p,%d %p,%d still new after the walks since the bookmarks\n", testnum++,__LINE__, bm[1], 41, bm[2], 42);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if ((bm[1] == (char*)resp[0].ptr) && (bm[2] == (char*)resp[1].ptr) && (NULL == resp[2].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %p %p %p\n", __LINE__, resp[0].ptr, resp[1].ptr, resp[2].ptr);
+		failed++;
+	}
+	requestBookmark(mq, BOOKMARK_DELETE, "first", &bookmarks);
+	int missing = requestBookmark(mq, BOOKMARK_DELETE, "first", &bookmarks);
+	PRINT("%d. [%d] Show bookmark first deleted, and not found when deleted again\n", testnum++,__LINE__);
+	if ((-1 == missing) && (1 == bookmarks.count) && !strcmp("second", bookmarks.bookmarks[0].name)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d,%u %s\n", __LINE__, missing, bookmarks.count, bookmarks.bookmarks[0].name);
+		failed++;
+	}
+	requestBookmark(mq, BOOKMARK_DELETE, "second", &bookmarks);
+	free(bm[1]);
+	free(bm[2]);
+#endif
+
+#ifdef ADDRESS_INDEX
+	char *own[3];
+	LISTxfer owner;
+	msg_owner ownerMsg;
+	gAddressIndex = true;
+	own[0] = malloc(64);
+	own[1] = malloc(5000);
+	own[2] = realloc(malloc(32), 100000);
+	PRINT("%d. [%d] Show %p,%d owning its address %p, and %p,%d owning %p\n", testnum++,__LINE__, own[1], 5000, own[1] + 4999, own[2], 100000, own[2] + 50000);
+	int owned = memwrapOwner(own[1] + 4999, &owner);
+	if ((0 == owned) && (own[1] == (char*)owner.ptr) && (5000 == owner.size) && (gettid() == owner.tid) &&
+			(0 == memwrapOwner(own[2] + 50000, &owner)) && (own[2] == (char*)owner.ptr) && (100000 == owner.size)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d %p,%lu\n", __LINE__, owned, owner.ptr, owner.size);
+		failed++;
+	}
+	PRINT("%d. [%d] Show %p after the end of %p,%d not owned by it\n", testnum++,__LINE__, own[0] + 64, own[0], 64);
+	memset(&owner, 0, sizeof(owner));
+	owned = memwrapOwner(own[0] + 64, &owner);
+	if ((0 != owned) || (own[0] != (char*)owner.ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d %p,%lu\n", __LINE__, owned, owner.ptr, owner.size);
+		failed++;
+	}
+	PRINT("%d. [%d] Show %p,%d owning %p through HEAPWALK_OWNER\n", testnum++,__LINE__, own[1], 5000, own[1] + 100);
+	owned = requestOwner(mq, own[1] + 100, &ownerMsg);
+	if ((0 == owned) && (own[1] == (char*)ownerMsg.owner.ptr) && (5000 == ownerMsg.owner.size)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d %p,%lu\n", __LINE__, owned, ownerMsg.owner.ptr, ownerMsg.owner.size);
+		failed++;
+	}
+	free(own[1]);
+	PRINT("%d. [%d] Show %p not owned once %p is free'd\n", testnum++,__LINE__, own[1] + 100, own[1]);
+	memset(&owner, 0, sizeof(owner));
+	owned = memwrapOwner(own[1] + 100, &owner);
+	if ((0 != owned) || (own[1] != (char*)owner.ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d %p,%lu\n", __LINE__, owned, owner.ptr, owner.size);
+		failed++;
+	}
+	free(own[0]);
+	free(own[2]);
+	gAddressIndex = false;
+#endif
+
+#ifdef MIRROR_DELTAS
+	char *mir[4];
+	msg_mirror mirror;
+	int mirroredCount = 16384;
+	LISTxfer *mirrored = malloc(mirroredCount * sizeof(LISTxfer));
+	mir[0] = malloc(48);
+	mir[1] = malloc(49);
+	mir[2] = malloc(200);
+	PRINT("%d. [%d] Show %p,%d %p,%d %p,%d in the first sync of mirror m, sent all the entries\n", testnum++,__LINE__, mir[0], 48, mir[1], 49, mir[2], 200);
+	int mirrorChanges = requestMirror(mq, "m", false, &mirror, mirrored, mirroredCount);
+	if ((0 < mirrorChanges) && (1 == mirror.full) && (48 == mirroredSize(mirrored, mirroredCount, mir[0])) &&
+			(49 == mirroredSize(mirrored, mirroredCount, mir[1])) && (200 == mirroredSize(mirrored, mirroredCount, mir[2]))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d,%u %ld\n", __LINE__, mirrorChanges, mirror.full, mirroredSize(mirrored, mirroredCount, mir[0]));
+		failed++;
+	}
+	// Allocated before the free, else it may be given the free'd pointer
+	mir[3] = malloc(51);
+	free(mir[0]);
+	mir[2] = realloc(mir[2], 100);
+	PRINT("%d. [%d] Show %p free'd, %p,%d reallocated and %p,%d allocated in the delta sync of mirror m\n", testnum++,__LINE__, mir[0], mir[2], 100, mir[3], 51);
+	mirrorChanges = requestMirror(mq, "m", false, &mirror, mirrored, mirroredCount);
+	if ((0 < mirrorChanges) && (0 == mirror.full) && (-1 == mirroredSize(mirrored, mirroredCount, mir[0])) && (49 == mirroredSize(mirrored, mirroredCount, mir[1])) &&
+			(100 == mirroredSize(mirrored, mirroredCount, mir[2])) && (51 == mirroredSize(mirrored, mirroredCount, mir[3]))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d,%u %ld %ld %ld\n", __LINE__, mirrorChanges, mirror.full, mirroredSize(mirrored, mirroredCount, mir[0]),
+				mirroredSize(mirrored, mirroredCount, mir[2]), mirroredSize(mirrored, mirroredCount, mir[3]));
+		failed++;
+	}
+	// The mirror is a bookmark, once it is deleted the next sync is sent all the entries
+	requestBookmark(mq, BOOKMARK_DELETE, "m", &bookmarks);
+	free(mir[3]);
+	PRINT("%d. [%d] Show mirror m sent all the entries after its bookmark is deleted, without %p\n", testnum++,__LINE__, mir[3]);
+	mirrorChanges = requestMirror(mq, "m", false, &mirror, mirrored, mirroredCount);
+	if ((0 < mirrorChanges) && (1 == mirror.full) && (-1 == mirroredSize(mirrored, mirroredCount, mir[3])) && (49 == mirroredSize(mirrored, mirroredCount, mir[1]))) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d,%u %ld\n", __LINE__, mirrorChanges, mirror.full, mirroredSize(mirrored, mirroredCount, mir[3]));
+		failed++;
+	}
+	requestBookmark(mq, BOOKMARK_DELETE, "m", &bookmarks);
+	free(mir[1]);
+	free(mir[2]);
+	free(mirrored);
+	mirrorFree();
 #endif
-	int testnum = 1;
 
-	char *z = malloc(27);
-	dbg(PRINT_MUST, "\n**********************************\n%s: %d\n**********************************\n", __FUNCTION__, getpid());
-	memset(z,0,27);
-	strcpy(z, "abcdefghijklmnopqrstuvwxyz");
-	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, z, 26, z);
+#ifdef COMPACT_TRANSFER
+	char *c[3];
+	c[0] = malloc(4000);
+	c[1] = malloc(24);
+	c[2] = malloc(40);
+	PRINT("%d. [%d] Show %p,%d %p,%d %p,%d decoded from compact transfer\n", testnum++,__LINE__, c[0], 4000, c[1], 24, c[2], 40);
 	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if ((z == (char*)resp[0].ptr) && (27 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+	if ((c[0] == (char*)resp[0].ptr) && (4000 == resp[0].size) && (c[1] == (char*)resp[1].ptr) && (24 == resp[1].size) &&
+			(c[2] == (char*)resp[2].ptr) && (40 == resp[2].size) && (NULL == resp[3].ptr)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		PRINT("\t%d: Fail %p,%d %p,%d %p,%d\n", __LINE__, resp[0].ptr, resp[0].size, resp[1].ptr, resp[1].size, resp[2].ptr, resp[2].size);
 		failed++;
 	}
-
-#ifdef OPTIMIZE_MQ_TRANSFER
-	// In sendAndRecv, fopen might use heap, therefore get the current ptr
-	char *z1 = &gInitialAlloc[gInitIndex] + listSize;
-#else
-	char *z1 = z + 32 + listSize;
+	free(c[0]);
+	free(c[1]);
+	free(c[2]);
 #endif
-	
-	z = realloc(z, 72);
-	memset(&z[25],0,45);
-	strcpy(&z[25], "1234567890");
-	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 72, z);
+
+#ifdef STACK_DEPOT
+	char *st[3];
+	unsigned int depth[2];
+	void *const *frames[2];
+	/* Unwinding is opt-in, with MEMWRAP_STACK_DEPTH */
+	gStackDepth = 8;
+	for (int i = 0; i < 2; i++) {
+		st[i] = malloc(100);
+	}
+	st[2] = malloc(100);
+	gStackDepth = STACK_DEPOT_DEFAULT_FRAMES;
+	PRINT("%d. [%d] Show %p,%p share a stack and %p has its own\n", testnum++,__LINE__, st[0], st[1], st[2]);
 	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if (((0 < gMemInitialized)? 1 : (z1 == (char*)resp[0].ptr)) && (72 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+	frames[0] = stackDepotFrames(resp[0].stack, &depth[0]);
+	if ((st[0] == (char*)resp[0].ptr) && (st[1] == (char*)resp[1].ptr) && (st[2] == (char*)resp[2].ptr) && (NULL == resp[3].ptr) &&
+			resp[0].stack && (resp[0].stack == resp[1].stack) && resp[2].stack && (resp[2].stack != resp[0].stack) &&
+			frames[0] && (1 < depth[0]) && (resp[0].ra == frames[0][0])) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		PRINT("\t%d: Fail %u %u %u depth %u\n", __LINE__, resp[0].stack, resp[1].stack, resp[2].stack, depth[0]);
 		failed++;
 	}
+	free(st[0]);
+	free(st[1]);
 
-#ifdef OPTIMIZE_MQ_TRANSFER
-	z1 =  &gInitialAlloc[gInitIndex] + listSize;
-#else
-	z1 = z + 72 + listSize;
-#endif
-	free(z);
-	z = realloc(NULL, 83);
-	memset(z,0,83);
-	strcpy(z, "abcdefghijklmnopqrstuvwxyz1234567890abcdefghijklmnopqrstuvwxyz");
-	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 83, z);
+	/* Depth of 1, the default, keeps the return address only, a stack of its own */
+	st[1] = malloc(100);
+	PRINT("%d. [%d] Show %p is captured with 1 frame\n", testnum++,__LINE__, st[1]);
 	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (83 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+	frames[1] = stackDepotFrames(resp[0].stack, &depth[1]);
+	if ((st[1] == (char*)resp[0].ptr) && (NULL == resp[1].ptr) && frames[1] && (1 == depth[1]) && (resp[0].ra == frames[1][0])) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		PRINT("\t%d: Fail %p %u depth %u\n", __LINE__, resp[0].ptr, resp[0].stack, depth[1]);
 		failed++;
 	}
-
-#ifdef OPTIMIZE_MQ_TRANSFER
-	z1 =  &gInitialAlloc[gInitIndex] + listSize;
-#else
-	z1 = z + 88 + listSize;
+	free(st[1]);
+	free(st[2]);
 #endif
-	free(z);
-	z = calloc(1, 32);
-	memset(z,0,32);
-	strcpy(z, "abcdefghijklmnopqrstuvwxyz01234");
-	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 32, z);
-	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (32 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+
+#ifdef SITE_STATS
+	SITExfer sites[64];
+	char *big[3];
+	for (int i = 0; i < 3; i++) {
+		big[i] = malloc(1 << 16);
+	}
+	char *half = malloc(1 << 15);
+	PRINT("%d. [%d] Show the sites of %p,%p,%p and %p hold the most live bytes\n", testnum++,__LINE__, big[0], big[1], big[2], half);
+	int count = requestSites(mq, 2, sites, 64);
+	if ((2 == count) && ((3 << 16) == sites[0].liveBytes) && (3 == sites[0].liveCount) && (3 == sites[0].allocs) && (0 == sites[0].frees) &&
+			(0 == sites[0].error) && (NULL != sites[0].ra) && ((1 << 15) == sites[1].liveBytes) && (1 == sites[1].liveCount)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		// This will fail, since we don't display nmem blocks in heapwalk!! we need to change the approach
-		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		PRINT("\t%d: Fail %d %lu,%lu,%lu,%lu %lu\n", __LINE__, count, sites[0].liveBytes, sites[0].liveCount, sites[0].allocs, sites[0].frees, sites[1].liveBytes);
 		failed++;
 	}
-
-#ifdef OPTIMIZE_MQ_TRANSFER
-	z1 =  &gInitialAlloc[gInitIndex] + listSize;
-#else
-	z1 = z + 32 + listSize;
-#endif
-	z = realloc(z, 40);
-	memset(&z[31],0,8);
-	strcpy(&z[31], "567890a");
-	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 40, z);
-	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (40 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+	free(big[0]);
+	PRINT("%d. [%d] Show the free of %p counted to its site\n", testnum++,__LINE__, big[0]);
+	count = requestSites(mq, 1, sites, 64);
+	if ((1 == count) && ((2 << 16) == sites[0].liveBytes) && (2 == sites[0].liveCount) && (3 == sites[0].allocs) && (1 == sites[0].frees)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		PRINT("\t%d: Fail %d %lu,%lu,%lu,%lu\n", __LINE__, count, sites[0].liveBytes, sites[0].liveCount, sites[0].allocs, sites[0].frees);
 		failed++;
 	}
 
-#ifdef OPTIMIZE_MQ_TRANSFER
-	z1 =  &gInitialAlloc[gInitIndex] + listSize;
-#else
-	z1 = z + 40 + listSize;
-#endif
-	free(z);
-	z = calloc(2, 16);
-	memset(z,0,32);
-	strcpy(z, "abcdefghijklmnopqrstuvwxyz01234");
-	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z1:z, 32, z);
-	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (32 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+	/* With the table of the shard full, a new site takes over the one with the least live bytes */
+	LISTSHARD *shard = getListShard();
+	unsigned long topK = gSiteTopK = shard->siteCount;
+	char *topk = malloc(1 << 14);
+	unsigned long kept = shard->siteCount;
+	PRINT("%d. [%d] Show the site of %p replaces another within top %lu\n", testnum++,__LINE__, topk, topK);
+	count = requestSites(mq, 0, sites, 64);
+	gSiteTopK = 0;
+	int found = 0;
+	for (int i = 0; (i < count) && (i < 64); i++) {
+		if ((1 == sites[i].allocs) && (sites[i].error + (1 << 14) == sites[i].liveBytes)) {
+			found++;
+		}
+	}
+	if ((kept == topK) && found) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		PRINT("\t%d: Fail %lu %d %d\n", __LINE__, kept, count, found);
 		failed++;
 	}
-
-#ifdef OPTIMIZE_MQ_TRANSFER
-	z1 =  &gInitialAlloc[gInitIndex] + listSize;
-#else
-	z1 = z + 32 + listSize;
+	free(topk);
+	free(half);
+	free(big[1]);
+	free(big[2]);
 #endif
-	z = realloc(z, 40);
-	memset(&z[31],0,8);
-	strcpy(&z[31], "567890a");
-	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z:z1, 40, z);
-	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if (((0 < gMemInitialized)?1:(z1 == (char*)resp[0].ptr)) && (40 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr))) {
+
+#ifdef LARGE_REGISTRY
+	LISTxfer large[64];
+	int largeCount = requestLarge(mq, 0, large, 64);
+	char *above = malloc(gLargeThreshold + 64);
+	char *below = malloc(gLargeThreshold - 64);
+	char *largeGrown = realloc(malloc(gLargeThreshold), 2 * gLargeThreshold);
+	PRINT("%d. [%d] Show %p and %p grown by realloc are the largest entries, not %p\n", testnum++,__LINE__, above, largeGrown, below);
+	int largest = requestLarge(mq, 2, large, 64);
+	if ((2 == largest) && (largeGrown == large[0].ptr) && (2 * gLargeThreshold == large[0].size) && (large[0].flags & 0x1) &&
+			(above == large[1].ptr) && (gLargeThreshold + 64 == large[1].size) && (largeCount + 2 == gLargeTable.count)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		PRINT("\t%d: Fail %d %p,%lu %p,%lu %lu\n", __LINE__, largest, large[0].ptr, large[0].size, large[1].ptr, large[1].size, gLargeTable.count);
 		failed++;
 	}
-	z = realloc(z, 0);
-#ifdef OPTIMIZE_MQ_TRANSFER
-	z =  &gInitialAlloc[gInitIndex] + listSize;
-#else
-	z = z1 + 40 + listSize;
+	free(above);
+	free(below);
+	free(largeGrown);
+#ifdef __LP64__
+	/* Over 4GB the size is kept in sizeHigh. Not from the bootstrap arena, which reserves less, and overcommit may refuse it */
+	size_t over4GSize = (1UL << 32) + (1 << 16);
+	char *over4G = (0 < gMemInitialized) ? malloc(over4GSize) : NULL;
+	PRINT("%d. [%d] Show %p of %zu Bytes is kept with its full size, others are removed on free\n", testnum++,__LINE__, over4G, over4GSize);
+	largest = requestLarge(mq, 1, large, 64);
+	if (((NULL == over4G) || ((1 == largest) && (over4G == large[0].ptr) && (over4GSize == large[0].size) && (over4GSize == getItem(over4G)->size +
+			((size_t)getItem(over4G)->sizeHigh << 32)))) && (largeCount + ((over4G) ? 1 : 0) == gLargeTable.count)) {
+		PRINT("\tPass%s\n", (over4G) ? "" : ", 4GB not available to check the size");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %d %p,%lu %lu\n", __LINE__, largest, large[0].ptr, large[0].size, gLargeTable.count);
+		failed++;
+	}
+	free(over4G);
 #endif
-	z1 = realloc(NULL, 40);
-	strcpy(z1, "abcdefghijklmnopqrstuvwxyz1234567890");
-	PRINT("%d. [%d] Show %p,%d,%s\n", testnum++,__LINE__, (0 < gMemInitialized)?z1:z, 40, z1);
-	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if (((0 < gMemInitialized)?(z1 == (char*)resp[0].ptr):(z == (char*)resp[0].ptr)) && (40 == resp[0].size) && (!strcmp(z1,(char*)resp[0].ptr))) {
+#endif
+
+	msg_backend backend;
+	PRINT("%d. [%d] Show the %s backend serves the allocations, in the library built with 0x%x\n", testnum++,__LINE__, MEMWRAP_BACKEND_TRACKED, HEAPWALK_BASE);
+	if ((0 == requestBackend(mq, &backend)) && !strcmp(MEMWRAP_BACKEND_TRACKED, backend.name) && (HEAPWALK_BASE == backend.cmdBase)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr);
+		PRINT("\t%d: Fail %s 0x%x\n", __LINE__, backend.name, backend.cmdBase);
 		failed++;
 	}
-	z = memalign(64, 40);
-	free(z1);
-#if 0 //def PREPEND_LISTDATA
-	unsigned int alignment = 64;
-	unsigned int size = 40;
-	unsigned int newSize;
-        if (listSize < alignment) {
-                newSize = size + alignment;
-        } else {
-                newSize = size + listSize + (listSize % alignment);
-        }
+#ifdef LARGE_REGISTRY
+	/* Libc blocks are not tracked. No other call in between, the blocks of other threads would be freed by the other backend */
+	if (0 < gMemInitialized) {
+		unsigned long largeTracked = gLargeTable.count;
+		PRINT("%d. [%d] Show the %s backend neither tracks nor frees through the lists\n", testnum++,__LINE__, MEMWRAP_BACKEND_NONE);
+		gBackend = &gPassthroughBackend;
+		char *untracked = realloc(malloc(gLargeThreshold), 2 * gLargeThreshold);
+		unsigned long largeUntracked = gLargeTable.count;
+		bool allocated = (NULL != untracked);
+		free(untracked);
+		gBackend = &gTrackedBackend;
+		if (allocated && (largeTracked == largeUntracked) && (largeTracked == gLargeTable.count)) {
+			PRINT("\tPass\n");
+			passed++;
+		}
+		else {
+			PRINT("\t%d: Fail %d %lu %lu\n", __LINE__, allocated, largeTracked, largeUntracked);
+			failed++;
+		}
+	}
 #endif
-	
-	//z1 = z1 + 40 + listSize;
-	strcpy(z, "abcdefghijklmnopqrstuvwxyz1234567890");
-	PRINT("%d. [%d] Show %p,%d,%s,mod(z,64)=0\n", testnum++,__LINE__, z, 40, z);
+
+#ifdef TRACKING_PAUSE
+	/* Blocks are moved across the pause both ways, the backends free and realloc each other's blocks */
+	if (0 < gMemInitialized) {
+		char *beforePause = malloc(4096);
+		char *freedPaused = malloc(4096);
+		heapwalkPause(true);
+		bool paused = (&gPausedBackend == gBackend);
+		char *pausedBlock = malloc(4096);
+		char *pausedGrown = realloc(malloc(4096), 8192);
+		char *movedOut = realloc(beforePause, 8192);
+		free(freedPaused);
+		heapwalkPause(false);
+		char *resumed = realloc(pausedBlock, 8192);
+		LIST *grownItem = (LIST *)(pausedGrown - sizeof(LIST));
+		LIST *movedItem = (LIST *)(movedOut - sizeof(LIST));
+		PRINT("%d. [%d] Show %p and %p of the pause are untracked, %p is tracked once resumed\n", testnum++,__LINE__, pausedGrown, movedOut, resumed);
+		if (paused && (&gTrackedBackend == gBackend) && (LIST_UNSAMPLED_MAGIC == (grownItem->flags & 0xFFFF0000)) && (8192 == grownItem->size) &&
+				(grownItem->flags & 0x1) && (LIST_UNSAMPLED_MAGIC == (movedItem->flags & 0xFFFF0000)) && (8192 == movedItem->size) &&
+				getItem(resumed) && (8192 == getItem(resumed)->size)) {
+			PRINT("\tPass\n");
+			passed++;
+		}
+		else {
+			PRINT("\t%d: Fail %d %x,%u %x,%u %p\n", __LINE__, paused, grownItem->flags, grownItem->size, movedItem->flags, movedItem->size, getItem(resumed));
+			failed++;
+		}
+		free(pausedGrown);
+		free(movedOut);
+		free(resumed);
+
+		/* A paused block has a LIST with its key whatever its size, the key is cleared when freed */
+		volatile size_t huge = SIZE_MAX / 2;
+		errno = 0;
+		void *trackedOverflow = calloc(huge, 2);
+		int trackedErrno = errno;
+		heapwalkPause(true);
+		char *pausedSmall = malloc(16);
+		LIST *smallItem = (LIST *)(pausedSmall - sizeof(LIST));
+		bool keyed = (LIST_PAUSED_KEY(pausedSmall) == LIST_PAUSED_KEY_OF(pausedSmall)) && (16 == smallItem->size);
+		free(pausedSmall);
+		errno = 0;
+		void *pausedOverflow = calloc(huge, 2);
+		int pausedErrno = errno;
+		heapwalkPause(false);
+		PRINT("%d. [%d] Show a paused block is keyed, calloc of %zu * 2 fails with ENOMEM tracked and paused\n", testnum++,__LINE__, (size_t)huge);
+		if (keyed && !trackedOverflow && (ENOMEM == trackedErrno) && !pausedOverflow && (ENOMEM == pausedErrno)) {
+			PRINT("\tPass\n");
+			passed++;
+		}
+		else {
+			PRINT("\t%d: Fail %d %p,%d %p,%d\n", __LINE__, keyed, trackedOverflow, trackedErrno, pausedOverflow, pausedErrno);
+			failed++;
+		}
+	}
+#endif
+
+#ifdef SAMPLED_TRACKING
+	/* Mean of 1KB between tracked allocations, an allocation of 64KB is tracked but for e^-64 probability */
+	gSampleLevel = 1;
+	resetSampling();
+	char *lg = malloc(64 << 10);
+	PRINT("%d. [%d] Show %p,%d is tracked with its sampling level when sampled\n", testnum++,__LINE__, lg, 64 << 10);
 	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if ((z == (char*)resp[0].ptr) && (40 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr)) && !((unsigned long)z%64)) {
+	if ((lg == (char*)resp[0].ptr) && ((64 << 10) == resp[0].size) && (NULL == resp[1].ptr) &&
+			((1 << LIST_SAMPLE_SHIFT) == (((LIST *)(lg - sizeof(LIST)))->flags & LIST_SAMPLE_MASK))) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s,%lu\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, ((unsigned long)z%64));
+		PRINT("\t%d: Fail %p,%d %p,%x\n", __LINE__, resp[0].ptr, resp[0].size, resp[1].ptr, ((LIST *)(lg - sizeof(LIST)))->flags);
 		failed++;
 	}
-	z1 = memalign(32, 64);
-	free(z);
-	//z = z1 + 64 + listSize;
-	strcpy(z1, "abcdefghijklmnopqrstuvwxyz123456abcdefghijklmnopqrstuvwxyz12345");
-	PRINT("%d. [%d] Show %p,%d,%s,mod(z,32)=0\n", testnum++,__LINE__, z1, 64, z1);
-	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if ((z1 == (char*)resp[0].ptr) && (64 == resp[0].size) && (!strcmp(z1,(char*)resp[0].ptr)) && !((unsigned long)z1%32)) {
+	/* Mean of 16MB, a small allocation is tracked with 1e-6 probability */
+	gSampleLevel = SAMPLE_LEVEL_MAX;
+	resetSampling();
+	char *sm = malloc(16);
+	PRINT("%d. [%d] Show %p,%d is not tracked when sampled\n", testnum++,__LINE__, sm, 16);
+	if ((LIST_UNSAMPLED_MAGIC == (((LIST *)(sm - sizeof(LIST)))->flags & 0xFFFF0000)) &&
+			(16 == ((LIST *)(sm - sizeof(LIST)))->size)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s,%lu\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, ((unsigned long)z1%32));
+		PRINT("\t%d: Fail %p,%x\n", __LINE__, sm, ((LIST *)(sm - sizeof(LIST)))->flags);
 		failed++;
 	}
-	free(z1);
-	z = memalign(128, 27);
-	strcpy(z, "abcdefghijklmnopqrstuvwxyz");
-	PRINT("%d. [%d] Show %p,%d,%s,mod(z,128)=0\n", testnum++,__LINE__, z, 27, z);
+	free(sm);
+	free(lg);
+
+	/* Tracking all with a budget of 1 byte, the next overhead check starts sampling */
+	char *tr[SAMPLE_BUDGET_CHECK];
+	gSampleLevel = 0;
+	gOverheadBudget = 1;
+	for (int i = 0; i < SAMPLE_BUDGET_CHECK; i++) {
+		tr[i] = malloc(8);
+	}
+	PRINT("%d. [%d] Show sampling level raised over the overhead budget\n", testnum++,__LINE__);
+	if (0 < gSampleLevel) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\t%d: Fail %u\n", __LINE__, gSampleLevel);
+		failed++;
+	}
+	gOverheadBudget = 0;
+	gSampleLevel = 0;
+	resetSampling();
+	for (int i = 0; i < SAMPLE_BUDGET_CHECK; i++) {
+		free(tr[i]);
+	}
+#endif
+
+#ifdef COMPACT_LIST
+	gCompactListMaxSize = COMPACT_LIST_MAX_SIZE;
+	char *cl = malloc(24);
+	strcpy(cl, "abcdefghijklmnopqrstuvw");
+	PRINT("%d. [%d] Show %p,%d,%s kept with the compact header\n", testnum++,__LINE__, cl, 24, cl);
 	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if ((z == (char*)resp[0].ptr) && (27 == resp[0].size) && (!strcmp(z,(char*)resp[0].ptr)) && !((unsigned long)z%128)) {
+	if ((cl == (char*)resp[0].ptr) && (24 == resp[0].size) && (gettid() == resp[0].tid) && (NULL != resp[0].ra) && (NULL == resp[1].ptr) &&
+			(0xBEAD0000 == (((CLIST *)(cl - sizeof(CLIST)))->flags & 0xFFFF0000)) && (((CLIST *)(cl - sizeof(CLIST)))->flags & LIST_COMPACT)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s,%lu\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, ((unsigned long)z%128));
+		PRINT("\t%d: Fail %p,%d,%d,%p %p,%x\n", __LINE__, resp[0].ptr, resp[0].size, resp[0].tid, resp[0].ra, resp[1].ptr, ((CLIST *)(cl - sizeof(CLIST)))->flags);
 		failed++;
 	}
-	z1 = memalign(4096, 64);
-	strcpy(z1, "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz0123456789");
-	PRINT("%d. [%d] Show %p,%d,%s,mod(z,4096)=0\n", testnum++,__LINE__, z1, 64, z1);
+	cl = realloc(cl, 4000);
+	PRINT("%d. [%d] Show %p,%d,%s moved to the full header\n", testnum++,__LINE__, cl, 4000, cl);
 	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if ((z1 == (char*)resp[0].ptr) && (64 == resp[0].size) && (!strcmp(z1,(char*)resp[0].ptr)) && !((unsigned long)z1%4096)) {
+	if ((cl == (char*)resp[0].ptr) && (4000 == resp[0].size) && (!strcmp(cl, "abcdefghijklmnopqrstuvw")) && (NULL == resp[1].ptr) &&
+			(0xBEAD0000 == (((LIST *)(cl - sizeof(LIST)))->flags & 0xFFFF0000)) && !(((LIST *)(cl - sizeof(LIST)))->flags & LIST_COMPACT)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
 	else {
-		PRINT("\t%d: Fail %p,%d,%s,%lu\n", __LINE__, resp[0].ptr, resp[0].size, (char*)resp[0].ptr, ((unsigned long)z1%4096));
+		PRINT("\t%d: Fail %p,%d,%s %p\n", __LINE__, resp[0].ptr, resp[0].size, cl, resp[1].ptr);
 		failed++;
 	}
+	free(cl);
+#endif
+
+	/* A client that doesn't receive the answer: /mq_util is filled, the answer is given up in a bounded time,
+	 * first for a client that has exited, then for a live one over the send timeout */
+	{
+		mqd_t mqfill = mq_open("/mq_util", O_WRONLY | O_NONBLOCK);
+		long timeoutMs = gWalkSendTimeoutMs;
+		msg_resp fill;
+		struct timespec start, now;
+
+		memset(&fill, 0, sizeof(fill));
+		while (0 == mq_send(mqfill, (const char *)&fill, sizeof(fill), 0));
+		pid_t gone = fork();
+		if (0 == gone) {
+			_exit(0);
+		}
+		waitpid(gone, NULL, 0);
+		for (int live = 0; live < 2; live++) {
+			unsigned long aborts = __atomic_load_n(&gWalkAborts, __ATOMIC_SEQ_CST);
+			long waitedMs = 0, maxAllocMs = 0;
+			msg_cmd msgcmd;
+			char mq_name[64];
+
+			gWalkSendTimeoutMs = (live) ? 300 : 10000;
+			memset(&msgcmd, 0, sizeof(msgcmd));
+			msgcmd.cmd = HEAPWALK_FULL;
+			msgcmd.pid = getpid();
+			msgcmd.client = (live) ? getpid() : gone;
+			msgcmd.options = HEAPWALK_OPT_NONE;
+			sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
+			mqd_t mqsend = mq_open(mq_name, O_WRONLY);
+			mq_send(mqsend, (const char *)&msgcmd, sizeof(msgcmd), 0);
+			mq_close(mqsend);
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			while ((aborts == __atomic_load_n(&gWalkAborts, __ATOMIC_SEQ_CST)) && (waitedMs < 5000)) {
+				struct timespec alloc;
+				clock_gettime(CLOCK_MONOTONIC, &alloc);
+				free(malloc(16));
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				long allocMs = (now.tv_sec - alloc.tv_sec) * 1000 + (now.tv_nsec - alloc.tv_nsec) / 1000000;
+				maxAllocMs = (allocMs > maxAllocMs) ? allocMs : maxAllocMs;
+				waitedMs = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+				usleep(1000);
+			}
+			PRINT("%d. [%d] Show the heapwalk is given up in %ld ms for the %s client not receiving\n", testnum++,__LINE__, waitedMs, (live) ? "live" : "exited");
+			if ((aborts + 1 == gWalkAborts) && (waitedMs < 2000) && (maxAllocMs < 2000)) {
+				PRINT("\tPass\n");
+				passed++;
+			}
+			else {
+				PRINT("\t%d: Fail %lu,%lu %ld,%ld\n", __LINE__, aborts, gWalkAborts, waitedMs, maxAllocMs);
+				failed++;
+			}
+		}
+		gWalkSendTimeoutMs = timeoutMs;
+		mq_close(mqfill);
+		/* Drop the filled messages, and anything the walks sent before giving up */
+		mqd_t mqpurge = mq_open("/mq_util", O_RDONLY | O_NONBLOCK);
+		while (0 <= mq_receive(mqpurge, (char *)&fill, sizeof(fill), NULL));
+		mq_close(mqpurge);
+	}
+
+#ifdef SNAPSHOT_HEAPWALK
+	/* A snapshot walk given up by its child leaves the entries new, the next walk shows them */
+	{
+		mqd_t mqfill = mq_open("/mq_util", O_WRONLY | O_NONBLOCK);
+		unsigned long aborts = __atomic_load_n(&gWalkAborts, __ATOMIC_SEQ_CST);
+		LIST snapResp[64];
+		msg_resp fill;
+		msg_cmd msgcmd;
+		char mq_name[64];
+		int waitedMs = 0, found = 0;
+		char *unwalked;
+
+		sendAndRecv(mq, HEAPWALK_MARKALL, resp, 8, 0);
+		unwalked = malloc(88);
+		memset(&fill, 0, sizeof(fill));
+		while (0 == mq_send(mqfill, (const char *)&fill, sizeof(fill), 0));
+		pid_t gone = fork();
+		if (0 == gone) {
+			_exit(0);
+		}
+		waitpid(gone, NULL, 0);
+		memset(&msgcmd, 0, sizeof(msgcmd));
+		msgcmd.cmd = HEAPWALK_INCREMENT;
+		msgcmd.pid = getpid();
+		msgcmd.client = gone;
+		msgcmd.options = HEAPWALK_OPT_SNAPSHOT;
+		sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
+		mqd_t mqsend = mq_open(mq_name, O_WRONLY);
+		mq_send(mqsend, (const char *)&msgcmd, sizeof(msgcmd), 0);
+		mq_close(mqsend);
+		while ((aborts == __atomic_load_n(&gWalkAborts, __ATOMIC_SEQ_CST)) && (waitedMs < 5000)) {
+			usleep(10000);
+			waitedMs += 10;
+		}
+		mq_close(mqfill);
+		mqd_t mqpurge = mq_open("/mq_util", O_RDONLY | O_NONBLOCK);
+		while (0 <= mq_receive(mqpurge, (char *)&fill, sizeof(fill), NULL));
+		mq_close(mqpurge);
+		gWalkOptions = HEAPWALK_OPT_SNAPSHOT;
+		sendAndRecv(mq, HEAPWALK_INCREMENT, snapResp, 64, 0);
+		gWalkOptions = HEAPWALK_OPT_NONE;
+		for (int i = 0; (i < 64) && snapResp[i].ptr; i++) {
+			found += (unwalked == (char*)snapResp[i].ptr) && (88 == snapResp[i].size);
+		}
+		PRINT("%d. [%d] Show %p,%d again after the snapshot walk given up in %d ms\n", testnum++,__LINE__, unwalked, 88, waitedMs);
+		if ((aborts + 1 == gWalkAborts) && (1 == found)) {
+			PRINT("\tPass\n");
+			passed++;
+		}
+		else {
+			PRINT("\t%d: Fail %lu,%lu %d\n", __LINE__, aborts, gWalkAborts, found);
+			failed++;
+		}
+		free(unwalked);
+	}
+#endif
 
 	dbg(PRINT_MUST, "Total test cases: %d [Pass %d Fail %d]\n", passed+failed, passed, failed);
 
@@ -516,11 +1993,106 @@ void runListTests(mqd_t mq)
 	int *x[10];
 	int passed=0, failed=0;
 	int testnum = 1;
+#ifdef COMPACT_LIST
+	/* Entries are checked through their LIST */
+	gCompactListMaxSize = 0;
+#endif
 
 	dbg(PRINT_MUST, "\n**********************************\n%s: %d\n**********************************\n", __FUNCTION__, getpid());
 	x[0] = malloc(8);
 
-#ifdef MAINTAIN_SINGLE_LIST
+#if defined(SIDE_TABLE)
+	LIST *item = getItem(x[0]);
+	PRINT("\n%d. [%d] Show ptr[%p] = item->ptr[%p], 8 = item->size, not walked, aligned as malloc's once loaded\n", testnum++,__LINE__, x[0], (item)?item->ptr:NULL);
+	if (item && (x[0] == (int*)item->ptr) && (8 == item->size) && !item->walked &&
+			((0 >= gMemInitialized) || (0 == ((unsigned long)x[0] % (2 * sizeof(size_t)))))) {
+		PRINT("\tPass\n");
+		passed++;
+	} else {
+		PRINT("\tFail %p,%u,%u\n", (item)?item->ptr:NULL, (item)?item->size:0, (item)?item->walked:0);
+		failed++;
+	}
+
+	PRINT("%d. [%d] Show %p,%p\n", testnum++,__LINE__, x[0], NULL);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	item = getItem(x[0]);
+	if ((x[0] == (int*)resp[0].ptr) && (NULL == (int*)resp[1].ptr) && item && item->walked) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\tFail %p,%p\n", resp[0].ptr, resp[1].ptr);
+		failed++;
+	}
+
+	PRINT("\n%d. [%d] Show [null]\n", testnum++,__LINE__);
+	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
+	if (NULL == (int*)resp[0].ptr) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\tFail %p\n", resp[0].ptr);
+		failed++;
+	}
+
+	/* Enough entries for the shards to grow, deleted slots in between */
+	static int *many[32768];
+	unsigned long capacity = 0, heapSize = 0;
+	int found = 0;
+	for (int i = 0; i < 32768; i++) {
+		many[i] = malloc(8);
+		if (i % 2) {
+			free(many[i - 1]);
+		}
+	}
+	for (int i = 1; i < 32768; i += 2) {
+		item = getItem(many[i]);
+		found += (item && (many[i] == (int*)item->ptr) && (8 == item->size)) ? 1 : 0;
+	}
+	for (int i = 0; i < SIDE_TABLE_SHARDS; i++) {
+		capacity += gSideTable[i].capacity;
+		heapSize += gSideTable[i].heapSize;
+	}
+	PRINT("\n%d. [%d] Show 16384 entries found, capacity[%lu] grown, heapSize[%lu] = %d\n", testnum++,__LINE__, capacity, heapSize, 8 * 16385);
+	if ((16384 == found) && (capacity > SIDE_TABLE_SHARDS * SIDE_TABLE_INITIAL_SLOTS) && (8 * 16385 == heapSize)) {
+		PRINT("\tPass\n");
+		passed++;
+	} else {
+		PRINT("\tFail %d\n", found);
+		failed++;
+	}
+
+	for (int i = 1; i < 32768; i += 2) {
+		free(many[i]);
+	}
+	found = 0;
+	for (int i = 1; i < 32768; i += 2) {
+		found += getItem(many[i]) ? 1 : 0;
+	}
+	PRINT("\n%d. [%d] Show %p and no other entry\n", testnum++,__LINE__, x[0]);
+	sendAndRecv(mq, HEAPWALK_FULL, resp, 8, 0);
+	if (!found && (x[0] == (int*)resp[0].ptr) && (NULL == (int*)resp[1].ptr)) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\tFail %d %p,%p\n", found, resp[0].ptr, resp[1].ptr);
+		failed++;
+	}
+
+	free(x[0]);
+	PRINT("\n%d. [%d] Show [null]\n", testnum++,__LINE__);
+	sendAndRecv(mq, HEAPWALK_FULL, resp, 8, 1);
+	if ((NULL == (int*)resp[0].ptr) && !getItem(x[0])) {
+		PRINT("\tPass\n");
+		passed++;
+	}
+	else {
+		PRINT("\tFail %p\n", resp[0].ptr);
+		failed++;
+	}
+#elif defined(MAINTAIN_SINGLE_LIST)
 	PRINT("\n%d. [%d] Show ptr[%p] = hpfmemhead->ptr[%p] = hpwmemhead->ptr[%p] = hpfmemtail->ptr[%p], [NULL] hpfmemhead->next[%p] hpfmemtail->next[%p]\n", 
 			testnum++,__LINE__, x[0], (hpfmemhead)?hpfmemhead->ptr:NULL, (hpfmemtail)?hpfmemtail->ptr:NULL, 
 			(hpwmemhead)?hpwmemhead->ptr:NULL, (hpfmemhead)?hpfmemhead->next:NULL, (hpfmemtail)?hpfmemtail->next:NULL);
@@ -1583,13 +3155,26 @@ void runListTests(mqd_t mq)
 
 	x[4] = malloc(8);
 	strcpy((char*)x[1], "12345678");;
+	/* realloc appends x[1] again, with INPLACE_REALLOC it keeps its place unless in the bootstrap arena */
+	int *order[5] = {x[0], x[2], x[3], x[4], NULL};
+#ifdef INPLACE_REALLOC
+	bool x1Kept = (0 < gMemInitialized) && !bootstrapHolds(x[1]);
+#else
+	bool x1Kept = false;
+#endif
 	x[1] = realloc(x[1], 17);
 	strcat((char*)x[1], "87654321");;
-	PRINT("\n%d. [%d] Show %p,%p,%p,%p,%p,[%s]\n", testnum++,__LINE__, x[0], x[2], x[3], x[4], x[1], "1234567887654321");
+	if (x1Kept) {
+		order[1] = x[1]; order[2] = x[2]; order[3] = x[3]; order[4] = x[4];
+	}
+	else {
+		order[4] = x[1];
+	}
+	PRINT("\n%d. [%d] Show %p,%p,%p,%p,%p,[%s]\n", testnum++,__LINE__, order[0], order[1], order[2], order[3], order[4], "1234567887654321");
 	sendAndRecv(mq, HEAPWALK_FULL, resp, 8, 0);
-	if ((x[0] == (int*)resp[0].ptr) && (x[2] == (int*)resp[1].ptr) && 
-	    (x[3] == (int*)resp[2].ptr) && (x[4] == (int*)resp[3].ptr) && 
-	    (x[1] == (int*)resp[4].ptr) && (!strcmp((char*)x[1], "1234567887654321")) && (NULL == (int*)resp[5].ptr)) {
+	if ((order[0] == (int*)resp[0].ptr) && (order[1] == (int*)resp[1].ptr) && 
+	    (order[2] == (int*)resp[2].ptr) && (order[3] == (int*)resp[3].ptr) && 
+	    (order[4] == (int*)resp[4].ptr) && (!strcmp((char*)x[1], "1234567887654321")) && (NULL == (int*)resp[5].ptr)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
@@ -1613,11 +3198,11 @@ void runListTests(mqd_t mq)
 		failed++;
 	}
 
-	PRINT("\n%d. [%d] Show %p,%p,%p,%p,%p,%p\n", testnum++,__LINE__, x[0], x[2], x[3], x[4], x[1], x[5]);
+	PRINT("\n%d. [%d] Show %p,%p,%p,%p,%p,%p\n", testnum++,__LINE__, order[0], order[1], order[2], order[3], order[4], x[5]);
 	sendAndRecv(mq, HEAPWALK_FULL, resp, 8, 0);
-	if ((x[0] == (int*)resp[0].ptr) && (x[2] == (int*)resp[1].ptr) && 
-	    (x[3] == (int*)resp[2].ptr) && (x[4] == (int*)resp[3].ptr) && 
-	    (x[1] == (int*)resp[4].ptr) && (x[5] == (int*)resp[5].ptr) && (NULL == (int*)resp[6].ptr)) {
+	if ((order[0] == (int*)resp[0].ptr) && (order[1] == (int*)resp[1].ptr) && 
+	    (order[2] == (int*)resp[2].ptr) && (order[3] == (int*)resp[3].ptr) && 
+	    (order[4] == (int*)resp[4].ptr) && (x[5] == (int*)resp[5].ptr) && (NULL == (int*)resp[6].ptr)) {
 		PRINT("\tPass\n");
 		passed++;
 	}
@@ -1629,12 +3214,12 @@ void runListTests(mqd_t mq)
 	}
 
 	x[6] = malloc(8);
-	PRINT("\n%d. [%d] Show %p,%p,%p,%p,%p,%p,%p\n", testnum++,__LINE__, x[0], x[2], x[3], x[4], x[1], x[5], x[6]);
+	PRINT("\n%d. [%d] Show %p,%p,%p,%p,%p,%p,%p\n", testnum++,__LINE__, order[0], order[1], order[2], order[3], order[4], x[5], x[6]);
 	sendAndRecv(mq, HEAPWALK_RESET_MARKED, resp, 8, 0);
 	sendAndRecv(mq, HEAPWALK_INCREMENT, resp, 8, 0);
-	if ((x[0] == (int*)resp[0].ptr) && (x[2] == (int*)resp[1].ptr) && 
-	    (x[3] == (int*)resp[2].ptr) && (x[4] == (int*)resp[3].ptr) && 
-	    (x[1] == (int*)resp[4].ptr) && (x[5] == (int*)resp[5].ptr) && 
+	if ((order[0] == (int*)resp[0].ptr) && (order[1] == (int*)resp[1].ptr) && 
+	    (order[2] == (int*)resp[2].ptr) && (order[3] == (int*)resp[3].ptr) && 
+	    (order[4] == (int*)resp[4].ptr) && (x[5] == (int*)resp[5].ptr) && 
 	    (x[6] == (int*)resp[6].ptr) && (NULL == (int*)resp[7].ptr)) {
 		PRINT("\tPass\n");
 		passed++;
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <fcntl.h>	  /* For O_* constants */
 #include <sys/stat.h> /* For mode constants */
+#include <sys/mman.h>
 #include <mqueue.h>
 #include <time.h>
 #include <sys/types.h>
@@ -12,6 +13,7 @@
 #include <errno.h>
 #include <string.h>
 #include <limits.h> /* For ULONG_MAX */
+#include <math.h>
 
 #include "memfns_wrap.h"
 
@@ -22,6 +24,12 @@ extern void spawntestrunthread();
 
 static const char versionString[] = "" MEMWRAP_MAJOR_VERSION "." MEMWRAP_MINOR_VERSION "";
 
+#ifdef CXX_OPERATORS
+#define ENTRY_API(flags) (((flags) & LIST_CXX) ? " - C++" : "")
+#else
+#define ENTRY_API(flags) ""
+#endif
+
 /**
  * @brief Creates a message queue for receiving messages.
  *
@@ -147,10 +155,159 @@ mqd_t createMq()
 }
 
 #ifdef OPTIMIZE_MQ_TRANSFER
+#ifdef SHM_TRANSFER
+/* Shared memory segments of the last walk, [0] for already walked and [1] for new. Unmapped once processed */
+static struct
+{
+	char *base;
+	size_t size;
+} gShmWalk[2];
+
+/**
+ * @brief Maps the shared memory segment of a walk and unlinks it.
+ *
+ * @param pid The process ID of the target process.
+ * @param walked true for the segment of already walked entries, false for new entries.
+ */
+static void mapShmSegment(int pid, bool walked)
+{
+	char shmName[32];
+	struct stat st;
+	int index = (walked) ? 0 : 1;
+
+	sprintf(shmName, (walked) ? SHM_WALKED_NAME : SHM_NEW_NAME, pid);
+	int fd = shm_open(shmName, O_RDONLY, 0);
+	if (0 > fd)
+	{
+		dbg(PRINT_MUST, "%s open error, %s\n", shmName, strerror(errno));
+		return;
+	}
+	/* Mapping stays till processHeapwalk is done with it */
+	shm_unlink(shmName);
+	if (!fstat(fd, &st) && st.st_size)
+	{
+		char *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (MAP_FAILED == base)
+		{
+			dbg(PRINT_MUST, "%s mmap error, %s\n", shmName, strerror(errno));
+		}
+		else
+		{
+			gShmWalk[index].base = base;
+			gShmWalk[index].size = st.st_size;
+		}
+	}
+	close(fd);
+}
+#endif
+
+#ifdef STACK_DEPOT
+/**
+ * @brief Stores the stacks sent after the entries of a heapwalk to a file.
+ *
+ * @param mqrecv The message queue descriptor to receive messages from.
+ * @param pid The process ID of the target process.
+ * @return 0 once the last stack message is stored.
+ */
+static int storeStacks(mqd_t mqrecv, int pid)
+{
+	msg_compact msg;
+	unsigned int prio;
+	struct timespec tm;
+	char stacksFile[32];
+	sprintf(stacksFile, "/tmp/hps_%d.dat", pid);
+	FILE *fpStacks = fopen(stacksFile, "wb");
+	if (NULL == fpStacks)
+	{
+		dbg(PRINT_MUST, "%s open error, %s\n", stacksFile, strerror(errno));
+		return 1;
+	}
+	do
+	{
+		clock_gettime(CLOCK_REALTIME, &tm);
+		tm.tv_sec += 10;
+		int msgsize = mq_timedreceive(mqrecv, (char *)&msg, sizeof(msg_compact), &prio, &tm);
+		if (-1 == msgsize) {
+			if (ETIMEDOUT == errno) {
+				dbg(PRINT_MUST, "%s:%d: Giving up..waited for 10 secs\n", __FUNCTION__, __LINE__);
+			}else {
+				dbg(PRINT_MUST, "%s:%d: mq_timedreceive failed [%s]\n", __FUNCTION__, __LINE__, strerror(errno));
+			}
+			fclose(fpStacks);
+			return 1;
+		}
+		if (!(HEAPWALK_STACK_DEPOT & msg.numItemOrInfo))
+		{
+			dbg(PRINT_MUST, "%s: Unexpected message %x\n", __FUNCTION__, msg.numItemOrInfo);
+			fclose(fpStacks);
+			return 1;
+		}
+		if (!fwrite((void *)&msg, msgsize, 1, fpStacks))
+		{
+			dbg(PRINT_MUST, "%s: Error storing %s\n", __FUNCTION__, strerror(errno));
+		}
+	} while (HEAPWALK_ITEM_CONTN & msg.numItemOrInfo);
+	fclose(fpStacks);
+	return 0;
+}
+#endif
+
+#ifdef MMAP_TRACKING
+/**
+ * @brief Stores the mappings sent after the walk of HEAPWALK_MMAP_ENTRIES to a file.
+ *
+ * @param mqrecv The message queue descriptor to receive messages from.
+ * @param pid The process ID of the target process.
+ * @return 0 once the last mapping message is stored.
+ */
+static int storeMappings(mqd_t mqrecv, int pid)
+{
+	union
+	{
+		msg_resp resp;
+		msg_mappings mappings;
+	} msg;
+	unsigned int prio;
+	struct timespec tm;
+	char mappingsFile[32];
+	sprintf(mappingsFile, "/tmp/hpm_%d.dat", pid);
+	FILE *fpMappings = fopen(mappingsFile, "wb");
+	if (NULL == fpMappings)
+	{
+		dbg(PRINT_MUST, "%s open error, %s\n", mappingsFile, strerror(errno));
+		return 1;
+	}
+	do
+	{
+		clock_gettime(CLOCK_REALTIME, &tm);
+		tm.tv_sec += 10;
+		if (-1 == mq_timedreceive(mqrecv, (char *)&msg, sizeof(msg), &prio, &tm))
+		{
+			if (ETIMEDOUT == errno) {
+				dbg(PRINT_MUST, "%s:%d: Giving up..waited for 10 secs\n", __FUNCTION__, __LINE__);
+			}else {
+				dbg(PRINT_MUST, "%s:%d: mq_timedreceive failed [%s]\n", __FUNCTION__, __LINE__, strerror(errno));
+			}
+			fclose(fpMappings);
+			return 1;
+		}
+		unsigned int count = msg.mappings.numItemOrInfo & 0xFFFFFFF;
+		if (count && ((MAX_MAPPING_XFER < count) || (count != fwrite(msg.mappings.mappings, sizeof(MAPPING), count, fpMappings))))
+		{
+			dbg(PRINT_MUST, "%s: Error storing %s\n", __FUNCTION__, strerror(errno));
+		}
+	} while (HEAPWALK_ITEM_CONTN & msg.mappings.numItemOrInfo);
+	fclose(fpMappings);
+	return 0;
+}
+#endif
+
 /**
  * @brief Stores heapwalk data to a file.
  *
  * This function receives heapwalk data from the message queue and stores it to a file for analysis.
+ * With STACK_DEPOT, the stacks following the entries are stored to /tmp/hps_<pid>.dat.
+ * With MMAP_TRACKING, the mappings following HEAPWALK_MMAP_ENTRIES are stored to /tmp/hpm_<pid>.dat.
  *
  * @param mqrecv The message queue descriptor to receive messages from.
  * @param cmd The command indicating the type of heapwalk operation.
@@ -209,9 +366,22 @@ int storeHeapwalk(mqd_t mqrecv, int cmd, int pid, bool isSelfTest)
 		else if (msgsize)
 		{
 			unsigned int info = msgresp.numItemOrInfo & 0x30000000;
+#ifdef SHM_TRANSFER
+			if (HEAPWALK_SHM_SEGMENT & msgresp.numItemOrInfo)
+			{
+				/* Entries are in the segment, rest follow on the queue if the segment couldn't hold them */
+				mapShmSegment(pid, (fpHWFull == fpCurrent));
+				if (HEAPWALK_ITEM_CONTN == info)
+				{
+					continue;
+				}
+			}
+			else
+#endif
 			if (info)
 			{
-				if (!fwrite((void *)&msgresp, sizeof(msg_resp), 1, fpCurrent))
+				/* Messages are variable length with COMPACT_TRANSFER */
+				if (!fwrite((void *)&msgresp, msgsize, 1, fpCurrent))
 				{
 					dbg(PRINT_MUST, "%s: Error storing %s\n", __FUNCTION__, strerror(errno));
 				}
@@ -240,6 +410,18 @@ int storeHeapwalk(mqd_t mqrecv, int cmd, int pid, bool isSelfTest)
 			}
 		}
 	}
+#ifdef STACK_DEPOT
+	if (storeStacks(mqrecv, pid))
+	{
+		return 1;
+	}
+#endif
+#ifdef MMAP_TRACKING
+	if (HEAPWALK_MMAP_ENTRIES == cmd)
+	{
+		return storeMappings(mqrecv, pid);
+	}
+#endif
 	return 0;
 }
 
@@ -306,6 +488,106 @@ void removeAnonEntries()
 }
 
 char storedTime[32];
+
+#ifdef MMAP_TRACKING
+/* Mappings of the HEAPWALK_MMAP_ENTRIES being processed by address, loaded from /tmp/hpm_<pid>.dat */
+static MAPPING *gMappings;
+static unsigned long gMappingCount;
+
+/**
+ * @brief Loads the mappings stored by storeMappings and adds their sizes to the anon entries they start in.
+ *
+ * @param pid The process ID of the target process.
+ * @param mmapIn The anon entries.
+ */
+static void loadMappings(int pid, MMAP_anon *mmapIn)
+{
+	char mappingsFile[32];
+	MAPPING mapping;
+	sprintf(mappingsFile, "/tmp/hpm_%d.dat", pid);
+	FILE *fpMappings = fopen(mappingsFile, "rb");
+
+	if (NULL == fpMappings)
+	{
+		dbg(PRINT_MUST, "%s open error, %s\n", mappingsFile, strerror(errno));
+		return;
+	}
+	while (1 == fread(&mapping, sizeof(MAPPING), 1, fpMappings))
+	{
+		MAPPING *mappings = realloc(gMappings, (gMappingCount + 1) * sizeof(MAPPING));
+		if (NULL == mappings)
+		{
+			break;
+		}
+		gMappings = mappings;
+		gMappings[gMappingCount++] = mapping;
+		for (MMAP_anon *tmpprn = mmapIn; tmpprn; tmpprn = tmpprn->next)
+		{
+			if ((tmpprn->startAddress <= mapping.start) && (tmpprn->endAddress > mapping.start))
+			{
+				tmpprn->mappedEntries += mapping.size;
+				break;
+			}
+		}
+	}
+	fclose(fpMappings);
+}
+
+/**
+ * @brief Prints the mappings starting in an address range, summed by the site that mapped them.
+ *
+ * @param startAddress The start of the range.
+ * @param endAddress The end of the range, 0 for the mappings outside of all the anon entries.
+ * @param mmapIn The anon entries, with endAddress 0.
+ * @param header Printed before the first site, if any.
+ */
+static void printMappings(unsigned long startAddress, unsigned long endAddress, MMAP_anon *mmapIn, const char *header)
+{
+	bool *printed = calloc(gMappingCount, sizeof(bool));
+	if ((NULL == printed) && gMappingCount)
+	{
+		return;
+	}
+	for (unsigned long i = 0; i < gMappingCount; i++)
+	{
+		bool within = (endAddress) ? ((startAddress <= gMappings[i].start) && (endAddress > gMappings[i].start)) : true;
+		for (MMAP_anon *tmpprn = (endAddress) ? NULL : mmapIn; tmpprn && within; tmpprn = tmpprn->next)
+		{
+			within = !((tmpprn->startAddress <= gMappings[i].start) && (tmpprn->endAddress > gMappings[i].start));
+		}
+		if (!within)
+		{
+			printed[i] = true;
+		}
+	}
+	for (unsigned long i = 0; i < gMappingCount; i++)
+	{
+		if (printed[i])
+		{
+			continue;
+		}
+		unsigned long size = 0, released = 0;
+		unsigned int count = 0;
+		for (unsigned long j = i; j < gMappingCount; j++)
+		{
+			if (!printed[j] && (gMappings[j].ra == gMappings[i].ra))
+			{
+				size += gMappings[j].size;
+				released += gMappings[j].released;
+				count++;
+				printed[j] = true;
+			}
+		}
+		if (header)
+		{
+			PRINT("%s", header);
+			header = NULL;
+		}
+		PRINT("\t  Explicitly mapped by site %p: %lu Bytes in %u mappings, %lu Bytes released\n", gMappings[i].ra, size, count, released);
+	}
+	free(printed);
+}
+#endif
 typedef struct threadstat
 {
 	int tid;
@@ -388,6 +670,243 @@ void printThreadStat()
 	PRINT("\n");
 }
 
+#ifdef COMPACT_TRANSFER
+/**
+ * @brief Reads an unsigned varint.
+ *
+ * @param in Read position, advanced past the varint.
+ * @param end End of the encoded data.
+ * @return The decoded value, 0 if the data is truncated.
+ */
+static unsigned long compactGetVarint(const unsigned char **in, const unsigned char *end)
+{
+	unsigned long value = 0;
+	unsigned int shift = 0;
+	while ((*in < end) && (shift < 64))
+	{
+		unsigned char byte = *(*in)++;
+		value |= (unsigned long)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			return value;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+/**
+ * @brief Reverses the zigzag mapping of a signed delta.
+ */
+static long compactUnzigzag(unsigned long value)
+{
+	return (long)(value >> 1) ^ -(long)(value & 1);
+}
+
+/**
+ * @brief Decodes the entries of a compact message into msg_resp.
+ *
+ * @param msg The compact message.
+ * @param msgresp The message to be filled.
+ * @return false if the message is corrupted.
+ */
+static bool compactDecode(const msg_compact *msg, msg_resp *msgresp)
+{
+	const unsigned char *in = msg->encoded;
+	const unsigned char *end = msg->encoded + msg->encodedSize;
+	unsigned int count = msg->numItemOrInfo & 0xFFFFFFF;
+	void *dict[COMPACT_RA_DICT_SIZE];
+	unsigned int dictCount = 0;
+	LISTxfer prev = {0};
+	void *prevRa = NULL;
+
+	msgresp->numItemOrInfo = msg->numItemOrInfo;
+	msgresp->totalHeapSize = msg->totalHeapSize;
+	msgresp->totalOverhead = msg->totalOverhead;
+	if ((MAX_MSG_XFER < count) || (sizeof(msg->encoded) < msg->encodedSize))
+	{
+		return false;
+	}
+	for (unsigned int i = 0; i < count; i++)
+	{
+		LISTxfer *xfer = &msgresp->xfer[i];
+		xfer->flags = prev.flags ^ (unsigned int)compactGetVarint(&in, end);
+		xfer->ptr = (void *)((unsigned long)prev.ptr + compactUnzigzag(compactGetVarint(&in, end)));
+		xfer->size = compactGetVarint(&in, end);
+		unsigned long index = compactGetVarint(&in, end);
+		if (index < dictCount)
+		{
+			xfer->ra = dict[index];
+		}
+		else
+		{
+			xfer->ra = prevRa = (void *)((unsigned long)prevRa + compactUnzigzag(compactGetVarint(&in, end)));
+			if (COMPACT_RA_DICT_SIZE > dictCount)
+			{
+				dict[dictCount++] = xfer->ra;
+			}
+		}
+		xfer->tid = (pid_t)((long)prev.tid + compactUnzigzag(compactGetVarint(&in, end)));
+#ifdef STACK_DEPOT
+		xfer->stack = (unsigned int)compactGetVarint(&in, end);
+#endif
+		xfer->seconds = prev.seconds + compactUnzigzag(compactGetVarint(&in, end));
+		prev = *xfer;
+	}
+	return (in == end);
+}
+#endif
+
+#ifdef STACK_DEPOT
+/* Stacks of the walk being processed by id, loaded from /tmp/hps_<pid>.dat */
+typedef struct walk_stack
+{
+	unsigned int depth;
+	void *frames[STACK_DEPOT_MAX_FRAMES];
+} WALKSTACK;
+static WALKSTACK *gWalkStacks[STACK_DEPOT_SLOTS];
+static bool gWalkStacksLoaded;
+
+/**
+ * @brief Loads the stacks stored by storeStacks.
+ *
+ * @param pid The process ID of the target process.
+ */
+static void loadStacks(int pid)
+{
+	msg_compact msg;
+	char stacksFile[32];
+	sprintf(stacksFile, "/tmp/hps_%d.dat", pid);
+	FILE *fpStacks = fopen(stacksFile, "rb");
+
+	gWalkStacksLoaded = true;
+	if (NULL == fpStacks)
+	{
+		dbg(PRINT_MUST, "%s open error, %s\n", stacksFile, strerror(errno));
+		return;
+	}
+	while ((1 == fread(&msg, COMPACT_HEADER_SIZE, 1, fpStacks)) && (sizeof(msg.encoded) >= msg.encodedSize) &&
+		   (!msg.encodedSize || (1 == fread(msg.encoded, msg.encodedSize, 1, fpStacks))))
+	{
+		const unsigned char *in = msg.encoded;
+		const unsigned char *end = msg.encoded + msg.encodedSize;
+		unsigned int count = msg.numItemOrInfo & 0xFFFFFFF;
+		void *prev = NULL;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned long id = compactGetVarint(&in, end);
+			unsigned long depth = compactGetVarint(&in, end);
+			if ((0 == id) || (STACK_DEPOT_SLOTS <= id) || (0 == depth) || (STACK_DEPOT_MAX_FRAMES < depth))
+			{
+				dbg(PRINT_MUST, "%s: Corrupted stack message\n", __FUNCTION__);
+				fclose(fpStacks);
+				return;
+			}
+			WALKSTACK *stack = gWalkStacks[id];
+			if ((NULL == stack) && (NULL == (stack = gWalkStacks[id] = malloc(sizeof(WALKSTACK)))))
+			{
+				fclose(fpStacks);
+				return;
+			}
+			stack->depth = depth;
+			for (unsigned int j = 0; j < depth; j++)
+			{
+				stack->frames[j] = prev = (void *)((unsigned long)prev + compactUnzigzag(compactGetVarint(&in, end)));
+			}
+		}
+	}
+	fclose(fpStacks);
+}
+
+/**
+ * @brief Prints the stacks of the walk and releases them.
+ *
+ * @param print false to only release the stacks.
+ */
+static void printStacks(bool print)
+{
+	bool header = print;
+	for (unsigned int id = 0; id < STACK_DEPOT_SLOTS; id++)
+	{
+		if (NULL == gWalkStacks[id])
+		{
+			continue;
+		}
+		if (header)
+		{
+			PRINT("Stacks:\nStackID Frames\n");
+			header = false;
+		}
+		if (print)
+		{
+			PRINT("%u", id);
+			for (unsigned int j = 0; j < gWalkStacks[id]->depth; j++)
+			{
+				PRINT(" %p", gWalkStacks[id]->frames[j]);
+			}
+			PRINT("\n");
+		}
+		free(gWalkStacks[id]);
+		gWalkStacks[id] = NULL;
+	}
+	if (!header && print)
+	{
+		PRINT("\n");
+	}
+	gWalkStacksLoaded = false;
+}
+#endif
+
+/**
+ * @brief Gets the estimated heap size represented by an entry.
+ *
+ * With SAMPLED_TRACKING, a sampled entry stands for size / (1 - e^(-size/rate)) bytes, same as the
+ * statistics of libmemfnswrap.so.
+ *
+ * @param xfer The entry.
+ * @return The estimated size, the entry size when all allocations are tracked.
+ */
+static unsigned long entryEstimate(const LISTxfer *xfer)
+{
+#ifdef SAMPLED_TRACKING
+	unsigned int level = (xfer->flags & LIST_SAMPLE_MASK) >> LIST_SAMPLE_SHIFT;
+	if (level && xfer->size)
+	{
+		return (unsigned long)(xfer->size / -expm1(-(double)xfer->size / SAMPLE_RATE(level)) + 0.5);
+	}
+#endif
+	return xfer->size;
+}
+
+/**
+ * @brief Reads a message stored by storeHeapwalk.
+ *
+ * With COMPACT_TRANSFER, reads the variable length message and decodes it.
+ *
+ * @param fp The heapwalk file or shared memory segment.
+ * @param msgresp The message to be filled.
+ * @return Bytes read, 0 at the end of the file.
+ */
+static int readHeapwalkMsg(FILE *fp, msg_resp *msgresp)
+{
+#ifdef COMPACT_TRANSFER
+	msg_compact msg;
+	if ((1 != fread(&msg, COMPACT_HEADER_SIZE, 1, fp)) || (sizeof(msg.encoded) < msg.encodedSize) ||
+		(msg.encodedSize && (1 != fread(msg.encoded, msg.encodedSize, 1, fp))))
+	{
+		return 0;
+	}
+	if (!compactDecode(&msg, msgresp))
+	{
+		dbg(PRINT_MUST, "%s: Corrupted heapwalk message\n", __FUNCTION__);
+		return 0;
+	}
+	return COMPACT_HEADER_SIZE + msg.encodedSize;
+#else
+	return fread(msgresp, 1, sizeof(msg_resp), fp);
+#endif
+}
+
 /**
  * @brief Processes heapwalk data.
  *
@@ -494,6 +1013,14 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 		}
 		/* Recursive call to complete HeapWalkAll processing */
 		processHeapwalk(HEAPWALK_FULL, pid, tid, isSelfTest, resp, listIndex, mmapIn);
+#ifdef MMAP_TRACKING
+		loadMappings(pid, mmapIn);
+		unsigned long mappedTotal = 0, releasedTotal = 0, anonSizeTotal = 0;
+		for (unsigned long i = 0; i < gMappingCount; i++)
+		{
+			releasedTotal += gMappings[i].released;
+		}
+#endif
 		
 		/* Print results */
 		MMAP_anon *tmpprn = mmapAnon;
@@ -541,11 +1068,30 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 						  tmpprn->startAddress, tmpprn->endAddress, tmpprn->size, tmpprn->rss);
 				}
 			}
+#ifdef MMAP_TRACKING
+			if (tmpprn->mappedEntries)
+			{
+				printMappings(tmpprn->startAddress, tmpprn->endAddress, NULL, NULL);
+				mappedTotal += tmpprn->mappedEntries;
+			}
+			anonSizeTotal += tmpprn->size;
+#endif
 			anonRSSTotal += tmpprn->rss;
 			heapTotal += tmpprn->heapEntries;
 			tmpprn = tmpprn->next;
 		}
+#ifdef MMAP_TRACKING
+		printMappings(0, 0, mmapAnon, "\tOutside heap/anon entries:\n");
+		free(gMappings);
+		gMappings = NULL;
+		gMappingCount = 0;
+#endif
 		removeAnonEntries();
+#ifdef MMAP_TRACKING
+		/* Mapped pages are resident once touched, so mappings are compared with the size of the anon entries */
+		PRINT("TOTAL MAPPED (%lu KB, %lu KB released) vs Anon size percentage: %f\n", mappedTotal/1024, releasedTotal/1024,
+			  anonSizeTotal?((double)mappedTotal / ((double)anonSizeTotal * 1024))*100:0);
+#endif
 		PRINT("TOTAL HEAP (%lu KB) vs Anon percentage: %f\n\n", heapTotal/1024, anonRSSTotal?((double)heapTotal / ((double)anonRSSTotal * 1024))*100:0); 
 	}
 	else
@@ -560,6 +1106,16 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 		}
 
 		FILE *fpHWalk = fopen(heapwalkFile, "rb");
+#ifdef STACK_DEPOT
+		if (!gWalkStacksLoaded)
+		{
+			loadStacks(pid);
+		}
+#endif
+#ifdef SHM_TRANSFER
+		int shmIndex = (HEAPWALK_FULL == cmd) ? 0 : 1;
+		FILE *fpShm = (gShmWalk[shmIndex].base) ? fmemopen(gShmWalk[shmIndex].base, gShmWalk[shmIndex].size, "rb") : NULL;
+#endif
 		if (NULL == fpHWalk)
 		{
 			dbg(PRINT_MUST, "%s open error, %s\n", heapwalkFile, strerror(errno));
@@ -570,9 +1126,20 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 			unsigned msgIndex;
 			unsigned totalMsgs = 0;
 			unsigned long long threadAllocationOnly = 0;
+#ifdef CXX_OPERATORS
+			unsigned long long cxxAllocationOnly = 0; /* Of threadAllocationOnly, allocated by operator new */
+#endif
 			do
 			{
-				msgsize = fread(&msgresp, 1, sizeof(msgresp), fpHWalk);
+#ifdef SHM_TRANSFER
+				if (fpShm && !(msgsize = readHeapwalkMsg(fpShm, &msgresp)))
+				{ /* Segment done, rest if any are in the file */
+					fclose(fpShm);
+					fpShm = NULL;
+				}
+				if (NULL == fpShm)
+#endif
+				msgsize = readHeapwalkMsg(fpHWalk, &msgresp);
 				if (msgsize)
 				{
 					if (msgresp.numItemOrInfo)
@@ -583,7 +1150,11 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 							if (!isSelfTest && (NULL == mmapIn))
 							{
 								dbg(PRINT_WALK, "\n%s\n", (HEAPWALK_FULL == cmd) ? "Already walked:" : "New Allocations:");
+#ifdef STACK_DEPOT
+								dbg(PRINT_WALK, "SNo Pointer Size RA ThreadID AllocationTime StackID\n");
+#else
 								dbg(PRINT_WALK, "SNo Pointer Size RA ThreadID AllocationTime\n");
+#endif
 							}
 						}
 						int msgCount = msgresp.numItemOrInfo & 0xFFFFFFF;
@@ -594,6 +1165,14 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 							{
 								resp[*listIndex].ptr = msgresp.xfer[msgIndex].ptr;
 								resp[*listIndex].size = msgresp.xfer[msgIndex].size;
+								resp[*listIndex].ra = msgresp.xfer[msgIndex].ra;
+								resp[*listIndex].tid = msgresp.xfer[msgIndex].tid;
+#ifdef STACK_DEPOT
+								resp[*listIndex].stack = msgresp.xfer[msgIndex].stack;
+#endif
+#ifdef PREPEND_LISTDATA
+								resp[*listIndex].flags = msgresp.xfer[msgIndex].flags;
+#endif
 								*listIndex = *listIndex + 1;
 							}
 							else
@@ -602,16 +1181,23 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 								{
 									if ((tid) ? tid == msgresp.xfer[msgIndex].tid : 1)
 									{
-#ifdef PREPEND_LISTDATA
-										PRINT("%u %p %u %p %u %ld%s\n", ++msgSeq, msgresp.xfer[msgIndex].ptr, msgresp.xfer[msgIndex].size, msgresp.xfer[msgIndex].ra,
+#if defined(STACK_DEPOT)
+										PRINT("%u %p %lu %p %u %ld %u%s%s\n", ++msgSeq, msgresp.xfer[msgIndex].ptr, msgresp.xfer[msgIndex].size, msgresp.xfer[msgIndex].ra,
+											  msgresp.xfer[msgIndex].tid, msgresp.xfer[msgIndex].seconds, msgresp.xfer[msgIndex].stack,
+											  (msgresp.xfer[msgIndex].flags & 0x1) ? " - R" : "", ENTRY_API(msgresp.xfer[msgIndex].flags));
+#elif defined(PREPEND_LISTDATA)
+										PRINT("%u %p %lu %p %u %ld%s%s\n", ++msgSeq, msgresp.xfer[msgIndex].ptr, msgresp.xfer[msgIndex].size, msgresp.xfer[msgIndex].ra,
 											  msgresp.xfer[msgIndex].tid, msgresp.xfer[msgIndex].seconds,
-											  (msgresp.xfer[msgIndex].flags & 0x1) ? " - R" : "");
+											  (msgresp.xfer[msgIndex].flags & 0x1) ? " - R" : "", ENTRY_API(msgresp.xfer[msgIndex].flags));
 #else
-										PRINT("%u %p %u %p %u %ld\n", ++msgSeq, msgresp.xfer[msgIndex].ptr, msgresp.xfer[msgIndex].size, msgresp.xfer[msgIndex].ra,
+										PRINT("%u %p %lu %p %u %ld\n", ++msgSeq, msgresp.xfer[msgIndex].ptr, msgresp.xfer[msgIndex].size, msgresp.xfer[msgIndex].ra,
 											  msgresp.xfer[msgIndex].tid, msgresp.xfer[msgIndex].seconds);
 #endif
-										threadAllocationOnly += msgresp.xfer[msgIndex].size;
-										addThreadStatEntry(msgresp.xfer[msgIndex].tid, msgresp.xfer[msgIndex].size);
+										threadAllocationOnly += entryEstimate(&msgresp.xfer[msgIndex]);
+#ifdef CXX_OPERATORS
+										cxxAllocationOnly += (msgresp.xfer[msgIndex].flags & LIST_CXX) ? entryEstimate(&msgresp.xfer[msgIndex]) : 0;
+#endif
+										addThreadStatEntry(msgresp.xfer[msgIndex].tid, entryEstimate(&msgresp.xfer[msgIndex]));
 									}
 								}
 								else
@@ -625,7 +1211,11 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 											((tmpprn->endAddress) > (unsigned long)msgresp.xfer[msgIndex].ptr))
 										{
 											/* Get entry size including the book keeping!! */
-											unsigned size = msgresp.xfer[msgIndex].size + sizeof(LIST);
+#ifdef PREPEND_LISTDATA
+											unsigned long size = msgresp.xfer[msgIndex].size + LIST_HEADER_SIZE(msgresp.xfer[msgIndex].flags);
+#else
+											unsigned long size = msgresp.xfer[msgIndex].size + sizeof(LIST);
+#endif
 											tmpprn->heapEntries += size;
 											// TODO optimize..
 											int i;
@@ -658,7 +1248,7 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 									}
 									if (NULL == tmpprn)
 									{
-										dbg(PRINT_MUST, "Error, entry unmapped? 0x%p:%u\n", msgresp.xfer[msgIndex].ptr, msgresp.xfer[msgIndex].size);
+										dbg(PRINT_MUST, "Error, entry unmapped? 0x%p:%lu\n", msgresp.xfer[msgIndex].ptr, msgresp.xfer[msgIndex].size);
 									}
 								}
 							}
@@ -681,6 +1271,9 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 				{
 					PRINT("HeapSize for walked thread(%d): %llu Bytes\n\n", tid, threadAllocationOnly);
 				}
+#ifdef CXX_OPERATORS
+				PRINT("C allocations: %llu Bytes, C++ allocations: %llu Bytes\n", threadAllocationOnly - cxxAllocationOnly, cxxAllocationOnly);
+#endif
 				if (prnThreadStatCmd == cmd)
 				{   
 					printThreadStat();
@@ -705,11 +1298,590 @@ void processHeapwalk(int cmd, int pid, int tid, bool isSelfTest, LIST *resp, int
 			}
 			fclose(fpHWalk);
 		}
+#ifdef SHM_TRANSFER
+		if (fpShm)
+		{
+			fclose(fpShm);
+		}
+		if (gShmWalk[shmIndex].base)
+		{
+			munmap(gShmWalk[shmIndex].base, gShmWalk[shmIndex].size);
+			gShmWalk[shmIndex].base = NULL;
+		}
+#endif
 
 		if (HEAPWALK_FULL == cmd)
 		{
 			processHeapwalk(HEAPWALK_INCREMENT, pid, tid, isSelfTest, resp, listIndex, mmapIn);
 		}
+#ifdef STACK_DEPOT
+		else
+		{ /* Last of the walk */
+			printStacks(!isSelfTest && (NULL == mmapIn));
+		}
+#endif
+	}
+}
+
+#ifdef SITE_STATS
+/**
+ * @brief Receives the sites sent for HEAPWALK_SITES and prints them.
+ *
+ * @param mqrecv The message queue descriptor to receive messages from.
+ * @param pid The process ID of the target process.
+ * @param resp Filled with the sites for self test, NULL to print them.
+ * @param respSize The number of sites resp can hold.
+ * @return The number of sites received, -1 if the sites couldn't be received.
+ */
+int processSites(mqd_t mqrecv, int pid, SITExfer *resp, int respSize)
+{
+	union
+	{
+		msg_resp resp;
+		msg_sites sites;
+	} msg;
+	unsigned int prio;
+	struct timespec tm;
+	int count = 0;
+
+	do
+	{
+		clock_gettime(CLOCK_REALTIME, &tm);
+		tm.tv_sec += 10;
+		if (-1 == mq_timedreceive(mqrecv, (char *)&msg, sizeof(msg), &prio, &tm))
+		{
+			if (ETIMEDOUT == errno) {
+				dbg(PRINT_MUST, "%s:%d: Giving up..waited for 10 secs\n", __FUNCTION__, __LINE__);
+			}else {
+				dbg(PRINT_MUST, "%s:%d: mq_timedreceive failed [%s]\n", __FUNCTION__, __LINE__, strerror(errno));
+			}
+			return -1;
+		}
+		if ((NULL == resp) && !count)
+		{
+#ifdef STACK_DEPOT
+			PRINT("\nRank RA StackID LiveBytes LiveCount Allocations Frees Error\n");
+#else
+			PRINT("\nRank RA LiveBytes LiveCount Allocations Frees Error\n");
+#endif
+		}
+		for (unsigned int i = 0; i < (msg.sites.numItemOrInfo & 0xFFFFFFF) && (MAX_SITE_XFER > i); i++)
+		{
+			const SITExfer *site = &msg.sites.sites[i];
+			if (resp)
+			{
+				if (count < respSize)
+				{
+					resp[count] = *site;
+				}
+			}
+			else
+			{
+#ifdef STACK_DEPOT
+				PRINT("%d %p %u %lu %lu %lu %lu %lu\n", count + 1, site->ra, site->stack, site->liveBytes, site->liveCount,
+					  site->allocs, site->frees, site->error);
+#else
+				PRINT("%d %p %lu %lu %lu %lu %lu\n", count + 1, site->ra, site->liveBytes, site->liveCount,
+					  site->allocs, site->frees, site->error);
+#endif
+			}
+			count++;
+		}
+	} while (HEAPWALK_ITEM_CONTN & msg.sites.numItemOrInfo);
+	if (NULL == resp)
+	{
+		PRINT("%s\nTotalHeapSize: %lu\nTool Overhead: %lu\n\n", (count) ? "" : "No sites", msg.sites.totalHeapSize, msg.sites.totalOverhead);
+	}
+#ifdef STACK_DEPOT
+	if (!storeStacks(mqrecv, pid))
+	{
+		loadStacks(pid);
+		printStacks(NULL == resp);
+	}
+#endif
+	return count;
+}
+#endif
+
+#ifdef LARGE_REGISTRY
+/**
+ * @brief Receives the entries sent for HEAPWALK_LARGE and prints them.
+ *
+ * @param mqrecv The message queue descriptor to receive messages from.
+ * @param pid The process ID of the target process.
+ * @param resp Filled with the entries for self test, NULL to print them.
+ * @param respSize The number of entries resp can hold.
+ * @return The number of entries received, -1 if the entries couldn't be received.
+ */
+int processLarge(mqd_t mqrecv, int pid, LISTxfer *resp, int respSize)
+{
+	msg_resp msgresp;
+	unsigned int prio;
+	struct timespec tm;
+	unsigned long total = 0;
+	int count = 0;
+
+	do
+	{
+		clock_gettime(CLOCK_REALTIME, &tm);
+		tm.tv_sec += 10;
+		if (-1 == mq_timedreceive(mqrecv, (char *)&msgresp, sizeof(msgresp), &prio, &tm))
+		{
+			if (ETIMEDOUT == errno) {
+				dbg(PRINT_MUST, "%s:%d: Giving up..waited for 10 secs\n", __FUNCTION__, __LINE__);
+			}else {
+				dbg(PRINT_MUST, "%s:%d: mq_timedreceive failed [%s]\n", __FUNCTION__, __LINE__, strerror(errno));
+			}
+			return -1;
+		}
+		if ((NULL == resp) && !count)
+		{
+#ifdef STACK_DEPOT
+			PRINT("\nRank Pointer Size RA ThreadID AllocationTime StackID\n");
+#else
+			PRINT("\nRank Pointer Size RA ThreadID AllocationTime\n");
+#endif
+		}
+		for (unsigned int i = 0; i < (msgresp.numItemOrInfo & 0xFFFFFFF) && (MAX_MSG_XFER > i); i++)
+		{
+			const LISTxfer *xfer = &msgresp.xfer[i];
+			if (resp)
+			{
+				if (count < respSize)
+				{
+					resp[count] = *xfer;
+				}
+			}
+			else
+			{
+#ifdef STACK_DEPOT
+				PRINT("%d %p %lu %p %u %ld %u%s%s\n", count + 1, xfer->ptr, xfer->size, xfer->ra, xfer->tid, xfer->seconds, xfer->stack,
+					  (xfer->flags & 0x1) ? " - R" : "", ENTRY_API(xfer->flags));
+#else
+				PRINT("%d %p %lu %p %u %ld%s%s\n", count + 1, xfer->ptr, xfer->size, xfer->ra, xfer->tid, xfer->seconds,
+					  (xfer->flags & 0x1) ? " - R" : "", ENTRY_API(xfer->flags));
+#endif
+			}
+			total += xfer->size;
+			count++;
+		}
+	} while (HEAPWALK_ITEM_CONTN & msgresp.numItemOrInfo);
+	if (NULL == resp)
+	{
+		PRINT("%s\nLarge entries: %lu Bytes\nTotalHeapSize: %lu\nTool Overhead: %lu\n\n", (count) ? "" : "No large entries", total,
+			  msgresp.totalHeapSize, msgresp.totalOverhead);
+	}
+#ifdef STACK_DEPOT
+	if (!storeStacks(mqrecv, pid))
+	{
+		loadStacks(pid);
+		printStacks(NULL == resp);
+	}
+#endif
+	return count;
+}
+#endif
+#endif
+
+/**
+ * @brief Receives the reply to HEAPWALK_BACKEND and prints it.
+ *
+ * @param mqrecv The message queue descriptor to receive messages from.
+ * @param resp Filled with the reply for self test, NULL to print it.
+ * @return 0 if the reply is received, -1 otherwise.
+ */
+int processBackend(mqd_t mqrecv, msg_backend *resp)
+{
+	union
+	{
+		msg_resp resp; /* The size of the queue's messages */
+		msg_backend backend;
+	} msg;
+	unsigned int prio;
+	struct timespec tm;
+
+	clock_gettime(CLOCK_REALTIME, &tm);
+	tm.tv_sec += 10;
+	if (-1 == mq_timedreceive(mqrecv, (char *)&msg, sizeof(msg), &prio, &tm))
+	{
+		if (ETIMEDOUT == errno) {
+			dbg(PRINT_MUST, "%s:%d: Giving up..waited for 10 secs\n", __FUNCTION__, __LINE__);
+		}else {
+			dbg(PRINT_MUST, "%s:%d: mq_timedreceive failed [%s]\n", __FUNCTION__, __LINE__, strerror(errno));
+		}
+		return -1;
+	}
+	msg.backend.name[sizeof(msg.backend.name) - 1] = '\0';
+	if (resp)
+	{
+		*resp = msg.backend;
+		return 0;
+	}
+	unsigned int base = msg.backend.cmdBase;
+	PRINT("\nBackend: %s\nCommands version: %u\n", msg.backend.name, base >> 24);
+	PRINT("OPTIMIZE_MQ_TRANSFER %c PREPEND_LISTDATA %c MAINTAIN_SINGLE_LIST %c COMPACT_TRANSFER %c STACK_DEPOT %c MMAP_TRACKING %c\n",
+		  (base & (1 << 23)) ? 'Y' : 'N', (base & (1 << 22)) ? 'Y' : 'N', (base & (1 << 21)) ? 'Y' : 'N',
+		  (base & (1 << 20)) ? 'Y' : 'N', (base & (1 << 19)) ? 'Y' : 'N', (base & (1 << 18)) ? 'Y' : 'N');
+	PRINT("TotalHeapSize: %lu\nTool Overhead: %lu\n\n", msg.backend.totalHeapSize, msg.backend.totalOverhead);
+	return 0;
+}
+
+/**
+ * @brief Receives the bookmarks of the process, replied to HEAPWALK_BOOKMARK, and prints them.
+ *
+ * @param mqrecv The message queue descriptor of /mq_util.
+ * @param resp Filled with the reply instead of printing it, when not NULL.
+ * @return The result of the bookmark change, -1 also if no reply is received.
+ */
+int processBookmarks(mqd_t mqrecv, msg_bookmarks *resp)
+{
+	union
+	{
+		msg_resp resp; /* The size of the queue's messages */
+		msg_bookmarks bookmarks;
+	} msg;
+	unsigned int prio;
+	struct timespec tm;
+
+	clock_gettime(CLOCK_REALTIME, &tm);
+	tm.tv_sec += 10;
+	if (-1 == mq_timedreceive(mqrecv, (char *)&msg, sizeof(msg), &prio, &tm))
+	{
+		if (ETIMEDOUT == errno) {
+			dbg(PRINT_MUST, "%s:%d: Giving up..waited for 10 secs\n", __FUNCTION__, __LINE__);
+		}else {
+			dbg(PRINT_MUST, "%s:%d: mq_timedreceive failed [%s]\n", __FUNCTION__, __LINE__, strerror(errno));
+		}
+		return -1;
+	}
+	msg.bookmarks.count = (msg.bookmarks.count < MAX_BOOKMARK_XFER) ? msg.bookmarks.count : MAX_BOOKMARK_XFER;
+	if (resp)
+	{
+		*resp = msg.bookmarks;
+		return msg.bookmarks.result;
+	}
+	PRINT("\nBookmarks:\nName Generation SetTime\n");
+	for (unsigned int i = 0; i < msg.bookmarks.count; i++)
+	{
+		msg.bookmarks.bookmarks[i].name[WALK_BOOKMARK_NAME_SIZE - 1] = '\0';
+		PRINT("%s %llu %ld\n", msg.bookmarks.bookmarks[i].name, msg.bookmarks.bookmarks[i].generation, (long)msg.bookmarks.bookmarks[i].seconds);
+	}
+	PRINT("TotalHeapSize: %lu\nTool Overhead: %lu\n\n", msg.bookmarks.totalHeapSize, msg.bookmarks.totalOverhead);
+	return msg.bookmarks.result;
+}
+
+#ifdef ADDRESS_INDEX
+/**
+ * @brief Receives the entry holding an address, replied to HEAPWALK_OWNER, and prints it.
+ *
+ * @param mqrecv The message queue descriptor of /mq_util.
+ * @param address The address looked up, printed with the entry.
+ * @param resp Filled with the reply instead of printing it, when not NULL.
+ * @return 0 if an entry holds the address, -1 if not or if no reply is received.
+ */
+int processOwner(mqd_t mqrecv, const void *address, msg_owner *resp)
+{
+	union
+	{
+		msg_resp resp; /* The size of the queue's messages */
+		msg_owner owner;
+	} msg;
+	unsigned int prio;
+	struct timespec tm;
+
+	clock_gettime(CLOCK_REALTIME, &tm);
+	tm.tv_sec += 10;
+	if (-1 == mq_timedreceive(mqrecv, (char *)&msg, sizeof(msg), &prio, &tm))
+	{
+		if (ETIMEDOUT == errno) {
+			dbg(PRINT_MUST, "%s:%d: Giving up..waited for 10 secs\n", __FUNCTION__, __LINE__);
+		}else {
+			dbg(PRINT_MUST, "%s:%d: mq_timedreceive failed [%s]\n", __FUNCTION__, __LINE__, strerror(errno));
+		}
+		return -1;
+	}
+	if (resp)
+	{
+		*resp = msg.owner;
+		return msg.owner.result;
+	}
+	if (0 == msg.owner.result)
+	{
+		LISTxfer *owner = &msg.owner.owner;
+		PRINT("\nOwner of %p at offset %lu:\n", address, (unsigned long)((const char *)address - (const char *)owner->ptr));
+#ifdef STACK_DEPOT
+		PRINT("Pointer Size RA ThreadID AllocationTime StackID\n%p %lu %p %d %ld %u\n",
+			  owner->ptr, owner->size, owner->ra, owner->tid, (long)owner->seconds, owner->stack);
+#else
+		PRINT("Pointer Size RA ThreadID AllocationTime\n%p %lu %p %d %ld\n", owner->ptr, owner->size, owner->ra, owner->tid, (long)owner->seconds);
+#endif
+	}
+	else
+	{
+		PRINT("\nNo tracked allocation holds %p\n", address);
+	}
+	PRINT("TotalHeapSize: %lu\nTool Overhead: %lu\n\n", msg.owner.totalHeapSize, msg.owner.totalOverhead);
+	return msg.owner.result;
+}
+#endif
+
+#ifdef MIRROR_DELTAS
+/* Live entries of the process as of the last sync of its mirror, in an open addressing table keyed by ptr */
+static struct
+{
+	int pid;
+	char name[WALK_BOOKMARK_NAME_SIZE];
+	LISTxfer *slots; /* NULL ptr for a free slot */
+	unsigned long capacity; /* Power of 2 */
+	unsigned long count;
+	unsigned long bytes;
+} gMirror;
+
+/**
+ * @brief Finds the slot of a pointer in the mirror, or the free slot where it would be put.
+ */
+static unsigned long mirrorSlot(const void *ptr)
+{
+	unsigned long hash = ((unsigned long)ptr >> 4) * 0x9E3779B97F4A7C15UL;
+	unsigned long i = (hash ^ (hash >> 32)) & (gMirror.capacity - 1);
+	while (gMirror.slots[i].ptr && (gMirror.slots[i].ptr != ptr))
+	{
+		i = (i + 1) & (gMirror.capacity - 1);
+	}
+	return i;
+}
+
+/**
+ * @brief Puts an entry in the mirror, replacing the one of its pointer. The table is doubled when 3/4 full.
+ *
+ * @return 0 on success, -1 if the table can't grow.
+ */
+static int mirrorPut(const LISTxfer *xfer)
+{
+	if (4 * (gMirror.count + 1) > 3 * gMirror.capacity)
+	{
+		LISTxfer *old = gMirror.slots;
+		unsigned long oldCapacity = gMirror.capacity;
+		unsigned long capacity = (oldCapacity) ? 2 * oldCapacity : 1024;
+		LISTxfer *slots = calloc(capacity, sizeof(LISTxfer));
+		if (NULL == slots)
+		{
+			return -1;
+		}
+		gMirror.slots = slots;
+		gMirror.capacity = capacity;
+		for (unsigned long i = 0; i < oldCapacity; i++)
+		{
+			if (old[i].ptr)
+			{
+				gMirror.slots[mirrorSlot(old[i].ptr)] = old[i];
+			}
+		}
+		free(old);
+	}
+	LISTxfer *slot = &gMirror.slots[mirrorSlot(xfer->ptr)];
+	if (slot->ptr)
+	{
+		gMirror.bytes -= entryEstimate(slot);
+	}
+	else
+	{
+		gMirror.count++;
+	}
+	*slot = *xfer;
+	gMirror.bytes += entryEstimate(xfer);
+	return 0;
+}
+
+/**
+ * @brief Removes the entry of a pointer from the mirror, shifting back the entries probed after it.
+ *
+ * @return true if the pointer was in the mirror.
+ */
+static bool mirrorRemove(const void *ptr)
+{
+	if (0 == gMirror.count)
+	{
+		return false;
+	}
+	unsigned long i = mirrorSlot(ptr);
+	if (NULL == gMirror.slots[i].ptr)
+	{
+		return false;
+	}
+	gMirror.bytes -= entryEstimate(&gMirror.slots[i]);
+	gMirror.count--;
+	for (unsigned long j = (i + 1) & (gMirror.capacity - 1); gMirror.slots[j].ptr; j = (j + 1) & (gMirror.capacity - 1))
+	{
+		unsigned long hash = ((unsigned long)gMirror.slots[j].ptr >> 4) * 0x9E3779B97F4A7C15UL;
+		unsigned long home = (hash ^ (hash >> 32)) & (gMirror.capacity - 1);
+		/* Moved back unless its home is cyclically in (i, j] */
+		if (((j - home) & (gMirror.capacity - 1)) >= ((j - i) & (gMirror.capacity - 1)))
+		{
+			gMirror.slots[i] = gMirror.slots[j];
+			i = j;
+		}
+	}
+	memset(&gMirror.slots[i], 0, sizeof(LISTxfer));
+	return true;
+}
+
+/**
+ * @brief Empties the mirror and assigns it to a process and a mirror name.
+ */
+static void mirrorClear(int pid, const char *name)
+{
+	if (gMirror.slots)
+	{
+		memset(gMirror.slots, 0, gMirror.capacity * sizeof(LISTxfer));
+	}
+	gMirror.count = gMirror.bytes = 0;
+	gMirror.pid = pid;
+	strncpy(gMirror.name, name, sizeof(gMirror.name) - 1);
+	gMirror.name[sizeof(gMirror.name) - 1] = '\0';
+}
+
+/**
+ * @brief Frees the mirror kept by memleakutil, the next sync of a mirror asks for all the entries.
+ */
+void mirrorFree()
+{
+	free(gMirror.slots);
+	memset(&gMirror, 0, sizeof(gMirror));
+}
+
+/**
+ * @brief Tells whether the mirror kept by memleakutil is the one of a process and a name, else it is to be sent all the entries.
+ */
+static bool mirrorOf(int pid, const char *name)
+{
+	return (gMirror.pid == pid) && !strncmp(gMirror.name, name, sizeof(gMirror.name) - 1);
+}
+
+/**
+ * @brief Receives the changes of a mirror, replied to HEAPWALK_MIRROR, and applies them to the mirror kept by memleakutil.
+ *
+ * The free'd entries are removed and the other ones put by pointer, in the order they are received.
+ *
+ * @param mqrecv The message queue descriptor of /mq_util.
+ * @param pid The process ID of the target process.
+ * @param name The name of the mirror.
+ * @param resp Filled with the reply instead of printing it, when not NULL.
+ * @param entries Filled with the live entries of the mirror for self test, up to size.
+ * @param size The number of entries entries can hold.
+ * @return The number of changes received, -1 if the mirror isn't synced.
+ */
+int processMirror(mqd_t mqrecv, int pid, const char *name, msg_mirror *resp, LISTxfer *entries, int size)
+{
+	union
+	{
+		msg_resp resp; /* The size of the queue's messages */
+		msg_mirror mirror;
+	} msg;
+	msg_mirror header = {0};
+	unsigned int prio;
+	struct timespec tm, start, end;
+	unsigned long changes = 0, frees = 0;
+	bool first = true;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do
+	{
+		clock_gettime(CLOCK_REALTIME, &tm);
+		tm.tv_sec += 10;
+		if (-1 == mq_timedreceive(mqrecv, (char *)&msg, sizeof(msg), &prio, &tm))
+		{
+			if (ETIMEDOUT == errno) {
+				dbg(PRINT_MUST, "%s:%d: Giving up..waited for 10 secs\n", __FUNCTION__, __LINE__);
+			}else {
+				dbg(PRINT_MUST, "%s:%d: mq_timedreceive failed [%s]\n", __FUNCTION__, __LINE__, strerror(errno));
+			}
+			/* Changes may be missed, the next sync asks for all the entries */
+			gMirror.pid = 0;
+			return -1;
+		}
+		if (first)
+		{
+			header = msg.mirror;
+			first = false;
+			if (0 != header.result)
+			{
+				break;
+			}
+			if (header.full || !mirrorOf(pid, name))
+			{
+				mirrorClear(pid, name);
+			}
+			continue;
+		}
+		for (unsigned int i = 0; i < (msg.resp.numItemOrInfo & 0xFFFFFFF) && (MAX_MSG_XFER > i); i++)
+		{
+			const LISTxfer *xfer = &msg.resp.xfer[i];
+			if (0xDEAD0000 == (xfer->flags & 0xFFFF0000))
+			{
+				frees += (mirrorRemove(xfer->ptr)) ? 1 : 0;
+			}
+			else if (0 == mirrorPut(xfer))
+			{
+				changes++;
+			}
+			else
+			{
+				dbg(PRINT_ERROR, "%s: No memory for the mirror, the next sync asks for all the entries\n", __FUNCTION__);
+				gMirror.pid = 0;
+			}
+		}
+	} while (HEAPWALK_ITEM_CONTN & msg.resp.numItemOrInfo);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (resp)
+	{
+		*resp = header;
+		for (unsigned long i = 0, count = 0; entries && (i < gMirror.capacity) && (count < (unsigned long)size); i++)
+		{
+			if (gMirror.slots[i].ptr)
+			{
+				entries[count++] = gMirror.slots[i];
+			}
+		}
+	}
+	else if (0 == header.result)
+	{
+		PRINT("\nMirror %s of %d: %s sync, %lu free'd and %lu new or reallocated entries applied in %ld us\n", name, pid,
+			  (header.full) ? "full" : "delta", frees, changes,
+			  (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000L);
+		PRINT("Live entries: %lu Bytes: %lu\nTotalHeapSize: %lu\nTool Overhead: %lu\n\n", gMirror.count, gMirror.bytes,
+			  header.totalHeapSize, header.totalOverhead);
+	}
+	else
+	{
+		PRINT("\nMirror %s not synced, no more bookmarks or no memory for its changes\n", name);
+	}
+	return (0 == header.result) ? (int)(frees + changes) : -1;
+}
+
+/**
+ * @brief Prints the live entries of the mirror kept by memleakutil, in the order of its table.
+ */
+static void printMirror()
+{
+#ifdef STACK_DEPOT
+	PRINT("Pointer Size RA ThreadID AllocationTime StackID\n");
+#else
+	PRINT("Pointer Size RA ThreadID AllocationTime\n");
+#endif
+	for (unsigned long i = 0; i < gMirror.capacity; i++)
+	{
+		const LISTxfer *xfer = &gMirror.slots[i];
+		if (xfer->ptr)
+		{
+#ifdef STACK_DEPOT
+			PRINT("%p %lu %p %d %ld %u%s%s\n", xfer->ptr, xfer->size, xfer->ra, xfer->tid, (long)xfer->seconds, xfer->stack,
+				  (xfer->flags & 0x1) ? " - R" : "", ENTRY_API(xfer->flags));
+#else
+			PRINT("%p %lu %p %d %ld%s%s\n", xfer->ptr, xfer->size, xfer->ra, xfer->tid, (long)xfer->seconds,
+				  (xfer->flags & 0x1) ? " - R" : "", ENTRY_API(xfer->flags));
+#endif
+		}
 	}
 }
 #endif
@@ -719,6 +1891,7 @@ int main(int argc, char *argv[])
 	/* mqrecv for mq_util, mqsend for sending to mq_wrapper_<pid> */
 	mqd_t mqrecv, mqsend;
 	msg_cmd msgcmd;
+	unsigned int walkOptions = HEAPWALK_OPT_NONE;
 
 	printf("memleakutil %s\n", versionString);
 #ifdef OPTIMIZE_MQ_TRANSFER_FOR_CMD
@@ -795,6 +1968,7 @@ int main(int argc, char *argv[])
 			break;
 		if (0 == msgcmd.pid)
 			msgcmd.pid = getpid();
+		msgcmd.client = getpid();
 
 		sprintf(mq_name, "/mq_wrapper_%d", msgcmd.pid);
 		mqsend = mq_open(mq_name, O_WRONLY);
@@ -811,8 +1985,17 @@ int main(int argc, char *argv[])
 			PRINT("5. Unmark walked allocations\n   %s\n", "-Doesn't show any entries, but subsequent walk shows all entries");
 			PRINT("6. Call malloc_stats\n   %s\n", "-Calls malloc_stats API that prints the details in stderr");
 			PRINT("7. Return\n   %s\n", "-Return to explore different Process");
+			PRINT("8. Set heapwalk options\n   %s\n", "-Walk holding the process, walk a fork'd snapshot of it, walk without holding it or holding it in slices. Transfer through shared memory");
+			PRINT("9. Top allocation sites\n   %s\n", "-Shows the sites holding the most live heap, counted by the process. Available with SITE_STATS");
+			PRINT("10. Largest live allocations\n   %s\n", "-Shows the allocations from MEMWRAP_LARGE_THRESHOLD bytes, without a heapwalk. Available with LARGE_REGISTRY");
+			PRINT("11. Show backend\n   %s\n", "-Shows the backend selected by MEMWRAP_BACKEND and the options the library is built with");
+			PRINT("12. Pause/Resume tracking\n   %s\n", "-Allocations made while paused go to libc untracked, frees of tracked ones are still tracked. Available with TRACKING_PAUSE");
+			PRINT("13. Bookmarks\n   %s\n", "-Sets, deletes or lists named bookmarks, heapwalks since a bookmark don't change the walked marks. Available with WALK_BOOKMARKS");
+			PRINT("14. Owner of an address\n   %s\n", "-Shows the allocation holding an address, its size, site, thread and time, without a heapwalk. Available with ADDRESS_INDEX");
+			PRINT("15. Mirror\n   %s\n", "-Keeps the live allocations of the process, synced with the allocations and frees since the last sync. Available with MIRROR_DELTAS");
 			PRINT("Enter cmd to send: ");
 			scanf("%d", &msgcmd.cmd);
+			msgcmd.options = walkOptions;
 
 			msgcmd.cmd |= HEAPWALK_BASE;
 #ifdef OPTIMIZE_MQ_TRANSFER
@@ -840,13 +2023,52 @@ int main(int argc, char *argv[])
 				}
 #endif
 				int threadid = 0;
+				memset(&msgcmd.filter, 0, sizeof(msgcmd.filter));
 				if (HEAPWALK_MMAP_ENTRIES != msgcmd.cmd)
 				{
+					int filter = 0;
 					PRINT("Enter threadid (0 for all):");
 					scanf("%d", &threadid);
 					if (threadid) {
 						PRINT("Walking only for thread %d\n", threadid);
 					}
+					PRINT("Filter by size, age, time, site or address in the process (1/0):");
+					scanf("%d", &filter);
+					if (filter) {
+						long minAge = 0, maxAge = 0, from = 0, to = 0;
+						PRINT("Enter min and max size (0 for no max):");
+						scanf("%lu %lu", &msgcmd.filter.minSize, &msgcmd.filter.maxSize);
+						PRINT("Enter min and max age in seconds (0 for no max):");
+						scanf("%ld %ld", &minAge, &maxAge);
+						msgcmd.filter.minAge = minAge;
+						msgcmd.filter.maxAge = maxAge;
+						PRINT("Enter allocation time range in seconds since the epoch (0 0 for all):");
+						scanf("%ld %ld", &from, &to);
+						msgcmd.filter.from = from;
+						msgcmd.filter.to = to;
+						PRINT("Enter up to %d return addresses (0 to end):", WALK_FILTER_MAX_RA);
+						for (int i = 0; i < WALK_FILTER_MAX_RA; i++) {
+							void *ra = NULL;
+							scanf("%p", &ra);
+							if (NULL == ra) {
+								break;
+							}
+							msgcmd.filter.ra[i] = ra;
+						}
+						PRINT("Enter start and end address (0 0 for all):");
+						scanf("%p %p", &msgcmd.filter.start, &msgcmd.filter.end);
+					}
+					/* The thread is also checked by processHeapwalk, for a library built without WALK_FILTER */
+					msgcmd.filter.tid = threadid;
+					if (threadid || filter) {
+						msgcmd.options |= HEAPWALK_OPT_FILTER;
+					}
+					PRINT("Enter bookmark to walk since (- for the walked marks):");
+					scanf("%15s", msgcmd.bookmark);
+					if (strcmp(msgcmd.bookmark, "-")) {
+						msgcmd.options |= HEAPWALK_OPT_BOOKMARK;
+						PRINT("New allocations are the ones since bookmark %s, the walked marks are left\n", msgcmd.bookmark);
+					}
 				}
 				dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
 				if (-1 != mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0))
@@ -949,6 +2171,184 @@ int main(int argc, char *argv[])
 				mqsend = -1;
 				break;
 
+			case HEAPWALK_SITES:
+#ifdef SITE_STATS
+			{
+				int sites = 0;
+				PRINT("Enter number of sites (0 for all):");
+				scanf("%d", &sites);
+				msgcmd.options = (0 < sites) ? sites : 0;
+				dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
+				if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0))
+				{
+					dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+				}
+				else if (0 > processSites(mqrecv, msgcmd.pid, NULL, 0))
+				{
+					dbg(PRINT_ERROR, "processSites failed\n");
+				}
+			}
+#else
+				PRINT("Cmd supported only with SITE_STATS, continuing..\n");
+#endif
+				break;
+
+			case HEAPWALK_LARGE:
+#ifdef LARGE_REGISTRY
+			{
+				int entries = 0;
+				PRINT("Enter number of allocations (0 for all):");
+				scanf("%d", &entries);
+				msgcmd.options = (0 < entries) ? entries : 0;
+				dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
+				if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0))
+				{
+					dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+				}
+				else if (0 > processLarge(mqrecv, msgcmd.pid, NULL, 0))
+				{
+					dbg(PRINT_ERROR, "processLarge failed\n");
+				}
+			}
+#else
+				PRINT("Cmd supported only with LARGE_REGISTRY, continuing..\n");
+#endif
+				break;
+
+			case HEAPWALK_BACKEND:
+				dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
+				if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0))
+				{
+					dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+				}
+				else if (0 > processBackend(mqrecv, NULL))
+				{
+					dbg(PRINT_ERROR, "processBackend failed\n");
+				}
+				break;
+
+			case HEAPWALK_PAUSE:
+#ifdef TRACKING_PAUSE
+			{
+				int pause = 0;
+				PRINT("Pause (1) or resume (0) tracking:");
+				scanf("%d", &pause);
+				msgcmd.options = (0 != pause);
+				dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
+				if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0))
+				{
+					dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+				}
+				else
+				{
+					dbg(PRINT_MUST, "%s. Show backend tells whether the tracking is paused\n", (msgcmd.options) ? "Paused" : "Resumed");
+				}
+			}
+#else
+				PRINT("Cmd supported only with TRACKING_PAUSE, continuing..\n");
+#endif
+				break;
+
+			case HEAPWALK_BOOKMARK:
+#ifdef WALK_BOOKMARKS
+			{
+				int op = BOOKMARK_LIST;
+				PRINT("Set (1), delete (2) or list (0) bookmarks:");
+				scanf("%d", &op);
+				msgcmd.options = op;
+				msgcmd.bookmark[0] = '\0';
+				if (BOOKMARK_LIST != op)
+				{
+					PRINT("Enter bookmark name (up to %d characters):", WALK_BOOKMARK_NAME_SIZE - 1);
+					scanf("%15s", msgcmd.bookmark);
+				}
+				dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
+				if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0))
+				{
+					dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+				}
+				else if (0 > processBookmarks(mqrecv, NULL))
+				{
+					dbg(PRINT_ERROR, "Bookmark %s %s\n", msgcmd.bookmark, (BOOKMARK_SET == op) ? "not set, no more bookmarks" : "not found");
+				}
+			}
+#else
+				PRINT("Cmd supported only with WALK_BOOKMARKS, continuing..\n");
+#endif
+				break;
+
+			case HEAPWALK_OWNER:
+#ifdef ADDRESS_INDEX
+				msgcmd.address = NULL;
+				PRINT("Enter address:");
+				scanf("%p", &msgcmd.address);
+				dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
+				if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0))
+				{
+					dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+				}
+				else
+				{
+					processOwner(mqrecv, msgcmd.address, NULL);
+				}
+#else
+				PRINT("Cmd supported only with ADDRESS_INDEX, continuing..\n");
+#endif
+				break;
+
+			case HEAPWALK_MIRROR:
+#ifdef MIRROR_DELTAS
+			{
+				int print = 0;
+				PRINT("Enter mirror name (up to %d characters):", WALK_BOOKMARK_NAME_SIZE - 1);
+				scanf("%15s", msgcmd.bookmark);
+				PRINT("Print the live entries (1/0):");
+				scanf("%d", &print);
+				/* A mirror of another process or name is sent all the entries */
+				msgcmd.options = (mirrorOf(msgcmd.pid, msgcmd.bookmark)) ? 0 : 1;
+				dbg(PRINT_MSGQ, "%s: sending cmd %d on mq %s\n", __FUNCTION__, msgcmd.cmd, mq_name);
+				if (-1 == mq_send(mqsend, (const char *)&msgcmd, sizeof(msg_cmd), 0))
+				{
+					dbg(PRINT_ERROR, "msgsnd failed, %s\n", strerror(errno));
+				}
+				else if ((0 <= processMirror(mqrecv, msgcmd.pid, msgcmd.bookmark, NULL, NULL, 0)) && print)
+				{
+					printMirror();
+				}
+			}
+#else
+				PRINT("Cmd supported only with MIRROR_DELTAS, continuing..\n");
+#endif
+				break;
+
+			case HEAPWALK_OPTIONS:
+			{
+				int mode = 0;
+				PRINT("Enter heapwalk mode (0 hold the process, 1 fork'd snapshot, 2 concurrent, 3 sliced):");
+				scanf("%d", &mode);
+				walkOptions &= ~(HEAPWALK_OPT_SNAPSHOT | HEAPWALK_OPT_CONCURRENT | HEAPWALK_OPT_SLICED);
+				if (1 == mode)
+				{
+					walkOptions |= HEAPWALK_OPT_SNAPSHOT;
+				}
+				else if (2 == mode)
+				{
+					walkOptions |= HEAPWALK_OPT_CONCURRENT;
+				}
+				else if (3 == mode)
+				{
+					walkOptions |= HEAPWALK_OPT_SLICED;
+				}
+				PRINT("Heapwalk %s\n", (walkOptions & HEAPWALK_OPT_SNAPSHOT) ? "walks a snapshot" :
+					  ((walkOptions & HEAPWALK_OPT_CONCURRENT) ? "walks without holding the process, entries may be fuzzy" :
+					   ((walkOptions & HEAPWALK_OPT_SLICED) ? "holds the process in slices of MEMWRAP_WALK_SLICE_US, entries may be fuzzy" : "holds the process")));
+				int shm = 0;
+				PRINT("Transfer through shared memory instead of message queue (1/0):");
+				scanf("%d", &shm);
+				walkOptions = (shm) ? (walkOptions | HEAPWALK_OPT_SHM) : (walkOptions & ~HEAPWALK_OPT_SHM);
+			}
+			break;
+
 			default:
 				dbg(PRINT_ERROR, "Invalid cmd 0x%x...continuing\n", msgcmd.cmd);
 				printf("This Utility Built with:\nMEMWRAP_COMMANDS_VERSION=%d\nOPTIMIZE_MQ_TRANSFER_FOR_CMD=%c\nPREPEND_LISTDATA_FOR_CMD=%c\nMAINTAIN_SINGLE_LIST_FOR_CMD=%c\n\n",